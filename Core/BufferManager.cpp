@@ -7,7 +7,6 @@
 namespace Graphics
 {
 ColorBuffer g_SceneColorBuffer;
-DepthBuffer g_SceneDepthBuffer;
 ColorBuffer g_OverlayBuffer;
 ColorBuffer g_HorizontalBuffer;
 
@@ -16,12 +15,12 @@ ShadowBuffer g_ShadowBuffer;
 ColorBuffer g_SSAOFullScreen(Color(1.0f, 1.0f, 1.0f));
 
 vk::Format DefaultHdrColorFormat = vk::Format::eB10G11R11UfloatPack32;
+vk::Format DefaultDepthFormat = vk::Format::eD32Sfloat;
 } // namespace Graphics
 
 void Graphics::InitializeRenderingBuffers(uint32_t NativeWidth, uint32_t NativeHeight)
 {
     g_SceneColorBuffer.Create("Main Color Buffer", NativeWidth, NativeHeight, 1, DefaultHdrColorFormat);
-    g_SceneDepthBuffer.Create("Scene Depth Buffer", NativeWidth, NativeHeight, 1, vk::Format::eD32Sfloat);
 
     g_SSAOFullScreen.Create("SSAO Full Res", NativeWidth, NativeHeight, 1, vk::Format::eR8Unorm);
 
@@ -40,7 +39,6 @@ void Graphics::ResizeDisplayDependentBuffers(uint32_t NativeWidth, uint32_t Nati
 void Graphics::DestroyRenderingBuffers()
 {
     g_SceneColorBuffer.Destroy();
-    g_SceneDepthBuffer.Destroy();
 
     g_OverlayBuffer.Destroy();
     g_HorizontalBuffer.Destroy();
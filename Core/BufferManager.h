@@ -5,7 +5,6 @@
 namespace Graphics
 {
 extern ColorBuffer g_SceneColorBuffer;
-extern DepthBuffer g_SceneDepthBuffer;
 extern ColorBuffer g_OverlayBuffer;
 extern ColorBuffer g_HorizontalBuffer;
 
@@ -13,6 +12,9 @@ extern ShadowBuffer g_ShadowBuffer;
 
 extern ColorBuffer g_SSAOFullScreen; // R8_UNORM
 
+// Scene depth is a transient render graph image, created by the frame that uses it
+extern vk::Format DefaultDepthFormat;
+
 void InitializeRenderingBuffers(uint32_t NativeWidth, uint32_t NativeHeight);
 void ResizeDisplayDependentBuffers(uint32_t NativeWidth, uint32_t NativeHeight);
 void DestroyRenderingBuffers();
@@ -1,6 +1,7 @@
 #include "CommandContext.h"
 
 #include "DepthBuffer.h"
+#include "FrameStats.h"
 #include "Framebuffer.h"
 #include "GraphicsCore.h"
 #include "RenderPass.h"
@@ -13,6 +14,21 @@ using namespace Graphics;
 
 #define DS_POOL_SIZE 100
 
+namespace
+{
+FrameCounter s_Draws("Draws");
+FrameCounter s_Dispatches("Dispatches");
+FrameCounter s_PipelineBinds("Pipeline binds");
+FrameCounter s_VertexBufferBinds("Vertex buffer binds");
+FrameCounter s_IndexBufferBinds("Index buffer binds");
+FrameCounter s_DescriptorSets("Descriptor sets");
+FrameCounter s_DescriptorWrites("Descriptor writes");
+FrameCounter s_Barriers("Barriers");
+FrameCounter s_BarrierBatches("Barrier batches");
+FrameCounter s_DynamicBytes("Dynamic data", true);
+FrameCounter s_StagingBytes("Staging uploads", true);
+} // namespace
+
 CommandContext *ContextManager::AllocateContext(vk::QueueFlagBits type)
 {
     std::lock_guard<std::mutex> LockGuard(sm_ContextAllocationMutex);
@@ -114,7 +130,8 @@ CommandContext::CommandContext(vk::QueueFlagBits type)
     : m_Type(type), m_CpuLinearAllocator(kCpuWritable), m_GpuLinearAllocator(kGpuExclusive), m_DsPool(DS_POOL_SIZE),
       m_DynamicImageSamplerHeap(*this, vk::DescriptorType::eCombinedImageSampler),
       m_DynamicUniformBufferHeap(*this, vk::DescriptorType::eUniformBuffer),
-      m_DynamicStorageImageHeap(*this, vk::DescriptorType::eStorageImage)
+      m_DynamicStorageImageHeap(*this, vk::DescriptorType::eStorageImage),
+      m_DynamicStorageBufferHeap(*this, vk::DescriptorType::eStorageBuffer)
 {
     vk::FenceCreateInfo fenceInfo;
     // fenceInfo.flags = vk::FenceCreateFlagBits::eSignaled;
@@ -126,6 +143,7 @@ void CommandContext::Reset()
     m_CpuLinearAllocator.Cleanup();
     m_GpuLinearAllocator.Cleanup();
     m_DsPool.Cleanup();
+    m_TransientArena.Reset();
 }
 
 CommandContext::~CommandContext(void)
@@ -147,6 +165,11 @@ void CommandContext::Finish(bool WaitForCompletion)
 {
     ASSERT(m_Type == vk::QueueFlagBits::eGraphics || m_Type == vk::QueueFlagBits::eCompute);
 
+    while (m_NumPendingClears > 0)
+    {
+        ExecutePendingClear(0);
+    }
+    FlushResourceBarriers();
     m_CommandBuffer.end();
 
     CommandQueue &Queue = g_CommandManager.GetQueue(m_Type);
@@ -177,6 +200,19 @@ void CommandContext::Finish(bool WaitForCompletion)
 
     Queue.Submit(submitInfo, m_Fence);
 
+    s_Draws.Add(m_Stats.Draws);
+    s_Dispatches.Add(m_Stats.Dispatches);
+    s_PipelineBinds.Add(m_Stats.PipelineBinds);
+    s_VertexBufferBinds.Add(m_Stats.VertexBufferBinds);
+    s_IndexBufferBinds.Add(m_Stats.IndexBufferBinds);
+    s_DescriptorSets.Add(m_Stats.DescriptorSets);
+    s_DescriptorWrites.Add(m_Stats.DescriptorWrites);
+    s_Barriers.Add(m_Stats.Barriers);
+    s_BarrierBatches.Add(m_Stats.BarrierBatches);
+    s_DynamicBytes.Add(m_Stats.DynamicBytes);
+    s_StagingBytes.Add(m_Stats.StagingBytes);
+    m_Stats = {};
+
     if (WaitForCompletion)
     {
         Queue.WaitForFence(m_Fence);
@@ -199,94 +235,382 @@ void CommandContext::InitializeBuffer(GpuBuffer &dst, const StagingBuffer &src,
     copyRegion.size = std::min(dst.GetBufferSize(), src.GetBufferSize());
 
     initContext.m_CommandBuffer.copyBuffer(src.m_Buffer, dst.m_Buffer, copyRegion);
+    initContext.m_Stats.StagingBytes += copyRegion.size;
 
     initContext.Finish(true);
 }
 
+void CommandContext::WriteBuffer(GpuBuffer &Dest, size_t DestOffset, const void *Data, size_t NumBytes)
+{
+    ASSERT(DestOffset + NumBytes <= Dest.GetBufferSize());
+
+    vk::BufferCreateInfo bufferInfo;
+    bufferInfo.size = NumBytes;
+    bufferInfo.usage = vk::BufferUsageFlagBits::eTransferSrc;
+    bufferInfo.sharingMode = vk::SharingMode::eExclusive;
+    vk::Buffer buffer = g_Device.createBuffer(bufferInfo);
+    auto allocInfo = m_CpuLinearAllocator.AllocAndBind(buffer);
+    memcpy(allocInfo.pMappedData, Data, NumBytes);
+    m_Stats.StagingBytes += NumBytes;
+
+    const vk::PipelineStageFlags2 readStages =
+        vk::PipelineStageFlagBits2::eVertexInput | vk::PipelineStageFlagBits2::eVertexShader |
+        vk::PipelineStageFlagBits2::eFragmentShader | vk::PipelineStageFlagBits2::eComputeShader;
+
+    // Earlier draws may still be reading the old contents. An execution dependency is enough for a
+    // write-after-read hazard, and it is recorded in one batch with the transitions already queued.
+    InsertMemoryBarrier(readStages, {}, vk::PipelineStageFlagBits2::eTransfer, {});
+    FlushResourceBarriers();
+
+    vk::BufferCopy copyRegion;
+    copyRegion.srcOffset = 0;
+    copyRegion.dstOffset = DestOffset;
+    copyRegion.size = NumBytes;
+    m_CommandBuffer.copyBuffer(buffer, Dest.m_Buffer, copyRegion);
+
+    // The reads wait in the batch flushed before the next draw, dispatch or render pass, so consecutive
+    // writes share their barriers
+    InsertMemoryBarrier(vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite, readStages,
+                        vk::AccessFlagBits2::eUniformRead | vk::AccessFlagBits2::eShaderRead |
+                            vk::AccessFlagBits2::eVertexAttributeRead | vk::AccessFlagBits2::eIndexRead);
+}
+
+vk::Buffer CommandContext::CreateDynamicBuffer(size_t NumBytes, vk::BufferUsageFlags Usage)
+{
+    vk::BufferCreateInfo bufferInfo;
+    bufferInfo.size = NumBytes;
+    bufferInfo.usage = Usage;
+    bufferInfo.sharingMode = vk::SharingMode::eExclusive;
+    vk::Buffer buffer = g_Device.createBuffer(bufferInfo);
+    m_GpuLinearAllocator.AllocAndBind(buffer);
+    return buffer;
+}
+
+void CommandContext::InsertMemoryBarrier(vk::PipelineStageFlags2 SrcStage, vk::AccessFlags2 SrcAccess,
+                                         vk::PipelineStageFlags2 DstStage, vk::AccessFlags2 DstAccess)
+{
+    if (!m_HasMemoryBarrier)
+    {
+        m_MemoryBarrier = vk::MemoryBarrier2();
+        m_HasMemoryBarrier = true;
+    }
+    m_MemoryBarrier.srcStageMask |= SrcStage;
+    m_MemoryBarrier.srcAccessMask |= SrcAccess;
+    m_MemoryBarrier.dstStageMask |= DstStage;
+    m_MemoryBarrier.dstAccessMask |= DstAccess;
+}
+
 void CommandContext::InitializeImage(ImageView &dst, const StagingBuffer &src,
                                      const vk::ArrayProxy<vk::BufferImageCopy> &regions)
 {
     auto &initContext = CommandContext::Begin();
 
-    initContext.TransitionImageLayout(dst, vk::ImageLayout::eTransferDstOptimal);
+    initContext.TransitionImageLayout(dst, vk::ImageLayout::eTransferDstOptimal, true);
 
     initContext.m_CommandBuffer.copyBufferToImage(src.m_Buffer, dst.m_Image, vk::ImageLayout::eTransferDstOptimal,
                                                   regions);
+    initContext.m_Stats.StagingBytes += src.GetBufferSize();
 
     initContext.TransitionImageLayout(dst, vk::ImageLayout::eShaderReadOnlyOptimal);
     initContext.Finish(true);
 }
 
-void CommandContext::TransitionImageLayout(ImageView &img, vk::ImageLayout newLayout)
+namespace
+{
+// The stages and accesses that can touch an image while it is in a layout. Only writes need to be
+// made available, so the source side of a barrier leaves reads out of the access mask.
+void GetLayoutSyncScope(vk::ImageLayout layout, bool isSource, vk::PipelineStageFlags2 &stage,
+                        vk::AccessFlags2 &access)
+{
+    using Stage = vk::PipelineStageFlagBits2;
+    using Access = vk::AccessFlagBits2;
+
+    switch (layout)
+    {
+    case vk::ImageLayout::eUndefined:
+        [[fallthrough]];
+    case vk::ImageLayout::ePreinitialized:
+        [[fallthrough]];
+    case vk::ImageLayout::ePresentSrcKHR:
+        // Acquiring waits on the host, presenting is ordered by the queue
+        stage = Stage::eNone;
+        access = Access::eNone;
+        break;
+    case vk::ImageLayout::eShaderReadOnlyOptimal:
+        stage = Stage::eFragmentShader | Stage::eComputeShader;
+        access = isSource ? Access::eNone : Access::eShaderRead;
+        break;
+    case vk::ImageLayout::eTransferDstOptimal:
+        stage = Stage::eTransfer;
+        access = Access::eTransferWrite;
+        break;
+    case vk::ImageLayout::eTransferSrcOptimal:
+        stage = Stage::eTransfer;
+        access = isSource ? Access::eNone : Access::eTransferRead;
+        break;
+    case vk::ImageLayout::eColorAttachmentOptimal:
+        stage = Stage::eColorAttachmentOutput;
+        access = isSource ? vk::AccessFlags2(Access::eColorAttachmentWrite)
+                          : Access::eColorAttachmentRead | Access::eColorAttachmentWrite;
+        break;
+    case vk::ImageLayout::eDepthStencilAttachmentOptimal:
+        stage = Stage::eEarlyFragmentTests | Stage::eLateFragmentTests;
+        access = isSource ? vk::AccessFlags2(Access::eDepthStencilAttachmentWrite)
+                          : Access::eDepthStencilAttachmentRead | Access::eDepthStencilAttachmentWrite;
+        break;
+    case vk::ImageLayout::eDepthStencilReadOnlyOptimal:
+        stage = Stage::eEarlyFragmentTests | Stage::eLateFragmentTests | Stage::eFragmentShader;
+        access = isSource ? vk::AccessFlags2() : Access::eDepthStencilAttachmentRead | Access::eShaderRead;
+        break;
+    case vk::ImageLayout::eGeneral:
+        stage = Stage::eComputeShader;
+        access = isSource ? vk::AccessFlags2(Access::eShaderWrite) : Access::eShaderRead | Access::eShaderWrite;
+        break;
+    default:
+        printf("Current image layout not suppported!\n");
+        stage = Stage::eAllCommands;
+        access = Access::eMemoryRead | Access::eMemoryWrite;
+        break;
+    }
+}
+} // namespace
+
+void CommandContext::TransitionImageLayout(ImageView &img, vk::ImageLayout newLayout, bool FlushImmediate)
+{
+    // A pending clear survives the move to an attachment layout, where the render pass can fold it in.
+    // Any other use needs the cleared contents now.
+    int pendingClear = m_NumPendingClears > 0 ? FindPendingClear(img.m_Image) : -1;
+    if (pendingClear >= 0 && newLayout != vk::ImageLayout::eColorAttachmentOptimal &&
+        newLayout != vk::ImageLayout::eDepthStencilAttachmentOptimal)
+    {
+        ExecutePendingClear(pendingClear);
+        pendingClear = -1;
+    }
+
+    if (img.m_Layout != newLayout)
+    {
+        // A second transition of an image that is still queued just retargets the pending barrier
+        vk::ImageMemoryBarrier2 *barrier = nullptr;
+        for (uint32_t i = 0; i < m_NumBarriersToFlush; ++i)
+        {
+            if (m_ImageBarrierBuffer[i].image == img.m_Image)
+            {
+                barrier = &m_ImageBarrierBuffer[i];
+                break;
+            }
+        }
+
+        if (barrier == nullptr)
+        {
+            if (m_NumBarriersToFlush == kMaxBarriersToFlush)
+            {
+                FlushBarriers();
+            }
+            barrier = &m_ImageBarrierBuffer[m_NumBarriersToFlush++];
+            *barrier = vk::ImageMemoryBarrier2();
+            // The old contents of an image that is going to be cleared don't have to be preserved
+            barrier->oldLayout = pendingClear >= 0 ? vk::ImageLayout::eUndefined : img.m_Layout;
+            barrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier->image = img.m_Image;
+            barrier->subresourceRange = img.m_SubresourceRange;
+            GetLayoutSyncScope(img.m_Layout, true, barrier->srcStageMask, barrier->srcAccessMask);
+        }
+
+        barrier->newLayout = newLayout;
+        GetLayoutSyncScope(newLayout, false, barrier->dstStageMask, barrier->dstAccessMask);
+
+        img.m_Layout = newLayout;
+    }
+
+    if (FlushImmediate)
+    {
+        FlushResourceBarriers();
+    }
+}
+
+void CommandContext::AliasImage(const ImageView *Before, ImageView &After, vk::ImageLayout NewLayout)
 {
-    if (img.m_Layout == newLayout)
+    ASSERT(NewLayout != vk::ImageLayout::eUndefined);
+
+    if (Before == nullptr || Before->m_Layout == vk::ImageLayout::eUndefined)
     {
+        // Nothing used the memory yet, so there is nothing to wait for
+        After.m_Layout = vk::ImageLayout::eUndefined;
+        TransitionImageLayout(After, NewLayout);
         return;
     }
-    vk::PipelineStageFlags srcStage, dstStage;
-    vk::ImageMemoryBarrier barrier;
-    barrier.oldLayout = img.m_Layout;
-    barrier.newLayout = newLayout;
+
+    // A complete barrier: the old contents are dropped, and the wait is for Before's last access
+    if (m_NumBarriersToFlush == kMaxBarriersToFlush)
+    {
+        FlushBarriers();
+    }
+    vk::ImageMemoryBarrier2 &barrier = m_ImageBarrierBuffer[m_NumBarriersToFlush++];
+    barrier = vk::ImageMemoryBarrier2();
+    barrier.oldLayout = vk::ImageLayout::eUndefined;
+    barrier.newLayout = NewLayout;
     barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
     barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.image = img.m_Image;
-    barrier.subresourceRange = img.m_SubresourceRange;
-    //    if (newLayout == vk::ImageLayout::eDepthStencilAttachmentOptimal)
-    //    {
-    //        barrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eDepth;
-    //    }
-    //    else
-    //    {
-    //        barrier.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
-    //    }
-    //    barrier.subresourceRange.baseMipLevel = 0;
-    //    barrier.subresourceRange.levelCount = 1;
-    //    barrier.subresourceRange.baseArrayLayer = 0;
-    //    barrier.subresourceRange.layerCount = 1;
+    barrier.image = After.m_Image;
+    barrier.subresourceRange = After.m_SubresourceRange;
+    GetLayoutSyncScope(Before->m_Layout, true, barrier.srcStageMask, barrier.srcAccessMask);
+    GetLayoutSyncScope(NewLayout, false, barrier.dstStageMask, barrier.dstAccessMask);
+
+    After.m_Layout = NewLayout;
+}
+
+void CommandContext::FlushBarriers(void)
+{
+    ASSERT(m_NumBarriersToFlush > 0 || m_HasMemoryBarrier);
+
+    // Transitions that came back to where they started cancel out
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < m_NumBarriersToFlush; ++i)
+    {
+        if (m_ImageBarrierBuffer[i].oldLayout != m_ImageBarrierBuffer[i].newLayout)
+        {
+            m_ImageBarrierBuffer[count++] = m_ImageBarrierBuffer[i];
+        }
+    }
+    m_NumBarriersToFlush = 0;
+    const uint32_t memoryCount = m_HasMemoryBarrier ? 1 : 0;
+    m_HasMemoryBarrier = false;
+    if (count == 0 && memoryCount == 0)
+    {
+        return;
+    }
 
-    auto Select = [](vk::ImageLayout layout, vk::AccessFlags &mask, vk::PipelineStageFlags &stage) {
-        switch (layout)
+    if (g_bSynchronization2)
+    {
+        vk::DependencyInfo dependency;
+        dependency.memoryBarrierCount = memoryCount;
+        dependency.pMemoryBarriers = &m_MemoryBarrier;
+        dependency.imageMemoryBarrierCount = count;
+        dependency.pImageMemoryBarriers = m_ImageBarrierBuffer;
+        g_vkCmdPipelineBarrier2(m_CommandBuffer, reinterpret_cast<const VkDependencyInfo *>(&dependency));
+    }
+    else
+    {
+        // The stage and access bits used above have the same values in the original barrier API
+        vk::ImageMemoryBarrier barriers[kMaxBarriersToFlush];
+        vk::MemoryBarrier memoryBarrier;
+        vk::PipelineStageFlags srcStage, dstStage;
+        if (memoryCount > 0)
+        {
+            const vk::MemoryBarrier2 &b = m_MemoryBarrier;
+            memoryBarrier.srcAccessMask = vk::AccessFlags((VkAccessFlags)(VkAccessFlags2)b.srcAccessMask);
+            memoryBarrier.dstAccessMask = vk::AccessFlags((VkAccessFlags)(VkAccessFlags2)b.dstAccessMask);
+            srcStage |= vk::PipelineStageFlags((VkPipelineStageFlags)(VkPipelineStageFlags2)b.srcStageMask);
+            dstStage |= vk::PipelineStageFlags((VkPipelineStageFlags)(VkPipelineStageFlags2)b.dstStageMask);
+        }
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const vk::ImageMemoryBarrier2 &b = m_ImageBarrierBuffer[i];
+            barriers[i].srcAccessMask = vk::AccessFlags((VkAccessFlags)(VkAccessFlags2)b.srcAccessMask);
+            barriers[i].dstAccessMask = vk::AccessFlags((VkAccessFlags)(VkAccessFlags2)b.dstAccessMask);
+            barriers[i].oldLayout = b.oldLayout;
+            barriers[i].newLayout = b.newLayout;
+            barriers[i].srcQueueFamilyIndex = b.srcQueueFamilyIndex;
+            barriers[i].dstQueueFamilyIndex = b.dstQueueFamilyIndex;
+            barriers[i].image = b.image;
+            barriers[i].subresourceRange = b.subresourceRange;
+            srcStage |= vk::PipelineStageFlags((VkPipelineStageFlags)(VkPipelineStageFlags2)b.srcStageMask);
+            dstStage |= vk::PipelineStageFlags((VkPipelineStageFlags)(VkPipelineStageFlags2)b.dstStageMask);
+        }
+        if (!srcStage)
         {
-        case vk::ImageLayout::eUndefined:
-            [[fallthrough]];
-        case vk::ImageLayout::ePreinitialized:
-            mask = vk::AccessFlagBits::eNone;
-            stage = vk::PipelineStageFlagBits::eTopOfPipe;
-            break;
-        case vk::ImageLayout::eShaderReadOnlyOptimal:
-            mask = vk::AccessFlagBits::eShaderRead;
-            stage = vk::PipelineStageFlagBits::eFragmentShader;
-            break;
-        case vk::ImageLayout::eTransferDstOptimal:
-            mask = vk::AccessFlagBits::eTransferWrite;
-            stage = vk::PipelineStageFlagBits::eTransfer;
-            break;
-        case vk::ImageLayout::eColorAttachmentOptimal:
-            [[fallthrough]];
-        case vk::ImageLayout::ePresentSrcKHR:
-            mask = vk::AccessFlagBits::eColorAttachmentWrite;
-            stage = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-            break;
-        case vk::ImageLayout::eDepthStencilAttachmentOptimal:
-            mask = vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
-            stage = vk::PipelineStageFlagBits::eEarlyFragmentTests;
-            break;
-        case vk::ImageLayout::eGeneral:
-            mask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
-            stage = vk::PipelineStageFlagBits::eComputeShader;
-            break;
-        default:
-            printf("Current image layout not suppported!\n");
-            break;
+            srcStage = vk::PipelineStageFlagBits::eTopOfPipe;
         }
-    };
+        if (!dstStage)
+        {
+            dstStage = vk::PipelineStageFlagBits::eBottomOfPipe;
+        }
+        m_CommandBuffer.pipelineBarrier(srcStage, dstStage, {},
+                                        vk::ArrayProxy<const vk::MemoryBarrier>(memoryCount, &memoryBarrier), {},
+                                        vk::ArrayProxy<const vk::ImageMemoryBarrier>(count, barriers));
+    }
 
-    Select(img.m_Layout, barrier.srcAccessMask, srcStage);
-    Select(newLayout, barrier.dstAccessMask, dstStage);
+    m_Stats.Barriers += count + memoryCount;
+    m_Stats.BarrierBatches += 1;
+}
 
-    m_CommandBuffer.pipelineBarrier(srcStage, dstStage, {}, {}, {}, barrier);
+void CommandContext::DeferClear(PixelBuffer &Target)
+{
+    if (FindPendingClear(Target.m_Image) >= 0)
+    {
+        return;
+    }
+    if (m_NumPendingClears == kMaxPendingClears)
+    {
+        ExecutePendingClear(0);
+    }
+    m_PendingClears[m_NumPendingClears++] = &Target;
+}
 
-    img.m_Layout = newLayout;
+bool CommandContext::TakePendingClear(const PixelBuffer &Target, vk::ClearValue &Value)
+{
+    int index = FindPendingClear(Target.m_Image);
+    if (index < 0)
+    {
+        return false;
+    }
+    Value = m_PendingClears[index]->GetClearValue();
+    m_PendingClears[index] = m_PendingClears[--m_NumPendingClears];
+    return true;
+}
+
+int CommandContext::FindPendingClear(vk::Image Image) const
+{
+    for (uint32_t i = 0; i < m_NumPendingClears; ++i)
+    {
+        if (m_PendingClears[i]->m_Image == Image)
+        {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+void CommandContext::ExecutePendingClear(uint32_t Index)
+{
+    ASSERT(Index < m_NumPendingClears);
+    PixelBuffer &Target = *m_PendingClears[Index];
+    // Removed first, the transition below must not find it again
+    m_PendingClears[Index] = m_PendingClears[--m_NumPendingClears];
+
+    TransitionImageLayout(Target, vk::ImageLayout::eTransferDstOptimal, true);
+
+    vk::ImageSubresourceRange range;
+    range.aspectMask = Target.m_AspectMask;
+    range.baseMipLevel = 0;
+    range.levelCount = 1;
+    range.baseArrayLayer = 0;
+    range.layerCount = 1;
+
+    vk::ClearValue value = Target.GetClearValue();
+    if (Target.m_AspectMask & vk::ImageAspectFlagBits::eColor)
+    {
+        m_CommandBuffer.clearColorImage(Target.m_Image, vk::ImageLayout::eTransferDstOptimal, value.color, range);
+    }
+    else
+    {
+        m_CommandBuffer.clearDepthStencilImage(Target.m_Image, vk::ImageLayout::eTransferDstOptimal,
+                                               value.depthStencil, range);
+    }
+}
+
+uint32_t CommandContext::GetLastFrameDrawCount(void) { return (uint32_t)s_Draws.GetLastFrame(); }
+
+void CommandContext::BindDynamicDescriptors(vk::PipelineBindPoint BindPoint)
+{
+    auto set = m_DsPool.NewDescriptorSet(m_CurrLayout);
+    m_Stats.DescriptorWrites += m_DynamicImageSamplerHeap.CommitDescriptorSet(set);
+    m_Stats.DescriptorWrites += m_DynamicUniformBufferHeap.CommitDescriptorSet(set);
+    m_Stats.DescriptorWrites += m_DynamicStorageImageHeap.CommitDescriptorSet(set);
+    m_Stats.DescriptorWrites += m_DynamicStorageBufferHeap.CommitDescriptorSet(set);
+    m_CommandBuffer.bindDescriptorSets(BindPoint, m_CurrPipelineLayout, 0, set, {});
+    ++m_Stats.DescriptorSets;
 }
 
 void CommandContext::SetDescriptorSet(const DescriptorSet &ds)
@@ -296,6 +620,7 @@ void CommandContext::SetDescriptorSet(const DescriptorSet &ds)
     m_DynamicImageSamplerHeap.Cleanup();
     m_DynamicUniformBufferHeap.Cleanup();
     m_DynamicStorageImageHeap.Cleanup();
+    m_DynamicStorageBufferHeap.Cleanup();
 }
 
 // void CommandContext::BeginUpdateDescriptorSet() { m_CurrSet = m_DsPool.NewDescriptorSet(m_CurrLayout); }
@@ -327,6 +652,7 @@ void CommandContext::UpdateDynamicUniformBuffer(uint32_t Binding, size_t DataSiz
     vk::Buffer buffer = g_Device.createBuffer(bufferInfo);
     auto allocInfo = m_CpuLinearAllocator.AllocAndBind(buffer);
     memcpy(allocInfo.pMappedData, Data, DataSize);
+    m_Stats.DynamicBytes += DataSize;
     // m_DynamicBuffers.push_back(buffer);
 
     vk::DescriptorBufferInfo info;
@@ -347,7 +673,7 @@ void CommandContext::UpdateDynamicUniformBuffer(uint32_t Binding, size_t DataSiz
 
 void CommandContext::UpdateImageSampler(uint32_t binding, const vk::ImageView &imageview, const vk::Sampler &sampler)
 {
-    std::vector<vk::DescriptorImageInfo> infos{{sampler, imageview, vk::ImageLayout::eShaderReadOnlyOptimal}};
+    vk::DescriptorImageInfo info{sampler, imageview, vk::ImageLayout::eShaderReadOnlyOptimal};
 
     // vk::WriteDescriptorSet write;
     // write.dstSet = m_CurrSet;
@@ -357,14 +683,12 @@ void CommandContext::UpdateImageSampler(uint32_t binding, const vk::ImageView &i
     // write.descriptorCount = 1;
     // write.setImageInfo(info);
     // g_Device.updateDescriptorSets(write, {});
-    m_DynamicImageSamplerHeap.SetDescriptorInfo(binding, 0, infos);
+    m_DynamicImageSamplerHeap.SetDescriptorInfo(binding, 0, info);
 }
 
 void CommandContext::UpdateImageSampler(uint32_t binding, uint32_t firstIndex,
                                         const vk::ArrayProxy<vk::DescriptorImageInfo> &imageSamplers)
 {
-    std::vector<vk::DescriptorImageInfo> infos{imageSamplers.begin(), imageSamplers.end()};
-
     // vk::WriteDescriptorSet write;
     // write.dstSet = m_CurrSet;
     // write.dstBinding = binding;
@@ -373,17 +697,16 @@ void CommandContext::UpdateImageSampler(uint32_t binding, uint32_t firstIndex,
     // write.descriptorCount = infos.size();
     // write.setImageInfo(infos);
     // g_Device.updateDescriptorSets(write, {});
-    m_DynamicImageSamplerHeap.SetDescriptorInfo(binding, firstIndex, infos);
+    m_DynamicImageSamplerHeap.SetDescriptorInfo(binding, firstIndex, imageSamplers);
 }
 void CommandContext::UpdateStorageImage(uint32_t binding, const vk::ImageView &image)
 {
-    std::vector<vk::DescriptorImageInfo> infos{{{}, image, vk::ImageLayout::eGeneral}};
-    m_DynamicStorageImageHeap.SetDescriptorInfo(binding, 0, infos);
+    vk::DescriptorImageInfo info{{}, image, vk::ImageLayout::eGeneral};
+    m_DynamicStorageImageHeap.SetDescriptorInfo(binding, 0, info);
 }
 void CommandContext::UpdateStorageImage(uint32_t binding, uint32_t firstIndex,
                                         const vk::ArrayProxy<vk::DescriptorImageInfo> &image)
 {
-    std::vector<vk::DescriptorImageInfo> infos{image.begin(), image.end()};
     // vk::DescriptorImageInfo info;
     // info.imageLayout = vk::ImageLayout::eGeneral;
     // info.imageView = imageview;
@@ -396,7 +719,12 @@ void CommandContext::UpdateStorageImage(uint32_t binding, uint32_t firstIndex,
     // write.descriptorCount = 1;
     // write.setImageInfo(info);
     // g_Device.updateDescriptorSets(write, {});
-    m_DynamicStorageImageHeap.SetDescriptorInfo(binding, firstIndex, infos);
+    m_DynamicStorageImageHeap.SetDescriptorInfo(binding, firstIndex, image);
+}
+
+void CommandContext::UpdateStorageBuffer(uint32_t binding, const vk::DescriptorBufferInfo &buffer)
+{
+    m_DynamicStorageBufferHeap.SetDescriptorInfo(binding, buffer);
 }
 
 void CommandContext::PushConstantBuffer(vk::ShaderStageFlags Stage, size_t Offset, size_t Size, const void *Data)
@@ -409,49 +737,143 @@ void CommandContext::InsertTimestamp(vk::PipelineStageFlagBits stage, const vk::
     m_CommandBuffer.writeTimestamp(stage, pool, query);
 }
 
+void CommandContext::ResetQueries(const vk::QueryPool &pool, uint32_t firstQuery, uint32_t queryCount)
+{
+    m_CommandBuffer.resetQueryPool(pool, firstQuery, queryCount);
+}
+
+void CommandContext::BeginQuery(const vk::QueryPool &pool, uint32_t query)
+{
+    m_CommandBuffer.beginQuery(pool, query, vk::QueryControlFlags());
+}
+
+void CommandContext::EndQuery(const vk::QueryPool &pool, uint32_t query) { m_CommandBuffer.endQuery(pool, query); }
+
 void GraphicsContext::BindPipeline(const PSO &pipeline)
 {
     m_CommandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline.GetPipeline());
+    ++m_Stats.PipelineBinds;
 }
 
-void GraphicsContext::BeginRenderPass(const vk::ArrayProxy<PixelBuffer> &colors)
+void GraphicsContext::BeginRendering(const vk::ArrayProxy<PixelBuffer> &colors, const PixelBuffer *depth,
+                                     const RenderPass::AttachmentOps *ops, const vk::ClearValue *clearValues)
 {
-    std::vector<vk::Format> colorFormats;
+    const uint32_t kMaxColorAttachments = 8;
+    ASSERT(colors.size() <= kMaxColorAttachments);
+
+    vk::RenderingAttachmentInfo colorAttachments[kMaxColorAttachments];
+    uint32_t colorCount = 0;
     for (auto &c : colors)
     {
-        colorFormats.push_back(c.GetFormat());
+        vk::RenderingAttachmentInfo &attachment = colorAttachments[colorCount];
+        attachment.imageView = c;
+        attachment.imageLayout = vk::ImageLayout::eColorAttachmentOptimal;
+        attachment.loadOp = ops[colorCount].load;
+        attachment.storeOp = ops[colorCount].store;
+        attachment.clearValue = clearValues[colorCount];
+        ++colorCount;
     }
-    vk::RenderPass renderPass = RenderPass::GetRenderPass(colorFormats, vk::Format::eUndefined);
-    Framebuffer framebuffer = g_FramebufferManager.GetFramebuffer(renderPass, colors);
 
-    vk::RenderPassBeginInfo info;
-    info.renderPass = renderPass;
-    info.framebuffer = framebuffer;
+    vk::RenderingAttachmentInfo depthAttachment;
+    if (depth != nullptr)
+    {
+        depthAttachment.imageView = *depth;
+        depthAttachment.imageLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+        depthAttachment.loadOp = ops[colorCount].load;
+        depthAttachment.storeOp = ops[colorCount].store;
+        depthAttachment.clearValue = clearValues[colorCount];
+    }
+
+    const PixelBuffer &first = colors.empty() ? *depth : *colors.begin();
+
+    vk::RenderingInfo info;
     info.renderArea.setOffset({0, 0});
-    info.renderArea.extent.width = framebuffer.GetWidth();
-    info.renderArea.extent.height = framebuffer.GetHeight();
+    info.renderArea.extent.width = first.GetWidth();
+    info.renderArea.extent.height = first.GetHeight();
+    info.layerCount = 1;
+    info.colorAttachmentCount = colorCount;
+    info.pColorAttachments = colorAttachments;
+    if (depth != nullptr)
+    {
+        info.pDepthAttachment = &depthAttachment;
+        if (RenderPass::HasStencil(depth->GetFormat()))
+        {
+            info.pStencilAttachment = &depthAttachment;
+        }
+    }
 
-    // auto clearValues = framebuffer.GetClearValues();
-    // info.setClearValues(clearValues);
-    // info.clearValueCount = clearValues.size();
+    g_vkCmdBeginRendering(m_CommandBuffer, reinterpret_cast<const VkRenderingInfo *>(&info));
+}
 
-    m_CommandBuffer.beginRenderPass(info, vk::SubpassContents::eInline);
+void GraphicsContext::BeginRenderPass(const vk::ArrayProxy<PixelBuffer> &colors)
+{
+    BeginRenderPass(colors, nullptr, nullptr);
 }
+
 void GraphicsContext::BeginRenderPass(const vk::ArrayProxy<PixelBuffer> &colors, const PixelBuffer &depth)
 {
-    std::vector<vk::Format> colorFormats;
+    BeginRenderPass(colors, nullptr, &depth);
+}
+
+void GraphicsContext::BeginRenderPass(const vk::ArrayProxy<PixelBuffer> &colors,
+                                      const RenderPass::AttachmentOps *colorOps, const PixelBuffer *depth,
+                                      RenderPass::AttachmentOps depthOps)
+{
+    const uint32_t kMaxAttachments = 9;
+    ASSERT(colors.size() < kMaxAttachments);
+
+    // Attachments with a pending clear are cleared by the load op instead
+    RenderPass::AttachmentOps ops[kMaxAttachments];
+    vk::ClearValue clearValues[kMaxAttachments];
+    uint32_t count = 0;
     for (auto &c : colors)
     {
-        colorFormats.push_back(c.GetFormat());
+        if (colorOps != nullptr)
+        {
+            ops[count] = colorOps[count];
+        }
+        if (TakePendingClear(c, clearValues[count]))
+        {
+            ops[count].load = vk::AttachmentLoadOp::eClear;
+        }
+        ++count;
     }
-    vk::RenderPass renderPass = RenderPass::GetRenderPass(colorFormats, depth.GetFormat());
-    std::vector<PixelBuffer> buffers;
-    for (auto &i : colors)
+    if (depth != nullptr)
     {
-        buffers.push_back(i);
+        ops[count] = depthOps;
+        if (TakePendingClear(*depth, clearValues[count]))
+        {
+            ops[count].load = vk::AttachmentLoadOp::eClear;
+        }
+        ++count;
     }
-    buffers.push_back(depth);
-    Framebuffer framebuffer = g_FramebufferManager.GetFramebuffer(renderPass, buffers);
+
+    FlushResourceBarriers();
+
+    if (g_bDynamicRendering)
+    {
+        BeginRendering(colors, depth, ops, clearValues);
+        return;
+    }
+
+    vk::Format colorFormats[kMaxAttachments];
+    const PixelBuffer *buffers[kMaxAttachments];
+    uint32_t numBuffers = 0;
+    for (auto &c : colors)
+    {
+        colorFormats[numBuffers] = c.GetFormat();
+        buffers[numBuffers++] = &c;
+    }
+    vk::Format depthFormat = vk::Format::eUndefined;
+    if (depth != nullptr)
+    {
+        depthFormat = depth->GetFormat();
+        buffers[numBuffers++] = depth;
+    }
+    vk::RenderPass renderPass =
+        RenderPass::GetRenderPass(vk::ArrayProxy<vk::Format>(colors.size(), colorFormats), depthFormat, ops,
+                                  depth != nullptr ? ops[colors.size()] : depthOps);
+    Framebuffer framebuffer = g_FramebufferManager.GetFramebuffer(renderPass, buffers, numBuffers);
 
     vk::RenderPassBeginInfo info;
     info.renderPass = renderPass;
@@ -459,43 +881,27 @@ void GraphicsContext::BeginRenderPass(const vk::ArrayProxy<PixelBuffer> &colors,
     info.renderArea.setOffset({0, 0});
     info.renderArea.extent.width = framebuffer.GetWidth();
     info.renderArea.extent.height = framebuffer.GetHeight();
-
-    // auto clearValues = framebuffer.GetClearValues();
-    // info.setClearValues(clearValues);
-    // info.clearValueCount = clearValues.size();
+    info.clearValueCount = count;
+    info.pClearValues = clearValues;
 
     m_CommandBuffer.beginRenderPass(info, vk::SubpassContents::eInline);
 }
 
-void GraphicsContext::EndRenderPass() { m_CommandBuffer.endRenderPass(); }
-
-void GraphicsContext::ClearColor(ColorBuffer &Target)
+void GraphicsContext::EndRenderPass()
 {
-    TransitionImageLayout(Target, vk::ImageLayout::eGeneral);
-
-    vk::ImageSubresourceRange range;
-    range.aspectMask = vk::ImageAspectFlagBits::eColor;
-    range.baseMipLevel = 0;
-    range.levelCount = 1;
-    range.baseArrayLayer = 0;
-    range.layerCount = 1;
-
-    m_CommandBuffer.clearColorImage(Target.GetImage(), vk::ImageLayout::eGeneral, Target.GetClearColor(), range);
+    if (g_bDynamicRendering)
+    {
+        g_vkCmdEndRendering(m_CommandBuffer);
+    }
+    else
+    {
+        m_CommandBuffer.endRenderPass();
+    }
 }
 
-void GraphicsContext::ClearDepth(DepthBuffer &Target)
-{
-    TransitionImageLayout(Target, vk::ImageLayout::eGeneral);
-
-    vk::ImageSubresourceRange range;
-    range.aspectMask = vk::ImageAspectFlagBits::eDepth;
-    range.baseMipLevel = 0;
-    range.levelCount = 1;
-    range.baseArrayLayer = 0;
-    range.layerCount = 1;
+void GraphicsContext::ClearColor(ColorBuffer &Target) { DeferClear(Target); }
 
-    m_CommandBuffer.clearDepthStencilImage(Target.GetImage(), vk::ImageLayout::eGeneral, Target.GetClearValue(), range);
-}
+void GraphicsContext::ClearDepth(DepthBuffer &Target) { DeferClear(Target); }
 
 void GraphicsContext::SetScissor(unsigned int left, unsigned int top, unsigned int right, unsigned int bottom)
 {
@@ -550,11 +956,13 @@ void GraphicsContext::SetPrimitiveTopology(vk::PrimitiveTopology topology)
 void GraphicsContext::BindVertexBuffer(uint32_t Binding, const VertexBuffer &buffer, size_t offset)
 {
     m_CommandBuffer.bindVertexBuffers(Binding, buffer.GetBuffer(), offset);
+    ++m_Stats.VertexBufferBinds;
 }
 
 void GraphicsContext::BindIndexBuffer(const IndexBuffer &buffer, size_t offset)
 {
     m_CommandBuffer.bindIndexBuffer(buffer.GetBuffer(), offset, buffer.GetIndexType());
+    ++m_Stats.IndexBufferBinds;
 }
 
 void GraphicsContext::BindDynamicVertexBuffer(uint32_t Binding, size_t DataSize, const void *VBData)
@@ -569,11 +977,32 @@ void GraphicsContext::BindDynamicVertexBuffer(uint32_t Binding, size_t DataSize,
     auto allocInfo = m_CpuLinearAllocator.AllocAndBind(buffer);
     memcpy(allocInfo.pMappedData, VBData, DataSize);
     // m_DynamicBuffers.push_back(buffer);
+    m_Stats.DynamicBytes += DataSize;
 
     m_CommandBuffer.bindVertexBuffers(Binding, buffer, {0});
+    ++m_Stats.VertexBufferBinds;
+}
+
+void GraphicsContext::DrawIndexedIndirect(vk::Buffer argumentBuffer, size_t argumentOffset, uint32_t drawCount)
+{
+    FlushResourceBarriers();
+    BindDynamicDescriptors(vk::PipelineBindPoint::eGraphics);
+
+    const uint32_t stride = sizeof(vk::DrawIndexedIndirectCommand);
+    if (g_bMultiDrawIndirect)
+    {
+        m_CommandBuffer.drawIndexedIndirect(argumentBuffer, argumentOffset, drawCount, stride);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < drawCount; ++i)
+            m_CommandBuffer.drawIndexedIndirect(argumentBuffer, argumentOffset + i * stride, 1, stride);
+    }
+    ++m_Stats.Draws;
 }
 
 void ComputeContext::BindPipeline(const PSO &pipeline)
 {
     m_CommandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.GetPipeline());
+    ++m_Stats.PipelineBinds;
 }
\ No newline at end of file
@@ -12,6 +12,8 @@
 #include "LinearAllocator.h"
 #include "Math/Common.h"
 #include "PipelineState.h"
+#include "RenderPass.h"
+#include "TransientArena.h"
 #include "Utility.h"
 
 #include <list>
@@ -91,6 +93,7 @@ public:
     void UpdateStorageImage(uint32_t binding, const vk::ImageView &image);
     void UpdateStorageImage(uint32_t binding, uint32_t firstIndex,
                             const vk::ArrayProxy<vk::DescriptorImageInfo> &image);
+    void UpdateStorageBuffer(uint32_t binding, const vk::DescriptorBufferInfo &buffer);
 
     void PushConstantBuffer(vk::ShaderStageFlags Stage, size_t Offset, size_t Size, const void *Data);
 
@@ -106,14 +109,57 @@ public:
     static void InitializeImage(ImageView &dst, const StagingBuffer &src,
                                 const vk::ArrayProxy<vk::BufferImageCopy> &regions);
 
-    void TransitionImageLayout(ImageView &img, vk::ImageLayout newLayout);
+    // Record a copy of CPU data into a GPU buffer. The data is staged in this context's upload
+    // memory, which is recycled once the context's fence signals, so this never waits on the GPU.
+    void WriteBuffer(GpuBuffer &Dest, size_t DestOffset, const void *Data, size_t NumBytes);
+
+    // A device local buffer for data the GPU produces and consumes within this context's commands, like
+    // indirect draw arguments. The CPU can't write it. It is freed with the other dynamic buffers once the
+    // context's fence signals, and must fit in one kGpuAllocatorPageSize page.
+    vk::Buffer CreateDynamicBuffer(size_t NumBytes, vk::BufferUsageFlags Usage);
+
+    // Makes writes of the earlier commands in SrcStage visible to the later ones in DstStage. Like the image
+    // transitions it is queued, and recorded in the same barrier batch before the next dependent command.
+    void InsertMemoryBarrier(vk::PipelineStageFlags2 SrcStage, vk::AccessFlags2 SrcAccess,
+                             vk::PipelineStageFlags2 DstStage, vk::AccessFlags2 DstAccess);
+
+    // Transitions are queued and recorded together right before the next command that depends on them
+    void TransitionImageLayout(ImageView &img, vk::ImageLayout newLayout, bool FlushImmediate = false);
+    // Drops the contents of an image whose memory was last used by Before (which may be the image itself
+    // or null) and moves it to NewLayout. The barrier waits for Before's last access.
+    void AliasImage(const ImageView *Before, ImageView &After, vk::ImageLayout NewLayout);
+    inline void FlushResourceBarriers(void)
+    {
+        if (m_NumBarriersToFlush > 0 || m_HasMemoryBarrier)
+            FlushBarriers();
+    }
+
+    // Draw calls submitted by all contexts during the last presented frame. This and the other work
+    // counted per frame (binds, descriptors, barriers, uploads) are FrameCounters, see FrameStats.h.
+    static uint32_t GetLastFrameDrawCount(void);
 
     void InsertTimestamp(vk::PipelineStageFlagBits stage, const vk::QueryPool &pool, uint32_t query);
+    void ResetQueries(const vk::QueryPool &pool, uint32_t firstQuery, uint32_t queryCount);
+    void BeginQuery(const vk::QueryPool &pool, uint32_t query);
+    void EndQuery(const vk::QueryPool &pool, uint32_t query);
+
+    // Scratch memory for recording, valid until the context is handed out again
+    TransientArena &GetTransientArena(void) { return m_TransientArena; }
 
 protected:
     CommandContext(vk::QueueFlagBits type);
 
     void Reset();
+    void FlushBarriers(void);
+    // Writes the dynamic descriptors into a new set and binds it
+    void BindDynamicDescriptors(vk::PipelineBindPoint BindPoint);
+
+    // Clears wait here until the target is used. A render pass folds them into its load op, any other use
+    // records them as a transfer clear first.
+    void DeferClear(PixelBuffer &Target);
+    bool TakePendingClear(const PixelBuffer &Target, vk::ClearValue &Value);
+    int FindPendingClear(vk::Image Image) const;
+    void ExecutePendingClear(uint32_t Index);
 
     vk::QueueFlagBits m_Type;
     vk::CommandBuffer m_CommandBuffer;
@@ -121,6 +167,34 @@ protected:
     // fence for summitting
     vk::Fence m_Fence;
 
+    static const uint32_t kMaxBarriersToFlush = 16;
+    vk::ImageMemoryBarrier2 m_ImageBarrierBuffer[kMaxBarriersToFlush];
+    uint32_t m_NumBarriersToFlush = 0;
+    // The queued memory barriers, merged into one
+    vk::MemoryBarrier2 m_MemoryBarrier;
+    bool m_HasMemoryBarrier = false;
+
+    static const uint32_t kMaxPendingClears = 8;
+    PixelBuffer *m_PendingClears[kMaxPendingClears];
+    uint32_t m_NumPendingClears = 0;
+
+    // Added to the frame counters when the context is finished
+    struct RecordStats
+    {
+        uint32_t Draws;
+        uint32_t Dispatches;
+        uint32_t PipelineBinds;
+        uint32_t VertexBufferBinds;
+        uint32_t IndexBufferBinds;
+        uint32_t DescriptorSets;
+        uint32_t DescriptorWrites;
+        uint32_t Barriers;
+        uint32_t BarrierBatches;
+        uint64_t DynamicBytes;
+        uint64_t StagingBytes;
+    };
+    RecordStats m_Stats = {};
+
     // for dynamic buffers
     LinearAllocator m_CpuLinearAllocator;
     LinearAllocator m_GpuLinearAllocator;
@@ -135,6 +209,9 @@ protected:
     DynamicDescriptorHeap m_DynamicImageSamplerHeap;
     DynamicDescriptorHeap m_DynamicUniformBufferHeap;
     DynamicDescriptorHeap m_DynamicStorageImageHeap;
+    DynamicDescriptorHeap m_DynamicStorageBufferHeap;
+
+    TransientArena m_TransientArena;
 
     // vk::PipelineBindPoint m_CurrBindPoint;
 
@@ -152,8 +229,13 @@ public:
     void BindPipeline(const PSO &pipeline);
     void BeginRenderPass(const vk::ArrayProxy<PixelBuffer> &colors);
     void BeginRenderPass(const vk::ArrayProxy<PixelBuffer> &colors, const PixelBuffer &depth);
+    // colorOps is null or holds one entry per color attachment, depth may be null. A pending clear of an
+    // attachment overrides its load op.
+    void BeginRenderPass(const vk::ArrayProxy<PixelBuffer> &colors, const RenderPass::AttachmentOps *colorOps,
+                         const PixelBuffer *depth, RenderPass::AttachmentOps depthOps = {});
     void EndRenderPass();
 
+    // Deferred until the target is used, see DeferClear
     void ClearColor(ColorBuffer &Target);
     void ClearDepth(DepthBuffer &Target);
 
@@ -171,30 +253,35 @@ public:
 
     inline void DrawIndexed(uint32_t indexCount, uint32_t firstIndex, uint32_t baseVertex = 0)
     {
-        auto set = m_DsPool.NewDescriptorSet(m_CurrLayout);
-        m_DynamicImageSamplerHeap.CommitDescriptorSet(set);
-        m_DynamicUniformBufferHeap.CommitDescriptorSet(set);
-        m_DynamicStorageImageHeap.CommitDescriptorSet(set);
-        m_CommandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_CurrPipelineLayout, 0, set, {});
+        FlushResourceBarriers();
+        BindDynamicDescriptors(vk::PipelineBindPoint::eGraphics);
 
         m_CommandBuffer.drawIndexed(indexCount, 1, firstIndex, baseVertex, 0);
+        ++m_Stats.Draws;
     }
     inline void DrawInstanced(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex,
                               uint32_t firstInstance)
     {
-        auto set = m_DsPool.NewDescriptorSet(m_CurrLayout);
-        m_DynamicImageSamplerHeap.CommitDescriptorSet(set);
-        m_DynamicUniformBufferHeap.CommitDescriptorSet(set);
-        m_DynamicStorageImageHeap.CommitDescriptorSet(set);
-        m_CommandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_CurrPipelineLayout, 0, set, {});
+        FlushResourceBarriers();
+        BindDynamicDescriptors(vk::PipelineBindPoint::eGraphics);
 
         m_CommandBuffer.draw(vertexCount, instanceCount, firstVertex, firstInstance);
+        ++m_Stats.Draws;
     }
 
     inline void Draw(uint32_t vertexCount, uint32_t vertexOffset = 0)
     {
         DrawInstanced(vertexCount, 1, vertexOffset, 0);
     }
+
+    // drawCount tightly packed vk::DrawIndexedIndirectCommands. Without multiDrawIndirect they are issued
+    // one call each.
+    void DrawIndexedIndirect(vk::Buffer argumentBuffer, size_t argumentOffset, uint32_t drawCount);
+
+private:
+    // Dynamic rendering path of BeginRenderPass, ops and clearValues hold the colors followed by the depth
+    void BeginRendering(const vk::ArrayProxy<PixelBuffer> &colors, const PixelBuffer *depth,
+                        const RenderPass::AttachmentOps *ops, const vk::ClearValue *clearValues);
 };
 
 class ComputeContext : public CommandContext
@@ -206,15 +293,27 @@ public:
 
     void BindPipeline(const PSO &pipeline);
 
+    inline void Dispatch(size_t GroupCountX = 1, size_t GroupCountY = 1, size_t GroupCountZ = 1)
+    {
+        FlushResourceBarriers();
+        BindDynamicDescriptors(vk::PipelineBindPoint::eCompute);
+
+        m_CommandBuffer.dispatch((uint32_t)GroupCountX, (uint32_t)GroupCountY, (uint32_t)GroupCountZ);
+        ++m_Stats.Dispatches;
+    }
+
+    inline void Dispatch1D(size_t ThreadCountX, size_t GroupSizeX = 64)
+    {
+        Dispatch(Math::DivideByMultiple(ThreadCountX, GroupSizeX), 1, 1);
+    }
+
     inline void Dispatch2D(size_t ThreadCountX, size_t ThreadCountY, size_t GroupSizeX, size_t GroupSizeY)
     {
-        auto set = m_DsPool.NewDescriptorSet(m_CurrLayout);
-        m_DynamicImageSamplerHeap.CommitDescriptorSet(set);
-        m_DynamicUniformBufferHeap.CommitDescriptorSet(set);
-        m_DynamicStorageImageHeap.CommitDescriptorSet(set);
-        m_CommandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_CurrPipelineLayout, 0, set, {});
+        FlushResourceBarriers();
+        BindDynamicDescriptors(vk::PipelineBindPoint::eCompute);
 
         m_CommandBuffer.dispatch(Math::DivideByMultiple(ThreadCountX, GroupSizeX),
                                  Math::DivideByMultiple(ThreadCountY, GroupSizeY), 1);
+        ++m_Stats.Dispatches;
     }
 };
@@ -21,8 +21,10 @@
 #include "DescriptorSet.h"
 #include "Display.h"
 #include "EngineTuning.h"
+#include "FrameStats.h"
 #include "GpuBuffer.h"
 #include "GraphicsCore.h"
+#include "HashMap.h"
 #include "RenderPass.h"
 #include "SystemTime.h"
 #include "Utility.h"
@@ -61,6 +63,8 @@ extern GLFWwindow *g_Window;
 // #include "CompiledShaders/GenerateMipsGammaOddYCS.h"
 
 #define SWAP_CHAIN_BUFFER_COUNT 3
+// Without a swapchain to block on, frames in flight are limited by waiting for the frame this many back
+#define HEADLESS_FRAMES_IN_FLIGHT 2
 
 vk::Format SwapChainFormat = vk::Format::eA2B10G10R10UnormPack32;
 
@@ -82,6 +86,7 @@ BoolVar s_DropRandomFrames("Timing/Drop Random Frames", false);
 namespace Graphics
 {
 void PreparePresentSDR();
+void EndFrame();
 // void PreparePresentHDR();
 void CompositeOverlays(GraphicsContext &Context);
 
@@ -186,11 +191,14 @@ void SetDisplayResolution(void)
 
     g_CommandManager.IdleGPU();
 
-    glfwSetWindowSize(GameCore::g_Window, g_DisplayWidth, g_DisplayHeight);
-    int f_w, f_h;
-    glfwGetFramebufferSize(GameCore::g_Window, &f_w, &f_h);
-    g_DisplayWidth = f_w;
-    g_DisplayHeight = f_h;
+    if (!g_bHeadless)
+    {
+        glfwSetWindowSize(GameCore::g_Window, g_DisplayWidth, g_DisplayHeight);
+        int f_w, f_h;
+        glfwGetFramebufferSize(GameCore::g_Window, &f_w, &f_h);
+        g_DisplayWidth = f_w;
+        g_DisplayHeight = f_h;
+    }
 
     Display::Resize(g_DisplayWidth, g_DisplayHeight);
 
@@ -206,8 +214,13 @@ ColorBuffer g_DisplayPlane[SWAP_CHAIN_BUFFER_COUNT];
 // vk::Semaphore g_imageSemaphores[SWAP_CHAIN_BUFFER_COUNT];
 // vk::Semaphore g_presentSemaphores[SWAP_CHAIN_BUFFER_COUNT];
 vk::Fence g_imageFences[SWAP_CHAIN_BUFFER_COUNT];
+// Signaled when the GPU is done with a headless frame, indexed by frame modulo HEADLESS_FRAMES_IN_FLIGHT
+vk::Fence g_headlessFences[HEADLESS_FRAMES_IN_FLIGHT];
 
 unsigned int g_CurrentBuffer = 0;
+
+// Without a swapchain there is a single offscreen display plane
+uint32_t GetDisplayPlaneCount() { return g_bHeadless ? 1 : SWAP_CHAIN_BUFFER_COUNT; }
 // unsigned int g_PresentIndex = 0;
 bool g_WindowResized = false;
 
@@ -254,17 +267,24 @@ void Display::Resize(uint32_t width, uint32_t height)
     // it should be the same format as DisplayPlane
     g_PreDisplayBuffer.Create("PreDisplay Buffer", width, height, 1, SwapChainFormat);
 
-    for (int i = 0; i < SWAP_CHAIN_BUFFER_COUNT; ++i)
+    for (uint32_t i = 0; i < GetDisplayPlaneCount(); ++i)
     {
         g_DisplayPlane[i].Destroy();
         //        g_DisplayFb[i].Destroy();
     }
 
-    s_Swapchain.Resize(g_DisplayWidth, g_DisplayHeight);
-
-    for (int i = 0; i < SWAP_CHAIN_BUFFER_COUNT; ++i)
+    if (g_bHeadless)
+    {
+        g_DisplayPlane[0].Create("Offscreen Display Plane", g_DisplayWidth, g_DisplayHeight, 1, SwapChainFormat);
+    }
+    else
     {
-        g_DisplayPlane[i].CreateFromSwapchain("Primary SwapChain Buffer", s_Swapchain, i);
+        s_Swapchain.Resize(g_DisplayWidth, g_DisplayHeight);
+
+        for (int i = 0; i < SWAP_CHAIN_BUFFER_COUNT; ++i)
+        {
+            g_DisplayPlane[i].CreateFromSwapchain("Primary SwapChain Buffer", s_Swapchain, i);
+        }
     }
 
     //    g_CurrentBuffer = 0;
@@ -279,16 +299,30 @@ void Display::Resize(uint32_t width, uint32_t height)
 // Initialize the DirectX resources required to run.
 void Display::Initialize(void)
 {
-    s_Swapchain.Create(g_DisplayWidth, g_DisplayHeight, SwapChainFormat, SWAP_CHAIN_BUFFER_COUNT,
-                       CONDITIONALLY_ENABLE_HDR_OUTPUT);
-    SwapChainFormat = s_Swapchain.GetFormat();
+    if (g_bHeadless)
+    {
+        g_DisplayPlane[0].Create("Offscreen Display Plane", g_DisplayWidth, g_DisplayHeight, 1, SwapChainFormat);
 
-    for (int i = 0; i < SWAP_CHAIN_BUFFER_COUNT; ++i)
+        // Signaled, so the first frames don't wait
+        vk::FenceCreateInfo fenceInfo(vk::FenceCreateFlagBits::eSignaled);
+        for (vk::Fence &fence : g_headlessFences)
+        {
+            fence = g_Device.createFence(fenceInfo);
+        }
+    }
+    else
     {
-        g_DisplayPlane[i].CreateFromSwapchain("Primary SwapChain Buffer", s_Swapchain, i);
+        s_Swapchain.Create(g_DisplayWidth, g_DisplayHeight, SwapChainFormat, SWAP_CHAIN_BUFFER_COUNT,
+                           CONDITIONALLY_ENABLE_HDR_OUTPUT);
+        SwapChainFormat = s_Swapchain.GetFormat();
 
-        vk::FenceCreateInfo fenceInfo;
-        g_imageFences[i] = g_Device.createFence(fenceInfo);
+        for (int i = 0; i < SWAP_CHAIN_BUFFER_COUNT; ++i)
+        {
+            g_DisplayPlane[i].CreateFromSwapchain("Primary SwapChain Buffer", s_Swapchain, i);
+
+            vk::FenceCreateInfo fenceInfo;
+            g_imageFences[i] = g_Device.createFence(fenceInfo);
+        }
     }
 
     s_PresentDS.AddBindings(0, 2, vk::DescriptorType::eCombinedImageSampler, 1,
@@ -310,7 +344,7 @@ void Display::Initialize(void)
     PresentSDRPS.SetDepthStencilState(DepthStateDisabled);
     PresentSDRPS.SetPipelineLayout(s_PresentDS.GetPipelineLayout());
     PresentSDRPS.SetPrimitiveTopologyType(vk::PrimitiveTopology::eTriangleList);
-    PresentSDRPS.SetRenderPassFormat(s_Swapchain.GetFormat());
+    PresentSDRPS.SetRenderPassFormat(SwapChainFormat);
     PresentSDRPS.SetVertexShader(g_ScreenQuadPresentVert, sizeof(g_ScreenQuadPresentVert));
     PresentSDRPS.SetFragmentShader(g_PresentSDRFrag, sizeof(g_PresentSDRFrag));
     PresentSDRPS.Finalize();
@@ -340,10 +374,21 @@ void Display::Initialize(void)
 
 void Display::Shutdown(void)
 {
-    for (int i = 0; i < SWAP_CHAIN_BUFFER_COUNT; ++i)
+    for (uint32_t i = 0; i < GetDisplayPlaneCount(); ++i)
     {
         g_DisplayPlane[i].Destroy();
-        g_Device.destroyFence(g_imageFences[i]);
+        if (g_imageFences[i])
+        {
+            g_Device.destroyFence(g_imageFences[i]);
+        }
+    }
+    for (vk::Fence &fence : g_headlessFences)
+    {
+        if (fence)
+        {
+            g_Device.destroyFence(fence);
+            fence = nullptr;
+        }
     }
 
     //    PresentSDRPS.Destroy();
@@ -356,7 +401,10 @@ void Display::Shutdown(void)
 
     s_PresentDS.Destroy();
 
-    s_Swapchain.Destroy();
+    if (!g_bHeadless)
+    {
+        s_Swapchain.Destroy();
+    }
 
     g_PreDisplayBuffer.Destroy();
 }
@@ -455,6 +503,20 @@ void Graphics::PreparePresentSDR(void)
         CompositeOverlays(Context);
     }
 
+    if (g_bHeadless)
+    {
+        Context.Finish();
+
+        // Nothing throttles the CPU without a swapchain. Like a present would, wait for the frame that last
+        // used this fence, HEADLESS_FRAMES_IN_FLIGHT frames ago, and fence this one after all its work.
+        vk::Fence &fence = g_headlessFences[s_FrameIndex % HEADLESS_FRAMES_IN_FLIGHT];
+        CommandQueue &queue = g_CommandManager.GetGraphicsQueue();
+        queue.WaitForFence(fence);
+        g_Device.resetFences(fence);
+        queue.Submit(vk::SubmitInfo(), fence);
+        return;
+    }
+
     Context.TransitionImageLayout(g_DisplayPlane[g_CurrentBuffer], vk::ImageLayout::ePresentSrcKHR);
 
     Context.Finish();
@@ -462,6 +524,13 @@ void Graphics::PreparePresentSDR(void)
 
 void Display::Present(void)
 {
+    if (g_bHeadless)
+    {
+        PreparePresentSDR();
+        EndFrame();
+        return;
+    }
+
     auto result =
         g_Device.acquireNextImageKHR(s_Swapchain.GetSwapchain(), UINT64_MAX, {}, g_imageFences[g_CurrentBuffer]);
     g_Device.waitForFences(g_imageFences[g_CurrentBuffer], VK_TRUE, UINT64_MAX);
@@ -494,6 +563,11 @@ void Display::Present(void)
 
     //    g_CurrentBuffer = (g_CurrentBuffer + 1) % SWAP_CHAIN_BUFFER_COUNT;
 
+    EndFrame();
+}
+
+void Graphics::EndFrame(void)
+{
     int64_t CurrentTick = SystemTime::GetCurrentTick();
 
     s_FrameTime = (float)SystemTime::TimeBetweenTicks(s_FrameStartTick, CurrentTick);
@@ -501,6 +575,9 @@ void Display::Present(void)
 
     s_FrameStartTick = CurrentTick;
 
+    FrameStats::EndFrame(s_FrameIndex);
+    Utility::AdvanceHashMapEpoch();
+
     ++s_FrameIndex;
 
     SetNativeResolution();
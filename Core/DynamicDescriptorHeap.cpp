@@ -14,12 +14,18 @@ DynamicDescriptorHeap::~DynamicDescriptorHeap() { Cleanup(); }
 
 void DynamicDescriptorHeap::Cleanup()
 {
-    m_ImageBindings.clear();
-    m_BufferBindings.clear();
+    for (auto &b : m_ImageBindings)
+    {
+        b.second.clear();
+    }
+    for (auto &b : m_BufferBindings)
+    {
+        b.second.clear();
+    }
 }
 
 void DynamicDescriptorHeap::SetDescriptorInfo(uint32_t binding, uint32_t firstIndex,
-                                              const std::vector<vk::DescriptorImageInfo> &infos)
+                                              const vk::ArrayProxy<vk::DescriptorImageInfo> &infos)
 {
     if (m_DescriptorType != vk::DescriptorType::eCombinedImageSampler &&
         m_DescriptorType != vk::DescriptorType::eStorageImage)
@@ -39,7 +45,7 @@ void DynamicDescriptorHeap::SetDescriptorInfo(uint32_t binding, uint32_t firstIn
     }
     for (int i = 0; i < count; ++i)
     {
-        vec[firstIndex + i] = infos[i];
+        vec[firstIndex + i] = infos.data()[i];
     }
 }
 
@@ -67,9 +73,24 @@ void DynamicDescriptorHeap::SetDescriptorInfo(uint32_t binding, const vk::Descri
     m_BufferBindings[binding].push_back(info);
 }
 
-void DynamicDescriptorHeap::CommitDescriptorSet(vk::DescriptorSet &set)
+uint32_t DynamicDescriptorHeap::CommitDescriptorSet(vk::DescriptorSet &set)
 {
-    std::vector<vk::WriteDescriptorSet> writes;
+    size_t maxWrites = 0;
+    for (auto &b : m_ImageBindings)
+    {
+        maxWrites += b.second.size();
+    }
+    for (auto &b : m_BufferBindings)
+    {
+        maxWrites += b.second.size();
+    }
+    if (maxWrites == 0)
+    {
+        return 0;
+    }
+
+    vk::WriteDescriptorSet *writes = m_OwningContext.GetTransientArena().Alloc<vk::WriteDescriptorSet>(maxWrites);
+    uint32_t count = 0;
     for (auto &b : m_ImageBindings)
     {
         for (size_t i = 0; i < b.second.size(); ++i)
@@ -79,14 +100,13 @@ void DynamicDescriptorHeap::CommitDescriptorSet(vk::DescriptorSet &set)
                 // skip the empty ones
                 continue;
             }
-            vk::WriteDescriptorSet write;
+            vk::WriteDescriptorSet &write = writes[count++];
             write.dstSet = set;
             write.dstBinding = b.first;
             write.dstArrayElement = i;
             write.descriptorType = m_DescriptorType;
             write.descriptorCount = 1;
             write.setImageInfo(b.second[i]);
-            writes.push_back(write);
         }
     }
 
@@ -94,17 +114,17 @@ void DynamicDescriptorHeap::CommitDescriptorSet(vk::DescriptorSet &set)
     {
         for (size_t i = 0; i < b.second.size(); ++i)
         {
-            vk::WriteDescriptorSet write;
+            vk::WriteDescriptorSet &write = writes[count++];
             write.dstSet = set;
             write.dstBinding = b.first;
             write.dstArrayElement = 0;
             write.descriptorType = m_DescriptorType;
             write.descriptorCount = 1;
             write.setBufferInfo(b.second[i]);
-            writes.push_back(write);
             // Graphics::g_Device.updateDescriptorSets(write, {});
         }
     }
 
-    Graphics::g_Device.updateDescriptorSets(writes, {});
+    Graphics::g_Device.updateDescriptorSets(vk::ArrayProxy<const vk::WriteDescriptorSet>(count, writes), {});
+    return count;
 }
\ No newline at end of file
@@ -15,12 +15,14 @@ public:
     DynamicDescriptorHeap(CommandContext &context, vk::DescriptorType type);
     ~DynamicDescriptorHeap();
 
+    // Drops the bindings but keeps their storage, so the next set of bindings doesn't allocate
     void Cleanup();
 
-    void SetDescriptorInfo(uint32_t binding, uint32_t firstIndex, const std::vector<vk::DescriptorImageInfo> &infos);
+    void SetDescriptorInfo(uint32_t binding, uint32_t firstIndex, const vk::ArrayProxy<vk::DescriptorImageInfo> &infos);
     void SetDescriptorInfo(uint32_t binding, const vk::DescriptorBufferInfo &info);
 
-    void CommitDescriptorSet(vk::DescriptorSet &set);
+    // Returns the number of descriptor writes, which are built in the owning context's transient arena
+    uint32_t CommitDescriptorSet(vk::DescriptorSet &set);
 
 private:
     CommandContext &m_OwningContext;
@@ -12,18 +12,260 @@
 //
 
 #include "EngineProfiling.h"
+#include "Color.h"
+#include "CommandContext.h"
+#include "EngineTuning.h"
+#include "GameInput.h"
+#include "Display.h"
 #include "GpuTimeManager.h"
 #include "SystemTime.h"
+#include "Util/CommandLineArg.h"
 #include "Utility.h"
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <fstream>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
 namespace EngineProfiling
 {
 bool Paused = false;
+BoolVar DrawFrameRate("Display Frame Rate", true);
+BoolVar DrawProfiler("Display Profiler", false);
+IntVar TraceFrames("Profiling/Trace Frames", 60, 1, 10000, 10);
+NumVar HitchThreshold("Profiling/Hitch Threshold (ms)", 50.0f, 1.0f, 1000.0f, 5.0f);
+CallbackTrigger ExportHitchesTrigger(
+    "Profiling/Export Hitches", [](void *) { ExportHitches("hitches.json"); }, nullptr);
+CallbackTrigger CaptureTraceTrigger(
+    "Profiling/Capture Trace", [](void *) { CaptureTrace("trace.json", TraceFrames); }, nullptr);
+BoolVar DrawPipelineStats("Profiling/Display Pipeline Stats", false);
+void PrintPipelineStats(void);
+CallbackTrigger PrintPipelineStatsTrigger(
+    "Profiling/Print Pipeline Stats", [](void *) { PrintPipelineStats(); }, nullptr);
+} // namespace EngineProfiling
+
+static std::string EscapeJson(const std::string &str)
+{
+    std::string result;
+    for (char c : str)
+    {
+        if (c == '"' || c == '\\')
+            result += '\\';
+        if ((unsigned char)c >= 0x20)
+            result += c;
+    }
+    return result;
 }
 
+// Collects scopes as Chrome trace events while a capture is running. CPU scopes are recorded when they
+// end, on whatever thread ran them. GPU scopes are added when their frame is read back.
+class TraceRecorder
+{
+public:
+    static const uint32_t kGpuThread = 0;
+
+    // Frames in [first, last) are captured. The file is written once the GPU times of the last one are in.
+    static void Start(const std::string &fileName, uint32_t firstFrame, uint32_t frameCount)
+    {
+        std::lock_guard<std::mutex> lock(s_Mutex);
+        s_FileName = fileName;
+        s_FirstFrame = firstFrame;
+        s_LastFrame = firstFrame + frameCount;
+        s_StartTick = 0;
+        s_Events.clear();
+        s_Capturing = true;
+        Utility::Printf("Capturing frames %u to %u into %s\n", firstFrame, s_LastFrame - 1, fileName.c_str());
+    }
+
+    static bool IsCapturing(void) { return s_Capturing; }
+
+    static bool IsCapturingFrame(uint32_t frame)
+    {
+        return s_Capturing && frame >= s_FirstFrame && frame < s_LastFrame;
+    }
+
+    // Called at the start of every frame, before the GPU times of the previous one are gathered
+    static void BeginFrame(uint32_t frame)
+    {
+        int64_t tick = SystemTime::GetCurrentTick();
+        if (IsCapturingFrame(frame) && s_StartTick == 0)
+            s_StartTick = tick;
+        if (IsCapturingFrame(frame - 1))
+            AddEvent("Frame " + std::to_string(frame - 1), GetThreadIndex(), s_FrameStartTick, tick);
+        s_FrameStartTick = tick;
+
+        // The GPU times of the last frames were dropped, which only happens when the GPU falls far behind
+        if (s_Capturing && frame > s_LastFrame + 4)
+            Write();
+    }
+
+    // Called once the GPU times of a frame have been gathered
+    static void EndGpuFrame(uint32_t frame)
+    {
+        if (s_Capturing && frame + 1 >= s_LastFrame)
+            Write();
+    }
+
+    static void AddEvent(const std::string &name, uint32_t thread, int64_t startTick, int64_t endTick)
+    {
+        std::lock_guard<std::mutex> lock(s_Mutex);
+        s_Events.push_back({name, thread, startTick, endTick});
+    }
+
+    // Thread 0 is the GPU, CPU threads are numbered in the order they first recorded a scope
+    static uint32_t GetThreadIndex(void)
+    {
+        thread_local uint32_t index = 0;
+        if (index == 0)
+        {
+            std::lock_guard<std::mutex> lock(s_Mutex);
+            index = ++s_NumThreads;
+        }
+        return index;
+    }
+
+private:
+    struct Event
+    {
+        std::string name;
+        uint32_t thread;
+        int64_t startTick;
+        int64_t endTick;
+    };
+
+    static void Write(void)
+    {
+        std::lock_guard<std::mutex> lock(s_Mutex);
+        s_Capturing = false;
+
+        std::ofstream out(s_FileName);
+        if (!out)
+        {
+            Utility::Printf("Can't write trace %s\n", s_FileName.c_str());
+            return;
+        }
+
+        // Times are in microseconds. The CPU and the GPU are separate processes so their tracks don't mix.
+        out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        out << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 0, \"args\": {\"name\": \"CPU\"}},\n";
+        out << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"GPU\"}},\n";
+        out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, "
+               "\"args\": {\"name\": \"Graphics Queue\"}}";
+        for (uint32_t i = 1; i <= s_NumThreads; ++i)
+        {
+            out << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": " << i
+                << ", \"args\": {\"name\": \"Thread " << i << "\"}}";
+        }
+
+        out.setf(std::ios::fixed);
+        out.precision(3);
+        for (const Event &e : s_Events)
+        {
+            // Scopes that started before the capture are cut off at its start
+            int64_t startTick = std::max(e.startTick, s_StartTick);
+            out << ",\n{\"name\": \"" << EscapeJson(e.name) << "\", \"ph\": \"X\", \"pid\": "
+                << (e.thread == kGpuThread ? 1 : 0) << ", \"tid\": " << e.thread
+                << ", \"ts\": " << SystemTime::TicksToMillisecs(startTick - s_StartTick) * 1000.0
+                << ", \"dur\": " << SystemTime::TicksToMillisecs(std::max(e.endTick - startTick, (int64_t)0)) * 1000.0
+                << "}";
+        }
+        out << "\n]}\n";
+
+        Utility::Printf("Wrote %zu trace events to %s\n", s_Events.size(), s_FileName.c_str());
+        s_Events.clear();
+    }
+
+    static std::mutex s_Mutex;
+    static std::vector<Event> s_Events;
+    static std::string s_FileName;
+    static std::atomic<bool> s_Capturing;
+    static uint32_t s_FirstFrame;
+    static uint32_t s_LastFrame;
+    static uint32_t s_NumThreads;
+    static int64_t s_StartTick;
+    static int64_t s_FrameStartTick;
+};
+
+std::mutex TraceRecorder::s_Mutex;
+std::vector<TraceRecorder::Event> TraceRecorder::s_Events;
+std::string TraceRecorder::s_FileName;
+std::atomic<bool> TraceRecorder::s_Capturing(false);
+uint32_t TraceRecorder::s_FirstFrame = 0;
+uint32_t TraceRecorder::s_LastFrame = 0;
+uint32_t TraceRecorder::s_NumThreads = 0;
+int64_t TraceRecorder::s_StartTick = 0;
+int64_t TraceRecorder::s_FrameStartTick = 0;
+
+// The scopes that are open on this thread. Names are only kept when a capture was running at the start.
+struct OpenScope
+{
+    std::string name;
+    int64_t startTick;
+};
+thread_local std::vector<OpenScope> s_OpenScopes;
+
+// The timing tree is only fed by the thread that runs the frame, which is the one that loaded the engine
+const std::thread::id s_MainThread = std::this_thread::get_id();
+
+class StatHistory
+{
+public:
+    StatHistory()
+    {
+        for (uint32_t i = 0; i < kHistorySize; ++i)
+            m_RecentHistory[i] = 0.0f;
+        m_Recent = 0.0f;
+        m_Average = 0.0f;
+        m_Minimum = 0.0f;
+        m_Maximum = 0.0f;
+    }
+
+    void RecordStat(uint32_t FrameIndex, float Value)
+    {
+        m_RecentHistory[FrameIndex % kHistorySize] = Value;
+        m_Recent = Value;
+
+        uint32_t ValidCount = 0;
+        m_Minimum = FLT_MAX;
+        m_Maximum = 0.0f;
+        m_Average = 0.0f;
+
+        for (float val : m_RecentHistory)
+        {
+            if (val > 0.0f)
+            {
+                ++ValidCount;
+                m_Average += val;
+                m_Minimum = std::min(val, m_Minimum);
+                m_Maximum = std::max(val, m_Maximum);
+            }
+        }
+
+        if (ValidCount > 0)
+            m_Average /= (float)ValidCount;
+        else
+            m_Minimum = 0.0f;
+    }
+
+    float GetLast(void) const { return m_Recent; }
+    float GetMax(void) const { return m_Maximum; }
+    float GetMin(void) const { return m_Minimum; }
+    float GetAvg(void) const { return m_Average; }
+
+private:
+    static const uint32_t kHistorySize = 64;
+    float m_RecentHistory[kHistorySize];
+    float m_Recent;
+    float m_Average;
+    float m_Minimum;
+    float m_Maximum;
+};
+
 class GpuTimer
 {
 public:
@@ -35,6 +277,8 @@ public:
 
     float GetTime(void) { return GpuTimeManager::GetTime(m_TimerIndex); }
 
+    float GetAverageTime(void) { return GpuTimeManager::GetAverageTime(m_TimerIndex); }
+
     uint32_t GetTimerIndex(void) { return m_TimerIndex; }
 
 private:
@@ -47,7 +291,8 @@ class NestedTimingTree
 {
 public:
     NestedTimingTree(const std::string &name, NestedTimingTree *parent = nullptr)
-        : m_Name(name), m_Parent(parent), m_IsExpanded(false)
+        : m_Name(name), m_Path(parent == nullptr || parent->m_Parent == nullptr ? name : parent->m_Path + "/" + name),
+          m_Parent(parent), m_IsExpanded(false), m_StartTick(0), m_EndTick(0), m_WasTimed(false)
     {
     }
 
@@ -160,15 +405,716 @@ public:
         // Context->PIXEndEvent();
     }
 
+    static void PushProfilingMarker(const std::string &name, CommandContext *Context);
+    static void PopProfilingMarker(CommandContext *Context);
+    static void Update(void);
+    static void UpdateTimes(CommandContext &Context)
+    {
+        uint32_t FrameIndex = (uint32_t)Graphics::GetFrameCount();
+
+        TraceRecorder::BeginFrame(FrameIndex);
+
+        // GPU times trail the CPU by a frame or two, and some frames bring none
+        GpuTimeManager::BeginReadBack(Context);
+        uint32_t GpuFrame = GpuTimeManager::GetReadBackFrame();
+        if (GpuFrame == sm_LastGpuFrame)
+            GpuFrame = UINT32_MAX;
+        else
+            sm_LastGpuFrame = GpuFrame;
+        sm_NewGpuTimes = GpuFrame != UINT32_MAX;
+
+        sm_RootScope.GatherTimes(FrameIndex, GpuFrame);
+
+        if (GpuFrame != UINT32_MAX)
+        {
+            s_FrameDelta.RecordStat(FrameIndex, GpuTimeManager::GetTime(0));
+
+            int64_t GpuStart, GpuStop;
+            if (TraceRecorder::IsCapturingFrame(GpuFrame) && GpuTimeManager::GetTimeRange(0, GpuStart, GpuStop))
+                TraceRecorder::AddEvent("Frame " + std::to_string(GpuFrame), TraceRecorder::kGpuThread, GpuStart,
+                                        GpuStop);
+            TraceRecorder::EndGpuFrame(GpuFrame);
+        }
+
+        GpuTimeManager::EndReadBack(Context);
+
+        float TotalCpuTime, TotalGpuTime;
+        sm_RootScope.SumInclusiveTimes(TotalCpuTime, TotalGpuTime);
+        s_TotalCpuTime.RecordStat(FrameIndex, TotalCpuTime);
+        s_TotalGpuTime.RecordStat(FrameIndex, TotalGpuTime);
+    }
+
+    static float GetTotalCpuTime(void) { return s_TotalCpuTime.GetAvg(); }
+    static float GetTotalGpuTime(void) { return s_TotalGpuTime.GetAvg(); }
+    static float GetFrameDelta(void) { return s_FrameDelta.GetAvg(); }
+    static float GetLastFrameDelta(void) { return s_FrameDelta.GetLast(); }
+    static float GetLastTotalCpuTime(void) { return s_TotalCpuTime.GetLast(); }
+    // Whether the last UpdateTimes read back the GPU times of another frame
+    static bool HasNewGpuTimes(void) { return sm_NewGpuTimes; }
+
+    static void Display(TextContext &Text, float x)
+    {
+        float curX = Text.GetCursorX();
+        Text.DrawString("  ");
+        float indent = Text.GetCursorX() - curX;
+        Text.SetCursorX(curX);
+        sm_RootScope.DisplayNode(Text, x - indent, indent);
+    }
+
+    static void GetLastFrameScopeTimes(std::vector<EngineProfiling::ScopeTime> &Scopes)
+    {
+        Scopes.clear();
+        for (auto node : sm_RootScope.m_Children)
+            node->GatherLastFrame(Scopes);
+    }
+
+    void Toggle() { m_IsExpanded = !m_IsExpanded; }
+
+    // GpuFrame is the frame the GPU timers were read back for, UINT32_MAX if there are no new ones
+    void GatherTimes(uint32_t FrameIndex, uint32_t GpuFrame)
+    {
+        if (EngineProfiling::Paused)
+        {
+            for (auto node : m_Children)
+                node->GatherTimes(FrameIndex, GpuFrame);
+            return;
+        }
+        m_WasTimed = m_StartTick != 0;
+        m_CpuTime.RecordStat(FrameIndex, (float)SystemTime::TimeBetweenTicks(m_StartTick, m_EndTick) * 1000.0f);
+
+        int64_t GpuStart, GpuStop;
+        if (GpuFrame != UINT32_MAX)
+            m_GpuTime.RecordStat(FrameIndex, m_GpuTimer.GetTime());
+        if (this != &sm_RootScope && TraceRecorder::IsCapturingFrame(GpuFrame) &&
+            GpuTimeManager::GetTimeRange(m_GpuTimer.GetTimerIndex(), GpuStart, GpuStop))
+        {
+            TraceRecorder::AddEvent(m_Name, TraceRecorder::kGpuThread, GpuStart, GpuStop);
+        }
+
+        for (auto node : m_Children)
+            node->GatherTimes(FrameIndex, GpuFrame);
+
+        m_StartTick = 0;
+        m_EndTick = 0;
+    }
+
+    void SumInclusiveTimes(float &cpuTime, float &gpuTime)
+    {
+        cpuTime = 0.0f;
+        gpuTime = 0.0f;
+        for (auto iter = m_Children.begin(); iter != m_Children.end(); ++iter)
+        {
+            cpuTime += (*iter)->m_CpuTime.GetLast();
+            gpuTime += (*iter)->m_GpuTime.GetLast();
+        }
+    }
+
+    void GatherLastFrame(std::vector<EngineProfiling::ScopeTime> &Scopes)
+    {
+        if (!m_WasTimed)
+            return;
+
+        Scopes.push_back({m_Path.c_str(), m_CpuTime.GetLast(), m_GpuTime.GetLast()});
+        for (auto node : m_Children)
+            node->GatherLastFrame(Scopes);
+    }
+
+    void DisplayNode(TextContext &Text, float x, float indent);
+
 private:
     std::string m_Name;
+    std::string m_Path; // Names from below the root down to this one, joined with '/'
     NestedTimingTree *m_Parent;
     std::vector<NestedTimingTree *> m_Children;
     bool m_IsExpanded;
     std::unordered_map<std::string, NestedTimingTree *> m_LUT;
     int64_t m_StartTick;
     int64_t m_EndTick;
+    bool m_WasTimed; // Started during the last frame that was gathered
     GpuTimer m_GpuTimer;
+    StatHistory m_CpuTime;
+    StatHistory m_GpuTime;
 
+    static StatHistory s_TotalCpuTime;
+    static StatHistory s_TotalGpuTime;
+    static StatHistory s_FrameDelta;
     static NestedTimingTree sm_RootScope;
+    static NestedTimingTree *sm_CurrentNode;
+    static NestedTimingTree *sm_SelectedScope;
+    static uint32_t sm_LastGpuFrame;
+    static bool sm_NewGpuTimes;
+};
+
+StatHistory NestedTimingTree::s_TotalCpuTime;
+StatHistory NestedTimingTree::s_TotalGpuTime;
+StatHistory NestedTimingTree::s_FrameDelta;
+NestedTimingTree NestedTimingTree::sm_RootScope("");
+NestedTimingTree *NestedTimingTree::sm_CurrentNode = &NestedTimingTree::sm_RootScope;
+NestedTimingTree *NestedTimingTree::sm_SelectedScope = &NestedTimingTree::sm_RootScope;
+uint32_t NestedTimingTree::sm_LastGpuFrame = UINT32_MAX;
+bool NestedTimingTree::sm_NewGpuTimes = false;
+
+// The last frames' values, for the percentiles an average hides
+class PercentileHistory
+{
+public:
+    void RecordStat(float Value)
+    {
+        m_Samples[m_Next] = Value;
+        m_Next = (m_Next + 1) % kHistorySize;
+        m_Count = std::min(m_Count + 1, kHistorySize);
+    }
+
+    uint32_t GetCount(void) const { return m_Count; }
+
+    EngineProfiling::Percentiles GetPercentiles(void) const
+    {
+        EngineProfiling::Percentiles result = {};
+        if (m_Count == 0)
+            return result;
+
+        // Each percentile only partitions what lies above the previous one
+        float *const end = std::copy(m_Samples, m_Samples + m_Count, m_Scratch);
+        float *from = m_Scratch;
+        auto percentile = [&](float p) {
+            uint32_t rank = std::min(std::max((uint32_t)std::ceil(p * m_Count), 1u), m_Count);
+            float *nth = m_Scratch + rank - 1;
+            std::nth_element(from, nth, end);
+            from = nth;
+            return *nth;
+        };
+        result.P50 = percentile(0.50f);
+        result.P95 = percentile(0.95f);
+        result.P99 = percentile(0.99f);
+        result.Max = *std::max_element(from, end);
+        return result;
+    }
+
+private:
+    static const uint32_t kHistorySize = 1024;
+    float m_Samples[kHistorySize];
+    mutable float m_Scratch[kHistorySize]; // GetPercentiles reorders a copy here, so drawing doesn't allocate
+    uint32_t m_Next = 0;
+    uint32_t m_Count = 0;
+};
+
+// Keeps the timing tree of frames whose present interval went over the hitch threshold. Stalls in the
+// middle of a frame (loading a texture, creating a PSO, waiting on the GPU) are easy to find in them.
+class HitchRecorder
+{
+public:
+    struct Hitch
+    {
+        uint32_t Frame;
+        float PresentInterval;
+        float CpuTime;
+        float GpuTime; // Of the last frame the GPU finished, which may be an earlier one
+        bool HasGpuTime; // False while no GPU times were read back yet, GpuTime and the scopes' are 0 then
+        std::vector<EngineProfiling::ScopeTime> Scopes;
+    };
+
+    // Called at the start of a frame, once the times of the previous one were gathered
+    static void Update(uint32_t FrameIndex)
+    {
+        float cpuTime = NestedTimingTree::GetLastTotalCpuTime();
+        float presentInterval = Graphics::GetFrameTime() * 1000.0f;
+        s_CpuFrameTime.RecordStat(cpuTime);
+        if (NestedTimingTree::HasNewGpuTimes())
+            s_GpuFrameTime.RecordStat(NestedTimingTree::GetLastFrameDelta());
+
+        // The first frame also spans the startup
+        if (FrameIndex < 2)
+            return;
+        s_PresentInterval.RecordStat(presentInterval);
+
+        if (presentInterval < EngineProfiling::HitchThreshold)
+            return;
+
+        // Once the ring is full the oldest hitch is overwritten, reusing its scope storage
+        if (s_Hitches.size() < kMaxHitches)
+            s_Hitches.emplace_back();
+        Hitch &hitch = s_Hitches[s_NumHitches % kMaxHitches];
+        hitch.Frame = FrameIndex - 1;
+        hitch.PresentInterval = presentInterval;
+        hitch.CpuTime = cpuTime;
+        hitch.GpuTime = NestedTimingTree::GetLastFrameDelta();
+        hitch.HasGpuTime = s_GpuFrameTime.GetCount() > 0;
+        NestedTimingTree::GetLastFrameScopeTimes(hitch.Scopes);
+        ++s_NumHitches;
+    }
+
+    static void Write(const std::string &FileName)
+    {
+        std::ofstream out(FileName);
+        if (!out)
+        {
+            Utility::Printf("Can't write hitches to %s\n", FileName.c_str());
+            return;
+        }
+
+        auto writePercentiles = [&](const char *name, const PercentileHistory &history) {
+            out << "    \"" << name << "\": ";
+            if (history.GetCount() == 0)
+            {
+                out << "null";
+                return;
+            }
+            EngineProfiling::Percentiles p = history.GetPercentiles();
+            out << "{\"p50\": " << p.P50 << ", \"p95\": " << p.P95 << ", \"p99\": " << p.P99 << ", \"max\": " << p.Max
+                << "}";
+        };
+
+        // Times are in milliseconds, scopes map to [cpu, gpu]. GPU times are null before any were read back.
+        out << "{\n  \"threshold\": " << (float)EngineProfiling::HitchThreshold << ",\n";
+        out << "  \"totalHitches\": " << s_NumHitches << ",\n";
+        out << "  \"percentiles\": {\n";
+        writePercentiles("cpuFrameTime", s_CpuFrameTime);
+        out << ",\n";
+        writePercentiles("gpuFrameTime", s_GpuFrameTime);
+        out << ",\n";
+        writePercentiles("presentInterval", s_PresentInterval);
+        out << "\n  },\n  \"hitches\": [";
+        const size_t oldest = s_Hitches.size() < kMaxHitches ? 0 : s_NumHitches % kMaxHitches;
+        for (size_t h = 0; h < s_Hitches.size(); ++h)
+        {
+            const Hitch &hitch = s_Hitches[(oldest + h) % s_Hitches.size()];
+            out << (h == 0 ? "\n" : ",\n") << "    {\"frame\": " << hitch.Frame
+                << ", \"presentInterval\": " << hitch.PresentInterval << ", \"cpu\": " << hitch.CpuTime
+                << ", \"gpu\": ";
+            if (hitch.HasGpuTime)
+                out << hitch.GpuTime;
+            else
+                out << "null";
+            out << ", \"scopes\": {";
+            for (size_t s = 0; s < hitch.Scopes.size(); ++s)
+            {
+                const EngineProfiling::ScopeTime &scope = hitch.Scopes[s];
+                out << (s == 0 ? "" : ", ") << "\"" << EscapeJson(scope.Name) << "\": [" << scope.CpuTime << ", ";
+                if (hitch.HasGpuTime)
+                    out << scope.GpuTime;
+                else
+                    out << "null";
+                out << "]";
+            }
+            out << "}}";
+        }
+        out << "\n  ]\n}\n";
+
+        Utility::Printf("Wrote %zu hitches to %s\n", s_Hitches.size(), FileName.c_str());
+    }
+
+    static void Display(TextContext &Text, float x)
+    {
+        auto drawRow = [&](const char *name, const PercentileHistory &history) {
+            EngineProfiling::Percentiles p = history.GetPercentiles();
+            Text.SetCursorX(x);
+            Text.DrawString(name);
+            Text.SetCursorX(x + 300.0f);
+            Text.DrawFormattedString("%6.2f %6.2f %6.2f %6.2f\n", p.P50, p.P95, p.P99, p.Max);
+        };
+
+        Text.SetColor(Color(0.8f, 0.8f, 0.8f));
+        Text.SetCursorX(x + 300.0f);
+        Text.DrawString("   p50    p95    p99    max\n");
+        Text.SetColor(Color(1.0f, 1.0f, 1.0f));
+        drawRow("CPU frame", s_CpuFrameTime);
+        drawRow("GPU frame", s_GpuFrameTime);
+        drawRow("Present interval", s_PresentInterval);
+
+        Text.SetCursorX(x);
+        if (s_NumHitches > 0)
+        {
+            const Hitch &last = s_Hitches[(s_NumHitches - 1) % kMaxHitches];
+            Text.DrawFormattedString("Hitches: %u, last in frame %u (%.1f ms)\n", s_NumHitches, last.Frame,
+                                     last.PresentInterval);
+        }
+        else
+        {
+            Text.DrawString("Hitches: 0\n");
+        }
+    }
+
+    static PercentileHistory s_CpuFrameTime;
+    static PercentileHistory s_GpuFrameTime;
+    static PercentileHistory s_PresentInterval;
+
+private:
+    static const size_t kMaxHitches = 64;
+    static std::vector<Hitch> s_Hitches; // Ring of the most recent ones, s_NumHitches % kMaxHitches is next
+    static uint32_t s_NumHitches;
 };
+
+PercentileHistory HitchRecorder::s_CpuFrameTime;
+PercentileHistory HitchRecorder::s_GpuFrameTime;
+PercentileHistory HitchRecorder::s_PresentInterval;
+std::vector<HitchRecorder::Hitch> HitchRecorder::s_Hitches;
+uint32_t HitchRecorder::s_NumHitches = 0;
+
+void NestedTimingTree::PushProfilingMarker(const std::string &name, CommandContext *Context)
+{
+    sm_CurrentNode = sm_CurrentNode->GetChild(name);
+    sm_CurrentNode->StartTiming(Context);
+}
+
+void NestedTimingTree::PopProfilingMarker(CommandContext *Context)
+{
+    sm_CurrentNode->StopTiming(Context);
+    sm_CurrentNode = sm_CurrentNode->m_Parent;
+}
+
+void NestedTimingTree::Update(void)
+{
+    ASSERT(sm_SelectedScope != nullptr, "Corrupted profiling data structure");
+
+    if (sm_SelectedScope == &sm_RootScope)
+    {
+        sm_SelectedScope = sm_RootScope.FirstChild();
+        if (sm_SelectedScope == nullptr)
+        {
+            sm_SelectedScope = &sm_RootScope;
+            return;
+        }
+    }
+
+    if (GameInput::IsFirstPressed(GameInput::kDPadLeft) || GameInput::IsFirstPressed(GameInput::kKey_left))
+    {
+        sm_SelectedScope->m_IsExpanded = false;
+    }
+    else if (GameInput::IsFirstPressed(GameInput::kDPadRight) || GameInput::IsFirstPressed(GameInput::kKey_right))
+    {
+        sm_SelectedScope->m_IsExpanded = true;
+    }
+    else if (GameInput::IsFirstPressed(GameInput::kDPadDown) || GameInput::IsFirstPressed(GameInput::kKey_down))
+    {
+        sm_SelectedScope = sm_SelectedScope->NextScope();
+    }
+    else if (GameInput::IsFirstPressed(GameInput::kDPadUp) || GameInput::IsFirstPressed(GameInput::kKey_up))
+    {
+        sm_SelectedScope = sm_SelectedScope->PrevScope();
+    }
+    else if (GameInput::IsFirstPressed(GameInput::kAButton) || GameInput::IsFirstPressed(GameInput::kKey_return))
+    {
+        sm_SelectedScope->Toggle();
+    }
+}
+
+void NestedTimingTree::DisplayNode(TextContext &Text, float leftMargin, float indent)
+{
+    if (this == &sm_RootScope)
+    {
+        m_IsExpanded = true;
+    }
+    else
+    {
+        if (sm_SelectedScope == this)
+            Text.SetColor(Color(1.0f, 1.0f, 0.5f));
+        else
+            Text.SetColor(Color(1.0f, 1.0f, 1.0f));
+
+        Text.SetLeftMargin(leftMargin);
+        Text.SetCursorX(leftMargin);
+
+        if (m_Children.size() == 0)
+            Text.DrawString("  ");
+        else if (m_IsExpanded)
+            Text.DrawString("- ");
+        else
+            Text.DrawString("+ ");
+
+        Text.DrawString(m_Name);
+        Text.SetCursorX(leftMargin + 300.0f);
+        Text.DrawFormattedString("%6.3f %6.3f   ", m_CpuTime.GetAvg(), m_GpuTimer.GetAverageTime());
+
+        Text.NewLine();
+    }
+
+    if (!m_IsExpanded)
+        return;
+
+    for (auto node : m_Children)
+        node->DisplayNode(Text, leftMargin + indent, indent);
+}
+
+// One entry per name. The queries can't nest, so there is no tree to build.
+class PipelineStatsScopes
+{
+public:
+    static void Begin(const std::string &name, CommandContext &Context)
+    {
+        ASSERT(s_Active == UINT32_MAX && !s_Skipped, "Pipeline statistics scopes can't nest");
+
+        auto iter = s_LUT.find(name);
+        if (iter == s_LUT.end())
+        {
+            iter = s_LUT.emplace(name, (uint32_t)s_Scopes.size()).first;
+            s_Scopes.push_back({name, PipelineStatsManager::NewQuery(), {}, false});
+        }
+        if (PipelineStatsManager::BeginQuery(Context, s_Scopes[iter->second].query))
+            s_Active = iter->second;
+        else
+            s_Skipped = true;
+    }
+
+    static void End(CommandContext &Context)
+    {
+        ASSERT(s_Active != UINT32_MAX || s_Skipped, "EndPipelineStats without BeginPipelineStats");
+        if (s_Active != UINT32_MAX)
+            PipelineStatsManager::EndQuery(Context, s_Scopes[s_Active].query);
+        s_Active = UINT32_MAX;
+        s_Skipped = false;
+    }
+
+    static void Update(CommandContext &Context)
+    {
+        PipelineStatsManager::BeginReadBack();
+        uint32_t frame = PipelineStatsManager::GetReadBackFrame();
+        if (frame != s_LastFrame && !EngineProfiling::Paused)
+        {
+            for (Scope &scope : s_Scopes)
+                scope.valid = PipelineStatsManager::GetStats(scope.query, scope.stats);
+            s_LastFrame = frame;
+        }
+        PipelineStatsManager::EndReadBack(Context);
+    }
+
+    static void GetLastFrame(std::vector<EngineProfiling::PassStats> &Passes)
+    {
+        Passes.clear();
+        for (const Scope &scope : s_Scopes)
+        {
+            if (scope.valid)
+                Passes.push_back({scope.name, scope.stats});
+        }
+    }
+
+private:
+    struct Scope
+    {
+        std::string name;
+        uint32_t query;
+        PipelineStatsManager::Stats stats;
+        bool valid; // Ran in the last frame read back
+    };
+
+    static std::vector<Scope> s_Scopes;
+    static std::unordered_map<std::string, uint32_t> s_LUT;
+    static uint32_t s_Active;
+    static bool s_Skipped; // The open scope has no query running
+    static uint32_t s_LastFrame;
+};
+
+std::vector<PipelineStatsScopes::Scope> PipelineStatsScopes::s_Scopes;
+std::unordered_map<std::string, uint32_t> PipelineStatsScopes::s_LUT;
+uint32_t PipelineStatsScopes::s_Active = UINT32_MAX;
+bool PipelineStatsScopes::s_Skipped = false;
+uint32_t PipelineStatsScopes::s_LastFrame = UINT32_MAX;
+
+// Counts are shown as thousands or millions so the columns line up
+static std::string FormatCount(uint64_t count)
+{
+    char buffer[32];
+    if (count >= 10000000)
+        snprintf(buffer, sizeof(buffer), "%7.2fM", count / 1000000.0);
+    else if (count >= 10000)
+        snprintf(buffer, sizeof(buffer), "%7.2fK", count / 1000.0);
+    else
+        snprintf(buffer, sizeof(buffer), "%7u ", (uint32_t)count);
+    return buffer;
+}
+
+void EngineProfiling::PrintPipelineStats(void)
+{
+    std::vector<PassStats> passes;
+    PipelineStatsScopes::GetLastFrame(passes);
+    if (passes.empty())
+    {
+        Utility::Printf(PipelineStatsManager::IsSupported() ? "No pipeline statistics gathered yet\n"
+                                                            : "Pipeline statistics queries not supported\n");
+        return;
+    }
+
+    Utility::Printf("%-24s %8s %8s %8s %8s %8s %8s\n", "Pass", "Prims", "VS", "Clip In", "Clip Out", "FS", "CS");
+    for (const PassStats &pass : passes)
+    {
+        const PipelineStatsManager::Stats &s = pass.Stats;
+        Utility::Printf("%-24s %s %s %s %s %s %s\n", pass.Name.c_str(), FormatCount(s.InputPrimitives).c_str(),
+                        FormatCount(s.VertexInvocations).c_str(), FormatCount(s.ClippingInvocations).c_str(),
+                        FormatCount(s.ClippingPrimitives).c_str(), FormatCount(s.FragmentInvocations).c_str(),
+                        FormatCount(s.ComputeInvocations).c_str());
+    }
+}
+
+void EngineProfiling::Update(void)
+{
+    // "-trace <file>" captures "-traceframes" frames (60 by default) from frame "-tracestart" (1 by default)
+    if (Graphics::GetFrameCount() == 0)
+    {
+        std::string traceFile;
+        if (CommandLineArgs::GetString("trace", traceFile))
+        {
+            uint32_t firstFrame = 1, frameCount = 60;
+            CommandLineArgs::GetInteger("tracestart", firstFrame);
+            CommandLineArgs::GetInteger("traceframes", frameCount);
+            TraceRecorder::Start(traceFile, std::max(firstFrame, 1u), std::max(frameCount, 1u));
+        }
+    }
+
+    if (GameInput::IsFirstPressed(GameInput::kStartButton) || GameInput::IsFirstPressed(GameInput::kKey_space))
+    {
+        Paused = !Paused;
+    }
+
+    // Closing the last frame's queries and resetting the next frame's go into one submission that comes
+    // before any other work of the frame
+    CommandContext &Context = CommandContext::Begin("Frame Start");
+    NestedTimingTree::UpdateTimes(Context);
+    PipelineStatsScopes::Update(Context);
+    Context.Finish();
+
+    if (!Paused)
+        HitchRecorder::Update((uint32_t)Graphics::GetFrameCount());
+}
+
+void EngineProfiling::BeginBlock(const std::string &name, CommandContext *Context)
+{
+    // Names are only kept when the scope may end up in a trace
+    s_OpenScopes.push_back({TraceRecorder::IsCapturing() ? name : std::string(), SystemTime::GetCurrentTick()});
+
+    if (std::this_thread::get_id() == s_MainThread)
+        NestedTimingTree::PushProfilingMarker(name, Context);
+}
+
+void EngineProfiling::EndBlock(CommandContext *Context)
+{
+    ASSERT(!s_OpenScopes.empty(), "EndBlock without BeginBlock");
+    const OpenScope &scope = s_OpenScopes.back();
+    if (TraceRecorder::IsCapturingFrame((uint32_t)Graphics::GetFrameCount()) && !scope.name.empty())
+    {
+        TraceRecorder::AddEvent(scope.name, TraceRecorder::GetThreadIndex(), scope.startTick,
+                                SystemTime::GetCurrentTick());
+    }
+    s_OpenScopes.pop_back();
+
+    if (std::this_thread::get_id() == s_MainThread)
+        NestedTimingTree::PopProfilingMarker(Context);
+}
+
+void EngineProfiling::CaptureTrace(const std::string &FileName, uint32_t FrameCount)
+{
+    if (TraceRecorder::IsCapturing())
+    {
+        Utility::Printf("A trace capture is already running\n");
+        return;
+    }
+    TraceRecorder::Start(FileName, (uint32_t)Graphics::GetFrameCount() + 1, std::max(FrameCount, 1u));
+}
+
+bool EngineProfiling::IsCapturingTrace() { return TraceRecorder::IsCapturing(); }
+
+void EngineProfiling::BeginPipelineStats(const std::string &name, CommandContext &Context)
+{
+    if (std::this_thread::get_id() == s_MainThread)
+        PipelineStatsScopes::Begin(name, Context);
+}
+
+void EngineProfiling::EndPipelineStats(CommandContext &Context)
+{
+    if (std::this_thread::get_id() == s_MainThread)
+        PipelineStatsScopes::End(Context);
+}
+
+void EngineProfiling::GetLastFramePipelineStats(std::vector<PassStats> &Passes)
+{
+    PipelineStatsScopes::GetLastFrame(Passes);
+}
+
+bool EngineProfiling::IsPaused() { return Paused; }
+
+float EngineProfiling::GetLastFrameGpuTime() { return NestedTimingTree::GetLastFrameDelta(); }
+
+void EngineProfiling::GetFrameTimePercentiles(Percentiles &CpuFrameTime, Percentiles &GpuFrameTime,
+                                              Percentiles &PresentInterval)
+{
+    CpuFrameTime = HitchRecorder::s_CpuFrameTime.GetPercentiles();
+    GpuFrameTime = HitchRecorder::s_GpuFrameTime.GetPercentiles();
+    PresentInterval = HitchRecorder::s_PresentInterval.GetPercentiles();
+}
+
+void EngineProfiling::ExportHitches(const std::string &FileName) { HitchRecorder::Write(FileName); }
+
+void EngineProfiling::GetLastFrameScopeTimes(std::vector<ScopeTime> &Scopes)
+{
+    NestedTimingTree::GetLastFrameScopeTimes(Scopes);
+}
+
+void EngineProfiling::DisplayFrameRate(TextContext &Text)
+{
+    if (!DrawFrameRate)
+        return;
+
+    float cpuTime = NestedTimingTree::GetTotalCpuTime();
+    float gpuTime = NestedTimingTree::GetTotalGpuTime();
+    float frameDelta = NestedTimingTree::GetFrameDelta();
+    float frameRate = frameDelta == 0.0f ? 0.0f : 1000.0f / frameDelta;
+
+    Text.DrawFormattedString("CPU %7.3f ms, GPU %7.3f ms, %3u Hz\n", cpuTime, gpuTime, (uint32_t)(frameRate + 0.5f));
+}
+
+void EngineProfiling::Display(TextContext &Text, float x, float y, float /*w*/, float /*h*/)
+{
+    Text.ResetCursor(x, y);
+
+    if (DrawProfiler)
+    {
+        NestedTimingTree::Update();
+
+        Text.SetColor(Color(0.5f, 1.0f, 1.0f));
+        Text.DrawString("Engine Profiling");
+        Text.SetColor(Color(0.8f, 0.8f, 0.8f));
+        Text.SetTextSize(20.0f);
+        Text.DrawString("           CPU    GPU");
+        Text.SetTextSize(24.0f);
+        Text.NewLine();
+        Text.SetTextSize(20.0f);
+        Text.SetColor(Color(1.0f, 1.0f, 1.0f));
+
+        NestedTimingTree::Display(Text, x);
+
+        Text.NewLine();
+        Text.SetLeftMargin(x);
+        HitchRecorder::Display(Text, x);
+    }
+
+    if (DrawPipelineStats && PipelineStatsManager::IsSupported())
+    {
+        std::vector<PassStats> passes;
+        PipelineStatsScopes::GetLastFrame(passes);
+
+        Text.SetLeftMargin(x);
+        Text.SetCursorX(x);
+        Text.SetTextSize(24.0f);
+        Text.SetColor(Color(0.5f, 1.0f, 1.0f));
+        Text.DrawString("Pipeline Statistics");
+        Text.SetColor(Color(0.8f, 0.8f, 0.8f));
+        Text.SetTextSize(20.0f);
+        Text.SetCursorX(x + 300.0f);
+        Text.DrawString("   Prims       VS  Clip In Clip Out       FS       CS");
+        Text.NewLine();
+        Text.SetColor(Color(1.0f, 1.0f, 1.0f));
+
+        for (const PassStats &pass : passes)
+        {
+            const PipelineStatsManager::Stats &s = pass.Stats;
+            Text.SetCursorX(x);
+            Text.DrawString(pass.Name);
+            Text.SetCursorX(x + 300.0f);
+            Text.DrawFormattedString("%s %s %s %s %s %s", FormatCount(s.InputPrimitives).c_str(),
+                                     FormatCount(s.VertexInvocations).c_str(),
+                                     FormatCount(s.ClippingInvocations).c_str(),
+                                     FormatCount(s.ClippingPrimitives).c_str(),
+                                     FormatCount(s.FragmentInvocations).c_str(),
+                                     FormatCount(s.ComputeInvocations).c_str());
+            Text.NewLine();
+        }
+    }
+}
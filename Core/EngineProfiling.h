@@ -13,8 +13,10 @@
 
 #pragma once
 
+#include "PipelineStatsManager.h"
 #include "TextRenderer.h"
 #include <string>
+#include <vector>
 
 class CommandContext;
 
@@ -22,6 +24,9 @@ namespace EngineProfiling
 {
 void Update();
 
+// Names are taken as std::string, so a literal longer than the small string buffer (15 characters with
+// libstdc++ and MSVC) allocates on every call. Scopes opened every frame keep short literal names or pass a
+// string that outlives the frame, like RenderGraph's pass names.
 void BeginBlock(const std::string &name, CommandContext *Context = nullptr);
 void EndBlock(CommandContext *Context = nullptr);
 
@@ -29,6 +34,51 @@ void DisplayFrameRate(TextContext &Text);
 // void DisplayPerfGraph(GraphicsContext &Text);
 void Display(TextContext &Text, float x, float y, float w, float h);
 bool IsPaused();
+
+struct ScopeTime
+{
+    const char *Name; // Nested scopes are joined with '/'. Owned by the profiler, which keeps every scope.
+    float CpuTime;    // Milliseconds
+    float GpuTime;    // Milliseconds, 0 for scopes without a context
+};
+
+// Captures the next frames as Chrome trace events (chrome://tracing, ui.perfetto.dev). Every ScopedTimer
+// becomes a CPU event on the thread that ran it and, if it had a context, an event on the GPU track.
+// The timing tree only follows the main thread, other threads only show up in traces.
+void CaptureTrace(const std::string &FileName, uint32_t FrameCount);
+bool IsCapturingTrace();
+
+// Time between the starts of the last two frames on the GPU timeline, in milliseconds. GPU times are
+// read back without waiting, so they come from a frame or two before the CPU times.
+float GetLastFrameGpuTime();
+// The scopes timed during the last frame, parents before their children
+void GetLastFrameScopeTimes(std::vector<ScopeTime> &Scopes);
+
+struct Percentiles
+{
+    float P50, P95, P99, Max; // Milliseconds
+};
+
+// Over the last 1024 frames. The present interval is the time between the ends of two frames.
+void GetFrameTimePercentiles(Percentiles &CpuFrameTime, Percentiles &GpuFrameTime, Percentiles &PresentInterval);
+
+// Frames whose present interval exceeds "Profiling/Hitch Threshold (ms)" keep their timing tree. This
+// writes the last 64 of them and the percentiles as JSON.
+void ExportHitches(const std::string &FileName);
+
+// Pipeline statistics of a scope, see PipelineStatsManager. These scopes can't nest, so they wrap whole
+// passes. Like the timing tree they only count on the main thread.
+void BeginPipelineStats(const std::string &name, CommandContext &Context);
+void EndPipelineStats(CommandContext &Context);
+
+struct PassStats
+{
+    std::string Name;
+    PipelineStatsManager::Stats Stats;
+};
+
+// The scopes of the last frame the GPU finished, in the order they first ran
+void GetLastFramePipelineStats(std::vector<PassStats> &Passes);
 } // namespace EngineProfiling
 
 #ifdef RELEASE
@@ -53,3 +103,24 @@ private:
     CommandContext *m_Context;
 };
 #endif
+
+#ifdef RELEASE
+class ScopedPipelineStats
+{
+public:
+    ScopedPipelineStats(const std::string &, CommandContext &) {}
+};
+#else
+class ScopedPipelineStats
+{
+public:
+    ScopedPipelineStats(const std::string &name, CommandContext &Context) : m_Context(Context)
+    {
+        EngineProfiling::BeginPipelineStats(name, m_Context);
+    }
+    ~ScopedPipelineStats() { EngineProfiling::EndPipelineStats(m_Context); }
+
+private:
+    CommandContext &m_Context;
+};
+#endif
@@ -15,8 +15,11 @@
 #include "Color.h"
 #include "CommandContext.h"
 #include "Display.h"
+#include "EngineProfiling.h"
+#include "FrameStats.h"
 #include "GameInput.h"
 #include "Math/Common.h"
+#include "MemoryTracker.h"
 #include "TextRenderer.h"
 #include "Utility.h"
 //#include "GraphRenderer.h"
@@ -621,15 +624,15 @@ void EngineTuning::Display(GraphicsContext &Context, float x, float y, float w,
     TextContext Text(Context);
     Text.Begin();
 
-    // TODO: EngineProfiling
-    // EngineProfiling::DisplayFrameRate(Text);
+    EngineProfiling::DisplayFrameRate(Text);
 
     Text.ResetCursor(x, y);
 
     if (!sm_IsVisible)
     {
-        // TODO: EngineProfiling
-        // EngineProfiling::Display(Text, x, y, w, h);
+        EngineProfiling::Display(Text, x, y, w, h);
+        FrameStats::Display(Text);
+        MemoryTracker::Display(Text);
     }
     else
     {
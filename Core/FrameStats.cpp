@@ -0,0 +1,114 @@
+#include "FrameStats.h"
+#include "EngineTuning.h"
+#include "TextRenderer.h"
+#include "Util/CommandLineArg.h"
+#include "Utility.h"
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+// Counters register during static initialization, so the list can't be a plain static
+std::vector<FrameCounter *> &GetCounters(void)
+{
+    static std::vector<FrameCounter *> s_Counters;
+    return s_Counters;
+}
+
+FILE *s_LogFile = nullptr;
+
+FrameCounter s_HeapAllocations("Heap Allocations");
+
+BoolVar DisplayFrameStats("Profiling/Display Frame Stats", false);
+CallbackTrigger LogFrameStats(
+    "Profiling/Log Frame Stats",
+    [](void *) {
+        if (FrameStats::IsLogging())
+            FrameStats::StopLog();
+        else
+            FrameStats::StartLog("framestats.csv");
+    },
+    nullptr);
+} // namespace
+
+// Constant initialized, so allocations made during static initialization are counted too
+std::atomic<uint64_t> g_HeapAllocationCount(0);
+
+FrameCounter::FrameCounter(const char *Name, bool IsBytes)
+    : m_Name(Name), m_IsBytes(IsBytes), m_Count(0), m_LastFrame(0)
+{
+    GetCounters().push_back(this);
+}
+
+void FrameStats::Initialize(void)
+{
+    std::string logFile;
+    if (CommandLineArgs::GetString("framestats", logFile))
+        StartLog(logFile);
+}
+
+void FrameStats::Shutdown(void) { StopLog(); }
+
+void FrameStats::EndFrame(uint64_t FrameIndex)
+{
+    s_HeapAllocations.Add(g_HeapAllocationCount.exchange(0, std::memory_order_relaxed));
+    for (FrameCounter *counter : GetCounters())
+        counter->EndFrame();
+
+    if (s_LogFile == nullptr)
+        return;
+
+    fprintf(s_LogFile, "%llu", (unsigned long long)FrameIndex);
+    for (FrameCounter *counter : GetCounters())
+        fprintf(s_LogFile, ",%llu", (unsigned long long)counter->GetLastFrame());
+    fprintf(s_LogFile, "\n");
+}
+
+void FrameStats::Display(TextContext &Text)
+{
+    if (!DisplayFrameStats)
+        return;
+
+    for (FrameCounter *counter : GetCounters())
+    {
+        float x = Text.GetCursorX();
+        Text.DrawString(counter->GetName());
+        Text.SetCursorX(x + 300.0f);
+        if (counter->IsBytes())
+            Text.DrawFormattedString("%10.1f KB\n", counter->GetLastFrame() / 1024.0);
+        else
+            Text.DrawFormattedString("%10llu\n", (unsigned long long)counter->GetLastFrame());
+    }
+}
+
+void FrameStats::StartLog(const std::string &FileName)
+{
+    StopLog();
+    s_LogFile = fopen(FileName.c_str(), "w");
+    if (s_LogFile == nullptr)
+    {
+        Utility::Printf("Can't write frame stats to %s\n", FileName.c_str());
+        return;
+    }
+
+    fprintf(s_LogFile, "frame");
+    for (FrameCounter *counter : GetCounters())
+        fprintf(s_LogFile, ",%s", counter->GetName());
+    fprintf(s_LogFile, "\n");
+    Utility::Printf("Logging frame stats to %s\n", FileName.c_str());
+}
+
+void FrameStats::StopLog(void)
+{
+    if (s_LogFile != nullptr)
+    {
+        fclose(s_LogFile);
+        s_LogFile = nullptr;
+    }
+}
+
+bool FrameStats::IsLogging(void) { return s_LogFile != nullptr; }
+
+uint64_t FrameStats::GetLastFrameHeapAllocations(void) { return s_HeapAllocations.GetLastFrame(); }
+
+uint64_t FrameStats::GetHeapAllocationCount(void) { return g_HeapAllocationCount.load(std::memory_order_relaxed); }
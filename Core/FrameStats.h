@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+class TextContext;
+
+// Something counted during a frame, summed over every thread that adds to it. Counters register by name
+// when they are constructed and must live until shutdown, so they are normally statics. The overlay
+// ("Profiling/Display Frame Stats") and the frame stats log show every registered counter.
+class FrameCounter
+{
+public:
+    explicit FrameCounter(const char *Name, bool IsBytes = false);
+    FrameCounter(const FrameCounter &) = delete;
+    FrameCounter &operator=(const FrameCounter &) = delete;
+
+    void Add(uint64_t Count) { m_Count.fetch_add(Count, std::memory_order_relaxed); }
+
+    // Total of the last presented frame
+    uint64_t GetLastFrame(void) const { return m_LastFrame; }
+    const char *GetName(void) const { return m_Name; }
+    bool IsBytes(void) const { return m_IsBytes; }
+
+    // Starts counting the next frame, see FrameStats::EndFrame
+    void EndFrame(void) { m_LastFrame = m_Count.exchange(0, std::memory_order_relaxed); }
+
+private:
+    const char *m_Name;
+    bool m_IsBytes;
+    std::atomic<uint64_t> m_Count;
+    uint64_t m_LastFrame;
+};
+
+// Heap allocations since the last FrameStats::EndFrame. Only bumped in executables that compile in
+// HeapAllocationCounter.cpp, which replaces the global operator new; everywhere else it stays 0.
+extern std::atomic<uint64_t> g_HeapAllocationCount;
+
+namespace FrameStats
+{
+// "-framestats <file>" logs every frame from the start
+void Initialize(void);
+void Shutdown(void);
+
+// Called once a frame has been presented
+void EndFrame(uint64_t FrameIndex);
+
+void Display(TextContext &Text);
+
+// Appends one CSV row per frame holding every counter
+void StartLog(const std::string &FileName);
+void StopLog(void);
+bool IsLogging(void);
+
+// Calls of the global operator new between the last two EndFrames, on any thread, see g_HeapAllocationCount.
+// A frame that only reuses what earlier frames allocated should report 0.
+uint64_t GetLastFrameHeapAllocations(void);
+
+// Calls of the global operator new since the last EndFrame, so the difference of two calls during a
+// frame is what was allocated in between
+uint64_t GetHeapAllocationCount(void);
+} // namespace FrameStats
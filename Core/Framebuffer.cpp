@@ -1,25 +1,24 @@
 #include "Framebuffer.h"
 #include "GraphicsCore.h"
 #include "Hash.h"
+#include "Utility.h"
 #include <algorithm>
 
-void Framebuffer::Create(vk::RenderPass renderPass, const vk::ArrayProxy<PixelBuffer>& imageViews)
+void Framebuffer::Create(vk::RenderPass renderPass, const PixelBuffer* const* buffers, uint32_t count)
 {
-    if (imageViews.empty())
+    if (count == 0)
     {
         return;
     }
-    m_Width = imageViews.front().GetWidth();
-    m_Height = imageViews.front().GetHeight();
+    m_Width = buffers[0]->GetWidth();
+    m_Height = buffers[0]->GetHeight();
 
     std::vector<vk::ImageView> ivs;
-    ivs.reserve(imageViews.size());
-    m_ClearValues.reserve(imageViews.size());
+    ivs.reserve(count);
 
-    for (auto& iv : imageViews)
+    for (uint32_t i = 0; i < count; ++i)
     {
-        ivs.push_back(iv);
-        m_ClearValues.push_back(iv.GetClearValue());
+        ivs.push_back(*buffers[i]);
     }
 
     vk::FramebufferCreateInfo framebufferInfo;
@@ -40,16 +39,18 @@ void Framebuffer::Destroy()
         Graphics::g_Device.destroyFramebuffer(m_Framebuffer);
         m_Framebuffer = nullptr;
     }
-    m_ClearValues.clear();
 }
 
-Framebuffer FramebufferManager::GetFramebuffer(vk::RenderPass renderPass, const vk::ArrayProxy<PixelBuffer>& buffers)
+Framebuffer FramebufferManager::GetFramebuffer(vk::RenderPass renderPass, const PixelBuffer* const* buffers,
+                                               uint32_t count)
 {
+    ASSERT(count <= kMaxAttachments);
+
     auto pass = VkRenderPass(renderPass);
     size_t hash = Utility::HashState(&pass);
-    for (auto &i : buffers)
+    for (uint32_t i = 0; i < count; ++i)
     {
-        auto view = VkImageView(vk::ImageView(i));
+        auto view = VkImageView(vk::ImageView(*buffers[i]));
         hash = Utility::HashState(&view, 1, hash);
     }
     
@@ -75,54 +76,46 @@ Framebuffer FramebufferManager::GetFramebuffer(vk::RenderPass renderPass, const
 //        return iter->second.fb;
 //    }
     
-    auto iter = m_FramebufferMap.find(hash);
-    if (iter != m_FramebufferMap.end())
+    FbInfo info;
+    if (m_FramebufferMap.Find(hash, info))
     {
-        return iter->second.fb;
+        return info.fb;
     }
-    
-    FbInfo info;
-    info.fb.Create(renderPass, buffers);
+
+    info.fb.Create(renderPass, buffers, count);
     info.rp = renderPass;
-    info.ivs.reserve(buffers.size());
-    for (auto& b : buffers)
+    info.numIvs = count;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        info.ivs[i] = *buffers[i];
+    }
+    FbInfo stored = m_FramebufferMap.Insert(hash, info);
+    if (stored.fb.m_Framebuffer != info.fb.m_Framebuffer)
     {
-        info.ivs.push_back(b);
+        info.fb.Destroy();
     }
-    m_FramebufferMap[hash] = info;
-    return info.fb;
+    return stored.fb;
 }
 void FramebufferManager::InformDestruction(const PixelBuffer& buffer)
 {
-    auto iter = m_FramebufferMap.begin();
-    while (iter != m_FramebufferMap.end())
-    {
-        auto& info = *iter;
-        bool found = false;
-        for (auto& i : info.second.ivs)
+    m_FramebufferMap.EraseIf(
+        [&](size_t, const FbInfo& info)
         {
-            if (vk::ImageView(buffer) == i)
+            for (uint32_t i = 0; i < info.numIvs; ++i)
             {
-                found = true;
-                break;
+                if (vk::ImageView(buffer) == info.ivs[i])
+                {
+                    // The map keeps the stale entry around for concurrent readers, destroy through a copy
+                    Framebuffer fb = info.fb;
+                    fb.Destroy();
+                    return true;
+                }
             }
-        }
-        if (found)
-        {
-            info.second.fb.Destroy();
-            iter = m_FramebufferMap.erase(iter);
-        }
-        else
-        {
-            iter++;
-        }
-    }
+            return false;
+        });
 }
 void FramebufferManager::DestroyAll()
 {
-    for (auto& f : m_FramebufferMap)
-    {
-        f.second.fb.Destroy();
-    }
-    m_FramebufferMap.clear();
+    m_FramebufferMap.ForEach([](size_t, FbInfo& info) { info.fb.Destroy(); });
+    m_FramebufferMap.Clear();
 }
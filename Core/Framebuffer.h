@@ -2,9 +2,9 @@
 
 #include <vulkan/vulkan.hpp>
 #include "PixelBuffer.h"
+#include "HashMap.h"
 #include <vector>
 #include <list>
-#include <map>
 
 class Framebuffer
 {
@@ -15,16 +15,14 @@ public:
 
     uint32_t GetWidth() const { return m_Width; }
     uint32_t GetHeight() const { return m_Height; }
-    std::vector<vk::ClearValue> GetClearValues() const { return m_ClearValues; }
 
 private:
-    void Create(vk::RenderPass renderPass, const vk::ArrayProxy<PixelBuffer>& buffers);
+    void Create(vk::RenderPass renderPass, const PixelBuffer* const* buffers, uint32_t count);
     void Destroy();
     
     uint32_t m_Width;
     uint32_t m_Height;
     vk::Framebuffer m_Framebuffer;
-    std::vector<vk::ClearValue> m_ClearValues;
 };
 
 // A framebuffer is created whenever a new attachment combination appears
@@ -33,16 +31,20 @@ private:
 class FramebufferManager
 {
 public:
-    Framebuffer GetFramebuffer(vk::RenderPass renderPass, const vk::ArrayProxy<PixelBuffer>& buffers);
+    static const uint32_t kMaxAttachments = 9;
+
+    Framebuffer GetFramebuffer(vk::RenderPass renderPass, const PixelBuffer* const* buffers, uint32_t count);
     void InformDestruction(const PixelBuffer& buffer);
     void DestroyAll();
     
 private:
+    // Copied out on every lookup, so it holds no heap memory
     struct FbInfo
     {
         Framebuffer fb;
         vk::RenderPass rp;
-        std::vector<vk::ImageView> ivs;
+        vk::ImageView ivs[kMaxAttachments];
+        uint32_t numIvs;
     };
-    std::map<size_t, FbInfo> m_FramebufferMap;
+    Utility::ShardedHashMap<size_t, FbInfo> m_FramebufferMap;
 };
@@ -21,9 +21,12 @@
 //#include "PostEffects.h"
 #include "Display.h"
 #include "EngineTuning.h"
+#include "EngineProfiling.h"
 #include "Util/CommandLineArg.h"
 //#include <shellapi.h>
 #include "Utility.h"
+#include <algorithm>
+#include <cfloat>
 
 //#pragma comment(lib, "runtimeobject.lib") 
 
@@ -33,10 +36,8 @@ using namespace Graphics;
 
 bool gIsSupending = false;
 
-void InitializeApplication(IGameApp& game, int argc, char** argv)
+void InitializeApplication(IGameApp& game)
 {
-    CommandLineArgs::Initialize(argc, argv);
-
     Graphics::Initialize(game.RequiresRaytracingSupport());
     SystemTime::Initialize();
     GameInput::Initialize();
@@ -56,7 +57,7 @@ void TerminateApplication(IGameApp& game)
 
 bool UpdateApplication(IGameApp& game)
 {
-    //EngineProfiling::Update();
+    EngineProfiling::Update();
 
     float DeltaTime = Graphics::GetFrameTime();
 
@@ -104,8 +105,56 @@ static void framebufferResizeCallback(GLFWwindow* window, int width, int height)
 
 GLFWwindow* g_Window = nullptr;
 
+// Renders a fixed number of frames into the offscreen display plane and reports how long they took
+static int RunHeadless(IGameApp& app, uint32_t frameCount)
+{
+    InitializeApplication(app);
+
+    int64_t startTick = SystemTime::GetCurrentTick();
+    float minFrameTime = FLT_MAX;
+    float maxFrameTime = 0.0f;
+    for (uint32_t i = 0; i < frameCount; ++i)
+    {
+        if (!UpdateApplication(app))
+        {
+            frameCount = i + 1;
+            break;
+        }
+        // The first frame time is measured from startup
+        if (i > 0)
+        {
+            minFrameTime = std::min(minFrameTime, Graphics::GetFrameTime());
+            maxFrameTime = std::max(maxFrameTime, Graphics::GetFrameTime());
+        }
+    }
+    double totalTime = SystemTime::TimeBetweenTicks(startTick, SystemTime::GetCurrentTick());
+
+    printf("Headless: %u frames in %.3f s, %.3f ms average", frameCount, totalTime, totalTime * 1000.0 / frameCount);
+    if (frameCount > 1)
+    {
+        printf(" (%.3f ms min, %.3f ms max)", minFrameTime * 1000.0f, maxFrameTime * 1000.0f);
+    }
+    printf("\n");
+
+    TerminateApplication(app);
+    Graphics::Shutdown();
+
+    return 0;
+}
+
 int RunApplication(IGameApp& app, const char* className, int argc, char** argv)
 {
+    CommandLineArgs::Initialize(argc, argv);
+
+    // "-headless <frames>" renders that many frames without a window and exits
+    uint32_t headlessFrames = 0;
+    CommandLineArgs::GetInteger("headless", headlessFrames);
+    if (headlessFrames > 0)
+    {
+        Graphics::g_bHeadless = true;
+        return RunHeadless(app, headlessFrames);
+    }
+
     // init glfw
     if (GLFW_TRUE != glfwInit())
     {
@@ -128,7 +177,7 @@ int RunApplication(IGameApp& app, const char* className, int argc, char** argv)
 
     glfwSetFramebufferSizeCallback(g_Window, framebufferResizeCallback);
 
-    InitializeApplication(app, argc, argv);
+    InitializeApplication(app);
 
     do
     {
@@ -47,6 +47,11 @@ namespace GameCore
 extern GLFWwindow *g_Window;
 }
 
+namespace Graphics
+{
+extern bool g_bHeadless;
+}
+
 namespace
 {
 bool s_Buttons[2][GameInput::kNumDigitalInputs];
@@ -331,14 +336,17 @@ void GameInput::Initialize()
     memset(&s_Analogs, 0, sizeof(s_Analogs));
 
 #ifdef USE_KEYBOARD_MOUSE
-    KbmInitialize();
+    // There is no window to take input from in headless mode, so every input stays released
+    if (!Graphics::g_bHeadless)
+        KbmInitialize();
 #endif
 }
 
 void GameInput::Shutdown()
 {
 #ifdef USE_KEYBOARD_MOUSE
-    KbmShutdown();
+    if (!Graphics::g_bHeadless)
+        KbmShutdown();
 #endif
 }
 
@@ -380,7 +388,8 @@ void GameInput::Update(float frameDelta)
     //    }
 
 #ifdef USE_KEYBOARD_MOUSE
-    KbmUpdate();
+    if (!Graphics::g_bHeadless)
+        KbmUpdate();
 
     for (uint32_t i = 0; i < kNumKeys; ++i)
     {
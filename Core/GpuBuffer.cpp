@@ -1,6 +1,7 @@
 #include "GpuBuffer.h"
 #include "CommandContext.h"
 #include "GraphicsCore.h"
+#include "MemoryTracker.h"
 
 using namespace Graphics;
 
@@ -18,12 +19,20 @@ void GpuBuffer::Create(size_t size)
     allocInfo.usage = m_MemoryUsage;
 
     std::tie(m_Buffer, m_Allocation) = g_Allocator.createBuffer(bufferInfo, allocInfo);
+
+    MemoryTracker::Category category = MemoryTracker::kOther;
+    if (m_MemoryUsage == vma::MemoryUsage::eCpuOnly)
+        category = MemoryTracker::kStaging;
+    else if (m_BufferUsage & (vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eIndexBuffer))
+        category = MemoryTracker::kGeometry;
+    MemoryTracker::Track(m_Allocation, category);
 }
 
 void GpuBuffer::Destroy()
 {
     if (m_Allocation)
     {
+        MemoryTracker::Untrack(m_Allocation);
         g_Allocator.destroyBuffer(m_Buffer, m_Allocation);
         m_Buffer = nullptr;
         m_Allocation = nullptr;
@@ -1,42 +1,220 @@
 #include "GpuTimeManager.h"
 #include "CommandBufferManager.h"
 #include "CommandContext.h"
+#include "Display.h"
 #include "GraphicsCore.h"
+#include "SystemTime.h"
+#include "Utility.h"
+#include <algorithm>
+#include <vector>
 #include <vulkan/vulkan_structs.hpp>
 
 namespace
 {
-vk::QueryPool sm_QueryPool = nullptr;
+// The CPU runs at most this many frames ahead of the GPU, so a frame's pool is free again when it comes back around
+const uint32_t kNumQueryFrames = 3;
+const uint32_t kStartupFrame = UINT32_MAX;
+
+struct QueryFrame
+{
+    vk::QueryPool pool;
+    uint32_t frame;     // Frame whose timers the pool holds
+    int64_t startTick;  // CPU tick just before the frame's first timestamp was submitted
+    bool pending;       // Closed but not read back yet
+};
+
+QueryFrame sm_QueryFrames[kNumQueryFrames] = {};
+QueryFrame *sm_CurrentFrame = nullptr;
+std::vector<uint64_t> sm_QueryResults; // Value and availability of every query
+std::vector<uint64_t> sm_TimeStamps;   // Last frame read back, zero for timers that didn't run in it
+std::vector<float> sm_AverageTimes;
+double sm_GpuTickDelta = 0.0; // Milliseconds per timestamp tick
+uint64_t sm_ValidTimeStart = 0;
+uint64_t sm_ValidTimeEnd = 0;
+uint32_t sm_ReadBackFrame = UINT32_MAX;
+bool sm_HaveClockOffset = false;
+int64_t sm_GpuToCpuOffset = 0; // SystemTime tick of GPU timestamp zero
 uint32_t sm_MaxNumTimers = 0;
 uint32_t sm_NumTimers = 1; // first timer is for global use
+
+double TicksPerGpuTick() { return sm_GpuTickDelta / SystemTime::TicksToMillisecs(1); }
+
+// Copies the frame's results if the GPU is done with it. Its closing timestamp is the last thing it
+// wrote, so once that one is available every timer of the frame is.
+bool ReadBack(QueryFrame &Frame)
+{
+    uint32_t queryCount = std::min(sm_NumTimers, sm_MaxNumTimers) * 2;
+    vk::Result result = Graphics::g_Device.getQueryPoolResults(
+        Frame.pool, 0, queryCount, queryCount * 2 * sizeof(uint64_t), sm_QueryResults.data(), 2 * sizeof(uint64_t),
+        vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability);
+    if ((result != vk::Result::eSuccess && result != vk::Result::eNotReady) || sm_QueryResults[3] == 0)
+        return false;
+
+    // Timers that were not used that frame are not available and read as zero
+    std::fill(sm_TimeStamps.begin(), sm_TimeStamps.end(), 0);
+    for (uint32_t i = 0; i < queryCount; ++i)
+        sm_TimeStamps[i] = sm_QueryResults[i * 2 + 1] ? sm_QueryResults[i * 2] : 0;
+
+    sm_ValidTimeStart = sm_TimeStamps[0];
+    sm_ValidTimeEnd = sm_TimeStamps[1];
+    sm_ReadBackFrame = Frame.frame;
+    Frame.pending = false;
+
+    // Don't trust timers of a frame whose bracketing timestamps are out of order
+    if (sm_ValidTimeEnd < sm_ValidTimeStart)
+    {
+        sm_ValidTimeStart = 0ull;
+        sm_ValidTimeEnd = 0ull;
+        return true;
+    }
+
+    // The GPU can't start a frame before it was submitted, so the submission tick bounds the offset between
+    // the clocks from below. The largest bound seen is the closest, and it is tight for frames that found
+    // the GPU idle.
+    int64_t offset = Frame.startTick - (int64_t)(sm_ValidTimeStart * TicksPerGpuTick());
+    if (!sm_HaveClockOffset || offset > sm_GpuToCpuOffset)
+        sm_GpuToCpuOffset = offset;
+    sm_HaveClockOffset = true;
+
+    for (uint32_t i = 0; i < queryCount / 2; ++i)
+    {
+        float time = GpuTimeManager::GetTime(i);
+        if (time > 0.0f)
+            sm_AverageTimes[i] += sm_AverageTimes[i] == 0.0f ? time : (time - sm_AverageTimes[i]) / 16.0f;
+    }
+    return true;
+}
 } // namespace
 
 void GpuTimeManager::Initialize(uint32_t MaxNumTimers)
 {
+    sm_MaxNumTimers = MaxNumTimers;
+    sm_TimeStamps.resize(MaxNumTimers * 2);
+    sm_QueryResults.resize(MaxNumTimers * 4);
+    sm_AverageTimes.resize(MaxNumTimers);
+
+    // Timers read as zero when the queues can't write timestamps
+    vk::PhysicalDeviceLimits limits = Graphics::g_PhysicalDevice.getProperties().limits;
+    if (!limits.timestampComputeAndGraphics)
+    {
+        printf("Timestamp queries not supported, GPU times are not available\n");
+        return;
+    }
+    sm_GpuTickDelta = limits.timestampPeriod * 1e-6;
+
     vk::QueryPoolCreateInfo queryInfo;
     queryInfo.queryType = vk::QueryType::eTimestamp;
     queryInfo.queryCount = MaxNumTimers * 2; // one for begin and one for end
-    sm_QueryPool = Graphics::g_Device.createQueryPool(queryInfo);
-    sm_MaxNumTimers = MaxNumTimers;
+    for (QueryFrame &Frame : sm_QueryFrames)
+        Frame.pool = Graphics::g_Device.createQueryPool(queryInfo);
+
+    // Queries have to be reset before their first use, and the first frame starts here. Whatever runs
+    // before the first frame is timed but never read.
+    sm_CurrentFrame = &sm_QueryFrames[0];
+    sm_CurrentFrame->frame = kStartupFrame;
+    CommandContext &Context = CommandContext::Begin("GPU Timer Reset");
+    Context.ResetQueries(sm_CurrentFrame->pool, 0, sm_MaxNumTimers * 2);
+    Context.InsertTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, sm_CurrentFrame->pool, 0);
+    Context.Finish();
 }
 
 void GpuTimeManager::Shutdown()
 {
-    if (sm_QueryPool)
+    for (QueryFrame &Frame : sm_QueryFrames)
     {
-        Graphics::g_Device.destroyQueryPool(sm_QueryPool);
-        sm_QueryPool = nullptr;
+        if (Frame.pool)
+            Graphics::g_Device.destroyQueryPool(Frame.pool);
+        Frame = {};
     }
+    sm_CurrentFrame = nullptr;
 }
 
+// Timers may be created before Initialize by static profiling scopes
 uint32_t GpuTimeManager::NewTimer(void) { return sm_NumTimers++; }
 
 void GpuTimeManager::StartTimer(CommandContext &Context, uint32_t TimerIdx)
 {
-    Context.InsertTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, sm_QueryPool, TimerIdx * 2);
+    if (!sm_CurrentFrame)
+        return;
+    ASSERT(TimerIdx < sm_MaxNumTimers, "Out of GPU timers");
+    Context.InsertTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, sm_CurrentFrame->pool, TimerIdx * 2);
 }
 
 void GpuTimeManager::StopTimer(CommandContext &Context, uint32_t TimerIdx)
 {
-    Context.InsertTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, sm_QueryPool, TimerIdx * 2 + 1);
+    if (!sm_CurrentFrame)
+        return;
+    ASSERT(TimerIdx < sm_MaxNumTimers, "Out of GPU timers");
+    Context.InsertTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, sm_CurrentFrame->pool, TimerIdx * 2 + 1);
+}
+
+void GpuTimeManager::BeginReadBack(CommandContext &Context)
+{
+    if (!sm_CurrentFrame)
+        return;
+
+    // Close the frame without waiting for it. The frame can't be read back before Context is submitted.
+    Context.InsertTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, sm_CurrentFrame->pool, 1);
+    sm_CurrentFrame->pending = sm_CurrentFrame->frame != kStartupFrame;
+
+    // Frames finish in order, so only the oldest one can be ready. If it isn't, the last results stay.
+    QueryFrame *Oldest = nullptr;
+    for (QueryFrame &Frame : sm_QueryFrames)
+    {
+        if (Frame.pending && (Oldest == nullptr || Frame.frame < Oldest->frame))
+            Oldest = &Frame;
+    }
+    if (Oldest != nullptr)
+        ReadBack(*Oldest);
+}
+
+void GpuTimeManager::EndReadBack(CommandContext &Context)
+{
+    if (!sm_CurrentFrame)
+        return;
+
+    // A GPU that is a whole ring behind loses the times of that frame rather than holding up the CPU.
+    // The reset is queued after the frame, so the GPU is done writing the pool before it is reused.
+    uint32_t Frame = (uint32_t)Graphics::GetFrameCount();
+    sm_CurrentFrame = &sm_QueryFrames[Frame % kNumQueryFrames];
+    if (sm_CurrentFrame->pending && !ReadBack(*sm_CurrentFrame))
+        sm_CurrentFrame->pending = false;
+
+    sm_CurrentFrame->frame = Frame;
+    Context.ResetQueries(sm_CurrentFrame->pool, 0, sm_MaxNumTimers * 2);
+    Context.InsertTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, sm_CurrentFrame->pool, 0);
+    // Context is submitted after this, so the tick is still a lower bound of the submission
+    sm_CurrentFrame->startTick = SystemTime::GetCurrentTick();
+}
+
+uint32_t GpuTimeManager::GetReadBackFrame(void) { return sm_ReadBackFrame; }
+
+float GpuTimeManager::GetTime(uint32_t TimerIdx)
+{
+    ASSERT(TimerIdx < sm_NumTimers, "Invalid GPU timer index");
+    if (TimerIdx >= sm_MaxNumTimers)
+        return 0.0f;
+
+    uint64_t TimeStamp1 = sm_TimeStamps[TimerIdx * 2];
+    uint64_t TimeStamp2 = sm_TimeStamps[TimerIdx * 2 + 1];
+
+    if (TimeStamp1 < sm_ValidTimeStart || TimeStamp2 > sm_ValidTimeEnd || TimeStamp2 <= TimeStamp1)
+        return 0.0f;
+
+    return static_cast<float>(sm_GpuTickDelta * (TimeStamp2 - TimeStamp1));
+}
+
+float GpuTimeManager::GetAverageTime(uint32_t TimerIdx)
+{
+    return TimerIdx < sm_MaxNumTimers ? sm_AverageTimes[TimerIdx] : 0.0f;
+}
+
+bool GpuTimeManager::GetTimeRange(uint32_t TimerIdx, int64_t &StartTick, int64_t &StopTick)
+{
+    if (GetTime(TimerIdx) == 0.0f)
+        return false;
+
+    StartTick = sm_GpuToCpuOffset + (int64_t)(sm_TimeStamps[TimerIdx * 2] * TicksPerGpuTick());
+    StopTick = sm_GpuToCpuOffset + (int64_t)(sm_TimeStamps[TimerIdx * 2 + 1] * TicksPerGpuTick());
+    return true;
 }
@@ -30,11 +30,24 @@ uint32_t NewTimer(void);
 void StartTimer(CommandContext &Context, uint32_t TimerIdx);
 void StopTimer(CommandContext &Context, uint32_t TimerIdx);
 
-// Bookend all calls to GetTime() with Begin/End which correspond to Map/Unmap.  This
-// needs to happen either at the very start or very end of a frame.
-void BeginReadBack(void);
-void EndReadBack(void);
+// Bookend all calls to GetTime() with Begin/End.  This needs to happen at the very start of
+// a frame: BeginReadBack closes the previous frame and reads the timers of the oldest frame the
+// GPU has finished, EndReadBack starts the next frame.  Each frame in flight has its own query
+// pool, so nothing waits for the GPU and the times lag the CPU by a frame or two.  Both record
+// into Context, which has to be submitted before any other work of the frame.
+void BeginReadBack(CommandContext &Context);
+void EndReadBack(CommandContext &Context);
+
+// Frame the timers read by the last BeginReadBack belong to, UINT32_MAX before the first one
+uint32_t GetReadBackFrame(void);
 
 // Returns the time in milliseconds between start and stop queries
 float GetTime(uint32_t TimerIdx);
+
+// Moving average of the time in milliseconds over the frames the timer ran in
+float GetAverageTime(uint32_t TimerIdx);
+
+// Start and stop of a timer converted to SystemTime ticks, false if the timer didn't run.  The GPU
+// clock is matched to the CPU clock by when frames were submitted, so GPU work may appear slightly early.
+bool GetTimeRange(uint32_t TimerIdx, int64_t &StartTick, int64_t &StopTick);
 } // namespace GpuTimeManager
@@ -18,7 +18,10 @@
 #include "GraphicsCore.h"
 #include <vulkan/vulkan.h>
 #include <vulkan/vulkan_beta.h>
-// #include "GpuTimeManager.h"
+#include "GpuTimeManager.h"
+#include "FrameStats.h"
+#include "MemoryTracker.h"
+#include "PipelineStatsManager.h"
 // #include "PostEffects.h"
 // #include "SSAO.h"
 #include "TextRenderer.h"
@@ -34,6 +37,7 @@
 // #include "GraphRenderer.h"
 // #include "TemporalEffects.h"
 #include "Display.h"
+#include "Hash.h"
 #include "Util/CommandLineArg.h"
 #include <algorithm>
 #include <inttypes.h>
@@ -76,6 +80,13 @@ namespace Graphics
 {
 bool g_bTypedUAVLoadSupport_R11G11B10_FLOAT = false;
 bool g_bTypedUAVLoadSupport_R16G16B16A16_FLOAT = false;
+bool g_bDynamicRendering = false;
+PFN_vkCmdBeginRenderingKHR g_vkCmdBeginRendering = nullptr;
+PFN_vkCmdEndRenderingKHR g_vkCmdEndRendering = nullptr;
+bool g_bSynchronization2 = false;
+PFN_vkCmdPipelineBarrier2KHR g_vkCmdPipelineBarrier2 = nullptr;
+bool g_bMultiDrawIndirect = false;
+bool g_bHeadless = false;
 
 vk::Instance g_Instance;
 vk::DebugUtilsMessengerEXT g_DebugMessenger;
@@ -199,15 +210,17 @@ void Graphics::Initialize(bool RequireDXRSupport)
     vk::InstanceCreateInfo instanceInfo;
 
     // Instance Extensions
-    std::vector<const char *> extensions = {
-        VK_KHR_SURFACE_EXTENSION_NAME,
-#if defined(_MSC_VER)
-        VK_KHR_WIN32_SURFACE_EXTENSION_NAME,
-#elif defined(__APPLE__)
-        VK_EXT_METAL_SURFACE_EXTENSION_NAME,
-        VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME,
+    std::vector<const char *> extensions;
+#if defined(__APPLE__)
+    extensions.push_back(VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME);
 #endif
-    };
+    if (!g_bHeadless)
+    {
+        // Whatever GLFW needs to create a surface on this platform
+        uint32_t glfwExtensionCount = 0;
+        const char **glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        extensions.insert(extensions.end(), glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
 
     auto CheckInstanceExtensionSupport = [](const char *extension) {
         bool found = false;
@@ -244,7 +257,10 @@ void Graphics::Initialize(bool RequireDXRSupport)
     // appInfo.setPApplicationName(appName);
     appInfo.setApplicationVersion(VK_MAKE_VERSION(1, 0, 0));
     appInfo.setPEngineName("MiniEngine");
-    appInfo.setApiVersion(VK_API_VERSION_1_2);
+    // Ask for 1.3 when the loader has it so dynamic rendering can be used from the core
+    uint32_t instanceVersion = vk::enumerateInstanceVersion();
+    uint32_t apiVersion = instanceVersion >= VK_API_VERSION_1_3 ? VK_API_VERSION_1_3 : VK_API_VERSION_1_2;
+    appInfo.setApiVersion(apiVersion);
 
     instanceInfo.setPApplicationInfo(&appInfo);
 
@@ -293,12 +309,15 @@ void Graphics::Initialize(bool RequireDXRSupport)
     auto physicalDevices = g_Instance.enumeratePhysicalDevices();
 
     // Device Extensions
-    const std::vector<const char *> deviceExtensions = {
-        VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+    std::vector<const char *> deviceExtensions = {
 #if defined(__APPLE__)
         VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME,
 #endif
     };
+    if (!g_bHeadless)
+    {
+        deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
 
     auto CheckDeviceExtensionSupport = [](const vk::PhysicalDevice &device, const char *extension) {
         bool found = false;
@@ -377,14 +396,10 @@ void Graphics::Initialize(bool RequireDXRSupport)
         }
 #ifndef __APPLE__
         // Is this support presentation queue family?
-        bool presentSupport = false;
-        for (int i = 0; i < queueFamilies.size(); ++i)
+        bool presentSupport = g_bHeadless;
+        for (int i = 0; !presentSupport && i < queueFamilies.size(); ++i)
         {
-            if (pd.getWin32PresentationSupportKHR(i))
-            {
-                presentSupport = true;
-                break;
-            }
+            presentSupport = glfwGetPhysicalDevicePresentationSupport(g_Instance, pd, i);
         }
         if (!presentSupport)
         {
@@ -409,6 +424,7 @@ void Graphics::Initialize(bool RequireDXRSupport)
         g_PhysicalDevice = pd;
 
         printf("Selected GPU:  %s (%" PRIu64 " MB)\n", properties.deviceName.data(), memory.memoryHeaps[0].size >> 20);
+        printf("State hashing: CRC32C (%s)\n", Utility::GetHashImplementation());
     }
     if (!g_PhysicalDevice)
     {
@@ -416,18 +432,62 @@ void Graphics::Initialize(bool RequireDXRSupport)
         raise(SIGABRT);
     }
 
+    // Dynamic rendering begins passes straight from image views, without render pass and framebuffer
+    // objects. It is core in 1.3 and VK_KHR_dynamic_rendering before that. "-dynamicrendering 0"
+    // forces the render pass path.
+    uint32_t useDynamicRendering = 1;
+    CommandLineArgs::GetInteger("dynamicrendering", useDynamicRendering);
+    apiVersion = std::min(apiVersion, g_PhysicalDevice.getProperties().apiVersion);
+    bool vulkan13 = apiVersion >= VK_API_VERSION_1_3;
+    // The extension being listed doesn't mean the feature is, so both paths check the feature bit
+    bool dynamicRenderingExtension =
+        !vulkan13 && CheckDeviceExtensionSupport(g_PhysicalDevice, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+    if (useDynamicRendering && (vulkan13 || dynamicRenderingExtension))
+    {
+        auto features = g_PhysicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2,
+                                                      vk::PhysicalDeviceDynamicRenderingFeatures>();
+        g_bDynamicRendering = features.get<vk::PhysicalDeviceDynamicRenderingFeatures>().dynamicRendering;
+        if (g_bDynamicRendering && dynamicRenderingExtension)
+        {
+            deviceExtensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+        }
+    }
+    printf("Rendering path: %s\n", g_bDynamicRendering ? "dynamic rendering" : "render pass");
+
+    // Lets VMA report the budget the driver gives us instead of estimating it
+    bool memoryBudget = CheckDeviceExtensionSupport(g_PhysicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if (memoryBudget)
+    {
+        deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
+
+    // Same for vkCmdPipelineBarrier2, "-synchronization2 0" keeps the original barriers
+    uint32_t useSynchronization2 = 1;
+    CommandLineArgs::GetInteger("synchronization2", useSynchronization2);
+    bool synchronization2Extension =
+        !vulkan13 && CheckDeviceExtensionSupport(g_PhysicalDevice, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+    if (useSynchronization2 && (vulkan13 || synchronization2Extension))
+    {
+        auto features = g_PhysicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2,
+                                                      vk::PhysicalDeviceSynchronization2Features>();
+        g_bSynchronization2 = features.get<vk::PhysicalDeviceSynchronization2Features>().synchronization2;
+        if (g_bSynchronization2 && synchronization2Extension)
+        {
+            deviceExtensions.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+        }
+    }
+
     // Get queue family
     auto queueFamilies = g_PhysicalDevice.getQueueFamilyProperties();
     CommandQueueFamilyIndice queueFamilyIndice;
     queueFamilyIndice.graphicsIndex = FindQueueFamily(queueFamilies, vk::QueueFlagBits::eGraphics);
     queueFamilyIndice.computeIndex = FindQueueFamily(queueFamilies, vk::QueueFlagBits::eCompute);
     queueFamilyIndice.transferIndex = FindQueueFamily(queueFamilies, vk::QueueFlagBits::eTransfer);
-#ifdef __APPLE__
     queueFamilyIndice.presentIndex = queueFamilyIndice.graphicsIndex;
-#else
-    for (int i = 0; i < queueFamilies.size(); ++i)
+#ifndef __APPLE__
+    for (int i = 0; !g_bHeadless && i < queueFamilies.size(); ++i)
     {
-        if (g_PhysicalDevice.getWin32PresentationSupportKHR(i))
+        if (glfwGetPhysicalDevicePresentationSupport(g_Instance, g_PhysicalDevice, i))
         {
             queueFamilyIndice.presentIndex = i;
             break;
@@ -454,21 +514,29 @@ void Graphics::Initialize(bool RequireDXRSupport)
     }
 
     // Create a surface
-    VkSurfaceKHR surface;
-    glfwCreateWindowSurface(g_Instance, GameCore::g_Window, nullptr, &surface);
-    g_Surface = surface;
-    // query for capabilities of surface
-    auto capabilities = g_PhysicalDevice.getSurfaceCapabilitiesKHR(g_Surface);
-    auto formats = g_PhysicalDevice.getSurfaceFormatsKHR(g_Surface);
-    auto presentModes = g_PhysicalDevice.getSurfacePresentModesKHR(g_Surface);
-    if (formats.empty() || presentModes.empty())
+    if (!g_bHeadless)
     {
-        printf("Surface not adequate for swapchain!\n");
-        raise(SIGABRT);
+        VkSurfaceKHR surface;
+        glfwCreateWindowSurface(g_Instance, GameCore::g_Window, nullptr, &surface);
+        g_Surface = surface;
+        // query for capabilities of surface
+        auto capabilities = g_PhysicalDevice.getSurfaceCapabilitiesKHR(g_Surface);
+        auto formats = g_PhysicalDevice.getSurfaceFormatsKHR(g_Surface);
+        auto presentModes = g_PhysicalDevice.getSurfacePresentModesKHR(g_Surface);
+        if (formats.empty() || presentModes.empty())
+        {
+            printf("Surface not adequate for swapchain!\n");
+            raise(SIGABRT);
+        }
     }
 
     vk::PhysicalDeviceFeatures deviceFeatures;
     deviceFeatures.samplerAnisotropy = VK_TRUE;
+    // Only used by the profiler, which checks for it again
+    deviceFeatures.pipelineStatisticsQuery = g_PhysicalDevice.getFeatures().pipelineStatisticsQuery;
+    // Lets one indirect call issue every draw of a mesh's surviving clusters
+    g_bMultiDrawIndirect = g_PhysicalDevice.getFeatures().multiDrawIndirect;
+    deviceFeatures.multiDrawIndirect = g_bMultiDrawIndirect;
     // create device
     vk::DeviceCreateInfo deviceInfo;
     deviceInfo.setQueueCreateInfos(queueInfos);
@@ -481,23 +549,67 @@ void Graphics::Initialize(bool RequireDXRSupport)
         deviceInfo.setEnabledLayerCount(validationLayers.size());
         deviceInfo.setPEnabledLayerNames(validationLayers);
     }
+    vk::PhysicalDeviceDynamicRenderingFeatures dynamicRenderingFeatures;
+    if (g_bDynamicRendering)
+    {
+        dynamicRenderingFeatures.dynamicRendering = VK_TRUE;
+        dynamicRenderingFeatures.pNext = const_cast<void *>(deviceInfo.pNext);
+        deviceInfo.pNext = &dynamicRenderingFeatures;
+    }
+    vk::PhysicalDeviceSynchronization2Features synchronization2Features;
+    if (g_bSynchronization2)
+    {
+        synchronization2Features.synchronization2 = VK_TRUE;
+        synchronization2Features.pNext = const_cast<void *>(deviceInfo.pNext);
+        deviceInfo.pNext = &synchronization2Features;
+    }
 #ifdef __APPLE__
     VkPhysicalDevicePortabilitySubsetFeaturesKHR portabilityFeatures = {};
     portabilityFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PORTABILITY_SUBSET_FEATURES_KHR;
     portabilityFeatures.mutableComparisonSamplers = VK_TRUE;
+    portabilityFeatures.pNext = const_cast<void *>(deviceInfo.pNext);
     deviceInfo.pNext = &portabilityFeatures;
 #endif
 
     g_Device = g_PhysicalDevice.createDevice(deviceInfo);
     // VULKAN_HPP_DEFAULT_DISPATCHER.init(g_Device);
 
+    if (g_bDynamicRendering)
+    {
+        // Not exported by the loader when only the extension is available, so load them like the debug messenger
+        g_vkCmdBeginRendering = (PFN_vkCmdBeginRenderingKHR)vkGetDeviceProcAddr(
+            g_Device, vulkan13 ? "vkCmdBeginRendering" : "vkCmdBeginRenderingKHR");
+        g_vkCmdEndRendering = (PFN_vkCmdEndRenderingKHR)vkGetDeviceProcAddr(
+            g_Device, vulkan13 ? "vkCmdEndRendering" : "vkCmdEndRenderingKHR");
+        if (!g_vkCmdBeginRendering || !g_vkCmdEndRendering)
+        {
+            printf("Dynamic rendering entry points not found!\n");
+            raise(SIGABRT);
+        }
+    }
+    if (g_bSynchronization2)
+    {
+        g_vkCmdPipelineBarrier2 = (PFN_vkCmdPipelineBarrier2KHR)vkGetDeviceProcAddr(
+            g_Device, vulkan13 ? "vkCmdPipelineBarrier2" : "vkCmdPipelineBarrier2KHR");
+        if (!g_vkCmdPipelineBarrier2)
+        {
+            printf("Synchronization2 entry points not found!\n");
+            raise(SIGABRT);
+        }
+    }
+
     // create allocator
     vma::AllocatorCreateInfo allocInfo;
-    allocInfo.vulkanApiVersion = VK_API_VERSION_1_2;
+    allocInfo.vulkanApiVersion = apiVersion;
     allocInfo.physicalDevice = g_PhysicalDevice;
     allocInfo.device = g_Device;
     allocInfo.instance = g_Instance;
+    if (memoryBudget)
+    {
+        allocInfo.flags |= vma::AllocatorCreateFlagBits::eExtMemoryBudget;
+    }
     g_Allocator = vma::createAllocator(allocInfo);
+    MemoryTracker::Initialize();
 
     g_CommandManager.Create(g_Device, queueFamilyIndice);
 
@@ -506,7 +618,9 @@ void Graphics::Initialize(bool RequireDXRSupport)
 
     Display::Initialize();
 
-    // GpuTimeManager::Initialize(4096);
+    GpuTimeManager::Initialize(4096);
+    PipelineStatsManager::Initialize(256);
+    FrameStats::Initialize();
     // TemporalEffects::Initialize();
     // PostEffects::Initialize();
     // SSAO::Initialize();
@@ -522,7 +636,9 @@ void Graphics::Shutdown(void)
     CommandContext::DestroyAllContexts();
     g_CommandManager.Shutdown();
     g_FramebufferManager.DestroyAll();
-    // GpuTimeManager::Shutdown();
+    GpuTimeManager::Shutdown();
+    PipelineStatsManager::Shutdown();
+    FrameStats::Shutdown();
     PSO::DestroyAll();
     RenderPass::DestroyAll();
     // RootSignature::DestroyAll();
@@ -543,7 +659,10 @@ void Graphics::Shutdown(void)
 
     g_Device.destroy();
 
-    g_Instance.destroySurfaceKHR(g_Surface);
+    if (g_Surface)
+    {
+        g_Instance.destroySurfaceKHR(g_Surface);
+    }
 
     if (g_DebugMessenger)
     {
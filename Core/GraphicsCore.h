@@ -54,6 +54,22 @@ extern vk::SurfaceKHR g_Surface;
 extern CommandBufferManager g_CommandManager;
 extern ContextManager g_ContextManager;
 extern FramebufferManager g_FramebufferManager;
+
+// Set when passes are begun with vkCmdBeginRendering instead of render pass and framebuffer objects
+extern bool g_bDynamicRendering;
+extern PFN_vkCmdBeginRenderingKHR g_vkCmdBeginRendering;
+extern PFN_vkCmdEndRenderingKHR g_vkCmdEndRendering;
+
+// Set when barriers are recorded with vkCmdPipelineBarrier2
+extern bool g_bSynchronization2;
+extern PFN_vkCmdPipelineBarrier2KHR g_vkCmdPipelineBarrier2;
+
+// Set when an indirect draw call can read more than one draw
+extern bool g_bMultiDrawIndirect;
+
+// Set by "-headless <frames>". There is no window, surface or swapchain, and frames are rendered into
+// an offscreen display plane.
+extern bool g_bHeadless;
 // extern ID3D12Device* g_Device;
 // extern CommandListManager g_CommandManager;
 
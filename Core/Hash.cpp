@@ -0,0 +1,169 @@
+#include "Hash.h"
+#include "HashMap.h"
+#include "Math/Common.h"
+#include <atomic>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define HASH_X86 1
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define HASH_TARGET_SSE42
+#else
+#include <cpuid.h>
+#define HASH_TARGET_SSE42 __attribute__((target("sse4.2")))
+#endif
+#else
+#define HASH_X86 0
+#endif
+
+#if defined(__ARM_FEATURE_CRC32)
+#define HASH_ARM_CRC 1
+#include <arm_acle.h>
+#else
+#define HASH_ARM_CRC 0
+#endif
+
+namespace
+{
+typedef uint32_t (*Crc32cFn)(uint32_t, const uint32_t *, const uint32_t *);
+
+struct Crc32cTable
+{
+    uint32_t entries[256];
+
+    Crc32cTable()
+    {
+        // Reflected Castagnoli polynomial, matches the SSE4.2 and ARMv8 crc32c instructions
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit)
+                crc = (crc >> 1) ^ (0x82F63B78u & (0u - (crc & 1u)));
+            entries[i] = crc;
+        }
+    }
+};
+
+uint32_t Crc32cSoftware(uint32_t Crc, const uint32_t *Begin, const uint32_t *End)
+{
+    static const Crc32cTable s_Table;
+
+    const uint8_t *Iter = (const uint8_t *)Begin;
+    const uint8_t *const IterEnd = (const uint8_t *)End;
+    while (Iter < IterEnd)
+        Crc = s_Table.entries[(Crc ^ *Iter++) & 0xFF] ^ (Crc >> 8);
+    return Crc;
+}
+
+#if HASH_X86
+HASH_TARGET_SSE42 uint32_t Crc32cSSE42(uint32_t Crc, const uint32_t *Begin, const uint32_t *End)
+{
+#if defined(_M_X64) || defined(__x86_64__)
+    const uint64_t *Iter64 = (const uint64_t *)Math::AlignUp(Begin, 8);
+    const uint64_t *const End64 = (const uint64_t *const)Math::AlignDown(End, 8);
+
+    // If not 64-bit aligned, start with a single u32 (an empty range can start unaligned too)
+    if ((const uint32_t *)Iter64 > Begin && Begin < End)
+        Crc = _mm_crc32_u32(Crc, *Begin);
+
+    // Iterate over consecutive u64 values
+    uint64_t Crc64 = Crc;
+    while (Iter64 < End64)
+        Crc64 = _mm_crc32_u64(Crc64, *Iter64++);
+    Crc = (uint32_t)Crc64;
+
+    // If there is a 32-bit remainder, accumulate that
+    if ((const uint32_t *)Iter64 < End)
+        Crc = _mm_crc32_u32(Crc, *(const uint32_t *)Iter64);
+#else
+    for (const uint32_t *Iter = Begin; Iter < End; ++Iter)
+        Crc = _mm_crc32_u32(Crc, *Iter);
+#endif
+    return Crc;
+}
+
+bool CpuHasSSE42()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;
+#else
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return false;
+    return (ecx & bit_SSE4_2) != 0;
+#endif
+}
+#endif
+
+#if HASH_ARM_CRC
+uint32_t Crc32cARM(uint32_t Crc, const uint32_t *Begin, const uint32_t *End)
+{
+    const uint64_t *Iter64 = (const uint64_t *)Math::AlignUp(Begin, 8);
+    const uint64_t *const End64 = (const uint64_t *const)Math::AlignDown(End, 8);
+
+    if ((const uint32_t *)Iter64 > Begin && Begin < End)
+        Crc = __crc32cw(Crc, *Begin);
+
+    while (Iter64 < End64)
+        Crc = __crc32cd(Crc, *Iter64++);
+
+    if ((const uint32_t *)Iter64 < End)
+        Crc = __crc32cw(Crc, *(const uint32_t *)Iter64);
+    return Crc;
+}
+#endif
+
+std::atomic<uint64_t> s_HashMapEpoch{0};
+
+uint32_t Crc32cResolve(uint32_t Crc, const uint32_t *Begin, const uint32_t *End);
+
+// Starts out pointing at the resolver, which swaps in the best implementation on first use. This
+// avoids a static initialization guard on every call. Every thread that races through the
+// resolver stores the same value.
+std::atomic<Crc32cFn> s_Crc32c{Crc32cResolve};
+
+struct Crc32cImplementation
+{
+    Crc32cFn Fn;
+    const char *const Name;
+};
+
+// Picks the implementation once, the function-local static makes it safe when threads race here
+const Crc32cImplementation &SelectCrc32c()
+{
+    static const Crc32cImplementation s_Selected = []() -> Crc32cImplementation {
+#if HASH_X86
+        if (CpuHasSSE42())
+            return {Crc32cSSE42, "SSE4.2"};
+#elif HASH_ARM_CRC
+        return {Crc32cARM, "ARMv8 CRC"};
+#endif
+        return {Crc32cSoftware, "software"};
+    }();
+    return s_Selected;
+}
+
+uint32_t Crc32cResolve(uint32_t Crc, const uint32_t *Begin, const uint32_t *End)
+{
+    Crc32cFn fn = SelectCrc32c().Fn;
+    s_Crc32c.store(fn, std::memory_order_relaxed);
+    return fn(Crc, Begin, End);
+}
+} // namespace
+
+uint32_t Utility::Crc32c(uint32_t Crc, const uint32_t *Begin, const uint32_t *End)
+{
+    return s_Crc32c.load(std::memory_order_relaxed)(Crc, Begin, End);
+}
+
+const char *Utility::GetHashImplementation()
+{
+    return SelectCrc32c().Name;
+}
+
+void Utility::AdvanceHashMapEpoch() { s_HashMapEpoch.fetch_add(1, std::memory_order_relaxed); }
+
+uint64_t Utility::GetHashMapEpoch() { return s_HashMapEpoch.load(std::memory_order_relaxed); }
@@ -12,55 +12,41 @@
 
 #pragma once
 
-#include "Math/Common.h"
-
-// This requires SSE4.2 which is present on Intel Nehalem (Nov. 2008)
-// and AMD Bulldozer (Oct. 2011) processors.  I could put a runtime
-// check for this, but I'm just going to assume people playing with
-// DirectX 12 on Windows 10 have fairly recent machines.
-#ifdef _M_X64
-#define ENABLE_SSE_CRC32 1
-#else
-#define ENABLE_SSE_CRC32 0
-#endif
-
-#if ENABLE_SSE_CRC32
-#pragma intrinsic(_mm_crc32_u32)
-#pragma intrinsic(_mm_crc32_u64)
-#endif
+#include <cstddef>
+#include <cstdint>
 
 namespace Utility
 {
-inline size_t HashRange(const uint32_t* const Begin, const uint32_t* const End, size_t Hash)
+// CRC32C (Castagnoli) over a range of words. The implementation is picked once at runtime: SSE4.2
+// on x86 CPUs that report it, the ARMv8 CRC instructions when the compiler targets them, and a
+// table driven loop otherwise. All paths produce the same value, so hashes don't depend on the CPU.
+uint32_t Crc32c(uint32_t Crc, const uint32_t *Begin, const uint32_t *End);
+
+// Name of the CRC32C implementation chosen for this CPU, for logging
+const char *GetHashImplementation();
+
+inline size_t HashRange(const uint32_t *const Begin, const uint32_t *const End, size_t Hash)
 {
-#if ENABLE_SSE_CRC32
-    const uint64_t* Iter64 = (const uint64_t*)Math::AlignUp(Begin, 8);
-    const uint64_t* const End64 = (const uint64_t* const)Math::AlignDown(End, 8);
-    
-    // If not 64-bit aligned, start with a single u32
-    if ((uint32_t*)Iter64 > Begin)
-        Hash = _mm_crc32_u32((uint32_t)Hash, *Begin);
-    
-    // Iterate over consecutive u64 values
-    while (Iter64 < End64)
-        Hash = _mm_crc32_u64((uint64_t)Hash, *Iter64++);
-    
-    // If there is a 32-bit remainder, accumulate that
-    if ((uint32_t*)Iter64 < End)
-        Hash = _mm_crc32_u32((uint32_t)Hash, *(uint32_t*)Iter64);
-#else
-    // An inexpensive hash for CPUs lacking SSE4.2
-    for (const uint32_t* Iter = Begin; Iter < End; ++Iter)
-        Hash = 16777619U * Hash ^ *Iter;
-#endif
-    
-    return Hash;
+    return Crc32c((uint32_t)Hash, Begin, End);
 }
 
-template <typename T> inline size_t HashState( const T* StateDesc, size_t Count = 1, size_t Hash = 2166136261U )
+template <typename T> inline size_t HashState(const T *StateDesc, size_t Count = 1, size_t Hash = 2166136261U)
 {
     static_assert((sizeof(T) & 3) == 0 && alignof(T) >= 4, "State object is not word-aligned");
-    return HashRange((uint32_t*)StateDesc, (uint32_t*)(StateDesc + Count), Hash);
+    return HashRange((uint32_t *)StateDesc, (uint32_t *)(StateDesc + Count), Hash);
+}
+
+// Spreads the bits of a key that is already a hash (or a pointer) so that both the low and the
+// high bits can be used to pick a bucket.
+inline size_t MixHash(size_t Key)
+{
+    uint64_t x = (uint64_t)Key;
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return (size_t)x;
 }
 
 } // namespace Utility
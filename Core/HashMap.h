@@ -0,0 +1,249 @@
+#pragma once
+
+#include "Hash.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Utility
+{
+// Called once per frame (Graphics::EndFrame). Tables retired by a ShardedHashMap are freed once the
+// epoch has moved on by two.
+void AdvanceHashMapEpoch();
+uint64_t GetHashMapEpoch();
+
+// Open addressing hash map for the object caches (pipelines, samplers, render passes, ...), where
+// entries are created once and then looked up every frame from any thread.
+//
+// Find never takes a lock. A slot's key and value are written before the slot is published and are
+// never modified afterwards: erased slots are only marked dead, and growing the table publishes a
+// new copy. The old copy is retired and freed by a later writer once two frame boundaries have
+// passed (see AdvanceHashMapEpoch), so a Find must not stay in flight for a whole frame. Writers
+// serialize on a per-shard mutex.
+//
+// Insert never overwrites: if another thread got there first, the existing value is returned and
+// the caller is expected to destroy the object it created.
+//
+// ForEach and Clear are meant for shutdown and must not run concurrently with Find.
+template <typename Key, typename Value, size_t ShardCount = 16>
+class ShardedHashMap
+{
+    static_assert((ShardCount & (ShardCount - 1)) == 0, "Shard count must be a power of two");
+
+public:
+    ShardedHashMap() = default;
+    ShardedHashMap(const ShardedHashMap &) = delete;
+    ShardedHashMap &operator=(const ShardedHashMap &) = delete;
+
+    bool Find(const Key &key, Value &value) const
+    {
+        size_t hash = HashKey(key);
+        const Shard &shard = m_Shards[hash & (ShardCount - 1)];
+
+        const Slot *slot = Lookup(shard.table.load(std::memory_order_acquire), key, hash);
+        if (slot == nullptr)
+            return false;
+        value = slot->value;
+        return true;
+    }
+
+    // Returns the value stored in the map, which is not 'value' if the key was already present
+    Value Insert(const Key &key, const Value &value)
+    {
+        size_t hash = HashKey(key);
+        Shard &shard = m_Shards[hash & (ShardCount - 1)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.ReleaseRetired();
+
+        const Slot *slot = Lookup(shard.table.load(std::memory_order_relaxed), key, hash);
+        if (slot != nullptr)
+            return slot->value;
+
+        // Keep live and dead slots under half of the table so probe sequences stay short
+        Table *table = shard.table.load(std::memory_order_relaxed);
+        if (table == nullptr || (table->occupied + 1) * 2 > table->size)
+            table = shard.Rebuild(table == nullptr ? 16 : table->size * 2);
+
+        Slot &newSlot = table->slots[FreeSlot(table, hash)];
+        newSlot.key = key;
+        newSlot.value = value;
+        newSlot.state.store(kUsed, std::memory_order_release);
+        ++table->occupied;
+        return value;
+    }
+
+    // Removes every entry for which pred(key, value) returns true. Readers may still see a removed
+    // value until they reload the slot, so the value itself must stay valid to read.
+    template <typename Pred>
+    void EraseIf(Pred &&pred)
+    {
+        for (Shard &shard : m_Shards)
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.ReleaseRetired();
+            Table *table = shard.table.load(std::memory_order_relaxed);
+            if (table == nullptr)
+                continue;
+
+            for (size_t i = 0; i < table->size; ++i)
+            {
+                Slot &slot = table->slots[i];
+                if (slot.state.load(std::memory_order_relaxed) == kUsed && pred(slot.key, (const Value &)slot.value))
+                    slot.state.store(kErased, std::memory_order_release);
+            }
+        }
+    }
+
+    template <typename Func>
+    void ForEach(Func &&func)
+    {
+        for (Shard &shard : m_Shards)
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            Table *table = shard.table.load(std::memory_order_relaxed);
+            if (table == nullptr)
+                continue;
+
+            for (size_t i = 0; i < table->size; ++i)
+            {
+                Slot &slot = table->slots[i];
+                if (slot.state.load(std::memory_order_relaxed) == kUsed)
+                    func(slot.key, slot.value);
+            }
+        }
+    }
+
+    void Clear()
+    {
+        for (Shard &shard : m_Shards)
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.table.store(nullptr, std::memory_order_relaxed);
+            shard.current.reset();
+            shard.retired.clear();
+        }
+    }
+
+    // Tables replaced by a grow that are not freed yet
+    size_t GetRetiredTableCount()
+    {
+        size_t count = 0;
+        for (Shard &shard : m_Shards)
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            count += shard.retired.size();
+        }
+        return count;
+    }
+
+private:
+    enum : uint8_t
+    {
+        kEmpty,
+        kUsed,
+        kErased
+    };
+
+    struct Slot
+    {
+        std::atomic<uint8_t> state{kEmpty};
+        Key key{};
+        Value value{};
+    };
+
+    struct Table
+    {
+        explicit Table(size_t count) : slots(new Slot[count]), size(count) {}
+
+        std::unique_ptr<Slot[]> slots;
+        size_t size;
+        size_t occupied = 0; // Live and erased slots, only touched under the shard mutex
+    };
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::atomic<Table *> table{nullptr};
+        std::unique_ptr<Table> current;
+        // Replaced tables with the epoch they were replaced in. A concurrent Find may still read them.
+        std::vector<std::pair<uint64_t, std::unique_ptr<Table>>> retired;
+
+        void ReleaseRetired()
+        {
+            uint64_t epoch = GetHashMapEpoch();
+            retired.erase(std::remove_if(retired.begin(), retired.end(),
+                                         [epoch](const auto &entry) { return entry.first + 2 <= epoch; }),
+                          retired.end());
+        }
+
+        Table *Rebuild(size_t size)
+        {
+            Table *old = table.load(std::memory_order_relaxed);
+
+            // Erased slots are dropped here, so a table full of them does not need to grow
+            size_t live = 0;
+            for (size_t i = 0; old != nullptr && i < old->size; ++i)
+                live += old->slots[i].state.load(std::memory_order_relaxed) == kUsed;
+            while (size > 16 && (live + 1) * 4 <= size)
+                size /= 2;
+
+            std::unique_ptr<Table> fresh(new Table(size));
+            for (size_t i = 0; old != nullptr && i < old->size; ++i)
+            {
+                const Slot &from = old->slots[i];
+                if (from.state.load(std::memory_order_relaxed) != kUsed)
+                    continue;
+
+                Slot &to = fresh->slots[FreeSlot(fresh.get(), HashKey(from.key))];
+                to.key = from.key;
+                to.value = from.value;
+                to.state.store(kUsed, std::memory_order_relaxed);
+                ++fresh->occupied;
+            }
+
+            Table *result = fresh.get();
+            table.store(result, std::memory_order_release);
+            if (current)
+                retired.emplace_back(GetHashMapEpoch(), std::move(current));
+            current = std::move(fresh);
+            return result;
+        }
+    };
+
+    static const Slot *Lookup(const Table *table, const Key &key, size_t hash)
+    {
+        if (table == nullptr)
+            return nullptr;
+
+        size_t mask = table->size - 1;
+        for (size_t i = SlotIndex(hash) & mask;; i = (i + 1) & mask)
+        {
+            const Slot &slot = table->slots[i];
+            uint8_t state = slot.state.load(std::memory_order_acquire);
+            if (state == kEmpty)
+                return nullptr;
+            if (state == kUsed && slot.key == key)
+                return &slot;
+        }
+    }
+
+    static size_t FreeSlot(const Table *table, size_t hash)
+    {
+        size_t mask = table->size - 1;
+        size_t i = SlotIndex(hash) & mask;
+        while (table->slots[i].state.load(std::memory_order_relaxed) != kEmpty)
+            i = (i + 1) & mask;
+        return i;
+    }
+
+    // The low bits select the shard, so buckets inside a shard are taken from the high bits
+    static size_t SlotIndex(size_t hash) { return hash >> 16; }
+    static size_t HashKey(const Key &key) { return MixHash(std::hash<Key>()(key)); }
+
+    Shard m_Shards[ShardCount];
+};
+
+} // namespace Utility
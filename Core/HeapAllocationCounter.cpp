@@ -0,0 +1,86 @@
+// Replaces the global operator new and delete to count heap allocations for FrameStats. It is left out of
+// the Core library so that linking Core doesn't replace the allocator of the whole program; executables
+// that want the "Heap Allocations" counter compile this file in themselves (see ModelViewer and Tests).
+#include "FrameStats.h"
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+void *AlignedAlloc(size_t Size, size_t Alignment)
+{
+#ifdef _MSC_VER
+    return _aligned_malloc(Size, Alignment);
+#else
+    // aligned_alloc wants a multiple of the alignment
+    return aligned_alloc(Alignment, (Size + Alignment - 1) & ~(Alignment - 1));
+#endif
+}
+
+void AlignedFree(void *Ptr)
+{
+#ifdef _MSC_VER
+    _aligned_free(Ptr);
+#else
+    free(Ptr);
+#endif
+}
+} // namespace
+
+// Every heap allocation of the executable goes through here to be counted. The nothrow and aligned forms are
+// replaced too, since the standard library's would otherwise allocate behind the counter's back, and
+// aligned blocks have to be freed by the aligned deletes on MSVC.
+void *operator new(size_t Size)
+{
+    g_HeapAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    void *ptr = malloc(Size != 0 ? Size : 1);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void *operator new[](size_t Size) { return operator new(Size); }
+
+void *operator new(size_t Size, const std::nothrow_t &) noexcept
+{
+    g_HeapAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    return malloc(Size != 0 ? Size : 1);
+}
+
+void *operator new[](size_t Size, const std::nothrow_t &Tag) noexcept { return operator new(Size, Tag); }
+
+void *operator new(size_t Size, std::align_val_t Alignment)
+{
+    g_HeapAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    void *ptr = AlignedAlloc(Size != 0 ? Size : 1, (size_t)Alignment);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void *operator new[](size_t Size, std::align_val_t Alignment) { return operator new(Size, Alignment); }
+
+void *operator new(size_t Size, std::align_val_t Alignment, const std::nothrow_t &) noexcept
+{
+    g_HeapAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    return AlignedAlloc(Size != 0 ? Size : 1, (size_t)Alignment);
+}
+
+void *operator new[](size_t Size, std::align_val_t Alignment, const std::nothrow_t &Tag) noexcept
+{
+    return operator new(Size, Alignment, Tag);
+}
+
+void operator delete(void *Ptr) noexcept { free(Ptr); }
+void operator delete[](void *Ptr) noexcept { free(Ptr); }
+void operator delete(void *Ptr, size_t) noexcept { free(Ptr); }
+void operator delete[](void *Ptr, size_t) noexcept { free(Ptr); }
+void operator delete(void *Ptr, const std::nothrow_t &) noexcept { free(Ptr); }
+void operator delete[](void *Ptr, const std::nothrow_t &) noexcept { free(Ptr); }
+
+void operator delete(void *Ptr, std::align_val_t) noexcept { AlignedFree(Ptr); }
+void operator delete[](void *Ptr, std::align_val_t) noexcept { AlignedFree(Ptr); }
+void operator delete(void *Ptr, size_t, std::align_val_t) noexcept { AlignedFree(Ptr); }
+void operator delete[](void *Ptr, size_t, std::align_val_t) noexcept { AlignedFree(Ptr); }
+void operator delete(void *Ptr, std::align_val_t, const std::nothrow_t &) noexcept { AlignedFree(Ptr); }
+void operator delete[](void *Ptr, std::align_val_t, const std::nothrow_t &) noexcept { AlignedFree(Ptr); }
@@ -3,6 +3,7 @@
 #include "GraphicsCore.h"
 #include "Swapchain.h"
 #include "CommandContext.h"
+#include "MemoryTracker.h"
 
 using namespace Graphics;
 
@@ -15,6 +16,7 @@ void ImageView::Destroy()
     }
     if (m_Allocation)
     {
+        MemoryTracker::Untrack(m_Allocation);
         g_Allocator.destroyImage(m_Image, m_Allocation);
         m_Image = nullptr;
         m_Allocation = nullptr;
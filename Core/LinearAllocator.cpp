@@ -1,16 +1,33 @@
 #include "LinearAllocator.h"
 #include "GraphicsCore.h"
+#include "MemoryTracker.h"
 
 using namespace Graphics;
 
+// The GPU exclusive pages live in device local memory the CPU never maps, for data that compute shaders
+// write and later commands read
+static vma::MemoryUsage GetMemoryUsage(LinearAllocatorType Type)
+{
+    return Type == kGpuExclusive ? vma::MemoryUsage::eGpuOnly : vma::MemoryUsage::eCpuToGpu;
+}
+
 LinearAllocator::LinearAllocator(LinearAllocatorType Type) : m_Type(Type)
 {
     vk::BufferCreateInfo bufferInfo;
     bufferInfo.size = 1024;
-    bufferInfo.usage = vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eIndexBuffer |
-                       vk::BufferUsageFlagBits::eUniformBuffer;
+    if (m_Type == kGpuExclusive)
+    {
+        bufferInfo.usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer |
+                           vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eIndexBuffer |
+                           vk::BufferUsageFlagBits::eTransferDst;
+    }
+    else
+    {
+        bufferInfo.usage = vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eIndexBuffer |
+                           vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eTransferSrc;
+    }
     vma::AllocationCreateInfo allocInfo;
-    allocInfo.usage = vma::MemoryUsage::eCpuToGpu;
+    allocInfo.usage = GetMemoryUsage(m_Type);
     uint32_t index = g_Allocator.findMemoryTypeIndexForBufferInfo(bufferInfo, allocInfo);
 
     vma::PoolCreateInfo poolInfo;
@@ -25,12 +42,16 @@ LinearAllocator::~LinearAllocator() { g_Allocator.destroyPool(m_Pool); }
 vma::AllocationInfo LinearAllocator::AllocAndBind(vk::Buffer &Buffer)
 {
     vma::AllocationCreateInfo createInfo;
-    createInfo.usage = vma::MemoryUsage::eCpuToGpu;
+    createInfo.usage = GetMemoryUsage(m_Type);
     createInfo.pool = m_Pool;
-    createInfo.flags = vma::AllocationCreateFlagBits::eMapped;
+    if (m_Type == kCpuWritable)
+    {
+        createInfo.flags = vma::AllocationCreateFlagBits::eMapped;
+    }
 
     vma::Allocation allocation = g_Allocator.allocateMemoryForBuffer(Buffer, createInfo);
     g_Allocator.bindBufferMemory(allocation, Buffer);
+    MemoryTracker::Track(allocation, MemoryTracker::kDynamic);
     m_Allocations.push_back(allocation);
     m_DynamicBuffers.push_back(Buffer);
 
@@ -48,6 +69,7 @@ void LinearAllocator::Cleanup()
 
     for (auto &a : m_Allocations)
     {
+        MemoryTracker::Untrack(a);
         g_Allocator.freeMemory(a);
     }
     m_Allocations.clear();
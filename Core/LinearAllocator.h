@@ -17,8 +17,8 @@ enum LinearAllocatorType
 
 enum
 {
-    kGpuAllocatorPageSize = 0x10000, // 64K
-    kCpuAllocatorPageSize = 0x200000 // 2MB
+    kGpuAllocatorPageSize = 0x200000, // 2MB, room for the indirect arguments of a frame's cluster culling
+    kCpuAllocatorPageSize = 0x200000  // 2MB
 };
 
 class LinearAllocator
@@ -27,6 +27,7 @@ public:
     LinearAllocator(LinearAllocatorType Type);
     ~LinearAllocator();
 
+    // The returned pMappedData is null for kGpuExclusive
     vma::AllocationInfo AllocAndBind(vk::Buffer &Buffer);
     void Cleanup();
 
@@ -0,0 +1,151 @@
+#include "MemoryTracker.h"
+#include "EngineTuning.h"
+#include "GraphicsCore.h"
+#include "TextRenderer.h"
+#include "Utility.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+
+using namespace Graphics;
+
+namespace
+{
+const char *s_CategoryNames[MemoryTracker::kNumCategories] = {"Geometry", "Textures", "Render Targets",
+                                                              "Dynamic",  "Staging",  "Other"};
+
+std::atomic<uint64_t> s_CategoryBytes[MemoryTracker::kNumCategories];
+std::atomic<uint32_t> s_CategoryAllocations[MemoryTracker::kNumCategories];
+
+vk::PhysicalDeviceMemoryProperties s_MemoryProperties;
+
+BoolVar DisplayMemory("Profiling/Display Memory", false);
+CallbackTrigger DumpMemoryStats(
+    "Profiling/Dump Memory Stats", [](void *) { MemoryTracker::WriteReport("memory.json"); }, nullptr);
+
+double ToMB(uint64_t Bytes) { return Bytes / 1048576.0; }
+} // namespace
+
+void MemoryTracker::Initialize(void) { s_MemoryProperties = g_PhysicalDevice.getMemoryProperties(); }
+
+void MemoryTracker::Track(vma::Allocation Allocation, Category Cat)
+{
+    ASSERT(Cat < kNumCategories);
+
+    // Stored off by one so untagged allocations read back as null
+    g_Allocator.setAllocationUserData(Allocation, (void *)(uintptr_t)(Cat + 1));
+
+    vma::AllocationInfo info = g_Allocator.getAllocationInfo(Allocation);
+    s_CategoryBytes[Cat].fetch_add(info.size, std::memory_order_relaxed);
+    s_CategoryAllocations[Cat].fetch_add(1, std::memory_order_relaxed);
+}
+
+void MemoryTracker::Untrack(vma::Allocation Allocation)
+{
+    vma::AllocationInfo info = g_Allocator.getAllocationInfo(Allocation);
+    uintptr_t tag = (uintptr_t)info.pUserData;
+    if (tag == 0)
+        return;
+
+    uint32_t cat = (uint32_t)tag - 1;
+    s_CategoryBytes[cat].fetch_sub(info.size, std::memory_order_relaxed);
+    s_CategoryAllocations[cat].fetch_sub(1, std::memory_order_relaxed);
+    g_Allocator.setAllocationUserData(Allocation, nullptr);
+}
+
+const char *MemoryTracker::GetCategoryName(Category Cat) { return s_CategoryNames[Cat]; }
+
+MemoryTracker::CategoryStats MemoryTracker::GetCategoryStats(Category Cat)
+{
+    CategoryStats stats;
+    stats.Bytes = s_CategoryBytes[Cat].load(std::memory_order_relaxed);
+    stats.Allocations = s_CategoryAllocations[Cat].load(std::memory_order_relaxed);
+    return stats;
+}
+
+uint32_t MemoryTracker::GetHeapStats(HeapStats *Heaps, uint32_t MaxHeaps)
+{
+    vma::Budget budgets[VK_MAX_MEMORY_HEAPS];
+    g_Allocator.getHeapBudgets(budgets);
+
+    uint32_t count = std::min(s_MemoryProperties.memoryHeapCount, MaxHeaps);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const vk::MemoryHeap &heap = s_MemoryProperties.memoryHeaps[i];
+        HeapStats &stats = Heaps[i];
+        stats.DeviceLocal = (bool)(heap.flags & vk::MemoryHeapFlagBits::eDeviceLocal);
+        stats.Size = heap.size;
+        stats.Budget = budgets[i].budget;
+        stats.Usage = budgets[i].usage;
+        stats.BlockBytes = budgets[i].statistics.blockBytes;
+        stats.AllocationBytes = budgets[i].statistics.allocationBytes;
+        stats.Allocations = budgets[i].statistics.allocationCount;
+    }
+    return count;
+}
+
+void MemoryTracker::Display(TextContext &Text)
+{
+    if (!DisplayMemory)
+        return;
+
+    HeapStats heaps[VK_MAX_MEMORY_HEAPS];
+    uint32_t numHeaps = GetHeapStats(heaps, VK_MAX_MEMORY_HEAPS);
+
+    float x = Text.GetCursorX();
+    for (uint32_t i = 0; i < numHeaps; ++i)
+    {
+        const HeapStats &heap = heaps[i];
+        Text.SetColor(heap.Usage > heap.Budget ? Color(1.0f, 0.25f, 0.25f) : Color(1.0f, 1.0f, 1.0f));
+        Text.DrawFormattedString("Heap %u (%s)", i, heap.DeviceLocal ? "device" : "host");
+        Text.SetCursorX(x + 300.0f);
+        Text.DrawFormattedString("%8.1f / %8.1f MB, VMA %8.1f MB in %u allocations\n", ToMB(heap.Usage),
+                                 ToMB(heap.Budget), ToMB(heap.BlockBytes), heap.Allocations);
+    }
+    Text.SetColor(Color(1.0f, 1.0f, 1.0f));
+
+    for (uint32_t i = 0; i < kNumCategories; ++i)
+    {
+        CategoryStats stats = GetCategoryStats((Category)i);
+        Text.DrawString(s_CategoryNames[i]);
+        Text.SetCursorX(x + 300.0f);
+        Text.DrawFormattedString("%8.1f MB in %u allocations\n", ToMB(stats.Bytes), stats.Allocations);
+    }
+}
+
+void MemoryTracker::WriteReport(const std::string &FileName)
+{
+    FILE *file = fopen(FileName.c_str(), "w");
+    if (file == nullptr)
+    {
+        Utility::Printf("Can't write memory stats to %s\n", FileName.c_str());
+        return;
+    }
+
+    HeapStats heaps[VK_MAX_MEMORY_HEAPS];
+    uint32_t numHeaps = GetHeapStats(heaps, VK_MAX_MEMORY_HEAPS);
+
+    // Sizes are in bytes
+    fprintf(file, "{\n  \"heaps\": [");
+    for (uint32_t i = 0; i < numHeaps; ++i)
+    {
+        const HeapStats &heap = heaps[i];
+        fprintf(file,
+                "%s\n    {\"index\": %u, \"deviceLocal\": %s, \"size\": %llu, \"budget\": %llu, \"usage\": %llu, "
+                "\"blockBytes\": %llu, \"allocationBytes\": %llu, \"allocations\": %u}",
+                i == 0 ? "" : ",", i, heap.DeviceLocal ? "true" : "false", (unsigned long long)heap.Size,
+                (unsigned long long)heap.Budget, (unsigned long long)heap.Usage, (unsigned long long)heap.BlockBytes,
+                (unsigned long long)heap.AllocationBytes, heap.Allocations);
+    }
+    fprintf(file, "\n  ],\n  \"categories\": {");
+    for (uint32_t i = 0; i < kNumCategories; ++i)
+    {
+        CategoryStats stats = GetCategoryStats((Category)i);
+        fprintf(file, "%s\n    \"%s\": {\"bytes\": %llu, \"allocations\": %u}", i == 0 ? "" : ",",
+                s_CategoryNames[i], (unsigned long long)stats.Bytes, stats.Allocations);
+    }
+    fprintf(file, "\n  }\n}\n");
+    fclose(file);
+
+    Utility::Printf("Memory stats written to %s\n", FileName.c_str());
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vulkan-memory-allocator-hpp/vk_mem_alloc.hpp>
+
+class TextContext;
+
+// Device memory per heap as VMA sees it, and what the engine's own allocations add up to per category.
+// With VK_EXT_memory_budget the budget and usage come from the driver and include other processes,
+// otherwise VMA estimates them from its own blocks.
+//
+// The category is kept in the allocation's user data, so Untrack only needs the allocation:
+//
+//     std::tie(m_Image, m_Allocation) = g_Allocator.createImage(imageInfo, allocInfo);
+//     MemoryTracker::Track(m_Allocation, MemoryTracker::kTextures);
+//     ...
+//     MemoryTracker::Untrack(m_Allocation);
+//     g_Allocator.destroyImage(m_Image, m_Allocation);
+namespace MemoryTracker
+{
+enum Category
+{
+    kGeometry,
+    kTextures,
+    kRenderTargets,
+    kDynamic,
+    kStaging,
+    kOther,
+    kNumCategories
+};
+
+struct HeapStats
+{
+    bool DeviceLocal;
+    uint64_t Size;            // Size of the heap
+    uint64_t Budget;          // How much this process can use before allocations start failing or evicting
+    uint64_t Usage;           // What this process uses, including memory VMA didn't allocate
+    uint64_t BlockBytes;      // Device memory VMA holds
+    uint64_t AllocationBytes; // The part of it handed out
+    uint32_t Allocations;
+};
+
+struct CategoryStats
+{
+    uint64_t Bytes;
+    uint32_t Allocations;
+};
+
+void Initialize(void);
+
+void Track(vma::Allocation Allocation, Category Cat);
+void Untrack(vma::Allocation Allocation);
+
+const char *GetCategoryName(Category Cat);
+CategoryStats GetCategoryStats(Category Cat);
+
+// One entry per memory heap of the device
+uint32_t GetHeapStats(HeapStats *Heaps, uint32_t MaxHeaps);
+
+// "Profiling/Display Memory" shows the heaps and categories in the overlay
+void Display(TextContext &Text);
+
+// Heaps and categories as JSON, "Profiling/Dump Memory Stats" writes memory.json
+void WriteReport(const std::string &FileName);
+} // namespace MemoryTracker
@@ -2,32 +2,47 @@
 #include "Display.h"
 #include "GraphicsCore.h"
 #include "Hash.h"
+#include "HashMap.h"
 #include "Utility.h"
-#include <map>
 
-static std::map<const unsigned int *, vk::ShaderModule> s_ShaderMap;
-static std::map<size_t, vk::Pipeline> s_GraphicsPSOHashMap;
-static std::map<size_t, vk::Pipeline> s_ComputePSOHashMap;
+static Utility::ShardedHashMap<const unsigned int *, vk::ShaderModule> s_ShaderMap;
+static Utility::ShardedHashMap<size_t, vk::Pipeline> s_GraphicsPSOHashMap;
+static Utility::ShardedHashMap<size_t, vk::Pipeline> s_ComputePSOHashMap;
 
-void PSO::DestroyAll()
+static vk::ShaderModule GetShaderModule(const std::pair<const unsigned int *, size_t> &source)
 {
-    for (auto &i : s_GraphicsPSOHashMap)
+    vk::ShaderModule module;
+    if (s_ShaderMap.Find(source.first, module))
     {
-        Graphics::g_Device.destroyPipeline(i.second);
+        return module;
     }
-    s_GraphicsPSOHashMap.clear();
 
-    for (auto &i : s_ComputePSOHashMap)
-    {
-        Graphics::g_Device.destroyPipeline(i.second);
-    }
-    s_ComputePSOHashMap.clear();
+    vk::ShaderModuleCreateInfo moduleInfo;
+    moduleInfo.pCode = source.first;
+    moduleInfo.codeSize = source.second;
+    vk::ShaderModule newModule = Graphics::g_Device.createShaderModule(moduleInfo);
 
-    for (auto &i : s_ShaderMap)
+    // Another thread may have created the same module in the meantime
+    module = s_ShaderMap.Insert(source.first, newModule);
+    if (module != newModule)
     {
-        Graphics::g_Device.destroyShaderModule(i.second);
+        Graphics::g_Device.destroyShaderModule(newModule);
     }
-    s_ShaderMap.clear();
+    return module;
+}
+
+void PSO::DestroyAll()
+{
+    s_GraphicsPSOHashMap.ForEach([](size_t, vk::Pipeline pso) { Graphics::g_Device.destroyPipeline(pso); });
+    s_GraphicsPSOHashMap.Clear();
+
+    s_ComputePSOHashMap.ForEach([](size_t, vk::Pipeline pso) { Graphics::g_Device.destroyPipeline(pso); });
+    s_ComputePSOHashMap.Clear();
+
+    s_ShaderMap.ForEach([](const unsigned int *, vk::ShaderModule module) {
+        Graphics::g_Device.destroyShaderModule(module);
+    });
+    s_ShaderMap.Clear();
 }
 
 void PSO::SetPipelineLayout(const vk::PipelineLayout &layout) { m_Layout = layout; }
@@ -83,7 +98,12 @@ void GraphicsPSO::SetBlendState(const ColorBlendState &blend)
 
 void GraphicsPSO::SetRenderPassFormat(const vk::ArrayProxy<vk::Format> &colors, vk::Format depth)
 {
-    m_RenderPass = RenderPass::GetRenderPass(colors, depth);
+    m_ColorFormats.assign(colors.begin(), colors.end());
+    m_DepthFormat = depth;
+    if (!Graphics::g_bDynamicRendering)
+    {
+        m_RenderPass = RenderPass::GetRenderPass(colors, depth);
+    }
 }
 
 void GraphicsPSO::SetPrimitiveTopologyType(vk::PrimitiveTopology topology)
@@ -99,21 +119,7 @@ void GraphicsPSO::Finalize()
     std::vector<vk::PipelineShaderStageCreateInfo> shaderStageInfos;
     if (m_VertShaderSource.first && m_VertShaderSource.second > 0)
     {
-        // find existed shader
-        auto iter = s_ShaderMap.find(m_VertShaderSource.first);
-        if (iter != s_ShaderMap.end())
-        {
-            m_VertShader = iter->second;
-        }
-        else
-        {
-            // create a new one. remember to add to shader map
-            vk::ShaderModuleCreateInfo moduleInfo;
-            moduleInfo.pCode = m_VertShaderSource.first;
-            moduleInfo.codeSize = m_VertShaderSource.second;
-            m_VertShader = Graphics::g_Device.createShaderModule(moduleInfo);
-            s_ShaderMap[m_VertShaderSource.first] = m_VertShader;
-        }
+        m_VertShader = GetShaderModule(m_VertShaderSource);
 
         vk::PipelineShaderStageCreateInfo stageInfo;
         stageInfo.setStage(vk::ShaderStageFlagBits::eVertex);
@@ -125,21 +131,7 @@ void GraphicsPSO::Finalize()
     }
     if (m_GeomShaderSource.first && m_GeomShaderSource.second > 0)
     {
-        // find existed shader
-        auto iter = s_ShaderMap.find(m_GeomShaderSource.first);
-        if (iter != s_ShaderMap.end())
-        {
-            m_GeomShader = iter->second;
-        }
-        else
-        {
-            // create a new one. remember to add to shader map
-            vk::ShaderModuleCreateInfo moduleInfo;
-            moduleInfo.pCode = m_GeomShaderSource.first;
-            moduleInfo.codeSize = m_GeomShaderSource.second;
-            m_GeomShader = Graphics::g_Device.createShaderModule(moduleInfo);
-            s_ShaderMap[m_GeomShaderSource.first] = m_GeomShader;
-        }
+        m_GeomShader = GetShaderModule(m_GeomShaderSource);
 
         vk::PipelineShaderStageCreateInfo stageInfo;
         stageInfo.setStage(vk::ShaderStageFlagBits::eGeometry);
@@ -151,20 +143,7 @@ void GraphicsPSO::Finalize()
     }
     if (m_FragShaderSource.first && m_FragShaderSource.second > 0)
     {
-        // find existed shader
-        auto iter = s_ShaderMap.find(m_FragShaderSource.first);
-        if (iter != s_ShaderMap.end())
-        {
-            m_FragShader = iter->second;
-        }
-        else
-        {
-            vk::ShaderModuleCreateInfo moduleInfo;
-            moduleInfo.pCode = m_FragShaderSource.first;
-            moduleInfo.codeSize = m_FragShaderSource.second;
-            m_FragShader = Graphics::g_Device.createShaderModule(moduleInfo);
-            s_ShaderMap[m_FragShaderSource.first] = m_FragShader;
-        }
+        m_FragShader = GetShaderModule(m_FragShaderSource);
         vk::PipelineShaderStageCreateInfo stageInfo;
         stageInfo.setStage(vk::ShaderStageFlagBits::eFragment);
         stageInfo.setModule(m_FragShader);
@@ -232,6 +211,19 @@ void GraphicsPSO::Finalize()
     psoInfo.setRenderPass(m_RenderPass);
     psoInfo.setSubpass(0);
 
+    // With dynamic rendering the pipeline is built against the attachment formats instead
+    vk::PipelineRenderingCreateInfo renderingInfo;
+    if (Graphics::g_bDynamicRendering)
+    {
+        renderingInfo.setColorAttachmentFormats(m_ColorFormats);
+        renderingInfo.setDepthAttachmentFormat(m_DepthFormat);
+        if (RenderPass::HasStencil(m_DepthFormat))
+        {
+            renderingInfo.setStencilAttachmentFormat(m_DepthFormat);
+        }
+        psoInfo.setPNext(&renderingInfo);
+    }
+
     hash = Utility::HashState(&m_AssemblyInfo, 1, hash);
     hash = Utility::HashState(&m_RasterizerState, 1, hash);
     hash = Utility::HashState(&m_BlendState, 1, hash);
@@ -240,17 +232,21 @@ void GraphicsPSO::Finalize()
     hash = Utility::HashState(&layout, 1, hash);
     VkRenderPass rp = VkRenderPass(m_RenderPass);
     hash = Utility::HashState(&rp, 1, hash);
+    hash = Utility::HashState(m_ColorFormats.data(), m_ColorFormats.size(), hash);
+    hash = Utility::HashState(&m_DepthFormat, 1, hash);
 
-    auto iter = s_GraphicsPSOHashMap.find(hash);
-    if (iter != s_GraphicsPSOHashMap.end())
+    if (s_GraphicsPSOHashMap.Find(hash, m_PSO))
     {
-        m_PSO = iter->second;
         return;
     }
 
-    m_PSO = Graphics::g_Device.createGraphicsPipeline(nullptr, psoInfo).value;
+    vk::Pipeline pso = Graphics::g_Device.createGraphicsPipeline(nullptr, psoInfo).value;
 
-    s_GraphicsPSOHashMap[hash] = m_PSO;
+    m_PSO = s_GraphicsPSOHashMap.Insert(hash, pso);
+    if (m_PSO != pso)
+    {
+        Graphics::g_Device.destroyPipeline(pso);
+    }
 }
 
 // void GraphicsPSO::Destroy()
@@ -286,21 +282,7 @@ void ComputePSO::Finalize()
     vk::PipelineShaderStageCreateInfo stageInfo;
     if (m_CompShaderSource.first && m_CompShaderSource.second > 0)
     {
-        // find existed shader
-        auto iter = s_ShaderMap.find(m_CompShaderSource.first);
-        if (iter != s_ShaderMap.end())
-        {
-            m_CompShader = iter->second;
-        }
-        else
-        {
-            // create a new one. remember to add to shader map
-            vk::ShaderModuleCreateInfo moduleInfo;
-            moduleInfo.pCode = m_CompShaderSource.first;
-            moduleInfo.codeSize = m_CompShaderSource.second;
-            m_CompShader = Graphics::g_Device.createShaderModule(moduleInfo);
-            s_ShaderMap[m_CompShaderSource.first] = m_CompShader;
-        }
+        m_CompShader = GetShaderModule(m_CompShaderSource);
 
         stageInfo.setStage(vk::ShaderStageFlagBits::eCompute);
         stageInfo.setModule(m_CompShader);
@@ -314,17 +296,19 @@ void ComputePSO::Finalize()
     VkPipelineLayout layout = VkPipelineLayout(m_Layout);
     hash = Utility::HashState(&layout, 1, hash);
 
-    auto iter = s_ComputePSOHashMap.find(hash);
-    if (iter != s_ComputePSOHashMap.end())
+    if (s_ComputePSOHashMap.Find(hash, m_PSO))
     {
-        m_PSO = iter->second;
         return;
     }
 
     vk::ComputePipelineCreateInfo psoInfo;
     psoInfo.setLayout(m_Layout);
     psoInfo.setStage(stageInfo);
-    m_PSO = Graphics::g_Device.createComputePipeline(nullptr, psoInfo).value;
+    vk::Pipeline pso = Graphics::g_Device.createComputePipeline(nullptr, psoInfo).value;
 
-    s_ComputePSOHashMap[hash] = m_PSO;
+    m_PSO = s_ComputePSOHashMap.Insert(hash, pso);
+    if (m_PSO != pso)
+    {
+        Graphics::g_Device.destroyPipeline(pso);
+    }
 }
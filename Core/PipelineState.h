@@ -54,6 +54,8 @@ private:
     std::vector<vk::VertexInputBindingDescription> m_BindingDescriptions;
     std::vector<vk::VertexInputAttributeDescription> m_AttributeDescriptions;
     vk::RenderPass m_RenderPass;
+    std::vector<vk::Format> m_ColorFormats;
+    vk::Format m_DepthFormat = vk::Format::eUndefined;
     vk::PipelineInputAssemblyStateCreateInfo m_AssemblyInfo;
     RasterizationState m_RasterizerState;
     ColorBlendState m_BlendState;
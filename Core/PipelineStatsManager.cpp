@@ -0,0 +1,186 @@
+#include "PipelineStatsManager.h"
+#include "CommandContext.h"
+#include "Display.h"
+#include "GraphicsCore.h"
+#include "Utility.h"
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+const uint32_t kNumQueryFrames = 3;
+const uint32_t kStartupFrame = UINT32_MAX;
+const uint32_t kValuesPerQuery = sizeof(PipelineStatsManager::Stats) / sizeof(uint64_t) + 1; // Plus availability
+
+const vk::QueryPipelineStatisticFlags kStatisticFlags =
+    vk::QueryPipelineStatisticFlagBits::eInputAssemblyPrimitives |
+    vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations |
+    vk::QueryPipelineStatisticFlagBits::eClippingInvocations |
+    vk::QueryPipelineStatisticFlagBits::eClippingPrimitives |
+    vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations |
+    vk::QueryPipelineStatisticFlagBits::eComputeShaderInvocations;
+
+struct QueryFrame
+{
+    vk::QueryPool pool;
+    uint32_t frame;
+    std::vector<bool> used; // Queries begun in the frame, the others never become available
+    bool pending;
+};
+
+QueryFrame sm_QueryFrames[kNumQueryFrames];
+QueryFrame *sm_CurrentFrame = nullptr;
+std::vector<uint64_t> sm_QueryResults;    // Values and availability of the last frame read back
+std::vector<uint64_t> sm_ReadBackResults; // Where ReadBack gets them, swapped in once all are available
+std::vector<bool> sm_Valid;               // Queries that ran in the last frame read back
+uint32_t sm_ReadBackFrame = UINT32_MAX;
+uint32_t sm_MaxNumQueries = 0;
+uint32_t sm_NumQueries = 0;
+
+// Unlike timers there is no query that is known to finish last, so every query the frame used has to be
+// available before any of them is taken
+bool ReadBack(QueryFrame &Frame)
+{
+    uint32_t queryCount = std::min(sm_NumQueries, sm_MaxNumQueries);
+    if (queryCount > 0)
+    {
+        (void)Graphics::g_Device.getQueryPoolResults(
+            Frame.pool, 0, queryCount, queryCount * kValuesPerQuery * sizeof(uint64_t), sm_ReadBackResults.data(),
+            kValuesPerQuery * sizeof(uint64_t),
+            vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability);
+    }
+
+    for (uint32_t i = 0; i < queryCount; ++i)
+    {
+        if (Frame.used[i] && sm_ReadBackResults[i * kValuesPerQuery + kValuesPerQuery - 1] == 0)
+            return false;
+    }
+
+    // Both are sized by Initialize, so neither allocates
+    sm_QueryResults.swap(sm_ReadBackResults);
+    std::copy(Frame.used.begin(), Frame.used.end(), sm_Valid.begin());
+    sm_ReadBackFrame = Frame.frame;
+    Frame.pending = false;
+    return true;
+}
+
+void StartFrame(CommandContext &Context, QueryFrame &Frame, uint32_t FrameIndex)
+{
+    Frame.frame = FrameIndex;
+    std::fill(Frame.used.begin(), Frame.used.end(), false);
+
+    Context.ResetQueries(Frame.pool, 0, sm_MaxNumQueries);
+    sm_CurrentFrame = &Frame;
+}
+} // namespace
+
+void PipelineStatsManager::Initialize(uint32_t MaxNumQueries)
+{
+    sm_MaxNumQueries = MaxNumQueries;
+    sm_QueryResults.resize(MaxNumQueries * kValuesPerQuery);
+    sm_ReadBackResults.resize(MaxNumQueries * kValuesPerQuery);
+    sm_Valid.resize(MaxNumQueries);
+
+    if (!Graphics::g_PhysicalDevice.getFeatures().pipelineStatisticsQuery)
+    {
+        printf("Pipeline statistics queries not supported\n");
+        return;
+    }
+
+    vk::QueryPoolCreateInfo queryInfo;
+    queryInfo.queryType = vk::QueryType::ePipelineStatistics;
+    queryInfo.queryCount = MaxNumQueries;
+    queryInfo.pipelineStatistics = kStatisticFlags;
+    for (QueryFrame &Frame : sm_QueryFrames)
+    {
+        Frame.pool = Graphics::g_Device.createQueryPool(queryInfo);
+        Frame.used.resize(MaxNumQueries);
+        Frame.pending = false;
+    }
+
+    CommandContext &Context = CommandContext::Begin("Pipeline Stats Reset");
+    StartFrame(Context, sm_QueryFrames[0], kStartupFrame);
+    Context.Finish();
+}
+
+void PipelineStatsManager::Shutdown()
+{
+    for (QueryFrame &Frame : sm_QueryFrames)
+    {
+        if (Frame.pool)
+            Graphics::g_Device.destroyQueryPool(Frame.pool);
+        Frame.pool = nullptr;
+        Frame.pending = false;
+    }
+    sm_CurrentFrame = nullptr;
+}
+
+bool PipelineStatsManager::IsSupported(void) { return sm_CurrentFrame != nullptr; }
+
+// Queries may be created before Initialize by static profiling scopes
+uint32_t PipelineStatsManager::NewQuery(void) { return sm_NumQueries++; }
+
+bool PipelineStatsManager::BeginQuery(CommandContext &Context, uint32_t QueryIdx)
+{
+    if (!sm_CurrentFrame)
+        return false;
+    ASSERT(QueryIdx < sm_MaxNumQueries, "Out of pipeline statistics queries");
+    if (sm_CurrentFrame->used[QueryIdx])
+        return false;
+    sm_CurrentFrame->used[QueryIdx] = true;
+    Context.BeginQuery(sm_CurrentFrame->pool, QueryIdx);
+    return true;
+}
+
+void PipelineStatsManager::EndQuery(CommandContext &Context, uint32_t QueryIdx)
+{
+    Context.EndQuery(sm_CurrentFrame->pool, QueryIdx);
+}
+
+void PipelineStatsManager::BeginReadBack(void)
+{
+    if (!sm_CurrentFrame)
+        return;
+
+    sm_CurrentFrame->pending = sm_CurrentFrame->frame != kStartupFrame;
+
+    QueryFrame *Oldest = nullptr;
+    for (QueryFrame &Frame : sm_QueryFrames)
+    {
+        if (Frame.pending && (Oldest == nullptr || Frame.frame < Oldest->frame))
+            Oldest = &Frame;
+    }
+    if (Oldest != nullptr)
+        ReadBack(*Oldest);
+}
+
+void PipelineStatsManager::EndReadBack(CommandContext &Context)
+{
+    if (!sm_CurrentFrame)
+        return;
+
+    // Frames the GPU is too far behind on are dropped, see GpuTimeManager::EndReadBack
+    uint32_t FrameIndex = (uint32_t)Graphics::GetFrameCount();
+    QueryFrame &Frame = sm_QueryFrames[FrameIndex % kNumQueryFrames];
+    if (Frame.pending && !ReadBack(Frame))
+        Frame.pending = false;
+
+    StartFrame(Context, Frame, FrameIndex);
+}
+
+uint32_t PipelineStatsManager::GetReadBackFrame(void) { return sm_ReadBackFrame; }
+
+bool PipelineStatsManager::GetStats(uint32_t QueryIdx, Stats &Result)
+{
+    if (QueryIdx >= sm_MaxNumQueries || !sm_Valid[QueryIdx])
+        return false;
+
+    const uint64_t *values = &sm_QueryResults[QueryIdx * kValuesPerQuery];
+    Result.InputPrimitives = values[0];
+    Result.VertexInvocations = values[1];
+    Result.ClippingInvocations = values[2];
+    Result.ClippingPrimitives = values[3];
+    Result.FragmentInvocations = values[4];
+    Result.ComputeInvocations = values[5];
+    return true;
+}
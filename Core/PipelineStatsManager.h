@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+
+class CommandContext;
+
+// Pipeline statistics queries, read back the same way as GpuTimeManager's timers: every frame in flight
+// has its own query pool, and results show up once the GPU has finished the frame. Unlike timers these
+// queries can't nest, only one can be active on a command buffer at a time.
+namespace PipelineStatsManager
+{
+// In the order Vulkan writes them
+struct Stats
+{
+    uint64_t InputPrimitives;
+    uint64_t VertexInvocations;
+    uint64_t ClippingInvocations;
+    uint64_t ClippingPrimitives;
+    uint64_t FragmentInvocations;
+    uint64_t ComputeInvocations;
+};
+
+void Initialize(uint32_t MaxNumQueries = 256);
+void Shutdown();
+
+// False when the device can't collect pipeline statistics, queries then do nothing
+bool IsSupported(void);
+
+// Reserve a unique query index
+uint32_t NewQuery(void);
+
+// A query only counts the first time it runs in a frame. BeginQuery returns false for the other times,
+// and for unsupported devices, and EndQuery must then not be called.
+bool BeginQuery(CommandContext &Context, uint32_t QueryIdx);
+void EndQuery(CommandContext &Context, uint32_t QueryIdx);
+
+// Bookend all calls to GetStats() with Begin/End at the very start of a frame, like GpuTimeManager.
+// EndReadBack records the reset of the next frame's queries into Context, the frame's first submission.
+void BeginReadBack(void);
+void EndReadBack(CommandContext &Context);
+
+// Frame the queries read by the last BeginReadBack belong to, UINT32_MAX before the first one
+uint32_t GetReadBackFrame(void);
+
+// False if the query didn't run in that frame
+bool GetStats(uint32_t QueryIdx, Stats &Result);
+} // namespace PipelineStatsManager
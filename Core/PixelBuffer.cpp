@@ -2,6 +2,7 @@
 #include "CommandContext.h"
 #include "GraphicsCommon.h"
 #include "GraphicsCore.h"
+#include "MemoryTracker.h"
 #include "Swapchain.h"
 
 using namespace Graphics;
@@ -11,6 +12,35 @@ void PixelBuffer::Create(const std::string &Name, uint32_t width, uint32_t heigh
 {
     Destroy();
 
+    vk::ImageCreateInfo imageInfo = DescribeImage(width, height, numMips, format);
+
+    vma::AllocationCreateInfo allocInfo;
+    allocInfo.usage = vma::MemoryUsage::eGpuOnly;
+    std::tie(m_Image, m_Allocation) = g_Allocator.createImage(imageInfo, allocInfo);
+    MemoryTracker::Track(m_Allocation, MemoryTracker::kRenderTargets);
+
+    CreateView();
+}
+
+vk::MemoryRequirements PixelBuffer::CreatePlaced(const std::string &Name, uint32_t width, uint32_t height,
+                                                 uint32_t numMips, vk::Format format)
+{
+    Destroy();
+
+    m_Image = g_Device.createImage(DescribeImage(width, height, numMips, format));
+    m_Placed = true;
+    return g_Device.getImageMemoryRequirements(m_Image);
+}
+
+void PixelBuffer::BindPlaced(vma::Allocation memory, vk::DeviceSize offset)
+{
+    ASSERT(m_Placed && !m_ImageView);
+    g_Allocator.bindImageMemory2(memory, offset, m_Image, nullptr);
+    CreateView();
+}
+
+vk::ImageCreateInfo PixelBuffer::DescribeImage(uint32_t width, uint32_t height, uint32_t numMips, vk::Format format)
+{
     m_Extent.width = width;
     m_Extent.height = height;
     m_Extent.depth = 1;
@@ -31,11 +61,11 @@ void PixelBuffer::Create(const std::string &Name, uint32_t width, uint32_t heigh
     imageInfo.usage = m_ImageUsage;
     imageInfo.sharingMode = vk::SharingMode::eExclusive;
     imageInfo.samples = vk::SampleCountFlagBits::e1;
+    return imageInfo;
+}
 
-    vma::AllocationCreateInfo allocInfo;
-    allocInfo.usage = vma::MemoryUsage::eGpuOnly;
-    std::tie(m_Image, m_Allocation) = g_Allocator.createImage(imageInfo, allocInfo);
-    
+void PixelBuffer::CreateView()
+{
     m_SubresourceRange.aspectMask = m_AspectMask;
     m_SubresourceRange.baseMipLevel = 0;
     m_SubresourceRange.levelCount = m_MipLevel;
@@ -45,7 +75,7 @@ void PixelBuffer::Create(const std::string &Name, uint32_t width, uint32_t heigh
     vk::ImageViewCreateInfo viewInfo;
     viewInfo.setImage(m_Image);
     viewInfo.setViewType(vk::ImageViewType::e2D);
-    viewInfo.setFormat(format);
+    viewInfo.setFormat(m_Format);
     viewInfo.setComponents(vk::ComponentMapping());
     viewInfo.subresourceRange = m_SubresourceRange;
     m_ImageView = g_Device.createImageView(viewInfo);
@@ -55,4 +85,12 @@ void PixelBuffer::Destroy()
 {
     g_FramebufferManager.InformDestruction(*this);
     ImageView::Destroy();
+
+    // The memory of a placed image belongs to whoever bound it
+    if (m_Placed)
+    {
+        g_Device.destroyImage(m_Image);
+        m_Image = nullptr;
+        m_Placed = false;
+    }
 }
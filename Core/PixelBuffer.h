@@ -9,11 +9,22 @@ public:
         ImageView(imageUsage, aspectMask) {}
     
     void Create(const std::string& Name, uint32_t width, uint32_t height, uint32_t numMips, vk::Format format);
+
+    // A placed image doesn't own its memory, so several of them can share one allocation as long as
+    // they are never in use at the same time. Create it first, then bind it into memory that satisfies
+    // the returned requirements.
+    vk::MemoryRequirements CreatePlaced(const std::string& Name, uint32_t width, uint32_t height, uint32_t numMips,
+                                        vk::Format format);
+    void BindPlaced(vma::Allocation memory, vk::DeviceSize offset);
     
     void Destroy();
     
-    vk::ClearDepthStencilValue GetClearValue() const { return m_ClearValue.depthStencil; }
+    vk::ClearValue GetClearValue() const { return m_ClearValue; }
     
 protected:
+    vk::ImageCreateInfo DescribeImage(uint32_t width, uint32_t height, uint32_t numMips, vk::Format format);
+    void CreateView();
+
     vk::ClearValue m_ClearValue;
+    bool m_Placed = false;
 };
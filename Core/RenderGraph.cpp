@@ -0,0 +1,364 @@
+#include "RenderGraph.h"
+#include "CommandContext.h"
+#include "EngineProfiling.h"
+#include "GraphicsCore.h"
+#include "MemoryTracker.h"
+#include "Utility.h"
+#include <algorithm>
+#include <memory>
+
+using namespace Graphics;
+
+namespace
+{
+bool IsDepthFormat(vk::Format format)
+{
+    return format == vk::Format::eD16Unorm || format == vk::Format::eX8D24UnormPack32 ||
+           format == vk::Format::eD32Sfloat || RenderPass::HasStencil(format);
+}
+} // namespace
+
+void RenderGraph::PassBuilder::Read(Resource res, vk::ImageLayout layout) { AddAccess(res, layout, false, false); }
+
+void RenderGraph::PassBuilder::Write(Resource res, vk::ImageLayout layout) { AddAccess(res, layout, true, false); }
+
+void RenderGraph::PassBuilder::Clear(Resource res, vk::ImageLayout layout) { AddAccess(res, layout, true, true); }
+
+void RenderGraph::PassBuilder::AddAccess(Resource res, vk::ImageLayout layout, bool write, bool clear)
+{
+    ASSERT(res < m_Graph.m_NumResources);
+    Pass &pass = m_Graph.m_Passes[m_Pass];
+    for (const Access &access : pass.accesses)
+    {
+        ASSERT(access.res != res, "A pass can only access a resource once");
+    }
+    pass.accesses.push_back({res, layout, write, clear});
+}
+
+void RenderGraph::PassBuilder::SetSideEffects() { m_Graph.m_Passes[m_Pass].sideEffects = true; }
+
+void RenderGraph::Reset()
+{
+    m_NumPasses = 0;
+    m_NumResources = 0;
+    m_Arena.Reset();
+}
+
+RenderGraph::ResourceInfo &RenderGraph::NewResource()
+{
+    if (m_NumResources == m_Resources.size())
+    {
+        m_Resources.emplace_back();
+    }
+    return m_Resources[m_NumResources++];
+}
+
+RenderGraph::Resource RenderGraph::Import(PixelBuffer &buffer, bool output)
+{
+    ResourceInfo &info = NewResource();
+    info.buffer = &buffer;
+    info.name.clear();
+    info.desc = {buffer.GetWidth(), buffer.GetHeight(), buffer.GetFormat()};
+    info.transient = false;
+    info.output = output;
+    return m_NumResources - 1;
+}
+
+RenderGraph::Resource RenderGraph::CreateTransient(const char *name, const TransientDesc &desc)
+{
+    ResourceInfo &info = NewResource();
+    info.buffer = nullptr;
+    info.name.assign(name);
+    info.desc = desc;
+    info.transient = true;
+    info.output = false;
+    return m_NumResources - 1;
+}
+
+uint32_t RenderGraph::NewPass(const char *name, void *execute, void (*invoke)(void *, GraphicsContext &))
+{
+    if (m_NumPasses == m_Passes.size())
+    {
+        m_Passes.emplace_back();
+    }
+    Pass &pass = m_Passes[m_NumPasses];
+    pass.name.assign(name);
+    pass.execute = execute;
+    pass.invoke = invoke;
+    pass.accesses.clear();
+    pass.sideEffects = false;
+    pass.live = false;
+    return m_NumPasses++;
+}
+
+PixelBuffer &RenderGraph::GetBuffer(Resource res)
+{
+    ASSERT(res < m_NumResources);
+    ASSERT(m_Resources[res].buffer != nullptr, "Transient %s is only available while the graph executes",
+           m_Resources[res].name.c_str());
+    return *m_Resources[res].buffer;
+}
+
+ColorBuffer &RenderGraph::GetColorBuffer(Resource res)
+{
+    ASSERT(!IsDepthFormat(m_Resources[res].desc.Format));
+    return static_cast<ColorBuffer &>(GetBuffer(res));
+}
+
+DepthBuffer &RenderGraph::GetDepthBuffer(Resource res)
+{
+    ASSERT(IsDepthFormat(m_Resources[res].desc.Format));
+    return static_cast<DepthBuffer &>(GetBuffer(res));
+}
+
+void RenderGraph::CullPasses()
+{
+    // Walk backwards from the outputs. A pass is needed if it writes something a later needed pass
+    // accesses, and then everything it accesses, except what it clears, is needed from the passes before it.
+    std::vector<bool> &needed = m_Needed;
+    needed.resize(m_NumResources);
+    for (size_t i = 0; i < m_NumResources; ++i)
+    {
+        needed[i] = m_Resources[i].output;
+    }
+
+    for (size_t i = m_NumPasses; i-- > 0;)
+    {
+        Pass &pass = m_Passes[i];
+        pass.live = pass.sideEffects;
+        for (const Access &access : pass.accesses)
+        {
+            pass.live |= access.write && needed[access.res];
+        }
+        if (!pass.live)
+        {
+            continue;
+        }
+        for (const Access &access : pass.accesses)
+        {
+            needed[access.res] = !access.clear;
+        }
+    }
+}
+
+void RenderGraph::ComputeLifetimes()
+{
+    for (uint32_t r = 0; r < m_NumResources; ++r)
+    {
+        m_Resources[r].firstPass = UINT32_MAX;
+        m_Resources[r].lastPass = 0;
+    }
+    for (uint32_t i = 0; i < m_NumPasses; ++i)
+    {
+        if (!m_Passes[i].live)
+        {
+            continue;
+        }
+        for (const Access &access : m_Passes[i].accesses)
+        {
+            ResourceInfo &res = m_Resources[access.res];
+            res.firstPass = std::min(res.firstPass, i);
+            res.lastPass = std::max(res.lastPass, i);
+        }
+    }
+}
+
+// Transient images go into the first block whose images are all dead while they live. A block is as
+// large as its largest image, and every image starts at offset 0.
+void RenderGraph::PlaceTransientImages()
+{
+    std::vector<uint32_t> order(m_TransientImages.size());
+    for (uint32_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+        return m_TransientImages[a].requirements.size > m_TransientImages[b].requirements.size;
+    });
+
+    for (uint32_t i : order)
+    {
+        TransientImage &image = m_TransientImages[i];
+
+        uint32_t blockIndex = 0;
+        for (; blockIndex < m_MemoryBlocks.size(); ++blockIndex)
+        {
+            MemoryBlock &block = m_MemoryBlocks[blockIndex];
+            if ((block.requirements.memoryTypeBits & image.requirements.memoryTypeBits) == 0)
+            {
+                continue;
+            }
+            bool overlaps = false;
+            for (uint32_t other : block.images)
+            {
+                const TransientImage &otherImage = m_TransientImages[other];
+                overlaps |= image.firstPass <= otherImage.lastPass && otherImage.firstPass <= image.lastPass;
+            }
+            if (!overlaps)
+            {
+                break;
+            }
+        }
+
+        if (blockIndex == m_MemoryBlocks.size())
+        {
+            MemoryBlock block;
+            block.requirements = image.requirements;
+            block.lastUser = nullptr;
+            m_MemoryBlocks.push_back(block);
+        }
+
+        MemoryBlock &block = m_MemoryBlocks[blockIndex];
+        block.requirements.size = std::max(block.requirements.size, image.requirements.size);
+        block.requirements.alignment = std::max(block.requirements.alignment, image.requirements.alignment);
+        block.requirements.memoryTypeBits &= image.requirements.memoryTypeBits;
+        block.images.push_back(i);
+        image.block = blockIndex;
+    }
+
+    vma::AllocationCreateInfo allocInfo;
+    allocInfo.usage = vma::MemoryUsage::eGpuOnly;
+
+    vk::DeviceSize aliasedSize = 0;
+    vk::DeviceSize totalSize = 0;
+    for (MemoryBlock &block : m_MemoryBlocks)
+    {
+        block.memory = g_Allocator.allocateMemory(block.requirements, allocInfo);
+        MemoryTracker::Track(block.memory, MemoryTracker::kRenderTargets);
+        aliasedSize += block.requirements.size;
+        for (uint32_t i : block.images)
+        {
+            m_TransientImages[i].buffer->BindPlaced(block.memory, 0);
+            totalSize += m_TransientImages[i].requirements.size;
+        }
+    }
+
+    m_TransientStats.Images = (uint32_t)m_TransientImages.size();
+    m_TransientStats.Allocations = (uint32_t)m_MemoryBlocks.size();
+    m_TransientStats.Size = aliasedSize;
+    m_TransientStats.UnaliasedSize = totalSize;
+
+    DEBUGPRINT("Render graph: %zu transient images in %zu allocations, %.1f MB (%.1f MB without aliasing)",
+               m_TransientImages.size(), m_MemoryBlocks.size(), aliasedSize / 1048576.0, totalSize / 1048576.0);
+}
+void RenderGraph::Execute(GraphicsContext &context)
+{
+    CullPasses();
+    ComputeLifetimes();
+
+    // Transient images that no live pass touches are not created at all
+    std::vector<Resource> &transients = m_Transients;
+    transients.clear();
+    for (Resource i = 0; i < m_NumResources; ++i)
+    {
+        if (m_Resources[i].transient && m_Resources[i].firstPass != UINT32_MAX)
+        {
+            transients.push_back(i);
+        }
+    }
+
+    bool unchanged = transients.size() == m_TransientImages.size();
+    for (uint32_t i = 0; unchanged && i < transients.size(); ++i)
+    {
+        const ResourceInfo &res = m_Resources[transients[i]];
+        const TransientImage &image = m_TransientImages[i];
+        unchanged = image.name == res.name && image.desc == res.desc && image.firstPass == res.firstPass &&
+                    image.lastPass == res.lastPass;
+    }
+
+    if (!unchanged)
+    {
+        if (!m_TransientImages.empty())
+        {
+            g_CommandManager.IdleGPU();
+            DestroyTransients();
+        }
+
+        for (Resource r : transients)
+        {
+            const ResourceInfo &res = m_Resources[r];
+
+            TransientImage image;
+            image.name = res.name;
+            image.desc = res.desc;
+            image.firstPass = res.firstPass;
+            image.lastPass = res.lastPass;
+            if (IsDepthFormat(res.desc.Format))
+            {
+                image.buffer.reset(new DepthBuffer());
+            }
+            else
+            {
+                image.buffer.reset(new ColorBuffer());
+            }
+            image.requirements =
+                image.buffer->CreatePlaced(res.name, res.desc.Width, res.desc.Height, 1, res.desc.Format);
+            m_TransientImages.push_back(std::move(image));
+        }
+        PlaceTransientImages();
+    }
+
+    for (uint32_t i = 0; i < transients.size(); ++i)
+    {
+        m_Resources[transients[i]].buffer = m_TransientImages[i].buffer.get();
+        m_Resources[transients[i]].slot = i;
+    }
+
+    for (uint32_t i = 0; i < m_NumPasses; ++i)
+    {
+        Pass &pass = m_Passes[i];
+        if (!pass.live)
+        {
+            continue;
+        }
+
+        ScopedTimer _prof(pass.name, context);
+        ScopedPipelineStats _stats(pass.name, context);
+
+        // All transitions of a pass end up in the same barrier batch
+        for (const Access &access : pass.accesses)
+        {
+            ResourceInfo &res = m_Resources[access.res];
+            if (res.transient && res.firstPass == i)
+            {
+                MemoryBlock &block = m_MemoryBlocks[m_TransientImages[res.slot].block];
+                context.AliasImage(block.lastUser, *res.buffer, access.layout);
+                block.lastUser = res.buffer;
+            }
+            // Clearing first lets the transition drop the old contents
+            if (access.clear && IsDepthFormat(res.desc.Format))
+            {
+                context.ClearDepth(static_cast<DepthBuffer &>(*res.buffer));
+            }
+            else if (access.clear)
+            {
+                context.ClearColor(static_cast<ColorBuffer &>(*res.buffer));
+            }
+            context.TransitionImageLayout(*res.buffer, access.layout);
+        }
+
+        pass.invoke(pass.execute, context);
+    }
+
+    for (Resource r : transients)
+    {
+        m_Resources[r].buffer = nullptr;
+    }
+}
+
+void RenderGraph::DestroyTransients()
+{
+    for (TransientImage &image : m_TransientImages)
+    {
+        image.buffer->Destroy();
+    }
+    for (MemoryBlock &block : m_MemoryBlocks)
+    {
+        MemoryTracker::Untrack(block.memory);
+        g_Allocator.freeMemory(block.memory);
+    }
+    m_TransientImages.clear();
+    m_MemoryBlocks.clear();
+    m_TransientStats = {};
+}
+
@@ -0,0 +1,193 @@
+#pragma once
+
+#include "ColorBuffer.h"
+#include "DepthBuffer.h"
+#include "TransientArena.h"
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class GraphicsContext;
+
+// A frame described as passes and the images they access. Passes run in the order they were added.
+// Before each pass the graph transitions every image it declared to the declared layout, so passes can
+// be reordered without touching any barrier. Passes that contribute nothing to an output are culled.
+//
+// Transient images only live for one execution. Each graph places its own into shared memory, and two
+// transient images whose passes never overlap end up in the same allocation.
+//
+// A graph is meant to be kept and rebuilt every frame after a Reset. Passes, resources and the execute
+// callbacks reuse the storage of earlier frames, so building the same frame again doesn't allocate.
+// The callbacks are copied into an arena that never runs destructors, so they should only capture
+// references and plain values.
+//
+//     graph.Reset();
+//     RenderGraph::Resource color = graph.Import(g_SceneColorBuffer, true);
+//     RenderGraph::Resource depth = graph.CreateTransient("Scene Depth", {width, height, vk::Format::eD32Sfloat});
+//     graph.AddPass(
+//         "Opaque",
+//         [&](RenderGraph::PassBuilder &pass) {
+//             pass.Clear(color, vk::ImageLayout::eColorAttachmentOptimal);
+//             pass.Clear(depth, vk::ImageLayout::eDepthStencilAttachmentOptimal);
+//         },
+//         [&](GraphicsContext &context) { context.BeginRenderPass(graph.GetColorBuffer(color), ...); });
+//     graph.Execute(context);
+class RenderGraph
+{
+public:
+    typedef uint32_t Resource;
+
+    struct TransientDesc
+    {
+        uint32_t Width;
+        uint32_t Height;
+        vk::Format Format;
+
+        bool operator==(const TransientDesc &rhs) const
+        {
+            return Width == rhs.Width && Height == rhs.Height && Format == rhs.Format;
+        }
+    };
+
+    class PassBuilder
+    {
+        friend class RenderGraph;
+
+    public:
+        void Read(Resource res, vk::ImageLayout layout = vk::ImageLayout::eShaderReadOnlyOptimal);
+        // Writes keep what earlier passes wrote
+        void Write(Resource res, vk::ImageLayout layout);
+        // Clears the image to its clear value before the pass, so earlier writers are not needed. The clear
+        // is folded into the first render pass that uses the image.
+        void Clear(Resource res, vk::ImageLayout layout);
+        // The pass has effects the graph can't see, so it is never culled
+        void SetSideEffects();
+
+    private:
+        PassBuilder(RenderGraph &graph, uint32_t pass) : m_Graph(graph), m_Pass(pass) {}
+        void AddAccess(Resource res, vk::ImageLayout layout, bool write, bool clear);
+
+        RenderGraph &m_Graph;
+        uint32_t m_Pass;
+    };
+
+    // Forgets the passes and resources of the last frame, but keeps their storage
+    void Reset();
+
+    // An output keeps its contents after the graph ran. Passes that don't lead to an output are culled.
+    Resource Import(PixelBuffer &buffer, bool output = false);
+    Resource CreateTransient(const char *name, const TransientDesc &desc);
+
+    // setup(PassBuilder &) runs right away, execute(GraphicsContext &) while the graph executes
+    template <typename SetupFunc, typename ExecuteFunc>
+    void AddPass(const char *name, SetupFunc &&setup, ExecuteFunc &&execute)
+    {
+        typedef typename std::decay<ExecuteFunc>::type Execute;
+        static_assert(std::is_trivially_destructible<Execute>::value, "Pass callbacks are never destructed");
+        void *storage = m_Arena.Alloc(sizeof(Execute), alignof(Execute));
+        new (storage) Execute(std::forward<ExecuteFunc>(execute));
+
+        void (*invoke)(void *, GraphicsContext &) = [](void *func, GraphicsContext &context) {
+            (*static_cast<Execute *>(func))(context);
+        };
+        PassBuilder builder(*this, NewPass(name, storage, invoke));
+        setup(builder);
+    }
+
+    // Transient images only exist while the graph executes
+    PixelBuffer &GetBuffer(Resource res);
+    ColorBuffer &GetColorBuffer(Resource res);
+    DepthBuffer &GetDepthBuffer(Resource res);
+
+    void Execute(GraphicsContext &context);
+
+    // Frees the transient images and their memory, which are otherwise kept for the next execution. Call it
+    // before the device goes away, e.g. from IGameApp::Cleanup.
+    void DestroyTransients();
+
+    struct TransientStats
+    {
+        uint32_t Images;
+        uint32_t Allocations;
+        vk::DeviceSize Size;          // Memory the transient images are placed in
+        vk::DeviceSize UnaliasedSize; // What they would take with an allocation each
+    };
+    // How the transient images of the last execution were placed
+    TransientStats GetTransientStats() const { return m_TransientStats; }
+
+private:
+    struct Access
+    {
+        Resource res;
+        vk::ImageLayout layout;
+        bool write;
+        bool clear;
+    };
+
+    struct Pass
+    {
+        std::string name;
+        void *execute; // The callback in m_Arena
+        void (*invoke)(void *execute, GraphicsContext &context);
+        std::vector<Access> accesses;
+        bool sideEffects;
+        bool live;
+    };
+
+    struct ResourceInfo
+    {
+        PixelBuffer *buffer;  // Null for transients until the graph executes
+        std::string name;
+        TransientDesc desc;
+        bool transient;
+        bool output;
+        uint32_t firstPass;
+        uint32_t lastPass;
+        uint32_t slot; // Index of the transient image backing it
+    };
+
+    struct TransientImage
+    {
+        std::string name;
+        TransientDesc desc;
+        uint32_t firstPass;
+        uint32_t lastPass;
+        std::unique_ptr<PixelBuffer> buffer;
+        vk::MemoryRequirements requirements;
+        uint32_t block;
+    };
+
+    struct MemoryBlock
+    {
+        vma::Allocation memory;
+        vk::MemoryRequirements requirements;
+        std::vector<uint32_t> images;
+        // The image that accessed this memory last, possibly during an earlier execution
+        const PixelBuffer *lastUser;
+    };
+
+    uint32_t NewPass(const char *name, void *execute, void (*invoke)(void *, GraphicsContext &));
+    ResourceInfo &NewResource();
+    void CullPasses();
+    void ComputeLifetimes();
+    void PlaceTransientImages();
+
+    // Only the first m_NumPasses and m_NumResources are in use, the others are kept from earlier frames
+    // so their strings and vectors don't have to be allocated again
+    std::vector<Pass> m_Passes;
+    std::vector<ResourceInfo> m_Resources;
+    uint32_t m_NumPasses = 0;
+    uint32_t m_NumResources = 0;
+    TransientArena m_Arena{4 * 1024};
+
+    // Kept across executions, and only rebuilt when the set of transient images or their lifetimes change
+    std::vector<TransientImage> m_TransientImages;
+    std::vector<MemoryBlock> m_MemoryBlocks;
+    TransientStats m_TransientStats = {};
+
+    // Scratch space of Execute
+    std::vector<bool> m_Needed;
+    std::vector<Resource> m_Transients;
+};
@@ -1,11 +1,11 @@
 #include "RenderPass.h"
 #include "GraphicsCore.h"
 #include "Hash.h"
-#include <map>
+#include "HashMap.h"
 
 namespace RenderPass
 {
-static std::map<size_t, vk::RenderPass> s_RenderPassMap;
+static Utility::ShardedHashMap<size_t, vk::RenderPass> s_RenderPassMap;
 
 // void RenderPass::SetColorAttachment(vk::Format format, ContentOp op)
 //{
@@ -140,34 +140,47 @@ static std::map<size_t, vk::RenderPass> s_RenderPassMap;
 // }
 
 vk::RenderPass GetRenderPass(const vk::ArrayProxy<vk::Format> &colors, vk::Format depth)
+{
+    return GetRenderPass(colors, depth, nullptr, AttachmentOps());
+}
+
+vk::RenderPass GetRenderPass(const vk::ArrayProxy<vk::Format> &colors, vk::Format depth,
+                             const AttachmentOps *colorOps, AttachmentOps depthOps)
 {
     size_t hash = 2166136261U;
     if (!colors.empty())
     {
         hash = Utility::HashState(colors.data(), colors.size(), hash);
+        if (colorOps != nullptr)
+        {
+            hash = Utility::HashState(colorOps, colors.size(), hash);
+        }
     }
     if (depth != vk::Format::eUndefined)
     {
         hash = Utility::HashState(&depth, 1, hash);
+        hash = Utility::HashState(&depthOps, 1, hash);
     }
     assert(hash != 2166136261U);
 
-    auto iter = s_RenderPassMap.find(hash);
-    if (iter != s_RenderPassMap.end())
+    vk::RenderPass renderPass;
+    if (s_RenderPassMap.Find(hash, renderPass))
     {
-        return iter->second;
+        return renderPass;
     }
 
     std::vector<vk::AttachmentDescription> attachments;
-    for (auto &c : colors)
+    for (uint32_t i = 0; i < colors.size(); ++i)
     {
+        AttachmentOps ops = colorOps != nullptr ? colorOps[i] : AttachmentOps();
+
         vk::AttachmentDescription colorAttachment;
-        colorAttachment.setFormat(c);
+        colorAttachment.setFormat(colors.data()[i]);
         colorAttachment.setSamples(vk::SampleCountFlagBits::e1);
         colorAttachment.setInitialLayout(vk::ImageLayout::eColorAttachmentOptimal);
         colorAttachment.setFinalLayout(vk::ImageLayout::eColorAttachmentOptimal);
-        colorAttachment.setLoadOp(vk::AttachmentLoadOp::eLoad);
-        colorAttachment.setStoreOp(vk::AttachmentStoreOp::eStore);
+        colorAttachment.setLoadOp(ops.load);
+        colorAttachment.setStoreOp(ops.store);
         colorAttachment.setStencilLoadOp(vk::AttachmentLoadOp::eLoad);
         colorAttachment.setStencilStoreOp(vk::AttachmentStoreOp::eStore);
 
@@ -178,12 +191,12 @@ vk::RenderPass GetRenderPass(const vk::ArrayProxy<vk::Format> &colors, vk::Forma
         vk::AttachmentDescription depthAttachment;
         depthAttachment.setFormat(depth);
         depthAttachment.setSamples(vk::SampleCountFlagBits::e1);
-        depthAttachment.setLoadOp(vk::AttachmentLoadOp::eLoad);
-        depthAttachment.setStoreOp(vk::AttachmentStoreOp::eStore);
+        depthAttachment.setLoadOp(depthOps.load);
+        depthAttachment.setStoreOp(depthOps.store);
         depthAttachment.setInitialLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal);
         depthAttachment.setFinalLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal);
-        depthAttachment.setStencilLoadOp(vk::AttachmentLoadOp::eLoad);
-        depthAttachment.setStencilStoreOp(vk::AttachmentStoreOp::eStore);
+        depthAttachment.setStencilLoadOp(depthOps.load);
+        depthAttachment.setStencilStoreOp(depthOps.store);
 
         attachments.push_back(depthAttachment);
     }
@@ -220,20 +233,20 @@ vk::RenderPass GetRenderPass(const vk::ArrayProxy<vk::Format> &colors, vk::Forma
     renderPassInfo.setSubpasses(subpass);
     //    renderPassInfo.setDependencyCount(1);
     //    renderPassInfo.setDependencies(dependency);
-    vk::RenderPass renderPass = Graphics::g_Device.createRenderPass(renderPassInfo);
-
-    s_RenderPassMap[hash] = renderPass;
+    vk::RenderPass newRenderPass = Graphics::g_Device.createRenderPass(renderPassInfo);
 
+    renderPass = s_RenderPassMap.Insert(hash, newRenderPass);
+    if (renderPass != newRenderPass)
+    {
+        Graphics::g_Device.destroyRenderPass(newRenderPass);
+    }
     return renderPass;
 }
 
 void DestroyAll()
 {
-    for (auto &i : s_RenderPassMap)
-    {
-        Graphics::g_Device.destroyRenderPass(i.second);
-    }
-    s_RenderPassMap.clear();
+    s_RenderPassMap.ForEach([](size_t, vk::RenderPass pass) { Graphics::g_Device.destroyRenderPass(pass); });
+    s_RenderPassMap.Clear();
 }
 
 } // namespace RenderPass
@@ -21,8 +21,26 @@ namespace RenderPass
 // };
 //    void SetColorAttachment(vk::Format format, ContentOp op);
 //    void SetDepthAttachment(vk::Format format, ContentOp op);
+
+// What happens to an attachment's contents at the start and the end of a render pass.
+// Render pass compatibility ignores these, so pipelines can be created against the default ops.
+struct AttachmentOps
+{
+    vk::AttachmentLoadOp load = vk::AttachmentLoadOp::eLoad;
+    vk::AttachmentStoreOp store = vk::AttachmentStoreOp::eStore;
+};
+
 vk::RenderPass GetRenderPass(const vk::ArrayProxy<vk::Format> &colors, vk::Format depth);
+// colorOps holds one entry per color format, or is null for the default ops
+vk::RenderPass GetRenderPass(const vk::ArrayProxy<vk::Format> &colors, vk::Format depth,
+                             const AttachmentOps *colorOps, AttachmentOps depthOps);
 void DestroyAll();
+
+inline bool HasStencil(vk::Format format)
+{
+    return format == vk::Format::eD16UnormS8Uint || format == vk::Format::eD24UnormS8Uint ||
+           format == vk::Format::eD32SfloatS8Uint || format == vk::Format::eS8Uint;
+}
 //    void Finalize();
 //    void Destroy();
 
@@ -2,13 +2,13 @@
 
 #include "GraphicsCore.h"
 #include "Hash.h"
+#include "HashMap.h"
 #include <algorithm>
 #include <float.h>
-#include <map>
 
 namespace
 {
-std::map<size_t, vk::Sampler> s_SamplerMap;
+Utility::ShardedHashMap<size_t, vk::Sampler> s_SamplerMap;
 }
 
 SamplerDesc::SamplerDesc()
@@ -40,22 +40,23 @@ void SamplerDesc::SetAddressMode(vk::SamplerAddressMode Mode)
 vk::Sampler SamplerDesc::CreateSampler()
 {
     size_t hash = Utility::HashState(this);
-    auto iter = s_SamplerMap.find(hash);
-    if (iter != s_SamplerMap.end())
+    vk::Sampler sampler;
+    if (s_SamplerMap.Find(hash, sampler))
     {
-        return iter->second;
+        return sampler;
     }
 
-    auto sampler = Graphics::g_Device.createSampler(*this);
-    s_SamplerMap[hash] = sampler;
+    vk::Sampler newSampler = Graphics::g_Device.createSampler(*this);
+    sampler = s_SamplerMap.Insert(hash, newSampler);
+    if (sampler != newSampler)
+    {
+        Graphics::g_Device.destroySampler(newSampler);
+    }
     return sampler;
 }
 
 void SamplerDesc::DestroyAll()
 {
-    for (auto &i : s_SamplerMap)
-    {
-        Graphics::g_Device.destroySampler(i.second);
-    }
-    s_SamplerMap.clear();
+    s_SamplerMap.ForEach([](size_t, vk::Sampler sampler) { Graphics::g_Device.destroySampler(sampler); });
+    s_SamplerMap.Clear();
 }
\ No newline at end of file
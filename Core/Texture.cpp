@@ -2,6 +2,7 @@
 #include "CommandContext.h"
 #include "GpuBuffer.h"
 #include "GraphicsCore.h"
+#include "MemoryTracker.h"
 #include <ktxvulkan.h>
 #include <vulkan/vulkan_enums.hpp>
 
@@ -36,6 +37,7 @@ void Texture::Create2D(uint32_t RowLength, uint32_t Width, uint32_t Height, vk::
     vma::AllocationCreateInfo allocInfo;
     allocInfo.usage = vma::MemoryUsage::eGpuOnly;
     std::tie(m_Image, m_Allocation) = g_Allocator.createImage(imageInfo, allocInfo);
+    MemoryTracker::Track(m_Allocation, MemoryTracker::kTextures);
 
     m_SubresourceRange.aspectMask = m_AspectMask;
     m_SubresourceRange.baseMipLevel = 0;
@@ -113,6 +115,7 @@ void Texture::CreateCube(uint32_t RowLength, uint32_t Width, uint32_t Height, vk
     vma::AllocationCreateInfo allocInfo;
     allocInfo.usage = vma::MemoryUsage::eGpuOnly;
     std::tie(m_Image, m_Allocation) = g_Allocator.createImage(imageInfo, allocInfo);
+    MemoryTracker::Track(m_Allocation, MemoryTracker::kTextures);
 
     m_SubresourceRange.aspectMask = m_AspectMask;
     m_SubresourceRange.baseMipLevel = 0;
@@ -606,6 +609,7 @@ bool Texture::CreateKTXFromMemory(const uint8_t *ktxData, size_t ktxDataSize, bo
     vma::AllocationCreateInfo allocInfo;
     allocInfo.usage = vma::MemoryUsage::eGpuOnly;
     std::tie(m_Image, m_Allocation) = g_Allocator.createImage(imageInfo, allocInfo);
+    MemoryTracker::Track(m_Allocation, MemoryTracker::kTextures);
 
     m_SubresourceRange.aspectMask = m_AspectMask;
     m_SubresourceRange.baseMipLevel = 0;
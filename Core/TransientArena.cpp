@@ -0,0 +1,27 @@
+#include "TransientArena.h"
+#include <algorithm>
+
+void *TransientArena::Alloc(size_t Size, size_t Alignment)
+{
+    for (; m_CurrentBlock < m_Blocks.size(); ++m_CurrentBlock, m_Offset = 0)
+    {
+        Block &block = m_Blocks[m_CurrentBlock];
+        uintptr_t base = (uintptr_t)block.data.get();
+        size_t offset = ((base + m_Offset + Alignment - 1) & ~(uintptr_t)(Alignment - 1)) - base;
+        if (offset + Size <= block.size)
+        {
+            m_Offset = offset + Size;
+            return block.data.get() + offset;
+        }
+    }
+
+    // Oversized requests get a block of their own, which is reused like any other after a reset
+    Block block;
+    block.size = std::max(m_BlockSize, Size + Alignment);
+    block.data.reset(new uint8_t[block.size]);
+    m_Blocks.push_back(std::move(block));
+
+    m_CurrentBlock = m_Blocks.size() - 1;
+    m_Offset = 0;
+    return Alloc(Size, Alignment);
+}
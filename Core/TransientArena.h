@@ -0,0 +1,53 @@
+#pragma once
+
+#include <memory>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+#include <vector>
+
+// Scratch memory for data that only lives while a command context records, like the descriptor writes
+// of a draw. Allocations are bumped out of blocks that are kept when the arena is reset, so once a
+// context has recorded a typical frame it stops touching the heap.
+//
+// Nothing is destructed on Reset, so only trivially destructible types can be allocated.
+class TransientArena
+{
+public:
+    explicit TransientArena(size_t BlockSize = 64 * 1024) : m_BlockSize(BlockSize) {}
+    TransientArena(const TransientArena &) = delete;
+    TransientArena &operator=(const TransientArena &) = delete;
+
+    void *Alloc(size_t Size, size_t Alignment);
+
+    // Value-initialized array of Count elements
+    template <typename T>
+    T *Alloc(size_t Count)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "The arena never runs destructors");
+        T *result = static_cast<T *>(Alloc(Count * sizeof(T), alignof(T)));
+        for (size_t i = 0; i < Count; ++i)
+            new (result + i) T();
+        return result;
+    }
+
+    // Makes every block available again
+    void Reset(void)
+    {
+        m_CurrentBlock = 0;
+        m_Offset = 0;
+    }
+
+private:
+    struct Block
+    {
+        std::unique_ptr<uint8_t[]> data;
+        size_t size;
+    };
+
+    size_t m_BlockSize;
+    std::vector<Block> m_Blocks;
+    size_t m_CurrentBlock = 0;
+    size_t m_Offset = 0;
+};
@@ -22,10 +22,152 @@
 #include "TextureConvert.h"
 #include "Util/VulkanMesh.h"
 #include "glTF.h"
+#include <SystemTime.h>
+#include <Util/CommandLineArg.h>
 
 using namespace glTF;
 using namespace Math;
 
+static MeshOptimizeStats s_OptimizeStats;
+
+void ResetMeshOptimizeStats() { s_OptimizeStats = MeshOptimizeStats(); }
+
+const MeshOptimizeStats &GetMeshOptimizeStats() { return s_OptimizeStats; }
+
+template <typename IndexType>
+static void AddOptimizeStats(const IndexType *indices, size_t faceCount, size_t vertexCount, size_t stride,
+                             bool source)
+{
+    float acmr, atvr;
+    ComputeVertexCacheMissRate(indices, faceCount, vertexCount, 32, acmr, atvr);
+    if (acmr < 0.0f)
+        return;
+
+    double transforms = (double)acmr * faceCount;
+    double fetchBytes = (double)ComputeVertexFetchBytes(indices, faceCount, vertexCount, stride);
+    if (source)
+    {
+        s_OptimizeStats.sourceTransforms += transforms;
+        s_OptimizeStats.sourceFetchBytes += fetchBytes;
+    }
+    else
+    {
+        double usedVertices = atvr > 0.0f ? transforms / atvr : 0.0;
+        s_OptimizeStats.faceCount += faceCount;
+        s_OptimizeStats.vertexCount += usedVertices;
+        s_OptimizeStats.vertexBytes += usedVertices * stride;
+        s_OptimizeStats.transforms += transforms;
+        s_OptimizeStats.fetchBytes += fetchBytes;
+    }
+}
+
+static bool InUnitRange(const glm::vec2 *texcoords, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (glm::any(glm::lessThan(texcoords[i], glm::vec2(0.0f))) ||
+            glm::any(glm::greaterThan(texcoords[i], glm::vec2(1.0f))))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Welds the depth vertices in place and writes their index buffer, returns how many are left.
+// depthVertexOf receives the depth vertex of each main vertex.
+template <typename IndexType>
+static uint32_t BuildDepthStream(const IndexType *indices, uint32_t indexCount, uint32_t vertexCount,
+                                 uint32_t depthStride, std::vector<uint8_t> &depthVB, IndexType *depthIndices,
+                                 uint32_t *depthVertexOf)
+{
+    const size_t faceCount = indexCount / 3;
+
+    VertexStream stream = {depthVB.data(), depthStride, 0};
+    std::unique_ptr<uint32_t[]> vertexRemap(new uint32_t[vertexCount]);
+    size_t depthVertexCount = WeldVertices(&stream, 1, vertexCount, vertexRemap.get());
+    if (depthVertexCount == 0)
+    {
+        memcpy(depthIndices, indices, sizeof(IndexType) * indexCount);
+        for (uint32_t v = 0; v < vertexCount; ++v)
+            depthVertexOf[v] = v;
+        return vertexCount;
+    }
+    memcpy(depthVertexOf, vertexRemap.get(), sizeof(uint32_t) * vertexCount);
+
+    std::vector<uint8_t> weldedVB(depthStride * depthVertexCount);
+    CompactVB(stream, vertexCount, vertexRemap.get(), weldedVB.data());
+
+    std::unique_ptr<IndexType[]> weldedIndices(new IndexType[indexCount]);
+    for (uint32_t k = 0; k < indexCount; ++k)
+        weldedIndices[k] = (IndexType)vertexRemap[indices[k]];
+    OptimizeFaces(weldedIndices.get(), indexCount, depthIndices, 64);
+
+    size_t unusedVertices = 0;
+    if (OptimizeVertices(depthIndices, faceCount, depthVertexCount, vertexRemap.get(), &unusedVertices) &&
+        FinalizeIB(depthIndices, faceCount, vertexRemap.get(), depthVertexCount))
+    {
+        FinalizeVB(weldedVB.data(), depthStride, depthVertexCount, vertexRemap.get());
+        depthVertexCount -= unusedVertices;
+
+        std::unique_ptr<uint32_t[]> newIndex(new uint32_t[depthVertexCount + unusedVertices]);
+        for (uint32_t v = 0; v < depthVertexCount; ++v)
+            newIndex[vertexRemap[v]] = v;
+        for (uint32_t v = 0; v < vertexCount; ++v)
+            depthVertexOf[v] = newIndex[depthVertexOf[v]];
+    }
+
+    weldedVB.resize(depthStride * depthVertexCount);
+    depthVB.swap(weldedVB);
+    return (uint32_t)depthVertexCount;
+}
+
+// -overdrawthreshold enables the overdraw pass on opaque primitives, 0 (the default) leaves it off
+static float GetOverdrawThreshold()
+{
+    static float s_Threshold = []() {
+        float threshold = 0.0f;
+        CommandLineArgs::GetFloat("overdrawthreshold", threshold);
+        return threshold;
+    }();
+    return s_Threshold;
+}
+
+// -lodcount is the number of LODs to build below full detail, 0 (the default) builds none
+static uint32_t GetLODCount()
+{
+    static uint32_t s_Count = []() {
+        uint32_t count = 0;
+        CommandLineArgs::GetInteger("lodcount", count);
+        return std::min(count, ::Mesh::kMaxLODs - 1);
+    }();
+    return s_Count;
+}
+
+// -lodratio is the share of triangles each LOD keeps from the one before
+static float GetLODRatio()
+{
+    static float s_Ratio = []() {
+        float ratio = 0.5f;
+        CommandLineArgs::GetFloat("lodratio", ratio);
+        return glm::clamp(ratio, 0.05f, 0.95f);
+    }();
+    return s_Ratio;
+}
+
+template <typename IndexType>
+static void ReorderForOverdraw(IndexType *indices, size_t faceCount, const glm::vec3 *positions, size_t vertexCount,
+                               float threshold)
+{
+    float sourceOverdraw = ComputeOverdraw(indices, faceCount, positions, vertexCount);
+    if (sourceOverdraw < 0.0f || !OptimizeOverdraw(indices, faceCount, positions, vertexCount, threshold))
+        return;
+
+    s_OptimizeStats.overdrawFaces += faceCount;
+    s_OptimizeStats.sourceOverdraw += (double)sourceOverdraw * faceCount;
+    s_OptimizeStats.overdraw += (double)ComputeOverdraw(indices, faceCount, positions, vertexCount) * faceCount;
+}
+
 static vk::Format JointIndexFormat(const Accessor &accessor)
 {
     switch (accessor.componentType)
@@ -82,7 +224,8 @@ static vk::Format AccessorFormat(const Accessor &accessor)
     }
 }
 
-void OptimizeMesh(Renderer::Primitive &outPrim, const glTF::Primitive &inPrim, const glm::mat4 &localToObject)
+void OptimizeMesh(Renderer::Primitive &outPrim, const glTF::Primitive &inPrim, const glm::mat4 &localToObject,
+                  const AxisAlignedBox *positionBounds, bool unormUVs)
 {
     ASSERT(inPrim.attributes[0] != nullptr, "Must have POSITION");
     uint32_t vertexCount = inPrim.attributes[0]->count;
@@ -96,28 +239,7 @@ void OptimizeMesh(Renderer::Primitive &outPrim, const glTF::Primitive &inPrim, c
     {
         // always process triangle
         ASSERT(inPrim.mode == 4, "Impossible primitive topology when lacking indices");
-
-        // no indice data in inPrim. Generate new ones
-        indexCount = vertexCount * 3;
-        maxIndex = indexCount - 1;
-        if (indexCount > 0xFFFF)
-        {
-            b32BitIndices = true;
-            outPrim.IB = std::make_shared<std::vector<uint8_t>>(4 * indexCount);
-            indices = outPrim.IB->data();
-            uint32_t *tmp = (uint32_t *)indices;
-            for (uint32_t i = 0; i < indexCount; ++i)
-                tmp[i] = i;
-        }
-        else
-        {
-            b32BitIndices = false;
-            outPrim.IB = std::make_shared<std::vector<uint8_t>>(2 * indexCount);
-            indices = outPrim.IB->data();
-            uint16_t *tmp = (uint16_t *)indices;
-            for (uint16_t i = 0; i < indexCount; ++i)
-                tmp[i] = i;
-        }
+        indexCount = vertexCount;
     }
     else
     {
@@ -138,52 +260,9 @@ void OptimizeMesh(Renderer::Primitive &outPrim, const glTF::Primitive &inPrim, c
             Utility::Printf("Found an index buffer that needs to be converted to a triangle list\n");
             return;
         }
-
-        // read indice data from inPrim
-        indices = inPrim.indices->dataPtr;
         indexCount = inPrim.indices->count;
-        if (maxIndex == 0)
-        {
-            // missing maxIndex info, find the max index
-            if (inPrim.indices->componentType == Accessor::kUnsignedInt)
-            {
-                uint32_t *ib = (uint32_t *)inPrim.indices->dataPtr;
-                for (uint32_t k = 0; k < indexCount; ++k)
-                    maxIndex = std::max(ib[k], maxIndex);
-            }
-            else
-            {
-                uint16_t *ib = (uint16_t *)inPrim.indices->dataPtr;
-                for (uint32_t k = 0; k < indexCount; ++k)
-                    maxIndex = std::max<uint32_t>(ib[k], maxIndex);
-            }
-        }
-
-        // optimize face indice and save to outPrim, made sure indice are float type
-        b32BitIndices = maxIndex > 0xFFFF;
-        uint32_t indexSize = b32BitIndices ? 4 : 2;
-        outPrim.IB = std::make_shared<std::vector<uint8_t>>(indexSize * indexCount);
-        if (b32BitIndices)
-        {
-            ASSERT(inPrim.indices->componentType == Accessor::kUnsignedInt);
-            OptimizeFaces((uint32_t *)inPrim.indices->dataPtr, inPrim.indices->count, (uint32_t *)outPrim.IB->data(),
-                          64);
-        }
-        else if (inPrim.indices->componentType == Accessor::kUnsignedShort)
-        {
-            OptimizeFaces((uint16_t *)inPrim.indices->dataPtr, inPrim.indices->count, (uint16_t *)outPrim.IB->data(),
-                          64);
-        }
-        else
-        {
-            OptimizeFaces((uint32_t *)inPrim.indices->dataPtr, inPrim.indices->count, (uint16_t *)outPrim.IB->data(),
-                          64);
-        }
-        indices = outPrim.IB->data();
     }
 
-    ASSERT(maxIndex > 0);
-
     const bool HasNormals = inPrim.attributes[glTF::Primitive::kNormal] != nullptr;
     const bool HasTangents = inPrim.attributes[glTF::Primitive::kTangent] != nullptr;
     const bool HasUV0 = inPrim.attributes[glTF::Primitive::kTexcoord0] != nullptr;
@@ -224,13 +303,126 @@ void OptimizeMesh(Renderer::Primitive &outPrim, const glTF::Primitive &inPrim, c
                                  AccessorFormat(*inPrim.attributes[glTF::Primitive::kWeights0])});
     }
 
+    // Merge the vertices that are identical in every attribute. Exporters leave plenty of them, and without
+    // an index buffer every corner of every face is one. Without normals the duplicates are what keeps the
+    // computed normals faceted, so those primitives keep them.
+    const uint32_t sourceVertexCount = vertexCount;
+    std::unique_ptr<uint32_t[]> weldedIndices;
+    std::unique_ptr<uint8_t[]> weldedStreams[Primitive::kNumAttribs];
+    if (HasNormals)
+    {
+        VertexStream streams[Primitive::kNumAttribs];
+        for (size_t i = 0; i < InputElements.size(); ++i)
+        {
+            const Accessor *attrib = inPrim.attributes[InputElements[i].location];
+            streams[i] = {attrib->dataPtr, vk::blockSize(InputElements[i].format), attrib->stride};
+        }
+
+        std::unique_ptr<uint32_t[]> vertexRemap(new uint32_t[vertexCount]);
+        size_t uniqueVertices = WeldVertices(streams, InputElements.size(), vertexCount, vertexRemap.get());
+        if (uniqueVertices > 0 && uniqueVertices < vertexCount)
+        {
+            weldedIndices.reset(new uint32_t[indexCount]);
+            for (uint32_t k = 0; k < indexCount; ++k)
+            {
+                uint32_t index = k;
+                if (inPrim.indices && inPrim.indices->componentType == Accessor::kUnsignedInt)
+                    index = ((const uint32_t *)inPrim.indices->dataPtr)[k];
+                else if (inPrim.indices)
+                    index = ((const uint16_t *)inPrim.indices->dataPtr)[k];
+                weldedIndices[k] = vertexRemap[index];
+            }
+
+            for (size_t i = 0; i < InputElements.size(); ++i)
+            {
+                std::unique_ptr<uint8_t[]> &stream = weldedStreams[InputElements[i].location];
+                stream.reset(new uint8_t[streams[i].size * uniqueVertices]);
+                CompactVB(streams[i], vertexCount, vertexRemap.get(), stream.get());
+            }
+
+            vertexCount = (uint32_t)uniqueVertices;
+            maxIndex = 0;
+        }
+    }
+    s_OptimizeStats.sourceVertexCount += sourceVertexCount;
+    s_OptimizeStats.weldedVertexCount += vertexCount;
+
+    if (inPrim.indices == nullptr && !weldedIndices)
+    {
+        // no indice data in inPrim. Generate new ones
+        maxIndex = indexCount - 1;
+        if (indexCount > 0xFFFF)
+        {
+            b32BitIndices = true;
+            outPrim.IB = std::make_shared<std::vector<uint8_t>>(4 * indexCount);
+            indices = outPrim.IB->data();
+            uint32_t *tmp = (uint32_t *)indices;
+            for (uint32_t i = 0; i < indexCount; ++i)
+                tmp[i] = i;
+        }
+        else
+        {
+            b32BitIndices = false;
+            outPrim.IB = std::make_shared<std::vector<uint8_t>>(2 * indexCount);
+            indices = outPrim.IB->data();
+            uint16_t *tmp = (uint16_t *)indices;
+            for (uint16_t i = 0; i < indexCount; ++i)
+                tmp[i] = i;
+        }
+    }
+    else
+    {
+        // read indice data from inPrim, or the welded ones
+        const void *sourceIndices = weldedIndices ? (const void *)weldedIndices.get() : inPrim.indices->dataPtr;
+        const bool bSource32BitIndices = weldedIndices || inPrim.indices->componentType == Accessor::kUnsignedInt;
+        if (maxIndex == 0)
+        {
+            // missing maxIndex info, find the max index
+            if (bSource32BitIndices)
+            {
+                const uint32_t *ib = (const uint32_t *)sourceIndices;
+                for (uint32_t k = 0; k < indexCount; ++k)
+                    maxIndex = std::max(ib[k], maxIndex);
+            }
+            else
+            {
+                const uint16_t *ib = (const uint16_t *)sourceIndices;
+                for (uint32_t k = 0; k < indexCount; ++k)
+                    maxIndex = std::max<uint32_t>(ib[k], maxIndex);
+            }
+        }
+
+        // optimize face indice and save to outPrim, made sure indice are float type
+        b32BitIndices = maxIndex > 0xFFFF;
+        uint32_t indexSize = b32BitIndices ? 4 : 2;
+        outPrim.IB = std::make_shared<std::vector<uint8_t>>(indexSize * indexCount);
+        if (b32BitIndices)
+        {
+            ASSERT(bSource32BitIndices);
+            OptimizeFaces((const uint32_t *)sourceIndices, indexCount, (uint32_t *)outPrim.IB->data(), 64);
+        }
+        else if (!bSource32BitIndices)
+        {
+            OptimizeFaces((const uint16_t *)sourceIndices, indexCount, (uint16_t *)outPrim.IB->data(), 64);
+        }
+        else
+        {
+            OptimizeFaces((const uint32_t *)sourceIndices, indexCount, (uint16_t *)outPrim.IB->data(), 64);
+        }
+        indices = outPrim.IB->data();
+    }
+
+    ASSERT(maxIndex > 0);
+
     VBReader vbr;
     vbr.Initialize(InputElements);
 
     for (uint32_t i = 0; i < Primitive::kNumAttribs; ++i)
     {
         Accessor *attrib = inPrim.attributes[i];
-        if (attrib)
+        if (weldedStreams[i])
+            vbr.AddStream(weldedStreams[i].get(), vertexCount, i); // packed
+        else if (attrib)
             vbr.AddStream(attrib->dataPtr, vertexCount, i, attrib->stride);
     }
 
@@ -358,13 +550,142 @@ void OptimizeMesh(Renderer::Primitive &outPrim, const glTF::Primitive &inPrim, c
         ASSERT_SUCCEEDED(vbr.Read(weights.get(), glTF::Primitive::kWeights0, vertexCount));
     }
 
+    const size_t faceCount = indexCount / 3;
+
+    // Blended primitives are sorted back to front by the renderer, for the rest order the faces to occlude
+    // more of the mesh early on. This trades some of the vertex cache efficiency OptimizeFaces gained.
+    const float overdrawThreshold = GetOverdrawThreshold();
+    if (overdrawThreshold > 0.0f && !material.alphaBlend)
+    {
+        if (b32BitIndices)
+            ReorderForOverdraw((uint32_t *)indices, faceCount, position.get(), vertexCount, overdrawThreshold);
+        else
+            ReorderForOverdraw((uint16_t *)indices, faceCount, position.get(), vertexCount, overdrawThreshold);
+    }
+
+    // Reorder the vertices by first use in the optimized index buffer. Both the main and the depth vertex
+    // buffer are written from these streams, so both are fetched front to back. Unused vertices are dropped.
+    std::unique_ptr<uint32_t[]> vertexRemap(new uint32_t[vertexCount]);
+    size_t unusedVertices = 0;
+    bool remapped;
+    if (b32BitIndices)
+    {
+        remapped = OptimizeVertices((uint32_t *)indices, faceCount, vertexCount, vertexRemap.get(), &unusedVertices) &&
+                   FinalizeIB((uint32_t *)indices, faceCount, vertexRemap.get(), vertexCount);
+    }
+    else
+    {
+        remapped = OptimizeVertices((uint16_t *)indices, faceCount, vertexCount, vertexRemap.get(), &unusedVertices) &&
+                   FinalizeIB((uint16_t *)indices, faceCount, vertexRemap.get(), vertexCount);
+    }
+    if (remapped)
+    {
+        FinalizeVB(position.get(), sizeof(glm::vec3), vertexCount, vertexRemap.get());
+        FinalizeVB(normal.get(), sizeof(glm::vec3), vertexCount, vertexRemap.get());
+        if (tangent.get())
+            FinalizeVB(tangent.get(), sizeof(glm::vec4), vertexCount, vertexRemap.get());
+        if (texcoord0.get())
+            FinalizeVB(texcoord0.get(), sizeof(glm::vec2), vertexCount, vertexRemap.get());
+        if (texcoord1.get())
+            FinalizeVB(texcoord1.get(), sizeof(glm::vec2), vertexCount, vertexRemap.get());
+        if (HasSkin)
+        {
+            FinalizeVB(joints.get(), sizeof(glm::vec4), vertexCount, vertexRemap.get());
+            FinalizeVB(weights.get(), sizeof(glm::vec4), vertexCount, vertexRemap.get());
+        }
+        vertexCount -= (uint32_t)unusedVertices;
+    }
+
+    // Cut the final face order into meshlets the renderer can cull one by one. Skinned positions move away
+    // from their bounds.
+    if (!HasSkin)
+    {
+        bool built;
+        if (b32BitIndices)
+        {
+            built = ComputeMeshlets((const uint32_t *)indices, faceCount, position.get(), vertexCount,
+                                    outPrim.meshlets);
+        }
+        else
+        {
+            built = ComputeMeshlets((const uint16_t *)indices, faceCount, position.get(), vertexCount,
+                                    outPrim.meshlets);
+        }
+        if (!built)
+            outPrim.meshlets.clear();
+
+        s_OptimizeStats.meshletCount += outPrim.meshlets.size();
+        for (const Meshlet &meshlet : outPrim.meshlets)
+        {
+            s_OptimizeStats.meshletFaces += meshlet.faceCount;
+            s_OptimizeStats.coneMeshlets += meshlet.coneCutoff < 1.0f ? 1 : 0;
+        }
+    }
+
+    // Each LOD is simplified from full detail, so its error is measured against the real surface. The chain
+    // ends where the simplifier stalls on borders and seams or the error grows past a tenth of the radius.
+    const uint32_t lodCount = b32BitIndices ? 0 : GetLODCount();
+    if (lodCount > 0)
+    {
+        const float maxError = outPrim.m_BoundsLS.GetRadius() * 0.1f;
+        std::unique_ptr<uint16_t[]> lodIndices(new uint16_t[indexCount]);
+        size_t lastFaces = faceCount;
+        for (uint32_t level = 1; level <= lodCount; ++level)
+        {
+            size_t lodFaces;
+            float error;
+            if (!SimplifyMesh((const uint16_t *)indices, faceCount, position.get(), vertexCount,
+                              (size_t)(lastFaces * GetLODRatio()), maxError, lodIndices.get(), lodFaces, error) ||
+                lodFaces == 0 || lodFaces > lastFaces * 9 / 10)
+            {
+                break;
+            }
+
+            Renderer::Primitive::LOD lod;
+            lod.IB = std::make_shared<std::vector<uint8_t>>(lodFaces * 3 * sizeof(uint16_t));
+            OptimizeFaces(lodIndices.get(), lodFaces * 3, (uint16_t *)lod.IB->data(), 64);
+            lod.primCount = (uint32_t)lodFaces * 3;
+            lod.error = error;
+            outPrim.lods.push_back(lod);
+            lastFaces = lodFaces;
+        }
+
+        if (!outPrim.lods.empty())
+        {
+            s_OptimizeStats.lodPrimitives++;
+            s_OptimizeStats.lodCount += outPrim.lods.size();
+            s_OptimizeStats.lodSourceFaces += faceCount;
+            s_OptimizeStats.coarsestFaces += lastFaces;
+        }
+    }
+
+    // Quantized positions go to [0, 1] within the bounds, the node's World maps them back
+    ASSERT(positionBounds == nullptr || !HasSkin, "Skinned positions can't be quantized");
+    std::unique_ptr<glm::vec3[]> quantizedPosition;
+    if (positionBounds)
+    {
+        const glm::vec3 boundsMin = positionBounds->GetMin();
+        const glm::vec3 invExtent = 1.0f / positionBounds->GetDimensions();
+        quantizedPosition.reset(new glm::vec3[vertexCount]);
+        for (uint32_t v = 0; v < vertexCount; ++v)
+            quantizedPosition[v] = (position[v] - boundsMin) * invExtent;
+    }
+    glm::vec3 *storedPosition = quantizedPosition ? quantizedPosition.get() : position.get();
+    const vk::Format positionFormat =
+        quantizedPosition ? vk::Format::eR16G16B16A16Unorm : vk::Format::eR32G32B32Sfloat;
+
+    const bool UnormUV0 = unormUVs && texcoord0.get() && InUnitRange(texcoord0.get(), vertexCount);
+    const bool UnormUV1 = unormUVs && texcoord1.get() && InUnitRange(texcoord1.get(), vertexCount);
+
     // Use VBWriter to generate a new, interleaved and compressed vertex buffer
     std::vector<vk::VertexInputAttributeDescription> OutputElements;
 
     outPrim.psoFlags = PSOFlags::kHasPosition | PSOFlags::kHasNormal;
     uint32_t inputOffset = 0;
-    OutputElements.push_back({0, 0, vk::Format::eR32G32B32Sfloat, inputOffset}); // position
-    inputOffset += vk::blockSize(vk::Format::eR32G32B32Sfloat);
+    OutputElements.push_back({0, 0, positionFormat, inputOffset}); // position
+    inputOffset += vk::blockSize(positionFormat);
+    if (quantizedPosition)
+        outPrim.psoFlags |= PSOFlags::kQuantizedPosition;
     OutputElements.push_back({1, 0, vk::Format::eA2B10G10R10SnormPack32, inputOffset}); // normal
     inputOffset += vk::blockSize(vk::Format::eA2B10G10R10SnormPack32);
     if (tangent.get())
@@ -375,15 +696,17 @@ void OptimizeMesh(Renderer::Primitive &outPrim, const glTF::Primitive &inPrim, c
     }
     if (texcoord0.get())
     {
-        OutputElements.push_back({3, 0, vk::Format::eR16G16Sfloat, inputOffset}); // texcoord
-        inputOffset += vk::blockSize(vk::Format::eR16G16Sfloat);
-        outPrim.psoFlags |= PSOFlags::kHasUV0;
+        const vk::Format format = UnormUV0 ? vk::Format::eR16G16Unorm : vk::Format::eR16G16Sfloat;
+        OutputElements.push_back({3, 0, format, inputOffset}); // texcoord
+        inputOffset += vk::blockSize(format);
+        outPrim.psoFlags |= PSOFlags::kHasUV0 | (UnormUV0 ? PSOFlags::kUnormUV0 : 0);
     }
     if (texcoord1.get())
     {
-        OutputElements.push_back({4, 0, vk::Format::eR16G16Sfloat, inputOffset}); // texcoord
-        inputOffset += vk::blockSize(vk::Format::eR16G16Sfloat);
-        outPrim.psoFlags |= PSOFlags::kHasUV1;
+        const vk::Format format = UnormUV1 ? vk::Format::eR16G16Unorm : vk::Format::eR16G16Sfloat;
+        OutputElements.push_back({4, 0, format, inputOffset}); // texcoord
+        inputOffset += vk::blockSize(format);
+        outPrim.psoFlags |= PSOFlags::kHasUV1 | (UnormUV1 ? PSOFlags::kUnormUV1 : 0);
     }
     if (HasSkin)
     {
@@ -410,10 +733,32 @@ void OptimizeMesh(Renderer::Primitive &outPrim, const glTF::Primitive &inPrim, c
     ComputeInputLayout(layout, offsets, strides);
     uint32_t stride = strides[0];
 
+    // Source order is the glTF index buffer against the glTF vertex order
+    if (inPrim.indices == nullptr)
+    {
+        // Every corner is its own vertex, read once front to back
+        s_OptimizeStats.sourceTransforms += 3.0 * faceCount;
+        s_OptimizeStats.sourceFetchBytes += (double)sourceVertexCount * stride;
+    }
+    else if (inPrim.indices->componentType == Accessor::kUnsignedInt)
+    {
+        AddOptimizeStats((const uint32_t *)inPrim.indices->dataPtr, faceCount, sourceVertexCount, stride, true);
+    }
+    else
+    {
+        AddOptimizeStats((const uint16_t *)inPrim.indices->dataPtr, faceCount, sourceVertexCount, stride, true);
+    }
+    if (b32BitIndices)
+        AddOptimizeStats((const uint32_t *)indices, faceCount, vertexCount, stride, false);
+    else
+        AddOptimizeStats((const uint16_t *)indices, faceCount, vertexCount, stride, false);
+
     outPrim.VB = std::make_shared<std::vector<uint8_t>>(stride * vertexCount);
     ASSERT_SUCCEEDED(vbw.AddStream(outPrim.VB->data(), vertexCount, 0, stride));
 
-    vbw.Write(position.get(), 0, vertexCount);
+    CpuTimer packTimer;
+    packTimer.Start();
+    vbw.Write(storedPosition, 0, vertexCount);
     vbw.Write(normal.get(), 1, vertexCount); // TODO: why here x2bias?
     if (tangent.get())
         vbw.Write(tangent.get(), 2, vertexCount); // TODO: why here x2bias?
@@ -428,11 +773,11 @@ void OptimizeMesh(Renderer::Primitive &outPrim, const glTF::Primitive &inPrim, c
     }
 
     // Now write a VB for positions only (or positions and UV when alpha testing)
-    uint32_t depthStride = 12;
+    uint32_t depthStride = vk::blockSize(positionFormat);
     std::vector<vk::VertexInputAttributeDescription> DepthElements;
     inputOffset = 0;
-    DepthElements.push_back({0, 0, vk::Format::eR32G32B32Sfloat, inputOffset}); // position
-    inputOffset += vk::blockSize(vk::Format::eR32G32B32Sfloat);
+    DepthElements.push_back({0, 0, positionFormat, inputOffset}); // position
+    inputOffset += vk::blockSize(positionFormat);
     if (material.alphaTest)
     {
         depthStride += 4;
@@ -454,7 +799,7 @@ void OptimizeMesh(Renderer::Primitive &outPrim, const glTF::Primitive &inPrim, c
     outPrim.DepthVB = std::make_shared<std::vector<uint8_t>>(depthStride * vertexCount);
     ASSERT_SUCCEEDED(dvbw.AddStream(outPrim.DepthVB->data(), vertexCount, 0, depthStride));
 
-    dvbw.Write(position.get(), 0, vertexCount);
+    dvbw.Write(storedPosition, 0, vertexCount);
     if (material.alphaTest)
     {
         dvbw.Write(material.baseColorUV ? texcoord1.get() : texcoord0.get(), 1, vertexCount);
@@ -464,14 +809,164 @@ void OptimizeMesh(Renderer::Primitive &outPrim, const glTF::Primitive &inPrim, c
         dvbw.Write(joints.get(), 2, vertexCount);
         dvbw.Write(weights.get(), 3, vertexCount);
     }
+    packTimer.Stop();
+    s_OptimizeStats.packedVertices += 2 * vertexCount;
+    s_OptimizeStats.packSeconds += packTimer.GetTime();
+
+    // Normal and UV seams split vertices the depth passes don't care about. Weld the depth stream on what it
+    // holds and give it an index buffer of its own, cache and fetch optimized like the main one.
+    outPrim.DepthIB = std::make_shared<std::vector<uint8_t>>(outPrim.IB->size());
+    std::unique_ptr<uint32_t[]> depthVertexOf(new uint32_t[vertexCount]);
+    uint32_t depthVertexCount;
+    if (b32BitIndices)
+    {
+        depthVertexCount = BuildDepthStream((const uint32_t *)indices, indexCount, vertexCount, depthStride,
+                                            *outPrim.DepthVB, (uint32_t *)outPrim.DepthIB->data(),
+                                            depthVertexOf.get());
+    }
+    else
+    {
+        depthVertexCount = BuildDepthStream((const uint16_t *)indices, indexCount, vertexCount, depthStride,
+                                            *outPrim.DepthVB, (uint16_t *)outPrim.DepthIB->data(),
+                                            depthVertexOf.get());
+    }
+    s_OptimizeStats.depthVertexCount += depthVertexCount;
+
+    // The depth passes draw the same LOD as the color pass, which tests for equal depth
+    for (Renderer::Primitive::LOD &lod : outPrim.lods)
+    {
+        std::unique_ptr<uint16_t[]> depthIndices(new uint16_t[lod.primCount]);
+        const uint16_t *ib = (const uint16_t *)lod.IB->data();
+        for (uint32_t k = 0; k < lod.primCount; ++k)
+            depthIndices[k] = (uint16_t)depthVertexOf[ib[k]];
+        lod.DepthIB = std::make_shared<std::vector<uint8_t>>(lod.IB->size());
+        OptimizeFaces(depthIndices.get(), lod.primCount, (uint16_t *)lod.DepthIB->data(), 64);
+    }
 
     ASSERT(material.index < 0x8000, "Only 15-bit material indices allowed");
 
     outPrim.vertexStride = (uint16_t)stride;
+    outPrim.depthVertexStride = (uint16_t)depthStride;
     outPrim.index32 = b32BitIndices ? 1 : 0;
     outPrim.materialIdx = material.index;
 
     outPrim.primCount = indexCount;
+}
+
+void SplitPrimitive(const Renderer::Primitive &prim, std::vector<Renderer::Primitive> &chunks)
+{
+    ASSERT(prim.index32, "Only primitives with 32-bit indices need splitting");
+    ASSERT(prim.lods.empty(), "LODs are only built for 16-bit indices");
+
+    const uint32_t *indices = (const uint32_t *)prim.IB->data();
+    const uint32_t *depthIndices = (const uint32_t *)prim.DepthIB->data();
+    const size_t faceCount = prim.primCount / 3;
+    const size_t vertexCount = prim.VB->size() / prim.vertexStride;
+    const size_t depthVertexCount = prim.DepthVB->size() / prim.depthVertexStride;
+
+    // Which chunk a vertex was last added to and its index there
+    std::vector<uint32_t> chunkOf(vertexCount, ~0u), localIndex(vertexCount);
+    std::vector<uint32_t> depthChunkOf(depthVertexCount, ~0u), depthLocalIndex(depthVertexCount);
+    std::vector<uint32_t> chunkVertices, chunkDepthVertices;
+
+    auto newVertices = [](const uint32_t *f, const std::vector<uint32_t> &owner, uint32_t chunk) {
+        uint32_t count = 0;
+        for (uint32_t j = 0; j < 3; ++j)
+        {
+            bool repeated = (j > 0 && f[j] == f[0]) || (j > 1 && f[j] == f[1]);
+            count += (owner[f[j]] != chunk && !repeated) ? 1 : 0;
+        }
+        return count;
+    };
+    auto addVertices = [](const uint32_t *f, std::vector<uint32_t> &owner, std::vector<uint32_t> &local,
+                          std::vector<uint32_t> &vertices, uint32_t chunk) {
+        for (uint32_t j = 0; j < 3; ++j)
+        {
+            if (owner[f[j]] != chunk)
+            {
+                owner[f[j]] = chunk;
+                local[f[j]] = (uint32_t)vertices.size();
+                vertices.push_back(f[j]);
+            }
+        }
+    };
+    auto gatherVertices = [](const std::vector<uint8_t> &vb, size_t stride, const std::vector<uint32_t> &vertices) {
+        auto out = std::make_shared<std::vector<uint8_t>>(stride * vertices.size());
+        for (size_t v = 0; v < vertices.size(); ++v)
+            memcpy(out->data() + v * stride, vb.data() + vertices[v] * stride, stride);
+        return out;
+    };
+
+    auto removeVertices = [](std::vector<uint32_t> &owner, std::vector<uint32_t> &vertices, size_t count) {
+        for (size_t v = count; v < vertices.size(); ++v)
+            owner[vertices[v]] = ~0u;
+        vertices.resize(count);
+    };
+
+    // Faces stay in their cache optimized order. Both streams take the same number of faces, their own
+    // next ones, until either would need more vertices than 16-bit indices reach. Meshlets move as a whole.
+    const uint32_t kMaxVertices = 0x10000;
+    size_t face = 0;
+    size_t meshlet = 0;
+    for (uint32_t chunk = 0; face < faceCount; ++chunk)
+    {
+        const size_t firstFace = face;
+        const size_t firstMeshlet = meshlet;
+        chunkVertices.clear();
+        chunkDepthVertices.clear();
+        while (face < faceCount)
+        {
+            const size_t runEnd = meshlet < prim.meshlets.size()
+                                      ? prim.meshlets[meshlet].firstFace + prim.meshlets[meshlet].faceCount
+                                      : face + 1;
+            const size_t vertexMark = chunkVertices.size();
+            const size_t depthVertexMark = chunkDepthVertices.size();
+            size_t runFace = face;
+            for (; runFace < runEnd; ++runFace)
+            {
+                const uint32_t *f = indices + runFace * 3;
+                const uint32_t *df = depthIndices + runFace * 3;
+                if (chunkVertices.size() + newVertices(f, chunkOf, chunk) > kMaxVertices ||
+                    chunkDepthVertices.size() + newVertices(df, depthChunkOf, chunk) > kMaxVertices)
+                {
+                    break;
+                }
+                addVertices(f, chunkOf, localIndex, chunkVertices, chunk);
+                addVertices(df, depthChunkOf, depthLocalIndex, chunkDepthVertices, chunk);
+            }
+            if (runFace < runEnd)
+            {
+                // The run starts the next chunk
+                removeVertices(chunkOf, chunkVertices, vertexMark);
+                removeVertices(depthChunkOf, chunkDepthVertices, depthVertexMark);
+                break;
+            }
+            face = runEnd;
+            if (meshlet < prim.meshlets.size())
+                ++meshlet;
+        }
 
-    // TODO:  Generate optimized depth-only streams
+        const uint32_t indexCount = (uint32_t)(face - firstFace) * 3;
+        Renderer::Primitive out = prim;
+        out.index32 = 0;
+        out.primCount = indexCount;
+        out.IB = std::make_shared<std::vector<uint8_t>>(indexCount * sizeof(uint16_t));
+        out.DepthIB = std::make_shared<std::vector<uint8_t>>(indexCount * sizeof(uint16_t));
+        uint16_t *ib = (uint16_t *)out.IB->data();
+        uint16_t *dib = (uint16_t *)out.DepthIB->data();
+        for (uint32_t k = 0; k < indexCount; ++k)
+        {
+            ib[k] = (uint16_t)localIndex[indices[firstFace * 3 + k]];
+            dib[k] = (uint16_t)depthLocalIndex[depthIndices[firstFace * 3 + k]];
+        }
+        out.VB = gatherVertices(*prim.VB, prim.vertexStride, chunkVertices);
+        out.DepthVB = gatherVertices(*prim.DepthVB, prim.depthVertexStride, chunkDepthVertices);
+        out.meshlets.assign(prim.meshlets.begin() + firstMeshlet, prim.meshlets.begin() + meshlet);
+        for (Meshlet &m : out.meshlets)
+            m.firstFace -= (uint32_t)firstFace;
+        chunks.push_back(out);
+
+        s_OptimizeStats.splitDraws++;
+    }
+    s_OptimizeStats.splitPrimitives++;
 }
@@ -13,12 +13,14 @@
 
 #pragma once
 
+#include "Util/VulkanMesh.h"
 #include "glTF.h"
 #include <Math/BoundingBox.h>
 #include <Math/BoundingSphere.h>
 
 #include <cstdint>
 #include <string>
+#include <vector>
 
 namespace Renderer
 {
@@ -26,6 +28,15 @@ using namespace Math;
 
 struct Primitive
 {
+    // A coarser version of the primitive over the same vertices
+    struct LOD
+    {
+        Utility::ByteArray IB;      // Same index format as the primitive's IB
+        Utility::ByteArray DepthIB; // The same triangles over DepthVB
+        uint32_t primCount;
+        float error; // Local space distance the simplification moved the surface by
+    };
+
     BoundingSphere m_BoundsLS; // local space bounds
     BoundingSphere m_BoundsOS; // object space bounds
     AxisAlignedBox m_BBoxLS;   // local space AABB
@@ -33,6 +44,9 @@ struct Primitive
     Utility::ByteArray VB;
     Utility::ByteArray IB;
     Utility::ByteArray DepthVB;
+    Utility::ByteArray DepthIB;    // Same triangles and index format as IB, over the welded DepthVB
+    std::vector<Meshlet> meshlets; // Consecutive faces of IB, empty when the primitive is skinned
+    std::vector<LOD> lods;         // Finest first, empty for primitives with 32-bit indices
     uint32_t primCount;
     union {
         uint32_t hash;
@@ -44,7 +58,51 @@ struct Primitive
         };
     };
     uint16_t vertexStride;
+    uint16_t depthVertexStride;
 };
 } // namespace Renderer
 
-void OptimizeMesh(Renderer::Primitive &outPrim, const glTF::Primitive &inPrim, const glm::mat4 &localToObject);
\ No newline at end of file
+// With positionBounds, positions are stored as 16-bit unorm within it, skinned primitives can't be. With
+// unormUVs, texture coordinates that stay within [0, 1] are stored as 16-bit unorm instead of half floats.
+// -lodcount adds up to that many simplified LODs to primitives with 16-bit indices, each with -lodratio
+// (0.5 by default) of the triangles of the one before.
+void OptimizeMesh(Renderer::Primitive &outPrim, const glTF::Primitive &inPrim, const glm::mat4 &localToObject,
+                  const Math::AxisAlignedBox *positionBounds, bool unormUVs);
+
+// Splits a primitive with 32-bit indices into primitives with 16-bit indices and at most 65536 vertices,
+// duplicating the vertices shared across the split. They stay in one mesh as separate draws, and the split
+// falls between meshlets.
+void SplitPrimitive(const Renderer::Primitive &prim, std::vector<Renderer::Primitive> &chunks);
+
+// How the converted primitives use the post-transform cache and the vertex fetch path, in the source order
+// and after OptimizeMesh. Summed over every OptimizeMesh call since the last reset.
+struct MeshOptimizeStats
+{
+    uint64_t sourceVertexCount = 0; // Vertices in the glTF attribute streams
+    uint64_t weldedVertexCount = 0; // Distinct ones after welding
+    uint64_t depthVertexCount = 0;  // Vertices in the depth-only buffers
+    uint64_t faceCount = 0;
+    double vertexCount = 0.0;      // Vertices referenced by a face
+    double vertexBytes = 0.0;      // Their size in the main vertex buffer
+    double sourceTransforms = 0.0; // Vertices transformed with a 32 entry FIFO cache
+    double transforms = 0.0;
+    double sourceFetchBytes = 0.0; // Bytes read from the main vertex buffer through 64 byte lines
+    double fetchBytes = 0.0;
+    uint64_t overdrawFaces = 0;  // Faces of the primitives the overdraw pass reordered
+    double sourceOverdraw = 0.0; // Their overdraw before and after the pass, weighted by face count
+    double overdraw = 0.0;
+    uint64_t splitPrimitives = 0; // Primitives with 32-bit indices SplitPrimitive broke up
+    uint64_t splitDraws = 0;      // The 16-bit draws they became
+    uint64_t meshletCount = 0;    // Meshlets of the unskinned primitives
+    uint64_t meshletFaces = 0;
+    uint64_t coneMeshlets = 0;   // Those whose faces are close enough in direction to be cone culled
+    uint64_t lodPrimitives = 0;  // Primitives that got LODs
+    uint64_t lodCount = 0;       // The LODs they got
+    uint64_t lodSourceFaces = 0; // Their full detail faces
+    uint64_t coarsestFaces = 0;  // And those left in their coarsest LOD
+    uint64_t packedVertices = 0; // Vertices VBWriter packed into the main and depth-only buffers
+    double packSeconds = 0.0;    // And the time it took
+};
+
+void ResetMeshOptimizeStats();
+const MeshOptimizeStats &GetMeshOptimizeStats();
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "Model.h"
 #include <Math/BoundingSphere.h>
+#include <cfloat>
+#include <cmath>
 #include <vulkan/vulkan_handles.hpp>
 
 using namespace Math;
@@ -14,10 +16,11 @@ void Model::Destroy()
     m_NumMeshes = 0;
     m_MeshData = nullptr;
     m_SceneGraph = nullptr;
+    m_PositionDequant = nullptr;
 }
 
-void Model::Render(MeshSorter &sorter, const UniformBuffer &meshConstants, const ScaleAndTranslation sphereTransforms[],
-                   const Joint *skeleton) const
+void Model::Render(MeshSorter &sorter, const UniformBuffer &meshConstants, const MeshConstants *meshConstantsCPU,
+                   const ScaleAndTranslation sphereTransforms[], const Joint *skeleton) const
 {
     // Pointer to current mesh
     const uint8_t *pMesh = m_MeshData.get();
@@ -25,6 +28,11 @@ void Model::Render(MeshSorter &sorter, const UniformBuffer &meshConstants, const
     const Frustum &frustum = sorter.GetViewFrustum();
     const AffineTransform &viewMat = AffineTransform(sorter.GetViewMatrix());
 
+    // Pixels per unit of radius at unit depth, perspective projections divide by the depth
+    const glm::mat4 &projMat = sorter.GetProjMatrix();
+    const bool perspective = projMat[2][3] != 0.0f;
+    const float pixelScale = std::abs(projMat[1][1]) * 0.5f * sorter.GetViewportHeight();
+
     for (uint32_t i = 0; i < m_NumMeshes; ++i)
     {
         const Mesh &mesh = *(const Mesh *)pMesh;
@@ -34,10 +42,21 @@ void Model::Render(MeshSorter &sorter, const UniformBuffer &meshConstants, const
         BoundingSphere sphereWS = sphereXform * sphereLS;                                               // world space
         BoundingSphere sphereVS = BoundingSphere(viewMat * sphereWS.GetCenter(), sphereWS.GetRadius()); // view space
 
+        // Meshes the camera is inside of are drawn in full
+        float depth = perspective ? -sphereVS.GetCenter().z : 1.0f;
+        float pixelRadius =
+            perspective && depth <= sphereVS.GetRadius() ? FLT_MAX : sphereVS.GetRadius() * pixelScale / depth;
+
         // only intersections will be add
-        if (frustum.IntersectSphere(sphereVS))
+        if (frustum.IntersectSphere(sphereVS) && 2.0f * pixelRadius >= SmallMeshPixels)
         {
             float distance = -sphereVS.GetCenter().z - sphereVS.GetRadius();
+
+            // The coarsest LOD whose error stays within LODErrorPixels on screen
+            uint32_t lod = 0;
+            while (lod + 1 < mesh.numLODs && mesh.lodError[lod + 1] * pixelRadius <= LODErrorPixels)
+                ++lod;
+
             vk::DescriptorBufferInfo meshInfo;
             meshInfo.buffer = meshConstants.GetBuffer();
             meshInfo.offset = mesh.meshUB * sizeof(MeshConstants);
@@ -46,10 +65,24 @@ void Model::Render(MeshSorter &sorter, const UniformBuffer &meshConstants, const
             matInfo.buffer = m_MaterialConstants.GetBuffer();
             matInfo.offset = mesh.materialUB * sizeof(MaterialConstants);
             matInfo.range = sizeof(MaterialConstants);
-            sorter.AddMesh(mesh, distance, meshInfo, matInfo, m_DataBuffer, skeleton);
+
+            // The clusters are bounded before the positions were quantized
+            glm::mat4 localToWorld;
+            if (mesh.numClusters > 0 && lod == 0)
+            {
+                localToWorld = meshConstantsCPU[mesh.meshUB].World;
+                if (m_PositionDequant)
+                    localToWorld *= glm::inverse(m_PositionDequant[mesh.meshUB]);
+            }
+            sorter.AddMesh(mesh, distance, meshInfo, matInfo, m_DataBuffer, skeleton,
+                           mesh.numClusters > 0 && lod == 0 ? &localToWorld : nullptr, lod);
+        }
+        else
+        {
+            sorter.AddCulledMesh();
         }
 
-        pMesh += sizeof(Mesh) + (mesh.numDraws - 1) * sizeof(Mesh::Draw);
+        pMesh += sizeof(Mesh) + (mesh.numDraws * mesh.numLODs - 1) * sizeof(Mesh::Draw);
     }
 }
 
@@ -58,8 +91,8 @@ void ModelInstance::Render(MeshSorter &sorter) const
     if (m_Model != nullptr)
     {
         // const Frustum& frustum = sorter.GetWorldFrustum();
-        m_Model->Render(sorter, m_MeshConstantsGPU, (const ScaleAndTranslation *)m_BoundingSphereTransforms.get(),
-                        m_Skeleton.get());
+        m_Model->Render(sorter, m_MeshConstantsGPU, m_MeshConstantsCPU.get(),
+                        (const ScaleAndTranslation *)m_BoundingSphereTransforms.get(), m_Skeleton.get());
     }
 }
 
@@ -77,9 +110,10 @@ ModelInstance &ModelInstance::operator=(std::shared_ptr<const Model> sourceModel
     m_Locator = UniformTransform(kIdentity);
 
     static_assert((alignof(MeshConstants) & 255) == 0, "Uniform Buffers needs 256 byte alignment");
+    m_MeshConstantsUploaded = false;
     if (sourceModel == nullptr)
     {
-        m_MeshConstantsCPU.Destroy();
+        m_MeshConstantsCPU = nullptr;
         m_MeshConstantsGPU.Destroy();
         m_BoundingSphereTransforms = nullptr;
         m_AnimGraph = nullptr;
@@ -88,7 +122,7 @@ ModelInstance &ModelInstance::operator=(std::shared_ptr<const Model> sourceModel
     }
     else
     {
-        m_MeshConstantsCPU.Create(sourceModel->m_NumNodes * sizeof(MeshConstants));
+        m_MeshConstantsCPU.reset(new MeshConstants[sourceModel->m_NumNodes]);
         m_MeshConstantsGPU.Create(sourceModel->m_NumNodes * sizeof(MeshConstants));
         m_BoundingSphereTransforms.reset(new glm::vec4[sourceModel->m_NumNodes]);
         m_Skeleton.reset(new Joint[sourceModel->m_NumJoints]);
@@ -121,7 +155,11 @@ void ModelInstance::Update(GraphicsContext &gfxContext, float deltaTime)
     glm::mat4 ParentMatrix = glm::mat4((AffineTransform)m_Locator);
 
     ScaleAndTranslation *boundingSphereTransforms = (ScaleAndTranslation *)m_BoundingSphereTransforms.get();
-    MeshConstants *cb = (MeshConstants *)m_MeshConstantsCPU.Map();
+    MeshConstants *cb = m_MeshConstantsCPU.get();
+
+    // Range of nodes whose constants changed since the last upload
+    uint32_t dirtyBegin = m_MeshConstantsUploaded ? m_Model->m_NumNodes : 0;
+    uint32_t dirtyEnd = m_MeshConstantsUploaded ? 0 : m_Model->m_NumNodes;
 
     if (m_AnimGraph)
     {
@@ -152,11 +190,17 @@ void ModelInstance::Update(GraphicsContext &gfxContext, float deltaTime)
 
         // Concatenate the transform with the parent's matrix and update the matrix list
         {
-            // Scoped so that I don't forget that I'm pointing to write-combined memory and
-            // should not read from it.
             MeshConstants &cbv = cb[Node->matrixIdx];
-            cbv.World = xform;
-            cbv.WorldIT = glm::transpose(glm::inverse(glm::mat3(xform)));
+            // Quantized positions are mapped back to mesh space first, normals aren't quantized
+            glm::mat4 world = m_Model->m_PositionDequant ? xform * m_Model->m_PositionDequant[Node->matrixIdx] : xform;
+            glm::mat4 worldIT = glm::transpose(glm::inverse(glm::mat3(xform)));
+            if (cbv.World != world || cbv.WorldIT != worldIT)
+            {
+                cbv.World = world;
+                cbv.WorldIT = worldIT;
+                dirtyBegin = std::min(dirtyBegin, (uint32_t)Node->matrixIdx);
+                dirtyEnd = std::max(dirtyEnd, (uint32_t)Node->matrixIdx + 1);
+            }
 
             float scaleXSqr = LengthSquare(glm::vec3(xform[0]));
             float scaleYSqr = LengthSquare(glm::vec3(xform[1]));
@@ -191,18 +235,22 @@ void ModelInstance::Update(GraphicsContext &gfxContext, float deltaTime)
     for (uint32_t i = 0; i < m_Model->m_NumJoints; ++i)
     {
         Joint &joint = m_Skeleton[i];
-        joint.posXform = cb[m_Model->m_JointIndices[i]].World * m_Model->m_JointIBMs[i];
+        uint16_t nodeIdx = m_Model->m_JointIndices[i];
+        glm::mat4 jointXform = cb[nodeIdx].World;
+        if (m_Model->m_PositionDequant && m_Model->m_PositionDequant[nodeIdx] != glm::mat4(1.0f))
+            jointXform *= glm::inverse(m_Model->m_PositionDequant[nodeIdx]);
+        joint.posXform = jointXform * m_Model->m_JointIBMs[i];
         joint.nrmXform = glm::transpose(glm::inverse(glm::mat3(joint.posXform)));
     }
 
-    m_MeshConstantsCPU.Unmap();
-
-    // gfxContext.TransitionResource(m_MeshConstantsGPU, D3D12_RESOURCE_STATE_COPY_DEST, true);
-    // gfxContext.GetCommandList()->CopyBufferRegion(m_MeshConstantsGPU.GetResource(), 0,
-    // m_MeshConstantsCPU.GetResource(),
-    //                                               0, m_MeshConstantsCPU.GetBufferSize());
-    // gfxContext.TransitionResource(m_MeshConstantsGPU, D3D12_RESOURCE_STATE_GENERIC_READ);
-    gfxContext.InitializeBuffer(m_MeshConstantsGPU, m_MeshConstantsCPU, 0);
+    // Record the copy into the frame's command buffer instead of waiting for a one-off upload.
+    // Static instances don't upload anything after the first frame.
+    if (dirtyBegin < dirtyEnd)
+    {
+        gfxContext.WriteBuffer(m_MeshConstantsGPU, dirtyBegin * sizeof(MeshConstants), &cb[dirtyBegin],
+                               (dirtyEnd - dirtyBegin) * sizeof(MeshConstants));
+    }
+    m_MeshConstantsUploaded = true;
 }
 
 void ModelInstance::Resize(float newRadius)
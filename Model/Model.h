@@ -47,12 +47,17 @@ enum : uint16_t
     kAlphaBlend = 0x020,
     kAlphaTest = 0x040,
     kTwoSided = 0x080,
-    kHasSkin = 0x100, // Implies having indices and weights
+    kHasSkin = 0x100,           // Implies having indices and weights
+    kQuantizedPosition = 0x200, // 16-bit unorm within the node's position box
+    kUnormUV0 = 0x400,          // 16-bit unorm instead of half
+    kUnormUV1 = 0x800,
 };
 }
 
 struct Mesh
 {
+    static constexpr uint32_t kMaxLODs = 4;
+
     float bounds[4];        // A bounding sphere
     uint32_t vbOffset;      // BufferLocation - Buffer.GpuVirtualAddress
     uint32_t vbSize;        // SizeInBytes
@@ -60,6 +65,10 @@ struct Mesh
     uint32_t vbDepthSize;   // SizeInBytes
     uint32_t ibOffset;      // BufferLocation - Buffer.GpuVirtualAddress
     uint32_t ibSize;        // SizeInBytes
+    uint32_t ibDepthOffset; // BufferLocation - Buffer.GpuVirtualAddress
+    uint32_t ibDepthSize;   // SizeInBytes
+    uint32_t clusterOffset; // BufferLocation of the DrawClusters, a multiple of their size
+    uint32_t numClusters;   // Over all draws, 0 when the mesh is only drawn whole
     uint8_t vbStride;       // StrideInBytes
     uint8_t ibFormat;       // DXGI_FORMAT
     uint16_t meshUB;        // Index of mesh constant buffer
@@ -72,16 +81,33 @@ struct Mesh
     uint16_t numJoints;  // Number of skeleton joints when skinning
     uint16_t startJoint; // Flat offset to first joint index
     uint16_t numDraws;   // Number of draw groups
+    uint16_t numLODs;    // draw holds numDraws draws for each LOD in turn, full detail first
+
+    // How far the surface of each LOD strays from full detail, relative to the bounding radius
+    float lodError[kMaxLODs];
 
     struct Draw
     {
-        uint32_t primCount;  // Number of indices = 3 * number of triangles
-        uint32_t startIndex; // Offset to first index in index buffer
-        uint32_t baseVertex; // Offset to first vertex in vertex buffer
+        uint32_t primCount;       // Number of indices = 3 * number of triangles
+        uint32_t startIndex;      // Offset to first index in index buffer
+        uint32_t baseVertex;      // Offset to first vertex in vertex buffer
+        uint32_t depthStartIndex; // Same for the depth-only index and vertex buffers
+        uint32_t depthBaseVertex;
     };
     Draw draw[1]; // Actually 1 or more draws
 };
 
+// A meshlet as the cluster culling shader reads it. The sphere and cone are in the space of the node before
+// position dequantization, the draw covers the meshlet's faces in the mesh's main index buffer.
+struct DrawCluster // 32 bytes
+{
+    float sphere[4];     // Center and radius
+    uint32_t cone;       // Axis and cutoff as snorm8, the cutoff rounded up. A cutoff of 1 disables the test
+    uint32_t firstIndex; // Relative to Mesh::ibOffset
+    uint32_t indexCount;
+    int32_t baseVertex;
+};
+
 struct GraphNode // 96 bytes
 {
     glm::mat4 xform;
@@ -106,13 +132,14 @@ class Model
 public:
     Model()
         : m_DataBuffer(vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer |
-                           vk::BufferUsageFlagBits::eIndexBuffer,
+                           vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eStorageBuffer,
                        vma::MemoryUsage::eGpuOnly)
     {
     }
     ~Model() { Destroy(); }
 
-    void Render(Renderer::MeshSorter &sorter, const UniformBuffer &meshConstants,
+    // meshConstantsCPU is the CPU copy of meshConstants, the cluster culling reads the world matrices from it
+    void Render(Renderer::MeshSorter &sorter, const UniformBuffer &meshConstants, const MeshConstants *meshConstantsCPU,
                 const Math::ScaleAndTranslation sphereTransforms[], const Joint *skeleton) const;
 
     Math::BoundingSphere m_BoundingSphere; // Object-space bounding sphere
@@ -131,6 +158,7 @@ public:
     std::unique_ptr<AnimationSet[]> m_Animations;
     std::unique_ptr<uint16_t[]> m_JointIndices;
     std::unique_ptr<glm::mat4[]> m_JointIBMs;
+    std::unique_ptr<glm::mat4[]> m_PositionDequant; // Per node, null when no mesh has quantized positions
 
 protected:
     void Destroy();
@@ -140,11 +168,7 @@ class ModelInstance
 {
 public:
     ModelInstance() {}
-    ~ModelInstance()
-    {
-        m_MeshConstantsCPU.Destroy();
-        m_MeshConstantsGPU.Destroy();
-    }
+    ~ModelInstance() { m_MeshConstantsGPU.Destroy(); }
     ModelInstance(std::shared_ptr<const Model> sourceModel);
     ModelInstance(const ModelInstance &modelInstance);
 
@@ -171,8 +195,9 @@ public:
 
 private:
     std::shared_ptr<const Model> m_Model;
-    StagingBuffer m_MeshConstantsCPU;
+    std::unique_ptr<MeshConstants[]> m_MeshConstantsCPU; // Shadow copy used to find changed nodes
     UniformBuffer m_MeshConstantsGPU;
+    bool m_MeshConstantsUploaded = false;
     std::unique_ptr<glm::vec4[]> m_BoundingSphereTransforms;
     Math::UniformTransform m_Locator;
 
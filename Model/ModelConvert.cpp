@@ -4,7 +4,10 @@
 #include "UniformBuffers.h"
 #include "glTF.h"
 #include <Math/Common.h>
+#include <Util/CommandLineArg.h>
 #include <Utility.h>
+#include <algorithm>
+#include <cmath>
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/glm.hpp>
 
@@ -16,9 +19,38 @@ static inline glm::vec3 SafeNormalize(glm::vec3 x)
     return lenSq < 1e-10f ? CreateXUnitVector() : x * glm::inversesqrt(lenSq);
 }
 
+// Axis and cutoff as snorm8. The cutoff grows by the error of the rounded axis so the test stays conservative.
+static uint32_t PackCone(const Meshlet &meshlet)
+{
+    int8_t packed[4] = {0, 0, 0, 127};
+    if (meshlet.coneCutoff < 1.0f)
+    {
+        float error = 0.0f;
+        for (int i = 0; i < 3; ++i)
+        {
+            packed[i] = (int8_t)glm::clamp(std::round(meshlet.coneAxis[i] * 127.0f), -127.0f, 127.0f);
+            error += std::abs(packed[i] / 127.0f - meshlet.coneAxis[i]);
+        }
+        packed[3] = (int8_t)std::min(127.0f, std::ceil((meshlet.coneCutoff + error) * 127.0f));
+    }
+    return (uint32_t)(uint8_t)packed[0] | (uint32_t)(uint8_t)packed[1] << 8 | (uint32_t)(uint8_t)packed[2] << 16 |
+           (uint32_t)(uint8_t)packed[3] << 24;
+}
+
+// -quantizevertices 1 stores positions and texture coordinates as 16-bit unorm where it can
+static bool QuantizeVertices()
+{
+    static bool s_Quantize = []() {
+        uint32_t quantize = 0;
+        CommandLineArgs::GetInteger("quantizevertices", quantize);
+        return quantize != 0;
+    }();
+    return s_Quantize;
+}
+
 void Renderer::CompileMesh(std::vector<Mesh *> &meshList, std::vector<uint8_t> &bufferMemory, glTF::Mesh &srcMesh,
                            uint32_t matrixIdx, const glm::mat4 &localToObject, BoundingSphere &boundingSphere,
-                           AxisAlignedBox &boundingBox)
+                           AxisAlignedBox &boundingBox, glm::mat4 &positionDequant)
 {
     // We still have a lot of work to do.  Now that we know about all of the primitives in this mesh
     // and have standardized their vertex buffer streams, we must set out to identify which primitives
@@ -28,16 +60,46 @@ void Renderer::CompileMesh(std::vector<Mesh *> &meshList, std::vector<uint8_t> &
     size_t totalVertexSize = 0;
     size_t totalDepthVertexSize = 0;
     size_t totalIndexSize = 0;
+    size_t totalDepthIndexSize = 0;
+    size_t totalClusterCount = 0;
 
     BoundingSphere sphereOS(kZero);
     AxisAlignedBox bboxOS(kZero);
 
-    std::vector<Primitive> primitives(srcMesh.primitives.size());
-    for (uint32_t i = 0; i < primitives.size(); ++i)
+    // All primitives share the node's mesh constants, so their positions are quantized within one box that
+    // World maps back. Skinning happens before World is applied, so skinned meshes stay in float.
+    bool quantizePositions = QuantizeVertices();
+    AxisAlignedBox positionBounds;
+    for (const glTF::Primitive &prim : srcMesh.primitives)
+    {
+        if (prim.attributes[glTF::Primitive::kJoints0] != nullptr)
+            quantizePositions = false;
+        positionBounds.AddPoint(glm::vec3(prim.minPos[0], prim.minPos[1], prim.minPos[2]));
+        positionBounds.AddPoint(glm::vec3(prim.maxPos[0], prim.maxPos[1], prim.maxPos[2]));
+    }
+    positionDequant = glm::mat4(1.0f);
+    if (quantizePositions)
+    {
+        // Keep flat meshes from dividing by zero
+        glm::vec3 extent = glm::max(positionBounds.GetDimensions(), glm::vec3(1e-6f));
+        positionBounds = AxisAlignedBox(positionBounds.GetMin(), positionBounds.GetMin() + extent);
+        positionDequant = glm::scale(glm::translate(glm::mat4(1.0f), positionBounds.GetMin()), extent);
+    }
+
+    // Large primitives become several draws with 16-bit indices rather than one with 32-bit indices
+    std::vector<Primitive> primitives;
+    primitives.reserve(srcMesh.primitives.size());
+    for (uint32_t i = 0; i < srcMesh.primitives.size(); ++i)
     {
-        OptimizeMesh(primitives[i], srcMesh.primitives[i], localToObject);
-        sphereOS = sphereOS.Union(primitives[i].m_BoundsOS);
-        bboxOS.AddBoundingBox(primitives[i].m_BBoxOS);
+        Primitive prim;
+        OptimizeMesh(prim, srcMesh.primitives[i], localToObject, quantizePositions ? &positionBounds : nullptr,
+                     QuantizeVertices());
+        sphereOS = sphereOS.Union(prim.m_BoundsOS);
+        bboxOS.AddBoundingBox(prim.m_BBoxOS);
+        if (prim.index32)
+            SplitPrimitive(prim, primitives);
+        else
+            primitives.push_back(prim);
     }
 
     boundingSphere = sphereOS;
@@ -51,9 +113,25 @@ void Renderer::CompileMesh(std::vector<Mesh *> &meshList, std::vector<uint8_t> &
         totalVertexSize += prim.VB->size();
         totalDepthVertexSize += prim.DepthVB->size();
         totalIndexSize += Math::AlignUp(prim.IB->size(), 4);
+        totalDepthIndexSize += Math::AlignUp(prim.DepthIB->size(), 4);
+        totalClusterCount += prim.meshlets.size();
+        for (const Primitive::LOD &lod : prim.lods)
+        {
+            totalIndexSize += Math::AlignUp(lod.IB->size(), 4);
+            totalDepthIndexSize += Math::AlignUp(lod.DepthIB->size(), 4);
+        }
     }
 
-    uint32_t totalBufferSize = (uint32_t)(totalVertexSize + totalDepthVertexSize + totalIndexSize);
+    // The culling shader reads the clusters as one array over the whole data buffer, so they start at a
+    // multiple of their size. Meshes without clusters don't pad the buffer.
+    const size_t geometrySize = totalVertexSize + totalDepthVertexSize + totalIndexSize + totalDepthIndexSize;
+    uint32_t curClusterOffset = (uint32_t)geometrySize;
+    if (totalClusterCount > 0)
+    {
+        curClusterOffset =
+            (uint32_t)(Math::AlignUp(bufferMemory.size() + geometrySize, sizeof(DrawCluster)) - bufferMemory.size());
+    }
+    uint32_t totalBufferSize = curClusterOffset + (uint32_t)(totalClusterCount * sizeof(DrawCluster));
 
     Utility::ByteArray stagingBuffer;
     stagingBuffer.reset(new std::vector<uint8_t>(totalBufferSize));
@@ -62,14 +140,23 @@ void Renderer::CompileMesh(std::vector<Mesh *> &meshList, std::vector<uint8_t> &
     uint32_t curVBOffset = 0;
     uint32_t curDepthVBOffset = (uint32_t)totalVertexSize;
     uint32_t curIBOffset = curDepthVBOffset + (uint32_t)totalDepthVertexSize;
+    uint32_t curDepthIBOffset = curIBOffset + (uint32_t)totalIndexSize;
 
     for (auto &iter : renderMeshes)
     {
+        // Draws without as many LODs as the others repeat their coarsest one
         size_t numDraws = iter.second.size();
-        Mesh *mesh = (Mesh *)malloc(sizeof(Mesh) + sizeof(Mesh::Draw) * (numDraws - 1));
+        size_t numLODs = 1;
+        for (auto &draw : iter.second)
+            numLODs = std::max(numLODs, draw->lods.size() + 1);
+        Mesh *mesh = (Mesh *)malloc(sizeof(Mesh) + sizeof(Mesh::Draw) * (numDraws * numLODs - 1));
         size_t vbSize = 0;
         size_t vbDepthSize = 0;
         size_t ibSize = 0;
+        size_t ibDepthSize = 0;
+
+        size_t numClusters = 0;
+        bool hasClusters = true;
 
         // Compute local space bounding sphere for all submeshes
         BoundingSphere collectiveSphere(kZero);
@@ -79,8 +166,18 @@ void Renderer::CompileMesh(std::vector<Mesh *> &meshList, std::vector<uint8_t> &
             vbSize += draw->VB->size();
             vbDepthSize += draw->DepthVB->size();
             ibSize += draw->IB->size();
+            ibDepthSize += draw->DepthIB->size();
+            for (const Primitive::LOD &lod : draw->lods)
+            {
+                ibSize += lod.IB->size();
+                ibDepthSize += lod.DepthIB->size();
+            }
+            numClusters += draw->meshlets.size();
+            hasClusters = hasClusters && !draw->meshlets.empty();
             collectiveSphere = collectiveSphere.Union(draw->m_BoundsLS);
         }
+        if (!hasClusters)
+            numClusters = 0;
 
         mesh->bounds[0] = collectiveSphere.GetCenter().x;
         mesh->bounds[1] = collectiveSphere.GetCenter().y;
@@ -92,6 +189,10 @@ void Renderer::CompileMesh(std::vector<Mesh *> &meshList, std::vector<uint8_t> &
         mesh->vbDepthSize = (uint32_t)vbDepthSize;
         mesh->ibOffset = (uint32_t)bufferMemory.size() + curIBOffset;
         mesh->ibSize = (uint32_t)ibSize;
+        mesh->ibDepthOffset = (uint32_t)bufferMemory.size() + curDepthIBOffset;
+        mesh->ibDepthSize = (uint32_t)ibDepthSize;
+        mesh->clusterOffset = (uint32_t)bufferMemory.size() + curClusterOffset;
+        mesh->numClusters = (uint32_t)numClusters;
         mesh->vbStride = (uint8_t)iter.second[0]->vertexStride;
         mesh->ibFormat = uint8_t(iter.second[0]->index32 ? vk::IndexType::eUint32 : vk::IndexType::eUint16);
         mesh->meshUB = (uint16_t)matrixIdx;
@@ -110,27 +211,85 @@ void Renderer::CompileMesh(std::vector<Mesh *> &meshList, std::vector<uint8_t> &
         }
 
         mesh->numDraws = (uint16_t)numDraws;
+        mesh->numLODs = (uint16_t)numLODs;
+        for (uint32_t lod = 0; lod < Mesh::kMaxLODs; ++lod)
+            mesh->lodError[lod] = 0.0f;
 
         uint32_t drawIdx = 0;
         uint32_t curVertOffset = 0;
+        uint32_t curDepthVertOffset = 0;
         uint32_t curIndexOffset = 0;
+        uint32_t curDepthIndexOffset = 0;
         for (auto &draw : iter.second)
         {
             Mesh::Draw &d = mesh->draw[drawIdx++];
             d.primCount = draw->primCount;
             d.baseVertex = curVertOffset;
             d.startIndex = curIndexOffset;
-            std::memcpy(uploadMem + curVBOffset + curVertOffset, draw->VB->data(), draw->VB->size());
+            d.depthBaseVertex = curDepthVertOffset;
+            d.depthStartIndex = curDepthIndexOffset;
+            std::memcpy(uploadMem + curVBOffset + curVertOffset * draw->vertexStride, draw->VB->data(),
+                        draw->VB->size());
             curVertOffset += (uint32_t)draw->VB->size() / draw->vertexStride;
-            std::memcpy(uploadMem + curDepthVBOffset, draw->DepthVB->data(), draw->DepthVB->size());
-            std::memcpy(uploadMem + curIBOffset + curIndexOffset, draw->IB->data(), draw->IB->size());
+            std::memcpy(uploadMem + curDepthVBOffset + curDepthVertOffset * draw->depthVertexStride,
+                        draw->DepthVB->data(), draw->DepthVB->size());
+            curDepthVertOffset += (uint32_t)draw->DepthVB->size() / draw->depthVertexStride;
+            std::memcpy(uploadMem + curIBOffset + (curIndexOffset << (draw->index32 + 1)), draw->IB->data(),
+                        draw->IB->size());
             curIndexOffset += (uint32_t)draw->IB->size() >> (draw->index32 + 1);
+            std::memcpy(uploadMem + curDepthIBOffset + (curDepthIndexOffset << (draw->index32 + 1)),
+                        draw->DepthIB->data(), draw->DepthIB->size());
+            curDepthIndexOffset += (uint32_t)draw->DepthIB->size() >> (draw->index32 + 1);
+
+            if (numClusters == 0)
+                continue;
+            for (const Meshlet &meshlet : draw->meshlets)
+            {
+                DrawCluster cluster;
+                cluster.sphere[0] = meshlet.center.x;
+                cluster.sphere[1] = meshlet.center.y;
+                cluster.sphere[2] = meshlet.center.z;
+                cluster.sphere[3] = meshlet.radius;
+                cluster.cone = PackCone(meshlet);
+                cluster.firstIndex = d.startIndex + meshlet.firstFace * 3;
+                cluster.indexCount = meshlet.faceCount * 3;
+                cluster.baseVertex = (int32_t)d.baseVertex;
+                std::memcpy(uploadMem + curClusterOffset, &cluster, sizeof(cluster));
+                curClusterOffset += sizeof(DrawCluster);
+            }
+        }
+
+        // The coarser LODs follow in the index buffers, drawn over the same vertices. A mesh's LOD is as far
+        // off as its worst draw.
+        for (uint32_t lod = 1; lod < numLODs; ++lod)
+        {
+            for (uint32_t i = 0; i < numDraws; ++i)
+            {
+                const Primitive &prim = *iter.second[i];
+                Mesh::Draw &d = mesh->draw[lod * numDraws + i];
+                d = mesh->draw[(lod - 1) * numDraws + i];
+                if (lod > prim.lods.size())
+                    continue;
+
+                const Primitive::LOD &source = prim.lods[lod - 1];
+                d.primCount = source.primCount;
+                d.startIndex = curIndexOffset;
+                d.depthStartIndex = curDepthIndexOffset;
+                std::memcpy(uploadMem + curIBOffset + (curIndexOffset << (prim.index32 + 1)), source.IB->data(),
+                            source.IB->size());
+                curIndexOffset += (uint32_t)source.IB->size() >> (prim.index32 + 1);
+                std::memcpy(uploadMem + curDepthIBOffset + (curDepthIndexOffset << (prim.index32 + 1)),
+                            source.DepthIB->data(), source.DepthIB->size());
+                curDepthIndexOffset += (uint32_t)source.DepthIB->size() >> (prim.index32 + 1);
+                mesh->lodError[lod] = std::max(mesh->lodError[lod], source.error / mesh->bounds[3]);
+            }
+            mesh->lodError[lod] = std::max(mesh->lodError[lod], mesh->lodError[lod - 1]);
         }
 
         curVBOffset += (uint32_t)vbSize;
         curDepthVBOffset += (uint32_t)vbDepthSize;
         curIBOffset += (uint32_t)Math::AlignUp(ibSize, 4);
-        curIndexOffset = Math::AlignUp(curIndexOffset, 4);
+        curDepthIBOffset += (uint32_t)Math::AlignUp(ibDepthSize, 4);
 
         meshList.push_back(mesh);
     }
@@ -138,9 +297,10 @@ void Renderer::CompileMesh(std::vector<Mesh *> &meshList, std::vector<uint8_t> &
     bufferMemory.insert(bufferMemory.end(), stagingBuffer->begin(), stagingBuffer->end());
 }
 
-static uint32_t WalkGraph(std::vector<GraphNode> &sceneGraph, BoundingSphere &modelBSphere, AxisAlignedBox &modelBBox,
-                          std::vector<Mesh *> &meshList, std::vector<uint8_t> &bufferMemory,
-                          const std::vector<glTF::Node *> &siblings, uint32_t curPos, const glm::mat4 &xform)
+static uint32_t WalkGraph(std::vector<GraphNode> &sceneGraph, std::vector<glm::mat4> &positionDequant,
+                          BoundingSphere &modelBSphere, AxisAlignedBox &modelBBox, std::vector<Mesh *> &meshList,
+                          std::vector<uint8_t> &bufferMemory, const std::vector<glTF::Node *> &siblings,
+                          uint32_t curPos, const glm::mat4 &xform)
 {
     size_t numSiblings = siblings.size();
 
@@ -177,7 +337,8 @@ static uint32_t WalkGraph(std::vector<GraphNode> &sceneGraph, BoundingSphere &mo
         {
             BoundingSphere sphereOS;
             AxisAlignedBox boxOS;
-            CompileMesh(meshList, bufferMemory, *curNode->mesh, curPos, LocalXform, sphereOS, boxOS);
+            CompileMesh(meshList, bufferMemory, *curNode->mesh, curPos, LocalXform, sphereOS, boxOS,
+                        positionDequant[curPos]);
             modelBSphere = modelBSphere.Union(sphereOS);
             modelBBox.AddBoundingBox(boxOS);
         }
@@ -187,8 +348,8 @@ static uint32_t WalkGraph(std::vector<GraphNode> &sceneGraph, BoundingSphere &mo
         if (curNode->children.size() > 0)
         {
             thisGraphNode.hasChildren = 1;
-            nextPos = WalkGraph(sceneGraph, modelBSphere, modelBBox, meshList, bufferMemory, curNode->children, nextPos,
-                                LocalXform);
+            nextPos = WalkGraph(sceneGraph, positionDequant, modelBSphere, modelBBox, meshList, bufferMemory,
+                                curNode->children, nextPos, LocalXform);
         }
 
         // Are there more siblings?
@@ -411,6 +572,7 @@ bool Renderer::BuildModel(ModelData &model, const glTF::Asset &asset, int sceneI
 
     // Generate scene graph and meshes
     model.m_SceneGraph.resize(asset.m_nodes.size());
+    model.m_PositionDequant.assign(asset.m_nodes.size(), glm::mat4(1.0f));
     const glTF::Scene *scene = sceneIdx < 0 ? asset.m_scene : &asset.m_scenes[sceneIdx];
     if (scene == nullptr)
         return false;
@@ -420,9 +582,65 @@ bool Renderer::BuildModel(ModelData &model, const glTF::Asset &asset, int sceneI
 
     model.m_BoundingSphere = BoundingSphere(kZero);
     model.m_BoundingBox = AxisAlignedBox(kZero);
-    uint32_t numNodes = WalkGraph(model.m_SceneGraph, model.m_BoundingSphere, model.m_BoundingBox, model.m_Meshes,
-                                  bufferMemory, scene->nodes, 0, glm::mat4(kIdentity));
+    ResetMeshOptimizeStats();
+    uint32_t numNodes = WalkGraph(model.m_SceneGraph, model.m_PositionDequant, model.m_BoundingSphere,
+                                  model.m_BoundingBox, model.m_Meshes, bufferMemory, scene->nodes, 0,
+                                  glm::mat4(kIdentity));
     model.m_SceneGraph.resize(numNodes);
+    model.m_PositionDequant.resize(numNodes);
+    if (std::all_of(model.m_PositionDequant.begin(), model.m_PositionDequant.end(),
+                    [](const glm::mat4 &m) { return m == glm::mat4(1.0f); }))
+    {
+        model.m_PositionDequant.clear();
+    }
+
+    const MeshOptimizeStats &stats = GetMeshOptimizeStats();
+    if (stats.weldedVertexCount < stats.sourceVertexCount)
+    {
+        Utility::Printf("Welded %llu vertices to %llu\n", (unsigned long long)stats.sourceVertexCount,
+                        (unsigned long long)stats.weldedVertexCount);
+    }
+    if (stats.faceCount > 0 && stats.vertexCount > 0.0)
+    {
+        Utility::Printf("Optimized %llu triangles: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, overfetch %.2f -> %.2f\n",
+                        (unsigned long long)stats.faceCount, stats.sourceTransforms / stats.faceCount,
+                        stats.transforms / stats.faceCount, stats.sourceTransforms / stats.vertexCount,
+                        stats.transforms / stats.vertexCount, stats.sourceFetchBytes / stats.vertexBytes,
+                        stats.fetchBytes / stats.vertexBytes);
+    }
+    if (stats.depthVertexCount > 0 && stats.vertexCount > 0.0)
+    {
+        Utility::Printf("Depth-only streams hold %llu vertices, %.2f per main vertex\n",
+                        (unsigned long long)stats.depthVertexCount, stats.depthVertexCount / stats.vertexCount);
+    }
+    if (stats.splitPrimitives > 0)
+    {
+        Utility::Printf("Split %llu primitives with 32-bit indices into %llu draws with 16-bit indices\n",
+                        (unsigned long long)stats.splitPrimitives, (unsigned long long)stats.splitDraws);
+    }
+    if (stats.meshletCount > 0)
+    {
+        Utility::Printf("Built %llu meshlets, %.1f triangles each, %.1f%% can be cone culled\n",
+                        (unsigned long long)stats.meshletCount, (double)stats.meshletFaces / stats.meshletCount,
+                        100.0 * stats.coneMeshlets / stats.meshletCount);
+    }
+    if (stats.lodPrimitives > 0)
+    {
+        Utility::Printf("Built %llu LODs for %llu primitives, the coarsest keep %.1f%% of their triangles\n",
+                        (unsigned long long)stats.lodCount, (unsigned long long)stats.lodPrimitives,
+                        100.0 * stats.coarsestFaces / stats.lodSourceFaces);
+    }
+    if (stats.packedVertices > 0)
+    {
+        Utility::Printf("Packed %llu vertices in %.2f ms, %.1f ns each\n", (unsigned long long)stats.packedVertices,
+                        stats.packSeconds * 1000.0, stats.packSeconds * 1e9 / stats.packedVertices);
+    }
+    if (stats.overdrawFaces > 0)
+    {
+        Utility::Printf("Reordered %llu triangles for overdraw: %.3f -> %.3f\n",
+                        (unsigned long long)stats.overdrawFaces, stats.sourceOverdraw / stats.overdrawFaces,
+                        stats.overdraw / stats.overdrawFaces);
+    }
 
     BuildAnimations(model, asset);
     BuildSkins(model, asset);
@@ -91,7 +91,7 @@ void LoadMaterials(Model &model, const std::vector<MaterialTextureData> &materia
         uint32_t offset = tableOffsets[mesh.materialUB];
         mesh.imageTable = offset;
         mesh.pso = Renderer::GetPSO(mesh.psoFlags);
-        meshPtr += sizeof(Mesh) + (mesh.numDraws - 1) * sizeof(Mesh::Draw);
+        meshPtr += sizeof(Mesh) + (mesh.numDraws * mesh.numLODs - 1) * sizeof(Mesh::Draw);
     }
 }
 
@@ -137,7 +137,7 @@ std::shared_ptr<Model> Renderer::LoadModel(const std::string &filePath, bool for
     size_t meshDataSize = 0;
     for (auto &mesh : modelData.m_Meshes)
     {
-        meshDataSize += sizeof(Mesh) + (mesh->numDraws - 1) * sizeof(Mesh::Draw);
+        meshDataSize += sizeof(Mesh) + (mesh->numDraws * mesh->numLODs - 1) * sizeof(Mesh::Draw);
     }
     model->m_MeshData.reset(new uint8_t[meshDataSize]);
 
@@ -154,10 +154,17 @@ std::shared_ptr<Model> Renderer::LoadModel(const std::string &filePath, bool for
 
     memcpy(model->m_SceneGraph.get(), modelData.m_SceneGraph.data(), model->m_NumNodes * sizeof(GraphNode));
 
+    if (!modelData.m_PositionDequant.empty())
+    {
+        model->m_PositionDequant.reset(new glm::mat4[model->m_NumNodes]);
+        memcpy(model->m_PositionDequant.get(), modelData.m_PositionDequant.data(),
+               model->m_NumNodes * sizeof(glm::mat4));
+    }
+
     char *meshPtr = (char *)model->m_MeshData.get();
     for (auto &mesh : modelData.m_Meshes)
     {
-        size_t meshSize = sizeof(Mesh) + (mesh->numDraws - 1) * sizeof(Mesh::Draw);
+        size_t meshSize = sizeof(Mesh) + (mesh->numDraws * mesh->numLODs - 1) * sizeof(Mesh::Draw);
         memcpy(meshPtr, mesh, meshSize);
         meshPtr += meshSize;
     }
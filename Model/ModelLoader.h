@@ -47,13 +47,14 @@ struct ModelData
     std::vector<MaterialConstantData> m_MaterialConstants;
     std::vector<Mesh *> m_Meshes;
     std::vector<GraphNode> m_SceneGraph;
+    std::vector<glm::mat4> m_PositionDequant; // Per node, empty when no mesh has quantized positions
     std::vector<std::string> m_TextureNames;
     std::vector<uint8_t> m_TextureOptions;
 };
 
 void CompileMesh(std::vector<Mesh *> &meshList, std::vector<uint8_t> &bufferMemory, glTF::Mesh &srcMesh,
                  uint32_t matrixIdx, const glm::mat4 &localToObject, Math::BoundingSphere &boundingSphere,
-                 Math::AxisAlignedBox &boundingBox);
+                 Math::AxisAlignedBox &boundingBox, glm::mat4 &positionDequant);
 
 bool BuildModel(ModelData &model, const glTF::Asset &asset, int sceneIdx = -1);
 
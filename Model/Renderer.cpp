@@ -5,6 +5,7 @@
 #include <CommandContext.h>
 #include <DepthBuffer.h>
 #include <DescriptorSet.h>
+#include <FrameStats.h>
 #include <Framebuffer.h>
 #include <GpuBuffer.h>
 #include <GraphicsCommon.h>
@@ -21,6 +22,7 @@
 
 #include <stb_image.h>
 
+#include <CompiledShaders/ClusterCullComp.h>
 #include <CompiledShaders/CutoutDepthFrag.h>
 #include <CompiledShaders/CutoutDepthSkinVert.h>
 #include <CompiledShaders/CutoutDepthVert.h>
@@ -47,6 +49,9 @@ using namespace Renderer;
 namespace Renderer
 {
 BoolVar SeparateZPass("Renderer/Separate Z Pass", true);
+BoolVar ClusterCulling("Renderer/Cluster Culling", true);
+NumVar LODErrorPixels("Renderer/LOD Error (pixels)", 1.0f, 0.0f, 16.0f, 0.25f);
+NumVar SmallMeshPixels("Renderer/Small Mesh Cull (pixels)", 1.0f, 0.0f, 16.0f, 0.25f);
 
 bool s_Initialized = false;
 
@@ -72,12 +77,33 @@ DescriptorSet m_DescriptorSet;
 GraphicsPSO m_SkyboxPSO("Renderer: Skybox PSO");
 GraphicsPSO m_DefaultPSO("Renderer: Default PSO"); // Not finalized.  Used as a template.
 
+// Matches ClusterCullComp.comp
+struct ClusterCullConstants
+{
+    glm::mat4 localToView;
+    float radiusScale;
+    uint32_t firstCluster;
+    uint32_t numClusters;
+    uint32_t firstCommand;
+    uint32_t coneCulling;
+};
+DescriptorSet s_ClusterCullDS;
+ComputePSO s_ClusterCullPSO("Renderer: Cluster Cull PSO");
+
 vk::Sampler DefaultSampler;
 vk::Sampler CubeMapSampler;
 std::vector<vk::DescriptorImageInfo> m_CommonCubeTextures;
 std::vector<vk::DescriptorImageInfo> m_Common2DTextures;
 std::vector<vk::DescriptorImageInfo> m_CommonShadowTextures;
 // std::vector<vk::DescriptorImageInfo> m_CommonTextures;
+
+// Considered and culled are indexed by batch type, drawn by pass
+FrameCounter s_MeshesConsidered[] = {FrameCounter("Meshes considered"), FrameCounter("Shadow meshes considered")};
+FrameCounter s_MeshesCulled[] = {FrameCounter("Meshes culled"), FrameCounter("Shadow meshes culled")};
+FrameCounter s_MeshesDrawn[] = {FrameCounter("Meshes drawn, depth"), FrameCounter("Meshes drawn, opaque"),
+                                FrameCounter("Meshes drawn, transparent")};
+FrameCounter s_ShadowMeshesDrawn("Shadow meshes drawn");
+FrameCounter s_ClustersConsidered("Clusters considered");
 } // namespace Renderer
 
 void Renderer::Initialize()
@@ -122,7 +148,7 @@ void Renderer::Initialize()
     m_DescriptorSet.Finalize();
 
     vk::Format ColorFormat = g_SceneColorBuffer.GetFormat();
-    vk::Format DepthFormat = g_SceneDepthBuffer.GetFormat();
+    vk::Format DepthFormat = DefaultDepthFormat;
 
     VertexInputBindingAttribute posOnly = {// binding, stride, inputRate
                                            {0, 4 * 3, vk::VertexInputRate::eVertex},
@@ -151,6 +177,18 @@ void Renderer::Initialize()
          {2, 0, vk::Format::eR16G16B16A16Uint, 4 * 3 + 4},            // jointIndices
          {3, 0, vk::Format::eR16G16B16A16Unorm, 4 * 3 + 4 + 4 * 2}}}; // jointWeights
 
+    // Quantized positions are never skinned
+    VertexInputBindingAttribute quantizedPosOnly = {// binding, stride, inputRate
+                                                    {0, 2 * 4, vk::VertexInputRate::eVertex},
+                                                    {// location, binding, format, offset
+                                                     {0, 0, vk::Format::eR16G16B16A16Unorm, 0}}}; // position
+
+    VertexInputBindingAttribute quantizedPosAndUV = {// binding, stride, inputRate
+                                                     {0, 2 * 4 + 4, vk::VertexInputRate::eVertex},
+                                                     {// location, binding, format, offset
+                                                      {0, 0, vk::Format::eR16G16B16A16Unorm, 0},  // position
+                                                      {1, 0, vk::Format::eR16G16Sfloat, 2 * 4}}}; // uv0
+
     // Depth only PSOs
     GraphicsPSO DepthOnlyPSO("Renderer: Depth Only PSO");
     DepthOnlyPSO.SetPipelineLayout(m_DescriptorSet.GetPipelineLayout());
@@ -186,31 +224,51 @@ void Renderer::Initialize()
     SkinCutoutDepthPSO.Finalize();
     sm_PSOs.push_back(SkinCutoutDepthPSO); // PSO3
 
-    ASSERT(sm_PSOs.size() == 4);
+    GraphicsPSO QuantizedDepthOnlyPSO = DepthOnlyPSO;
+    QuantizedDepthOnlyPSO.SetInputLayout(quantizedPosOnly);
+    QuantizedDepthOnlyPSO.Finalize();
+    sm_PSOs.push_back(QuantizedDepthOnlyPSO); // PSO4
+
+    GraphicsPSO QuantizedCutoutDepthPSO = CutoutDepthPSO;
+    QuantizedCutoutDepthPSO.SetInputLayout(quantizedPosAndUV);
+    QuantizedCutoutDepthPSO.Finalize();
+    sm_PSOs.push_back(QuantizedCutoutDepthPSO); // PSO5
+
+    ASSERT(sm_PSOs.size() == 6);
 
     // Shadow PSOs
 
     DepthOnlyPSO.SetRasterizerState(RasterizerShadow);
     DepthOnlyPSO.SetRenderPassFormat({}, g_ShadowBuffer.GetFormat());
     DepthOnlyPSO.Finalize();
-    sm_PSOs.push_back(DepthOnlyPSO); // PSO5
+    sm_PSOs.push_back(DepthOnlyPSO); // PSO6
 
     CutoutDepthPSO.SetRasterizerState(RasterizerShadowTwoSided);
     CutoutDepthPSO.SetRenderPassFormat({}, g_ShadowBuffer.GetFormat());
     CutoutDepthPSO.Finalize();
-    sm_PSOs.push_back(CutoutDepthPSO); // PSO6
+    sm_PSOs.push_back(CutoutDepthPSO); // PSO7
 
     SkinDepthOnlyPSO.SetRasterizerState(RasterizerShadow);
     SkinDepthOnlyPSO.SetRenderPassFormat({}, g_ShadowBuffer.GetFormat());
     SkinDepthOnlyPSO.Finalize();
-    sm_PSOs.push_back(SkinDepthOnlyPSO); // PSO7
+    sm_PSOs.push_back(SkinDepthOnlyPSO); // PSO8
 
     SkinCutoutDepthPSO.SetRasterizerState(RasterizerShadowTwoSided);
     SkinCutoutDepthPSO.SetRenderPassFormat({}, g_ShadowBuffer.GetFormat());
     SkinCutoutDepthPSO.Finalize();
-    sm_PSOs.push_back(SkinCutoutDepthPSO); // PSO8
+    sm_PSOs.push_back(SkinCutoutDepthPSO); // PSO9
 
-    ASSERT(sm_PSOs.size() == 8);
+    QuantizedDepthOnlyPSO.SetRasterizerState(RasterizerShadow);
+    QuantizedDepthOnlyPSO.SetRenderPassFormat({}, g_ShadowBuffer.GetFormat());
+    QuantizedDepthOnlyPSO.Finalize();
+    sm_PSOs.push_back(QuantizedDepthOnlyPSO); // PSO10
+
+    QuantizedCutoutDepthPSO.SetRasterizerState(RasterizerShadowTwoSided);
+    QuantizedCutoutDepthPSO.SetRenderPassFormat({}, g_ShadowBuffer.GetFormat());
+    QuantizedCutoutDepthPSO.Finalize();
+    sm_PSOs.push_back(QuantizedCutoutDepthPSO); // PSO11
+
+    ASSERT(sm_PSOs.size() == 12);
 
     // Default PSO
 
@@ -232,6 +290,16 @@ void Renderer::Initialize()
     m_SkyboxPSO.SetFragmentShader(g_SkyboxFrag, sizeof(g_SkyboxFrag));
     m_SkyboxPSO.Finalize();
 
+    // Frustum planes, clusters and the indirect draws written for them
+    s_ClusterCullDS.AddBindings(0, 1, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eCompute);
+    s_ClusterCullDS.AddBindings(1, 2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute);
+    s_ClusterCullDS.AddPushConstant(0, sizeof(ClusterCullConstants), vk::ShaderStageFlagBits::eCompute);
+    s_ClusterCullDS.Finalize();
+
+    s_ClusterCullPSO.SetPipelineLayout(s_ClusterCullDS.GetPipelineLayout());
+    s_ClusterCullPSO.SetComputeShader(g_ClusterCullComp, sizeof(g_ClusterCullComp));
+    s_ClusterCullPSO.Finalize();
+
     TextureManager::Initialize("");
 
     m_CommonCubeTextures = std::vector<vk::DescriptorImageInfo>{
@@ -350,6 +418,7 @@ void Renderer::Shutdown(void)
     TextureManager::Shutdown();
 
     m_DescriptorSet.Destroy();
+    s_ClusterCullDS.Destroy();
     // DefaultDS.Destroy();
     // DefaultTex.Destroy();
     // indexBuffer.Destroy();
@@ -370,8 +439,11 @@ uint8_t Renderer::GetPSO(uint16_t psoFlags)
     // location, binding, format, offset
     if (psoFlags & kHasPosition)
     {
-        vertexLayout.second.push_back({0, 0, vk::Format::eR32G32B32Sfloat, offset});
-        offset += vk::blockSize(vk::Format::eR32G32B32Sfloat);
+        // The default shaders take either, World undoes the quantization
+        vk::Format format =
+            psoFlags & kQuantizedPosition ? vk::Format::eR16G16B16A16Unorm : vk::Format::eR32G32B32Sfloat;
+        vertexLayout.second.push_back({0, 0, format, offset});
+        offset += vk::blockSize(format);
     }
     if (psoFlags & kHasNormal)
     {
@@ -385,13 +457,15 @@ uint8_t Renderer::GetPSO(uint16_t psoFlags)
     }
     if (psoFlags & kHasUV0)
     {
-        vertexLayout.second.push_back({3, 0, vk::Format::eR16G16Sfloat, offset});
-        offset += vk::blockSize(vk::Format::eR16G16Sfloat);
+        vk::Format format = psoFlags & kUnormUV0 ? vk::Format::eR16G16Unorm : vk::Format::eR16G16Sfloat;
+        vertexLayout.second.push_back({3, 0, format, offset});
+        offset += vk::blockSize(format);
     }
     if (psoFlags & kHasUV1)
     {
-        vertexLayout.second.push_back({4, 0, vk::Format::eR16G16Sfloat, offset});
-        offset += vk::blockSize(vk::Format::eR16G16Sfloat);
+        vk::Format format = psoFlags & kUnormUV1 ? vk::Format::eR16G16Unorm : vk::Format::eR16G16Sfloat;
+        vertexLayout.second.push_back({4, 0, format, offset});
+        offset += vk::blockSize(format);
     }
     if (psoFlags & kHasSkin)
     {
@@ -531,7 +605,7 @@ void Renderer::SetIBLTextures(TextureRef diffuseIBL, TextureRef specularIBL)
 void Renderer::SetIBLBias(float LODBias) { s_SpecularIBLBias = std::min(LODBias, s_SpecularIBLRange); }
 
 void Renderer::DrawSkybox(GraphicsContext &gfxContext, const Camera &camera, const vk::Viewport &viewport,
-                          const vk::Rect2D &scissor)
+                          const vk::Rect2D &scissor, ColorBuffer &color, DepthBuffer &depth)
 {
     struct alignas(16) SkyboxVSCB
     {
@@ -557,10 +631,10 @@ void Renderer::DrawSkybox(GraphicsContext &gfxContext, const Camera &camera, con
     // gfxContext.UpdateImageSampler(kCommonSamplers, 0, m_CommonTextures);
     // gfxContext.EndUpdateAndBindDescriptorSet();
 
-    gfxContext.TransitionImageLayout(g_SceneDepthBuffer, vk::ImageLayout::eDepthStencilAttachmentOptimal);
-    gfxContext.TransitionImageLayout(g_SceneColorBuffer, vk::ImageLayout::eColorAttachmentOptimal);
+    gfxContext.TransitionImageLayout(depth, vk::ImageLayout::eDepthStencilAttachmentOptimal);
+    gfxContext.TransitionImageLayout(color, vk::ImageLayout::eColorAttachmentOptimal);
 
-    gfxContext.BeginRenderPass(g_SceneColorBuffer, g_SceneDepthBuffer);
+    gfxContext.BeginRenderPass(color, depth);
     gfxContext.BindPipeline(m_SkyboxPSO);
     gfxContext.SetViewportAndScissor(viewport, scissor);
     gfxContext.Draw(3);
@@ -605,8 +679,11 @@ void Renderer::DrawSkybox(GraphicsContext &gfxContext, const Camera &camera, con
 // }
 
 void MeshSorter::AddMesh(const Mesh &mesh, float distance, const vk::DescriptorBufferInfo &meshUB,
-                         const vk::DescriptorBufferInfo &materialUB, const GpuBuffer &bufferPtr, const Joint *skeleton)
+                         const vk::DescriptorBufferInfo &materialUB, const GpuBuffer &bufferPtr, const Joint *skeleton,
+                         const glm::mat4 *localToWorld, uint32_t lod)
 {
+    ++m_NumConsidered;
+
     SortKey key;
     key.value = m_SortObjects.size(); // this is the ID of mesh
 
@@ -614,10 +691,11 @@ void MeshSorter::AddMesh(const Mesh &mesh, float distance, const vk::DescriptorB
     bool alphaBlend = (mesh.psoFlags & PSOFlags::kAlphaBlend) == PSOFlags::kAlphaBlend;
     bool alphaTest = (mesh.psoFlags & PSOFlags::kAlphaTest) == PSOFlags::kAlphaTest;
     bool skinned = (mesh.psoFlags & PSOFlags::kHasSkin) == PSOFlags::kHasSkin;
+    bool quantized = (mesh.psoFlags & PSOFlags::kQuantizedPosition) == PSOFlags::kQuantizedPosition;
 
-    // 0=posOny, 1=posAndUV, 2=skinpos, 3= skinposAndUV
-    // +4 for shadows
-    uint64_t depthPSO = (skinned ? 2 : 0) + (alphaTest ? 1 : 0);
+    // 0=posOny, 1=posAndUV, 2=skinpos, 3= skinposAndUV, 4=quantizedPos, 5=quantizedPosAndUV
+    // +6 for shadows
+    uint64_t depthPSO = (quantized ? 4 : skinned ? 2 : 0) + (alphaTest ? 1 : 0);
 
     // float follows IEEE754 standard SXXXXXXX XMMMMMMM MMMMMMMM MMMMMMMM,
     // Distance is always positive here. we can sort uint as we sort float.
@@ -638,7 +716,7 @@ void MeshSorter::AddMesh(const Mesh &mesh, float distance, const vk::DescriptorB
         }
 
         key.passID = kZPass;
-        key.psoIdx = depthPSO + 4;
+        key.psoIdx = depthPSO + 6;
         key.key = dist.u;
         m_SortKeys.push_back(key.value);
         m_PassCounts[kZPass]++;
@@ -674,19 +752,117 @@ void MeshSorter::AddMesh(const Mesh &mesh, float distance, const vk::DescriptorB
         m_PassCounts[kOpaque]++;
     }
 
-    m_SortObjects.emplace_back(SortObject{&mesh, skeleton, meshUB, materialUB, bufferPtr});
+    // The clusters only cover full detail
+    ASSERT(lod < mesh.numLODs);
+    bool hasClusters = mesh.numClusters > 0 && localToWorld != nullptr && lod == 0;
+    m_SortObjects.emplace_back(SortObject{&mesh, skeleton, meshUB, materialUB, bufferPtr,
+                                          hasClusters ? *localToWorld : glm::mat4(1.0f), hasClusters, lod, ~0u});
 }
 
 void MeshSorter::Sort()
 {
     // uint64_t can be directly sorted. why write a cmp function?
     std::sort(m_SortKeys.begin(), m_SortKeys.end());
+
+    s_MeshesConsidered[m_BatchType].Add(m_NumConsidered);
+    s_MeshesCulled[m_BatchType].Add(m_NumCulled);
+    m_NumConsidered = 0;
+    m_NumCulled = 0;
+}
+
+void MeshSorter::CullClusters(GraphicsContext &context)
+{
+    // Sorting put the opaque keys right after the depth ones
+    const uint32_t firstKey = m_PassCounts[kZPass];
+    const uint32_t lastKey = firstKey + m_PassCounts[kOpaque];
+
+    // The commands come out of one GPU page, meshes past it are drawn whole
+    const uint32_t maxCommands = kGpuAllocatorPageSize / sizeof(vk::DrawIndexedIndirectCommand);
+    uint32_t numCommands = 0;
+    for (uint32_t i = firstKey; i < lastKey; ++i)
+    {
+        SortKey key;
+        key.value = m_SortKeys[i];
+        SortObject &object = m_SortObjects[key.objectIdx];
+        if (object.hasClusters && numCommands + object.mesh->numClusters <= maxCommands)
+        {
+            object.firstCommand = numCommands;
+            numCommands += object.mesh->numClusters;
+        }
+    }
+    if (numCommands == 0)
+    {
+        return;
+    }
+    s_ClustersConsidered.Add(numCommands);
+
+    m_ClusterCommands =
+        context.CreateDynamicBuffer(numCommands * sizeof(vk::DrawIndexedIndirectCommand),
+                                    vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer);
+
+    glm::vec4 frustumPlanes[6];
+    for (uint32_t i = 0; i < 6; ++i)
+    {
+        frustumPlanes[i] = GetViewFrustum().GetFrustumPlane((Frustum::PlaneID)i);
+    }
+
+    ComputeContext &computeContext = context.GetComputeContext();
+    computeContext.SetDescriptorSet(s_ClusterCullDS);
+    computeContext.UpdateDynamicUniformBuffer(0, sizeof(frustumPlanes), frustumPlanes);
+    computeContext.UpdateStorageBuffer(2, {m_ClusterCommands, 0, VK_WHOLE_SIZE});
+    computeContext.BindPipeline(s_ClusterCullPSO);
+
+    for (uint32_t i = firstKey; i < lastKey; ++i)
+    {
+        SortKey key;
+        key.value = m_SortKeys[i];
+        const SortObject &object = m_SortObjects[key.objectIdx];
+        if (object.firstCommand == ~0u)
+        {
+            continue;
+        }
+        const Mesh &mesh = *object.mesh;
+
+        // The view matrix is rigid, so only the world matrix scales the spheres
+        glm::vec3 scale(glm::length(glm::vec3(object.localToWorld[0])), glm::length(glm::vec3(object.localToWorld[1])),
+                        glm::length(glm::vec3(object.localToWorld[2])));
+        float maxScale = std::max(std::max(scale.x, scale.y), scale.z);
+        float minScale = std::min(std::min(scale.x, scale.y), scale.z);
+
+        // Skewed or mirrored normals and faces seen from behind break the cone test
+        bool twoSided = (mesh.psoFlags & PSOFlags::kTwoSided) == PSOFlags::kTwoSided;
+        bool mirrored = glm::determinant(glm::mat3(object.localToWorld)) < 0.0f;
+        bool uniformScale = maxScale <= minScale * 1.01f;
+
+        ClusterCullConstants constants;
+        constants.localToView = GetViewMatrix() * object.localToWorld;
+        constants.radiusScale = maxScale;
+        constants.firstCluster = mesh.clusterOffset / sizeof(DrawCluster);
+        constants.numClusters = mesh.numClusters;
+        constants.firstCommand = object.firstCommand;
+        constants.coneCulling = !twoSided && !mirrored && uniformScale ? 1 : 0;
+
+        computeContext.UpdateStorageBuffer(1, {object.bufferPtr.GetBuffer(), 0, VK_WHOLE_SIZE});
+        computeContext.PushConstants(vk::ShaderStageFlagBits::eCompute, 0, constants);
+        computeContext.Dispatch1D(mesh.numClusters, 64);
+    }
+
+    // Recorded with the opaque pass's layout transitions when it begins
+    context.InsertMemoryBarrier(vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderWrite,
+                                vk::PipelineStageFlagBits2::eDrawIndirect, vk::AccessFlagBits2::eIndirectCommandRead);
 }
 
 void MeshSorter::RenderMeshes(DrawPass pass, GraphicsContext &context, GlobalConstants &globals)
 {
     ASSERT(m_DepthBuffer != nullptr);
 
+    // Dispatches can't be recorded inside the render passes below
+    if (m_BatchType == kDefault && ClusterCulling && m_CurrentPass <= kOpaque && pass >= kOpaque &&
+        m_PassCounts[kOpaque] > 0)
+    {
+        CullClusters(context);
+    }
+
     // Update common textures, in case they are changed
     m_Common2DTextures[0].imageView = g_SSAOFullScreen;
     m_CommonShadowTextures[0].imageView = g_ShadowBuffer;
@@ -756,6 +932,7 @@ void MeshSorter::RenderMeshes(DrawPass pass, GraphicsContext &context, GlobalCon
         {
             continue;
         }
+        (m_BatchType == kShadows ? s_ShadowMeshesDrawn : s_MeshesDrawn[m_CurrentPass]).Add(passCount);
 
         if (m_BatchType == kDefault)
         {
@@ -763,7 +940,7 @@ void MeshSorter::RenderMeshes(DrawPass pass, GraphicsContext &context, GlobalCon
             {
             case kZPass:
                 context.TransitionImageLayout(*m_DepthBuffer, vk::ImageLayout::eDepthStencilAttachmentOptimal);
-                context.BeginRenderPass(*m_DepthBuffer);
+                context.BeginRenderPass({}, *m_DepthBuffer);
                 break;
             case kOpaque:
                 // if (SeparateZPass)
@@ -774,18 +951,30 @@ void MeshSorter::RenderMeshes(DrawPass pass, GraphicsContext &context, GlobalCon
                 //{
                 // }
                 context.TransitionImageLayout(*m_DepthBuffer, vk::ImageLayout::eDepthStencilAttachmentOptimal);
-                context.TransitionImageLayout(g_SceneColorBuffer, vk::ImageLayout::eColorAttachmentOptimal);
-                context.BeginRenderPass(g_SceneColorBuffer, *m_DepthBuffer);
+                context.TransitionImageLayout(*m_ColorBuffers[0], vk::ImageLayout::eColorAttachmentOptimal);
+                context.BeginRenderPass(*m_ColorBuffers[0], *m_DepthBuffer);
                 break;
             case kTransparent:
+            {
                 context.TransitionImageLayout(*m_DepthBuffer, vk::ImageLayout::eDepthStencilAttachmentOptimal);
-                context.TransitionImageLayout(g_SceneColorBuffer, vk::ImageLayout::eColorAttachmentOptimal);
-                context.BeginRenderPass(g_SceneColorBuffer, *m_DepthBuffer);
+                context.TransitionImageLayout(*m_ColorBuffers[0], vk::ImageLayout::eColorAttachmentOptimal);
+                RenderPass::AttachmentOps depthOps;
+                if (m_DiscardDepth)
+                {
+                    depthOps.store = vk::AttachmentStoreOp::eDontCare;
+                }
+                context.BeginRenderPass(*m_ColorBuffers[0], nullptr, m_DepthBuffer, depthOps);
                 break;
+            }
             default:
                 break;
             }
         }
+        else
+        {
+            context.TransitionImageLayout(*m_DepthBuffer, vk::ImageLayout::eDepthStencilAttachmentOptimal);
+            context.BeginRenderPass({}, *m_DepthBuffer);
+        }
 
         context.SetViewportAndScissor(m_Viewport, m_Scissor);
 
@@ -810,32 +999,39 @@ void MeshSorter::RenderMeshes(DrawPass pass, GraphicsContext &context, GlobalCon
 
             context.BindPipeline(sm_PSOs[key.psoIdx]);
 
-            // bufferPtr consists of three parts one bye one: VB, VBDepth, IB
+            // bufferPtr consists of four parts one by one: VB, VBDepth, IB, IBDepth. Depth passes use the
+            // welded depth-only streams, which have their own indices.
+            const Mesh::Draw *draws = mesh.draw + object.lod * mesh.numDraws;
+            VertexBuffer buffer(object.bufferPtr);
+            IndexBuffer ib(object.bufferPtr, (vk::IndexType)mesh.ibFormat);
             if (m_CurrentPass == kZPass)
             {
-                // alpha test needs uv coords, which needs 4 bytes
-                // TODO: Didn't see skin matrices strides. doesn't need to process?
-                //
-                // seems vertex buffer don't care about the strides. GPU will read data according to input layout
-                // bool alphaTest = (mesh.psoFlags & PSOFlags::kAlphaTest) == PSOFlags::kAlphaTest;
-                // uint32_t stride = alphaTest ? 16u : 12u;
-                // if (mesh.numJoints > 0)
-                //    stride += 16;
-                VertexBuffer buffer(object.bufferPtr);
                 context.BindVertexBuffer(0, buffer, mesh.vbDepthOffset);
+                context.BindIndexBuffer(ib, mesh.ibDepthOffset);
+
+                for (uint32_t i = 0; i < mesh.numDraws; ++i)
+                {
+                    context.DrawIndexed(draws[i].primCount, draws[i].depthStartIndex, draws[i].depthBaseVertex);
+                }
             }
             else
             {
-                VertexBuffer buffer(object.bufferPtr);
                 context.BindVertexBuffer(0, buffer, mesh.vbOffset);
-            }
-
-            IndexBuffer ib(object.bufferPtr, (vk::IndexType)mesh.ibFormat);
-            context.BindIndexBuffer(ib, mesh.ibOffset);
-
-            for (uint32_t i = 0; i < mesh.numDraws; ++i)
-            {
-                context.DrawIndexed(mesh.draw[i].primCount, mesh.draw[i].startIndex, mesh.draw[i].baseVertex);
+                context.BindIndexBuffer(ib, mesh.ibOffset);
+
+                if (object.firstCommand != ~0u)
+                {
+                    context.DrawIndexedIndirect(m_ClusterCommands,
+                                                object.firstCommand * sizeof(vk::DrawIndexedIndirectCommand),
+                                                mesh.numClusters);
+                }
+                else
+                {
+                    for (uint32_t i = 0; i < mesh.numDraws; ++i)
+                    {
+                        context.DrawIndexed(draws[i].primCount, draws[i].startIndex, draws[i].baseVertex);
+                    }
+                }
             }
 
             ++m_CurrentDraw;
@@ -24,6 +24,9 @@ namespace Renderer
 using namespace Math;
 
 extern BoolVar SeparateZPass;
+extern BoolVar ClusterCulling;
+extern NumVar LODErrorPixels;
+extern NumVar SmallMeshPixels;
 
 extern GraphicsPSO m_PSO;
 
@@ -55,7 +58,7 @@ uint8_t GetPSO(uint16_t psoFlags);
 void SetIBLTextures(TextureRef diffuseIBL, TextureRef specularIBL);
 void SetIBLBias(float LODBias);
 void DrawSkybox(GraphicsContext &gfxContext, const Camera &camera, const vk::Viewport &viewport,
-                const vk::Rect2D &scissor);
+                const vk::Rect2D &scissor, ColorBuffer &color, DepthBuffer &depth);
 
 void Render(GraphicsContext &gfxContext, const GlobalConstants &globals);
 
@@ -78,6 +81,13 @@ public:
     MeshSorter(BatchType type)
     {
         m_BatchType = type;
+        Reset();
+    }
+
+    // Starts a new frame. The sort lists keep their capacity, so a sorter that lives across frames stops
+    // allocating once it has seen the largest frame.
+    void Reset()
+    {
         m_Camera = nullptr;
         m_NumColorBuffers = 0;
         m_DepthBuffer = nullptr;
@@ -86,6 +96,10 @@ public:
         std::memset(m_PassCounts, 0, sizeof(m_PassCounts));
         m_CurrentPass = kZPass;
         m_CurrentDraw = 0;
+        m_DiscardDepth = false;
+        m_NumConsidered = 0;
+        m_NumCulled = 0;
+        m_ClusterCommands = nullptr;
     }
 
     void SetCamera(const BaseCamera &camera) { m_Camera = &camera; }
@@ -97,14 +111,30 @@ public:
         m_ColorBuffers[m_NumColorBuffers++] = &color;
     }
     void SetDepthBuffer(DepthBuffer &depth) { m_DepthBuffer = &depth; }
+    // Nothing reads the depth buffer after the transparent pass, so that pass doesn't have to store it
+    void SetDiscardDepth(bool discard) { m_DiscardDepth = discard; }
 
     const Frustum &GetWorldFrustum() const { return m_Camera->GetWorldSpaceFrustum(); }
     const Frustum &GetViewFrustum() const { return m_Camera->GetViewSpaceFrustum(); }
     const glm::mat4 &GetViewMatrix() const { return m_Camera->GetViewMatrix(); }
+    const glm::mat4 &GetProjMatrix() const { return m_Camera->GetProjMatrix(); }
+    // Pixels the viewport spans vertically, before RenderMeshes sizes it the depth buffer's height
+    float GetViewportHeight() const
+    {
+        if (m_Viewport.height != 0.0f)
+            return std::abs(m_Viewport.height);
+        return m_DepthBuffer != nullptr ? (float)m_DepthBuffer->GetHeight() : 0.0f;
+    }
 
     void AddMesh(const Mesh &mesh, float distance, const vk::DescriptorBufferInfo &meshUB,
                  const vk::DescriptorBufferInfo &materialUB, const GpuBuffer &bufferPtr,
-                 const Joint *skeleton = nullptr);
+                 const Joint *skeleton = nullptr, const glm::mat4 *localToWorld = nullptr, uint32_t lod = 0);
+    // Counts a mesh that didn't pass the frustum test
+    void AddCulledMesh()
+    {
+        ++m_NumConsidered;
+        ++m_NumCulled;
+    }
 
     void Sort();
 
@@ -131,8 +161,15 @@ private:
         vk::DescriptorBufferInfo meshUB;
         vk::DescriptorBufferInfo materialUB;
         GpuBuffer bufferPtr;
+        glm::mat4 localToWorld; // Space of the mesh's clusters, only set when hasClusters
+        bool hasClusters;
+        uint32_t lod;
+        uint32_t firstCommand; // Of the culled cluster draws in m_ClusterCommands, ~0u to draw the mesh whole
     };
 
+    // Writes an indirect draw per cluster of the opaque meshes, with no instances when it can't be seen
+    void CullClusters(GraphicsContext &context);
+
     std::vector<SortObject> m_SortObjects;
     std::vector<uint64_t> m_SortKeys;
     BatchType m_BatchType;
@@ -146,5 +183,11 @@ private:
     uint32_t m_NumColorBuffers;
     ColorBuffer *m_ColorBuffers[8];
     DepthBuffer *m_DepthBuffer;
+    bool m_DiscardDepth;
+    vk::Buffer m_ClusterCommands;
+
+    // Added to the frame counters by Sort
+    uint32_t m_NumConsidered;
+    uint32_t m_NumCulled;
 };
 } // namespace Renderer
@@ -0,0 +1,138 @@
+#include "VulkanMesh.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+// The sphere is centered on the box around the vertices, the cone on the average of the face normals.
+// Degenerate faces come in as zero normals and don't widen the cone.
+void ComputeMeshletBounds(Meshlet &meshlet, const glm::vec3 *positions, const std::vector<uint32_t> &vertices,
+                          const std::vector<glm::vec3> &faceNormals)
+{
+    glm::vec3 boxMin(FLT_MAX), boxMax(-FLT_MAX);
+    for (uint32_t v : vertices)
+    {
+        boxMin = glm::min(boxMin, positions[v]);
+        boxMax = glm::max(boxMax, positions[v]);
+    }
+    meshlet.center = (boxMin + boxMax) * 0.5f;
+
+    float radiusSq = 0.0f;
+    for (uint32_t v : vertices)
+    {
+        glm::vec3 offset = positions[v] - meshlet.center;
+        radiusSq = std::max(radiusSq, glm::dot(offset, offset));
+    }
+    meshlet.radius = std::sqrt(radiusSq);
+
+    meshlet.coneAxis = glm::vec3(0.0f);
+    meshlet.coneCutoff = 1.0f;
+
+    glm::vec3 axis(0.0f);
+    for (const glm::vec3 &n : faceNormals)
+        axis += n;
+    float axisLength = glm::length(axis);
+    if (axisLength < FLT_EPSILON)
+        return;
+    axis /= axisLength;
+
+    float minDot = 1.0f;
+    for (const glm::vec3 &n : faceNormals)
+    {
+        if (n != glm::vec3(0.0f))
+            minDot = std::min(minDot, glm::dot(n, axis));
+    }
+
+    // Faces more than 90 degrees apart can't all face away from the same viewer
+    meshlet.coneAxis = axis;
+    if (minDot > 0.0f)
+        meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+}
+} // namespace
+
+template <class index_t>
+bool ComputeMeshletsImpl(const index_t *indices, size_t nFaces, const glm::vec3 *positions, size_t nVerts,
+                         std::vector<Meshlet> &meshlets, size_t maxVerts, size_t maxFaces)
+{
+    meshlets.clear();
+
+    // Index of each vertex within the current meshlet, -1 when it isn't in it yet
+    std::vector<uint32_t> local(nVerts, uint32_t(-1));
+    std::vector<uint32_t> vertices;
+    std::vector<glm::vec3> faceNormals;
+    vertices.reserve(maxVerts);
+    faceNormals.reserve(maxFaces);
+
+    Meshlet meshlet = {};
+    auto closeMeshlet = [&]() {
+        if (meshlet.faceCount == 0)
+            return;
+        ComputeMeshletBounds(meshlet, positions, vertices, faceNormals);
+        meshlets.push_back(meshlet);
+        for (uint32_t v : vertices)
+            local[v] = uint32_t(-1);
+        vertices.clear();
+        faceNormals.clear();
+        meshlet.firstFace += meshlet.faceCount;
+        meshlet.faceCount = 0;
+    };
+
+    for (size_t face = 0; face < nFaces; ++face)
+    {
+        const index_t *f = indices + face * 3;
+        if (f[0] >= nVerts || f[1] >= nVerts || f[2] >= nVerts)
+            return false;
+
+        size_t newVerts = 0;
+        for (size_t j = 0; j < 3; ++j)
+        {
+            bool repeated = (j > 0 && f[j] == f[0]) || (j > 1 && f[j] == f[1]);
+            if (local[f[j]] == uint32_t(-1) && !repeated)
+                ++newVerts;
+        }
+        if (vertices.size() + newVerts > maxVerts || meshlet.faceCount == maxFaces)
+            closeMeshlet();
+
+        for (size_t j = 0; j < 3; ++j)
+        {
+            if (local[f[j]] == uint32_t(-1))
+            {
+                local[f[j]] = uint32_t(vertices.size());
+                vertices.push_back(uint32_t(f[j]));
+            }
+        }
+
+        glm::vec3 normal = glm::cross(positions[f[1]] - positions[f[0]], positions[f[2]] - positions[f[0]]);
+        float length = glm::length(normal);
+        faceNormals.push_back(length > 0.0f ? normal / length : glm::vec3(0.0f));
+        ++meshlet.faceCount;
+    }
+    closeMeshlet();
+
+    return true;
+}
+
+bool ComputeMeshlets(const uint16_t *indices, size_t nFaces, const glm::vec3 *positions, size_t nVerts,
+                     std::vector<Meshlet> &meshlets, size_t maxVerts, size_t maxFaces) noexcept
+{
+    if (!indices || !nFaces || !positions || !nVerts || maxVerts < 3 || !maxFaces)
+        return false;
+
+    if (nVerts >= UINT16_MAX)
+        return false;
+
+    return ComputeMeshletsImpl<uint16_t>(indices, nFaces, positions, nVerts, meshlets, maxVerts, maxFaces);
+}
+
+bool ComputeMeshlets(const uint32_t *indices, size_t nFaces, const glm::vec3 *positions, size_t nVerts,
+                     std::vector<Meshlet> &meshlets, size_t maxVerts, size_t maxFaces) noexcept
+{
+    if (!indices || !nFaces || !positions || !nVerts || maxVerts < 3 || !maxFaces)
+        return false;
+
+    if (nVerts >= UINT32_MAX)
+        return false;
+
+    return ComputeMeshletsImpl<uint32_t>(indices, nFaces, positions, nVerts, meshlets, maxVerts, maxFaces);
+}
@@ -1,4 +1,22 @@
-#include "VulkanMesh.h"
+#include "VulkanMeshP.h"
+
+namespace
+{
+// Work below these sizes stays on one thread
+constexpr size_t c_MinFacesPerThread = 4096;
+constexpr size_t c_MinVertsPerThread = 4096;
+
+// The angle between two unit vectors
+Float4 CornerAngle(const Vec3x4 &a, const Vec3x4 &b)
+{
+    const Float4 cosine = Min(Max(Dot(a, b), Float4::Splat(-1.0f)), Float4::Splat(1.0f));
+    float angles[4];
+    cosine.Store(angles);
+    for (float &angle : angles)
+        angle = glm::acos(angle);
+    return Float4::Load(angles);
+}
+} // namespace
 
 //---------------------------------------------------------------------------------
 // Compute normals with weighting by angle
@@ -7,69 +25,89 @@ template <class index_t>
 bool ComputeNormalsWeightedByAngle(const index_t *indices, size_t nFaces, const glm::vec3 *positions, size_t nVerts,
                                    glm::vec3 *normals)
 {
-    auto temp = std::make_unique<glm::vec3[]>(nVerts);
-    if (!temp)
-    {
-        return false;
-    }
-
-    glm::vec3 *vertNormals = temp.get();
-    memset(vertNormals, 0, sizeof(glm::vec3) * nVerts);
-
     for (size_t face = 0; face < nFaces; ++face)
     {
-        index_t i0 = indices[face * 3];
-        index_t i1 = indices[face * 3 + 1];
-        index_t i2 = indices[face * 3 + 2];
-
-        if (i0 == index_t(-1) || i1 == index_t(-1) || i2 == index_t(-1))
+        const index_t *f = indices + face * 3;
+        if (f[0] == index_t(-1) || f[1] == index_t(-1) || f[2] == index_t(-1))
             continue;
-
-        if (i0 >= nVerts || i1 >= nVerts || i2 >= nVerts)
+        if (f[0] >= nVerts || f[1] >= nVerts || f[2] >= nVerts)
             return false;
-
-        const glm::vec3 p0 = positions[i0];
-        const glm::vec3 p1 = positions[i1];
-        const glm::vec3 p2 = positions[i2];
-
-        const glm::vec3 u = p1 - p0;
-        const glm::vec3 v = p2 - p0;
-
-        const glm::vec3 faceNormal = glm::normalize(glm::cross(u, v));
-
-        // Corner 0 -> 1 - 0, 2 - 0
-        const glm::vec3 a = glm::normalize(u);
-        const glm::vec3 b = glm::normalize(v);
-        float w0 = glm::dot(a, b);
-        w0 = glm::clamp(w0, -1.0f, 1.0f);
-        w0 = glm::acos(w0);
-
-        // Corner 1 -> 2 - 1, 0 - 1
-        const glm::vec3 c = glm::normalize(p2 - p1);
-        const glm::vec3 d = glm::normalize(p0 - p1);
-        float w1 = glm::dot(c, d);
-        w1 = glm::clamp(w1, -1.0f, 1.0f);
-        w1 = glm::acos(w1);
-
-        // Corner 2 -> 0 - 2, 1 - 2
-        const glm::vec3 e = glm::normalize(p0 - p2);
-        const glm::vec3 f = glm::normalize(p1 - p2);
-        float w2 = glm::dot(e, f);
-        w2 = glm::clamp(w2, -1.0f, 1.0f);
-        w2 = glm::acos(w2);
-
-        vertNormals[i0] = faceNormal * w0 + vertNormals[i0];
-        vertNormals[i1] = faceNormal * w1 + vertNormals[i1];
-        vertNormals[i2] = faceNormal * w2 + vertNormals[i2];
     }
 
-    // Store results
-
-    for (size_t vert = 0; vert < nVerts; ++vert)
+    // Each corner's share of its vertex normal, four faces at a time. Faces with a missing index get zero
+    // positions and so contribute nothing.
+    auto temp = std::make_unique<glm::vec3[]>(nFaces * 3);
+    if (!temp)
     {
-        const glm::vec3 n = glm::normalize(vertNormals[vert]);
-        normals[vert] = n;
+        return false;
     }
+    glm::vec3 *corners = temp.get();
+
+    ParallelFor(nFaces, c_MinFacesPerThread, [&](size_t begin, size_t end) {
+        for (size_t face = begin; face < end; face += 4)
+        {
+            glm::vec3 p[3][4];
+            for (size_t j = 0; j < 4; ++j)
+            {
+                const index_t *f = indices + std::min(face + j, end - 1) * 3;
+                const bool missing = f[0] == index_t(-1) || f[1] == index_t(-1) || f[2] == index_t(-1);
+                for (size_t k = 0; k < 3; ++k)
+                    p[k][j] = missing ? glm::vec3(0.0f) : positions[f[k]];
+            }
+            const Vec3x4 p0 = Vec3x4::Gather(p[0][0], p[0][1], p[0][2], p[0][3]);
+            const Vec3x4 p1 = Vec3x4::Gather(p[1][0], p[1][1], p[1][2], p[1][3]);
+            const Vec3x4 p2 = Vec3x4::Gather(p[2][0], p[2][1], p[2][2], p[2][3]);
+
+            const Vec3x4 u = p1 - p0;
+            const Vec3x4 v = p2 - p0;
+
+            const Vec3x4 faceNormal = SafeNormalize(Cross(u, v));
+
+            // Corner 0 -> 1 - 0, 2 - 0
+            const Float4 w0 = CornerAngle(SafeNormalize(u), SafeNormalize(v));
+
+            // Corner 1 -> 2 - 1, 0 - 1
+            const Float4 w1 = CornerAngle(SafeNormalize(p2 - p1), SafeNormalize(p0 - p1));
+
+            // Corner 2 -> 0 - 2, 1 - 2
+            const Float4 w2 = CornerAngle(SafeNormalize(p0 - p2), SafeNormalize(p1 - p2));
+
+            glm::vec3 out[3][4];
+            (faceNormal * w0).Scatter(&out[0][0], &out[0][1], &out[0][2], &out[0][3]);
+            (faceNormal * w1).Scatter(&out[1][0], &out[1][1], &out[1][2], &out[1][3]);
+            (faceNormal * w2).Scatter(&out[2][0], &out[2][1], &out[2][2], &out[2][3]);
+            for (size_t j = 0; j < 4 && face + j < end; ++j)
+            {
+                for (size_t k = 0; k < 3; ++k)
+                    corners[(face + j) * 3 + k] = out[k][j];
+            }
+        }
+    });
+
+    // Each thread sums the corners of its own range of vertices in face order, so no two threads write the same
+    // normal and the sums come out as a single thread would add them.
+    VertexCorners vertexCorners;
+    BuildVertexCorners(indices, nFaces, nVerts, vertexCorners);
+
+    ParallelFor(nVerts, c_MinVertsPerThread, [&](size_t begin, size_t end) {
+        for (size_t vert = begin; vert < end; ++vert)
+        {
+            glm::vec3 normal(0.0f);
+            for (uint32_t i = vertexCorners.offsets[vert]; i < vertexCorners.offsets[vert + 1]; ++i)
+                normal = corners[vertexCorners.corners[i]] + normal;
+            normals[vert] = normal;
+        }
+
+        // Store results
+        size_t vert = begin;
+        for (; vert + 3 < end; vert += 4)
+        {
+            glm::vec3 *n = normals + vert;
+            SafeNormalize(Vec3x4::Gather(n[0], n[1], n[2], n[3])).Scatter(n, n + 1, n + 2, n + 3);
+        }
+        for (; vert < end; ++vert)
+            normals[vert] = SafeNormalize(normals[vert]);
+    });
 
     return true;
 }
@@ -0,0 +1,576 @@
+#include "VulkanMesh.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+//---------------------------------------------------------------------------------
+// Vertex fetch order
+//---------------------------------------------------------------------------------
+template <class index_t>
+bool OptimizeVerticesImpl(const index_t *indices, size_t nFaces, size_t nVerts, uint32_t *vertexRemap,
+                          size_t *trailingUnused)
+{
+    auto temp = std::make_unique<uint32_t[]>(nVerts);
+    if (!temp)
+    {
+        return false;
+    }
+
+    // Old to new while walking the faces, unused vertices stay at -1
+    uint32_t *newIndex = temp.get();
+    memset(newIndex, 0xff, sizeof(uint32_t) * nVerts);
+
+    uint32_t curVertex = 0;
+    for (size_t j = 0; j < nFaces * 3; ++j)
+    {
+        index_t i = indices[j];
+        if (i == index_t(-1))
+            continue;
+
+        if (i >= nVerts)
+            return false;
+
+        if (newIndex[i] == uint32_t(-1))
+            newIndex[i] = curVertex++;
+    }
+
+    memset(vertexRemap, 0xff, sizeof(uint32_t) * nVerts);
+    for (size_t vert = 0; vert < nVerts; ++vert)
+    {
+        if (newIndex[vert] != uint32_t(-1))
+            vertexRemap[newIndex[vert]] = uint32_t(vert);
+    }
+
+    if (trailingUnused)
+        *trailingUnused = nVerts - curVertex;
+
+    return true;
+}
+
+bool OptimizeVertices(const uint16_t *indices, size_t nFaces, size_t nVerts, uint32_t *vertexRemap,
+                      size_t *trailingUnused) noexcept
+{
+    if (!indices || !nFaces || !nVerts || !vertexRemap)
+        return false;
+
+    if (nVerts >= UINT16_MAX)
+        return false;
+
+    if ((uint64_t(nFaces) * 3) >= UINT32_MAX)
+        return false;
+
+    return OptimizeVerticesImpl<uint16_t>(indices, nFaces, nVerts, vertexRemap, trailingUnused);
+}
+
+bool OptimizeVertices(const uint32_t *indices, size_t nFaces, size_t nVerts, uint32_t *vertexRemap,
+                      size_t *trailingUnused) noexcept
+{
+    if (!indices || !nFaces || !nVerts || !vertexRemap)
+        return false;
+
+    if (nVerts >= UINT32_MAX)
+        return false;
+
+    if ((uint64_t(nFaces) * 3) >= UINT32_MAX)
+        return false;
+
+    return OptimizeVerticesImpl<uint32_t>(indices, nFaces, nVerts, vertexRemap, trailingUnused);
+}
+
+//---------------------------------------------------------------------------------
+// Apply a vertex remap to the index and vertex buffers
+//---------------------------------------------------------------------------------
+template <class index_t>
+bool FinalizeIBImpl(index_t *indices, size_t nFaces, const uint32_t *vertexRemap, size_t nVerts)
+{
+    auto temp = std::make_unique<uint32_t[]>(nVerts);
+    if (!temp)
+    {
+        return false;
+    }
+
+    uint32_t *newIndex = temp.get();
+    memset(newIndex, 0xff, sizeof(uint32_t) * nVerts);
+    for (size_t vert = 0; vert < nVerts; ++vert)
+    {
+        uint32_t old = vertexRemap[vert];
+        if (old == uint32_t(-1))
+            continue;
+
+        if (old >= nVerts)
+            return false;
+
+        newIndex[old] = uint32_t(vert);
+    }
+
+    for (size_t j = 0; j < nFaces * 3; ++j)
+    {
+        index_t i = indices[j];
+        if (i == index_t(-1))
+            continue;
+
+        if (i >= nVerts || newIndex[i] == uint32_t(-1))
+            return false;
+
+        indices[j] = index_t(newIndex[i]);
+    }
+
+    return true;
+}
+
+bool FinalizeIB(uint16_t *indices, size_t nFaces, const uint32_t *vertexRemap, size_t nVerts) noexcept
+{
+    if (!indices || !nFaces || !vertexRemap || !nVerts)
+        return false;
+
+    if (nVerts >= UINT16_MAX)
+        return false;
+
+    return FinalizeIBImpl<uint16_t>(indices, nFaces, vertexRemap, nVerts);
+}
+
+bool FinalizeIB(uint32_t *indices, size_t nFaces, const uint32_t *vertexRemap, size_t nVerts) noexcept
+{
+    if (!indices || !nFaces || !vertexRemap || !nVerts)
+        return false;
+
+    if (nVerts >= UINT32_MAX)
+        return false;
+
+    return FinalizeIBImpl<uint32_t>(indices, nFaces, vertexRemap, nVerts);
+}
+
+bool FinalizeVB(void *vb, size_t stride, size_t nVerts, const uint32_t *vertexRemap) noexcept
+{
+    if (!vb || !stride || !nVerts || !vertexRemap)
+        return false;
+
+    auto temp = std::make_unique<uint8_t[]>(stride * nVerts);
+    if (!temp)
+    {
+        return false;
+    }
+
+    uint8_t *dst = static_cast<uint8_t *>(vb);
+    memcpy(temp.get(), dst, stride * nVerts);
+
+    // Unused vertices all sit at the end of the remap, their slots are left as they were
+    for (size_t vert = 0; vert < nVerts; ++vert)
+    {
+        uint32_t old = vertexRemap[vert];
+        if (old == uint32_t(-1))
+            break;
+
+        if (old >= nVerts)
+            return false;
+
+        memcpy(dst + vert * stride, temp.get() + old * stride, stride);
+    }
+
+    return true;
+}
+
+//---------------------------------------------------------------------------------
+// Cache and fetch analysis
+//---------------------------------------------------------------------------------
+template <class index_t>
+void ComputeVertexCacheMissRateImpl(const index_t *indices, size_t nFaces, size_t nVerts, size_t cacheSize,
+                                    float &acmr, float &atvr)
+{
+    // A vertex is still in the FIFO if fewer than cacheSize misses happened since it went in
+    auto temp = std::make_unique<size_t[]>(nVerts);
+    size_t *insertedAt = temp.get();
+    memset(insertedAt, 0, sizeof(size_t) * nVerts);
+
+    size_t time = cacheSize + 1;
+    size_t misses = 0;
+    size_t used = 0;
+    for (size_t j = 0; j < nFaces * 3; ++j)
+    {
+        index_t i = indices[j];
+        if (i == index_t(-1) || i >= nVerts)
+            continue;
+
+        if (insertedAt[i] == 0)
+            ++used;
+
+        if (time - insertedAt[i] > cacheSize)
+        {
+            insertedAt[i] = time++;
+            ++misses;
+        }
+    }
+
+    acmr = float(misses) / float(nFaces);
+    atvr = used > 0 ? float(misses) / float(used) : 0.0f;
+}
+
+void ComputeVertexCacheMissRate(const uint16_t *indices, size_t nFaces, size_t nVerts, size_t cacheSize,
+                                float &acmr, float &atvr) noexcept
+{
+    acmr = atvr = -1.0f;
+    if (!indices || !nFaces || !nVerts || !cacheSize)
+        return;
+
+    ComputeVertexCacheMissRateImpl<uint16_t>(indices, nFaces, nVerts, cacheSize, acmr, atvr);
+}
+
+void ComputeVertexCacheMissRate(const uint32_t *indices, size_t nFaces, size_t nVerts, size_t cacheSize,
+                                float &acmr, float &atvr) noexcept
+{
+    acmr = atvr = -1.0f;
+    if (!indices || !nFaces || !nVerts || !cacheSize)
+        return;
+
+    ComputeVertexCacheMissRateImpl<uint32_t>(indices, nFaces, nVerts, cacheSize, acmr, atvr);
+}
+
+template <class index_t>
+size_t ComputeVertexFetchBytesImpl(const index_t *indices, size_t nFaces, size_t nVerts, size_t stride)
+{
+    // Direct mapped, 16 KB of 64 byte lines
+    constexpr size_t c_LineSize = 64;
+    constexpr size_t c_NumLines = 256;
+    size_t cache[c_NumLines];
+    std::fill(cache, cache + c_NumLines, size_t(-1));
+
+    size_t bytes = 0;
+    for (size_t j = 0; j < nFaces * 3; ++j)
+    {
+        index_t i = indices[j];
+        if (i == index_t(-1) || i >= nVerts)
+            continue;
+
+        size_t first = i * stride / c_LineSize;
+        size_t last = (i * stride + stride - 1) / c_LineSize;
+        for (size_t line = first; line <= last; ++line)
+        {
+            size_t &slot = cache[line % c_NumLines];
+            if (slot != line)
+            {
+                slot = line;
+                bytes += c_LineSize;
+            }
+        }
+    }
+
+    return bytes;
+}
+
+size_t ComputeVertexFetchBytes(const uint16_t *indices, size_t nFaces, size_t nVerts, size_t stride) noexcept
+{
+    if (!indices || !nFaces || !nVerts || !stride)
+        return 0;
+
+    return ComputeVertexFetchBytesImpl<uint16_t>(indices, nFaces, nVerts, stride);
+}
+
+size_t ComputeVertexFetchBytes(const uint32_t *indices, size_t nFaces, size_t nVerts, size_t stride) noexcept
+{
+    if (!indices || !nFaces || !nVerts || !stride)
+        return 0;
+
+    return ComputeVertexFetchBytesImpl<uint32_t>(indices, nFaces, nVerts, stride);
+}
+
+//---------------------------------------------------------------------------------
+// Overdraw
+//---------------------------------------------------------------------------------
+namespace
+{
+constexpr uint32_t c_OverdrawCacheSize = 16;
+
+// FIFO cache as in ComputeVertexCacheMissRate, advancing time by cacheSize + 1 empties it
+inline uint32_t UpdateCache(uint32_t a, uint32_t b, uint32_t c, uint32_t *timestamps, uint32_t &time)
+{
+    uint32_t misses = 0;
+    for (uint32_t v : {a, b, c})
+    {
+        if (time - timestamps[v] > c_OverdrawCacheSize)
+        {
+            timestamps[v] = time++;
+            ++misses;
+        }
+    }
+    return misses;
+}
+} // namespace
+
+// Splits the patches further wherever the ACMR since the last split gets within threshold of the ACMR of
+// the whole patch. Each cluster starts with an empty cache, which is what the threshold pays for.
+template <class index_t>
+void SplitClusters(const index_t *indices, size_t nFaces, const std::vector<uint32_t> &patches, float threshold,
+                   uint32_t *timestamps, uint32_t &time, std::vector<uint32_t> &clusters)
+{
+    clusters.clear();
+    for (size_t p = 0; p < patches.size(); ++p)
+    {
+        uint32_t start = patches[p];
+        uint32_t end = p + 1 < patches.size() ? patches[p + 1] : uint32_t(nFaces);
+
+        time += c_OverdrawCacheSize + 1;
+        uint32_t patchMisses = 0;
+        for (uint32_t face = start; face < end; ++face)
+        {
+            const index_t *f = indices + face * 3;
+            patchMisses += UpdateCache(f[0], f[1], f[2], timestamps, time);
+        }
+        float clusterThreshold = threshold * float(patchMisses) / float(end - start);
+
+        clusters.push_back(start);
+        time += c_OverdrawCacheSize + 1;
+        uint32_t misses = 0;
+        uint32_t faces = 0;
+        for (uint32_t face = start; face < end; ++face)
+        {
+            const index_t *f = indices + face * 3;
+            misses += UpdateCache(f[0], f[1], f[2], timestamps, time);
+            ++faces;
+            if (float(misses) / float(faces) <= clusterThreshold && face + 1 < end)
+            {
+                clusters.push_back(face + 1);
+                time += c_OverdrawCacheSize + 1;
+                misses = 0;
+                faces = 0;
+            }
+        }
+
+        // The faces after the last split never got down to the threshold, a cold cache would make them
+        // the worst cluster of all. They go with the cluster before them instead.
+        if (clusters.back() != start && float(misses) / float(faces) > clusterThreshold)
+            clusters.pop_back();
+    }
+}
+
+template <class index_t>
+bool OptimizeOverdrawImpl(index_t *indices, size_t nFaces, const glm::vec3 *positions, size_t nVerts,
+                          float threshold)
+{
+    for (size_t j = 0; j < nFaces * 3; ++j)
+    {
+        if (indices[j] >= nVerts)
+            return false;
+    }
+
+    auto temp = std::make_unique<uint32_t[]>(nVerts);
+    uint32_t *timestamps = temp.get();
+
+    // A face that misses the cache on all three vertices starts a new patch of the mesh
+    std::vector<uint32_t> patches;
+    memset(timestamps, 0, sizeof(uint32_t) * nVerts);
+    uint32_t time = c_OverdrawCacheSize + 1;
+    uint32_t sourceMisses = 0;
+    for (size_t face = 0; face < nFaces; ++face)
+    {
+        const index_t *f = indices + face * 3;
+        uint32_t misses = UpdateCache(f[0], f[1], f[2], timestamps, time);
+        if (misses == 3 || face == 0)
+            patches.push_back(uint32_t(face));
+        sourceMisses += misses;
+    }
+
+    glm::vec3 meshCentroid(0.0f);
+    for (size_t j = 0; j < nFaces * 3; ++j)
+        meshCentroid += positions[indices[j]];
+    meshCentroid /= float(nFaces * 3);
+
+    // The per cluster threshold doesn't bound the ACMR of the whole buffer, the cluster that keeps the
+    // faces after the last split can still miss a lot. When the reordered buffer misses more than the
+    // threshold allows, split again with a threshold halfway closer to 1, which gives fewer clusters.
+    std::vector<uint32_t> clusters;
+    std::vector<float> sortKeys;
+    std::vector<uint32_t> order;
+    std::vector<index_t> sorted(nFaces * 3);
+    float clusterThreshold = threshold;
+    for (int attempt = 0; attempt < 4; ++attempt, clusterThreshold = 1.0f + (clusterThreshold - 1.0f) * 0.5f)
+    {
+        SplitClusters(indices, nFaces, patches, clusterThreshold, timestamps, time, clusters);
+
+        // Clusters far out from the center that face away from it are likely to occlude the rest, draw them
+        // first
+        sortKeys.resize(clusters.size());
+        for (size_t c = 0; c < clusters.size(); ++c)
+        {
+            uint32_t start = clusters[c];
+            uint32_t end = c + 1 < clusters.size() ? clusters[c + 1] : uint32_t(nFaces);
+
+            glm::vec3 centroid(0.0f);
+            glm::vec3 normal(0.0f);
+            float area = 0.0f;
+            for (uint32_t face = start; face < end; ++face)
+            {
+                const glm::vec3 p0 = positions[indices[face * 3]];
+                const glm::vec3 p1 = positions[indices[face * 3 + 1]];
+                const glm::vec3 p2 = positions[indices[face * 3 + 2]];
+
+                // Twice the area, pointing along the face normal
+                const glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+                const float a = glm::length(n);
+
+                centroid += (p0 + p1 + p2) * (a / 3.0f);
+                normal += n;
+                area += a;
+            }
+
+            centroid = area > 0.0f ? centroid / area : centroid;
+            const float normalLength = glm::length(normal);
+            normal = normalLength > 0.0f ? normal / normalLength : normal;
+            sortKeys[c] = glm::dot(centroid - meshCentroid, normal);
+        }
+
+        order.resize(clusters.size());
+        for (uint32_t c = 0; c < order.size(); ++c)
+            order[c] = c;
+        std::stable_sort(order.begin(), order.end(),
+                         [&](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+        index_t *dest = sorted.data();
+        for (uint32_t c : order)
+        {
+            uint32_t start = clusters[c];
+            uint32_t end = c + 1 < clusters.size() ? clusters[c + 1] : uint32_t(nFaces);
+            dest = std::copy(indices + start * 3, indices + end * 3, dest);
+        }
+
+        time += c_OverdrawCacheSize + 1;
+        uint32_t sortedMisses = 0;
+        for (size_t face = 0; face < nFaces; ++face)
+        {
+            const index_t *f = sorted.data() + face * 3;
+            sortedMisses += UpdateCache(f[0], f[1], f[2], timestamps, time);
+        }
+
+        if (float(sortedMisses) <= threshold * float(sourceMisses))
+        {
+            memcpy(indices, sorted.data(), sizeof(index_t) * nFaces * 3);
+            break;
+        }
+    }
+
+    // Otherwise the faces keep their order
+    return true;
+}
+
+bool OptimizeOverdraw(uint16_t *indices, size_t nFaces, const glm::vec3 *positions, size_t nVerts,
+                      float threshold) noexcept
+{
+    if (!indices || !nFaces || !positions || !nVerts)
+        return false;
+
+    if (nVerts >= UINT16_MAX)
+        return false;
+
+    return OptimizeOverdrawImpl<uint16_t>(indices, nFaces, positions, nVerts, threshold);
+}
+
+bool OptimizeOverdraw(uint32_t *indices, size_t nFaces, const glm::vec3 *positions, size_t nVerts,
+                      float threshold) noexcept
+{
+    if (!indices || !nFaces || !positions || !nVerts)
+        return false;
+
+    if (nVerts >= UINT32_MAX)
+        return false;
+
+    return OptimizeOverdrawImpl<uint32_t>(indices, nFaces, positions, nVerts, threshold);
+}
+
+template <class index_t>
+float ComputeOverdrawImpl(const index_t *indices, size_t nFaces, const glm::vec3 *positions, size_t nVerts)
+{
+    constexpr int c_Resolution = 256;
+
+    glm::vec3 minPos(FLT_MAX);
+    glm::vec3 maxPos(-FLT_MAX);
+    for (size_t j = 0; j < nFaces * 3; ++j)
+    {
+        if (indices[j] >= nVerts)
+            return -1.0f;
+        minPos = glm::min(minPos, positions[indices[j]]);
+        maxPos = glm::max(maxPos, positions[indices[j]]);
+    }
+    const glm::vec3 extent = maxPos - minPos;
+    const float scale = float(c_Resolution) / std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-20f));
+
+    // Front and back faces test against their own depth buffer, so the result doesn't depend on the winding.
+    // Back faces are seen from the opposite direction, so for them the farthest fragment wins.
+    std::vector<float> depth(c_Resolution * c_Resolution * 2);
+    uint64_t covered = 0;
+    uint64_t shaded = 0;
+
+    // Orthographic views down both directions of each axis
+    for (int view = 0; view < 6; ++view)
+    {
+        const int axis = view / 2;
+        const float dir = view & 1 ? -1.0f : 1.0f;
+        const int u = (axis + 1) % 3;
+        const int v = (axis + 2) % 3;
+
+        std::fill(depth.begin(), depth.end(), FLT_MAX);
+
+        for (size_t face = 0; face < nFaces; ++face)
+        {
+            glm::vec3 p[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                const glm::vec3 pos = (positions[indices[face * 3 + k]] - minPos) * scale;
+                p[k] = glm::vec3(dir > 0.0f ? pos[u] : c_Resolution - pos[u], pos[v], dir * pos[axis]);
+            }
+
+            const float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+            if (area == 0.0f)
+                continue;
+            float *buffer = depth.data() + (area > 0.0f ? 0 : c_Resolution * c_Resolution);
+            const float invArea = 1.0f / area;
+
+            int x0 = std::max(0, int(std::floor(std::min(std::min(p[0].x, p[1].x), p[2].x))));
+            int x1 = std::min(c_Resolution - 1, int(std::ceil(std::max(std::max(p[0].x, p[1].x), p[2].x))));
+            int y0 = std::max(0, int(std::floor(std::min(std::min(p[0].y, p[1].y), p[2].y))));
+            int y1 = std::min(c_Resolution - 1, int(std::ceil(std::max(std::max(p[0].y, p[1].y), p[2].y))));
+
+            for (int y = y0; y <= y1; ++y)
+            {
+                for (int x = x0; x <= x1; ++x)
+                {
+                    const float px = x + 0.5f;
+                    const float py = y + 0.5f;
+
+                    // Barycentrics, all of the same sign as the area inside the triangle
+                    const float w0 = ((p[1].x - px) * (p[2].y - py) - (p[2].x - px) * (p[1].y - py)) * invArea;
+                    const float w1 = ((p[2].x - px) * (p[0].y - py) - (p[0].x - px) * (p[2].y - py)) * invArea;
+                    const float w2 = 1.0f - w0 - w1;
+                    if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+                        continue;
+
+                    const float z = (w0 * p[0].z + w1 * p[1].z + w2 * p[2].z) * (area < 0.0f ? 1.0f : -1.0f);
+                    float &d = buffer[y * c_Resolution + x];
+                    if (z < d)
+                    {
+                        covered += d == FLT_MAX;
+                        d = z;
+                        ++shaded;
+                    }
+                }
+            }
+        }
+    }
+
+    return covered > 0 ? float(shaded) / float(covered) : 0.0f;
+}
+
+float ComputeOverdraw(const uint16_t *indices, size_t nFaces, const glm::vec3 *positions, size_t nVerts) noexcept
+{
+    if (!indices || !nFaces || !positions || !nVerts)
+        return -1.0f;
+
+    return ComputeOverdrawImpl<uint16_t>(indices, nFaces, positions, nVerts);
+}
+
+float ComputeOverdraw(const uint32_t *indices, size_t nFaces, const glm::vec3 *positions, size_t nVerts) noexcept
+{
+    if (!indices || !nFaces || !positions || !nVerts)
+        return -1.0f;
+
+    return ComputeOverdrawImpl<uint32_t>(indices, nFaces, positions, nVerts);
+}
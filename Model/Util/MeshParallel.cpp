@@ -0,0 +1,124 @@
+#include "VulkanMeshP.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+size_t GetHardwareThreads() { return std::max(1u, std::thread::hardware_concurrency()); }
+
+// Worker threads shared by every ParallelFor, so a mesh function doesn't start and join threads on each pass
+class WorkerPool
+{
+public:
+    WorkerPool() : m_NumThreads(GetHardwareThreads())
+    {
+        m_Workers.reserve(m_NumThreads - 1);
+        for (size_t t = 1; t < m_NumThreads; ++t)
+            m_Workers.emplace_back([this, t] { WorkerLoop(t); });
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Exit = true;
+        }
+        m_Wake.notify_all();
+        for (std::thread &worker : m_Workers)
+            worker.join();
+    }
+
+    void Run(size_t threads, size_t count, void (*fn)(const void *, size_t, size_t), const void *context)
+    {
+        std::unique_lock<std::mutex> busy(m_RunMutex, std::try_to_lock);
+        if (!busy.owns_lock())
+        {
+            fn(context, 0, count);
+            return;
+        }
+
+        threads = std::min(threads, m_NumThreads);
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Fn = fn;
+            m_Context = context;
+            m_Count = count;
+            m_Threads = threads;
+            m_Pending = threads - 1;
+            ++m_Generation;
+        }
+        m_Wake.notify_all();
+
+        fn(context, 0, count / threads);
+
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_Done.wait(lock, [this] { return m_Pending == 0; });
+    }
+
+private:
+    // Worker t takes range t of every call that uses at least t + 1 threads
+    void WorkerLoop(size_t t)
+    {
+        uint64_t generation = 0;
+        for (;;)
+        {
+            void (*fn)(const void *, size_t, size_t);
+            const void *context;
+            size_t count, threads;
+            {
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                m_Wake.wait(lock, [&] { return m_Exit || m_Generation != generation; });
+                if (m_Exit)
+                    return;
+                generation = m_Generation;
+                fn = m_Fn;
+                context = m_Context;
+                count = m_Count;
+                threads = m_Threads;
+            }
+            if (t >= threads)
+                continue;
+
+            fn(context, count * t / threads, count * (t + 1) / threads);
+
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            if (--m_Pending == 0)
+                m_Done.notify_one();
+        }
+    }
+
+    const size_t m_NumThreads;
+    std::vector<std::thread> m_Workers;
+
+    // Held for a whole call, so only one caller hands out ranges at a time
+    std::mutex m_RunMutex;
+
+    // The current call, guarded by m_Mutex
+    std::mutex m_Mutex;
+    std::condition_variable m_Wake;
+    std::condition_variable m_Done;
+    void (*m_Fn)(const void *, size_t, size_t) = nullptr;
+    const void *m_Context = nullptr;
+    size_t m_Count = 0;
+    size_t m_Threads = 0;
+    size_t m_Pending = 0;
+    uint64_t m_Generation = 0;
+    bool m_Exit = false;
+};
+
+WorkerPool &GetWorkerPool()
+{
+    static WorkerPool s_Pool;
+    return s_Pool;
+}
+} // namespace
+
+// Doesn't start the workers, so meshes too small to split never do
+size_t GetParallelThreadCount() { return GetHardwareThreads(); }
+
+void RunParallelRanges(size_t threads, size_t count, void (*fn)(const void *, size_t, size_t), const void *context)
+{
+    GetWorkerPool().Run(threads, count, fn, context);
+}
@@ -0,0 +1,282 @@
+#include "VulkanMesh.h"
+#include <algorithm>
+#include <cmath>
+#include <unordered_set>
+
+namespace
+{
+// Sum of squared distances to the planes of the faces around a vertex, weighted by their area
+struct Quadric
+{
+    double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+    double weight;
+
+    void AddPlane(const glm::vec3 &n, float d, float w)
+    {
+        a2 += w * n.x * n.x;
+        ab += w * n.x * n.y;
+        ac += w * n.x * n.z;
+        ad += w * n.x * d;
+        b2 += w * n.y * n.y;
+        bc += w * n.y * n.z;
+        bd += w * n.y * d;
+        c2 += w * n.z * n.z;
+        cd += w * n.z * d;
+        d2 += w * d * d;
+        weight += w;
+    }
+
+    void Add(const Quadric &q)
+    {
+        a2 += q.a2;
+        ab += q.ab;
+        ac += q.ac;
+        ad += q.ad;
+        b2 += q.b2;
+        bc += q.bc;
+        bd += q.bd;
+        c2 += q.c2;
+        cd += q.cd;
+        d2 += q.d2;
+        weight += q.weight;
+    }
+
+    // Mean squared distance of p to the planes
+    double Error(const glm::vec3 &p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        double e = a2 * x * x + b2 * y * y + c2 * z * z + 2.0 * (ab * x * y + ac * x * z + bc * y * z) +
+                   2.0 * (ad * x + bd * y + cd * z) + d2;
+        return weight > 0.0 ? std::max(e, 0.0) / weight : 0.0;
+    }
+};
+
+struct Collapse
+{
+    uint32_t source;
+    uint32_t target;
+    double error;
+};
+} // namespace
+
+template <class index_t>
+bool SimplifyMeshImpl(const index_t *indices, size_t nFaces, const glm::vec3 *positions, size_t nVerts,
+                      size_t targetFaces, float maxError, index_t *outIndices, size_t &outFaces, float &outError)
+{
+    // Vertices split by their other attributes share a position, the collapses work on these groups
+    std::unique_ptr<uint32_t[]> group(new uint32_t[nVerts]);
+    VertexStream stream = {positions, sizeof(glm::vec3), sizeof(glm::vec3)};
+    const size_t nGroups = WeldVertices(&stream, 1, nVerts, group.get());
+    if (nGroups == 0)
+        return false;
+
+    std::vector<uint32_t> wedges(nGroups, 0);
+    for (size_t v = 0; v < nVerts; ++v)
+        ++wedges[group[v]];
+
+    // Faces without area between the groups are dropped up front
+    std::vector<Quadric> quadrics(nGroups, Quadric{});
+    std::unordered_set<uint64_t> edges;
+    edges.reserve(nFaces * 3);
+    std::vector<index_t> ib;
+    ib.reserve(nFaces * 3);
+    for (size_t face = 0; face < nFaces; ++face)
+    {
+        const index_t *f = indices + face * 3;
+        if (f[0] >= nVerts || f[1] >= nVerts || f[2] >= nVerts)
+            return false;
+        if (group[f[0]] == group[f[1]] || group[f[1]] == group[f[2]] || group[f[2]] == group[f[0]])
+            continue;
+        ib.insert(ib.end(), f, f + 3);
+
+        glm::vec3 normal = glm::cross(positions[f[1]] - positions[f[0]], positions[f[2]] - positions[f[0]]);
+        float area = glm::length(normal);
+        if (area > 0.0f)
+        {
+            normal /= area;
+            float d = -glm::dot(normal, positions[f[0]]);
+            for (size_t j = 0; j < 3; ++j)
+                quadrics[group[f[j]]].AddPlane(normal, d, area);
+        }
+
+        for (size_t j = 0; j < 3; ++j)
+            edges.insert((uint64_t)group[f[j]] << 32 | group[f[(j + 1) % 3]]);
+    }
+
+    // An edge only one face walks along is on a border, its ends stay where they are
+    std::vector<bool> locked(nGroups, false);
+    for (uint64_t edge : edges)
+    {
+        uint32_t from = (uint32_t)(edge >> 32), to = (uint32_t)edge;
+        if (edges.count((uint64_t)to << 32 | from) == 0)
+            locked[from] = locked[to] = true;
+    }
+    edges.clear();
+
+    // Only a vertex inside one attribute chart moves. Its neighbor's attributes fit the faces around it.
+    auto movable = [&](uint32_t v) { return wedges[group[v]] == 1 && !locked[group[v]]; };
+
+    size_t faceCount = ib.size() / 3;
+    const double maxErrorSq = (double)maxError * maxError;
+    double errorSq = 0.0;
+
+    std::vector<uint32_t> faceStart(nVerts + 1), faceList;
+    std::vector<Collapse> best(nVerts);
+    std::vector<Collapse> collapses;
+    std::vector<bool> touched(nGroups);
+    std::vector<bool> removed;
+
+    while (faceCount > targetFaces)
+    {
+        // Faces around each vertex
+        std::fill(faceStart.begin(), faceStart.end(), 0);
+        for (size_t k = 0; k < faceCount * 3; ++k)
+            ++faceStart[ib[k] + 1];
+        for (size_t v = 0; v < nVerts; ++v)
+            faceStart[v + 1] += faceStart[v];
+        faceList.resize(faceCount * 3);
+        {
+            std::vector<uint32_t> fill(faceStart.begin(), faceStart.end() - 1);
+            for (size_t k = 0; k < faceCount * 3; ++k)
+                faceList[fill[ib[k]]++] = (uint32_t)(k / 3);
+        }
+
+        // The cheapest collapse of every movable vertex onto one of its neighbors
+        for (Collapse &c : best)
+            c.error = -1.0;
+        for (size_t k = 0; k < faceCount * 3; ++k)
+        {
+            const uint32_t source = ib[k];
+            if (!movable(source))
+                continue;
+            const size_t faceBase = k - k % 3;
+            for (size_t j = 1; j < 3; ++j)
+            {
+                const uint32_t target = ib[faceBase + (k % 3 + j) % 3];
+                if (group[target] == group[source])
+                    continue;
+                double error = quadrics[group[source]].Error(positions[target]);
+                if (best[source].error < 0.0 || error < best[source].error)
+                    best[source] = {source, target, error};
+            }
+        }
+
+        collapses.clear();
+        for (const Collapse &c : best)
+        {
+            if (c.error >= 0.0 && c.error <= maxErrorSq)
+                collapses.push_back(c);
+        }
+        if (collapses.empty())
+            break;
+        std::sort(collapses.begin(), collapses.end(),
+                  [](const Collapse &a, const Collapse &b) { return a.error < b.error; });
+
+        // Collapse in order of error. A group that moved or received a vertex waits for the next pass, so
+        // every quadric and face checked here is current.
+        std::fill(touched.begin(), touched.end(), false);
+        removed.assign(faceCount, false);
+        size_t liveFaces = faceCount;
+        size_t applied = 0;
+        for (const Collapse &c : collapses)
+        {
+            if (liveFaces <= targetFaces)
+                break;
+            const uint32_t gs = group[c.source], gt = group[c.target];
+            if (touched[gs] || touched[gt])
+                continue;
+
+            // Reject collapses that fold a remaining face over, or flatten it into a line. A face of three
+            // border vertices on a straight edge has no direction left to test later.
+            const glm::vec3 &moved = positions[c.target];
+            bool flips = false;
+            for (uint32_t i = faceStart[c.source]; i < faceStart[c.source + 1] && !flips; ++i)
+            {
+                const index_t *f = &ib[faceList[i] * 3];
+                if (removed[faceList[i]] || group[f[0]] == gt || group[f[1]] == gt || group[f[2]] == gt)
+                    continue;
+                glm::vec3 p[3] = {positions[f[0]], positions[f[1]], positions[f[2]]};
+                glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                for (size_t j = 0; j < 3; ++j)
+                {
+                    if (f[j] == c.source)
+                        p[j] = moved;
+                }
+                glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+                const float beforeLength = glm::length(before), afterLength = glm::length(after);
+                flips = beforeLength > 0.0f && (glm::dot(before, after) <= 0.25f * beforeLength * afterLength ||
+                                                afterLength <= 1e-3f * beforeLength);
+            }
+            if (flips)
+                continue;
+
+            for (uint32_t i = faceStart[c.source]; i < faceStart[c.source + 1]; ++i)
+            {
+                const uint32_t face = faceList[i];
+                if (removed[face])
+                    continue;
+                index_t *f = &ib[face * 3];
+                for (size_t j = 0; j < 3; ++j)
+                {
+                    if (f[j] == c.source)
+                        f[j] = (index_t)c.target;
+                }
+                if (group[f[0]] == group[f[1]] || group[f[1]] == group[f[2]] || group[f[2]] == group[f[0]])
+                {
+                    removed[face] = true;
+                    --liveFaces;
+                }
+            }
+
+            quadrics[gt].Add(quadrics[gs]);
+            touched[gs] = touched[gt] = true;
+            errorSq = std::max(errorSq, c.error);
+            ++applied;
+        }
+        if (applied == 0)
+            break;
+
+        size_t kept = 0;
+        for (size_t face = 0; face < faceCount; ++face)
+        {
+            if (removed[face])
+                continue;
+            std::copy_n(&ib[face * 3], 3, &ib[kept * 3]);
+            ++kept;
+        }
+        faceCount = kept;
+    }
+
+    std::copy_n(ib.data(), faceCount * 3, outIndices);
+    outFaces = faceCount;
+    outError = (float)std::sqrt(errorSq);
+    return true;
+}
+
+bool SimplifyMesh(const uint16_t *indices, size_t nFaces, const glm::vec3 *positions, size_t nVerts,
+                  size_t targetFaces, float maxError, uint16_t *outIndices, size_t &outFaces,
+                  float &outError) noexcept
+{
+    if (!indices || !nFaces || !positions || !nVerts || !outIndices)
+        return false;
+
+    if (nVerts >= UINT16_MAX)
+        return false;
+
+    return SimplifyMeshImpl<uint16_t>(indices, nFaces, positions, nVerts, targetFaces, maxError, outIndices,
+                                      outFaces, outError);
+}
+
+bool SimplifyMesh(const uint32_t *indices, size_t nFaces, const glm::vec3 *positions, size_t nVerts,
+                  size_t targetFaces, float maxError, uint32_t *outIndices, size_t &outFaces,
+                  float &outError) noexcept
+{
+    if (!indices || !nFaces || !positions || !nVerts || !outIndices)
+        return false;
+
+    if (nVerts >= UINT32_MAX)
+        return false;
+
+    return SimplifyMeshImpl<uint32_t>(indices, nFaces, positions, nVerts, targetFaces, maxError, outIndices,
+                                      outFaces, outError);
+}
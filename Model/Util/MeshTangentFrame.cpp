@@ -1,6 +1,75 @@
-#include "VulkanMesh.h"
+#include "VulkanMeshP.h"
 #include <glm/geometric.hpp>
 
+namespace
+{
+// Work below these sizes stays on one thread
+constexpr size_t c_MinFacesPerThread = 4096;
+constexpr size_t c_MinVertsPerThread = 4096;
+
+constexpr float EPSILON = 0.0001f;
+
+glm::vec4 OrthonormalizeTangent(const glm::vec3 &normal, const glm::vec3 &tan1, const glm::vec3 &tan2)
+{
+    // Gram-Schmidt orthonormalization
+    glm::vec3 b0 = normal;
+    b0 = SafeNormalize(b0);
+
+    glm::vec3 b1 = tan1 - glm::dot(b0, tan1) * b0;
+    b1 = SafeNormalize(b1);
+
+    glm::vec3 b2 = tan2 - glm::dot(b0, tan2) * b0 - glm::dot(b1, tan2) * b1;
+    b2 = SafeNormalize(b2);
+
+    // handle degenerate vectors
+    const float len1 = glm::length(b1);
+    const float len2 = glm::length(b2);
+
+    if ((len1 <= EPSILON) || (len2 <= EPSILON))
+    {
+        if (len1 > 0.5f)
+        {
+            // Reset bi-tangent from tangent and normal
+            b2 = glm::cross(b0, b1);
+        }
+        else if (len2 > 0.5f)
+        {
+            // Reset tangent from bi-tangent and normal
+            b1 = glm::cross(b2, b0);
+        }
+        else
+        {
+            // Reset both tangent and bi-tangent from normal
+            glm::vec3 axis;
+
+            const float d0 = fabsf(glm::dot(glm::vec3(1.0, 0.0, 0.0), b0));
+            const float d1 = fabsf(glm::dot(glm::vec3(0.0, 1.0, 0.0), b0));
+            const float d2 = fabsf(glm::dot(glm::vec3(0.0, 0.0, 1.0), b0));
+            if (d0 < d1)
+            {
+                axis = (d0 < d2) ? glm::vec3(1.0, 0.0, 0.0) : glm::vec3(0.0, 0.0, 1.0);
+            }
+            else if (d1 < d2)
+            {
+                axis = glm::vec3(0.0, 1.0, 0.0);
+            }
+            else
+            {
+                axis = glm::vec3(0.0, 0.0, 2.0);
+            }
+
+            b1 = glm::cross(b0, axis);
+            b2 = glm::cross(b0, b1);
+        }
+    }
+
+    glm::vec3 bi = glm::cross(b0, tan1);
+    const float w = glm::dot(bi, tan2) < 0 ? -1.f : 1.f;
+
+    return glm::vec4(b1, w);
+}
+} // namespace
+
 template <class index_t>
 bool ComputeTangentFrameImpl(const index_t *indices, size_t nFaces, const glm::vec3 *positions,
                              const glm::vec3 *normals, const glm::vec2 *texcoords, size_t nVerts,
@@ -15,135 +84,130 @@ bool ComputeTangentFrameImpl(const index_t *indices, size_t nFaces, const glm::v
     if ((uint64_t(nFaces) * 3) >= UINT32_MAX)
         return false;
 
-    static constexpr float EPSILON = 0.0001f;
+    for (size_t face = 0; face < nFaces; ++face)
+    {
+        const index_t *f = indices + face * 3;
+        if (f[0] == index_t(-1) || f[1] == index_t(-1) || f[2] == index_t(-1))
+            continue;
+        if (f[0] >= nVerts || f[1] >= nVerts || f[2] >= nVerts)
+            return false;
+    }
+
     static constexpr glm::vec4 s_flips(1.f, -1.f, -1.f, 1.f);
 
-    auto temp = std::make_unique<glm::vec4[]>(nVerts * 2);
+    // Each face's tangent and bi-tangent, followed by the sums of them at every vertex
+    auto temp = std::make_unique<glm::vec3[]>(nFaces * 2 + nVerts * 2);
     if (!temp)
     {
         return false;
     }
-    memset(temp.get(), 0, sizeof(glm::vec4) * nVerts * 2);
 
-    glm::vec4 *tangent1 = temp.get();
-    glm::vec4 *tangent2 = temp.get() + nVerts;
+    glm::vec3 *faceTangents = temp.get();
+    glm::vec3 *tangent1 = temp.get() + nFaces * 2;
+    glm::vec3 *tangent2 = tangent1 + nVerts;
 
-    for (size_t face = 0; face < nFaces; ++face)
-    {
-        index_t i0 = indices[face * 3];
-        index_t i1 = indices[face * 3 + 1];
-        index_t i2 = indices[face * 3 + 2];
+    ParallelFor(nFaces, c_MinFacesPerThread, [&](size_t begin, size_t end) {
+        for (size_t face = begin; face < end; ++face)
+        {
+            index_t i0 = indices[face * 3];
+            index_t i1 = indices[face * 3 + 1];
+            index_t i2 = indices[face * 3 + 2];
 
-        if (i0 == index_t(-1) || i1 == index_t(-1) || i2 == index_t(-1))
-            continue;
+            if (i0 == index_t(-1) || i1 == index_t(-1) || i2 == index_t(-1))
+            {
+                faceTangents[face * 2] = faceTangents[face * 2 + 1] = glm::vec3(0.0f);
+                continue;
+            }
 
-        if (i0 >= nVerts || i1 >= nVerts || i2 >= nVerts)
-            return false;
+            const glm::vec2 t0 = texcoords[i0];
+            const glm::vec2 t1 = texcoords[i1];
+            const glm::vec2 t2 = texcoords[i2];
 
-        const glm::vec2 t0 = texcoords[i0];
-        const glm::vec2 t1 = texcoords[i1];
-        const glm::vec2 t2 = texcoords[i2];
+            glm::vec2 t10 = t1 - t0;
+            glm::vec2 t20 = t2 - t0;
+            glm::vec4 s = glm::vec4(t10.x, t20.x, t10.y, t20.y);
 
-        glm::vec2 t10 = t1 - t0;
-        glm::vec2 t20 = t2 - t0;
-        glm::vec4 s = glm::vec4(t10.x, t20.x, t10.y, t20.y);
+            glm::vec4 tmp = s;
 
-        glm::vec4 tmp = s;
+            float d = tmp.x * tmp.w - tmp.z * tmp.y;
+            d = (fabsf(d) <= EPSILON) ? 1.f : (1.f / d);
+            s = s * d;
+            s = s * s_flips;
 
-        float d = tmp.x * tmp.w - tmp.z * tmp.y;
-        d = (fabsf(d) <= EPSILON) ? 1.f : (1.f / d);
-        s = s * d;
-        s = s * s_flips;
+            glm::mat4 m0; // glm mat4 is column major
+            m0[0] = glm::vec4(s[3], s[2], 0.0, 0.0);
+            m0[1] = glm::vec4(s[1], s[0], 0.0, 0.0);
+            m0[2] = m0[3] = glm::vec4(0.0);
 
-        glm::mat4 m0; // glm mat4 is column major
-        m0[0] = glm::vec4(s[3], s[2], 0.0, 0.0);
-        m0[1] = glm::vec4(s[1], s[0], 0.0, 0.0);
-        m0[2] = m0[3] = glm::vec4(0.0);
+            const glm::vec4 p0 = glm::vec4(positions[i0], 0.0);
+            const glm::vec4 p1 = glm::vec4(positions[i1], 0.0);
+            glm::vec4 p2 = glm::vec4(positions[i2], 0.0);
 
-        const glm::vec4 p0 = glm::vec4(positions[i0], 0.0);
-        const glm::vec4 p1 = glm::vec4(positions[i1], 0.0);
-        glm::vec4 p2 = glm::vec4(positions[i2], 0.0);
+            glm::mat4 m1;
+            m1[0] = p1 - p0;
+            m1[1] = p2 - p0;
+            m1[2] = m1[3] = glm::vec4(0.0);
 
-        glm::mat4 m1;
-        m1[0] = p1 - p0;
-        m1[1] = p2 - p0;
-        m1[2] = m1[3] = glm::vec4(0.0);
+            const glm::mat4 uv = m1 * m0; // transposed matrix reverse order when multiply
 
-        const glm::mat4 uv = m1 * m0; // transposed matrix reverse order when multiply
+            faceTangents[face * 2] = glm::vec3(uv[0]);
+            faceTangents[face * 2 + 1] = glm::vec3(uv[1]);
+        }
+    });
 
-        tangent1[i0] = tangent1[i0] + uv[0];
-        tangent1[i1] = tangent1[i1] + uv[0];
-        tangent1[i2] = tangent1[i2] + uv[0];
+    // Like the normals, every thread sums the faces around its own range of vertices in face order. Four
+    // vertices are orthonormalized at a time, any of them that needs the degenerate cases goes on its own.
+    VertexCorners vertexCorners;
+    BuildVertexCorners(indices, nFaces, nVerts, vertexCorners);
 
-        tangent2[i0] = tangent2[i0] + uv[1];
-        tangent2[i1] = tangent2[i1] + uv[1];
-        tangent2[i2] = tangent2[i2] + uv[1];
-    }
+    ParallelFor(nVerts, c_MinVertsPerThread, [&](size_t begin, size_t end) {
+        for (size_t vert = begin; vert < end; ++vert)
+        {
+            glm::vec3 tan1(0.0f), tan2(0.0f);
+            for (uint32_t i = vertexCorners.offsets[vert]; i < vertexCorners.offsets[vert + 1]; ++i)
+            {
+                const size_t face = vertexCorners.corners[i] / 3;
+                tan1 = tan1 + faceTangents[face * 2];
+                tan2 = tan2 + faceTangents[face * 2 + 1];
+            }
+            tangent1[vert] = tan1;
+            tangent2[vert] = tan2;
+        }
 
-    for (size_t j = 0; j < nVerts; ++j)
-    {
-        // Gram-Schmidt orthonormalization
-        glm::vec3 b0 = normals[j];
-        b0 = glm::normalize(b0);
+        if (!tangents4)
+            return;
 
-        const glm::vec3 tan1 = tangent1[j];
-        glm::vec3 b1 = tan1 - glm::dot(b0, tan1) * b0;
-        b1 = glm::normalize(b1);
+        size_t j = begin;
+        for (; j + 3 < end; j += 4)
+        {
+            const glm::vec3 *n = normals + j;
+            const Vec3x4 tan1 = Vec3x4::Gather(tangent1[j], tangent1[j + 1], tangent1[j + 2], tangent1[j + 3]);
+            const Vec3x4 tan2 = Vec3x4::Gather(tangent2[j], tangent2[j + 1], tangent2[j + 2], tangent2[j + 3]);
 
-        const glm::vec3 tan2 = tangent2[j];
-        glm::vec3 b2 = tan2 - glm::dot(b0, tan2) * b0 - glm::dot(b1, tan2) * b1;
-        b2 = glm::normalize(b2);
+            const Vec3x4 b0 = SafeNormalize(Vec3x4::Gather(n[0], n[1], n[2], n[3]));
+            const Vec3x4 b1 = SafeNormalize(tan1 - b0 * Dot(b0, tan1));
+            const Vec3x4 b2 = SafeNormalize(tan2 - b0 * Dot(b0, tan2) - b1 * Dot(b1, tan2));
 
-        // handle degenerate vectors
-        const float len1 = glm::length(b1);
-        const float len2 = glm::length(b2);
+            const Float4 epsilon = Float4::Splat(EPSILON);
+            const int degenerate = ((Sqrt(Dot(b1, b1)) <= epsilon) | (Sqrt(Dot(b2, b2)) <= epsilon)).Bits();
 
-        if ((len1 <= EPSILON) || (len2 <= EPSILON))
-        {
-            if (len1 > 0.5f)
-            {
-                // Reset bi-tangent from tangent and normal
-                b2 = glm::cross(b0, b1);
-            }
-            else if (len2 > 0.5f)
-            {
-                // Reset tangent from bi-tangent and normal
-                b1 = glm::cross(b2, b0);
-            }
-            else
+            float w[4];
+            const Float4 flipped = Dot(Cross(b0, tan1), tan2) < Float4::Splat(0.0f);
+            Select(flipped, Float4::Splat(-1.f), Float4::Splat(1.f)).Store(w);
+
+            glm::vec3 tangent[4];
+            b1.Scatter(&tangent[0], &tangent[1], &tangent[2], &tangent[3]);
+            for (size_t k = 0; k < 4; ++k)
             {
-                // Reset both tangent and bi-tangent from normal
-                glm::vec3 axis;
-
-                const float d0 = fabsf(glm::dot(glm::vec3(1.0, 0.0, 0.0), b0));
-                const float d1 = fabsf(glm::dot(glm::vec3(0.0, 1.0, 0.0), b0));
-                const float d2 = fabsf(glm::dot(glm::vec3(0.0, 0.0, 1.0), b0));
-                if (d0 < d1)
-                {
-                    axis = (d0 < d2) ? glm::vec3(1.0, 0.0, 0.0) : glm::vec3(0.0, 0.0, 1.0);
-                }
-                else if (d1 < d2)
-                {
-                    axis = glm::vec3(0.0, 1.0, 0.0);
-                }
+                if (degenerate & (1 << k))
+                    tangents4[j + k] = OrthonormalizeTangent(normals[j + k], tangent1[j + k], tangent2[j + k]);
                 else
-                {
-                    axis = glm::vec3(0.0, 0.0, 2.0);
-                }
-
-                b1 = glm::cross(b0, axis);
-                b2 = glm::cross(b0, b1);
+                    tangents4[j + k] = glm::vec4(tangent[k], w[k]);
             }
         }
-
-        if (tangents4)
-        {
-            glm::vec3 bi = glm::cross(b0, tan1);
-            const float w = glm::dot(bi, tan2) < 0 ? -1.f : 1.f;
-
-            tangents4[j] = glm::vec4(b1, w);
-        }
-    }
+        for (; j < end; ++j)
+            tangents4[j] = OrthonormalizeTangent(normals[j], tangent1[j], tangent2[j]);
+    });
 
     return true;
 }
@@ -166,4 +230,4 @@ bool ComputeTangentFrame(const uint32_t *indices, size_t nFaces, const glm::vec3
         return false;
     }
     return ComputeTangentFrameImpl<uint32_t>(indices, nFaces, positions, normals, texcoords, nVerts, tangents);
-}
\ No newline at end of file
+}
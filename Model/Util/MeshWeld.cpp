@@ -0,0 +1,100 @@
+#include "VulkanMesh.h"
+#include <cstring>
+
+namespace
+{
+inline const uint8_t *GetElement(const VertexStream &stream, size_t v)
+{
+    return static_cast<const uint8_t *>(stream.data) + v * (stream.stride ? stream.stride : stream.size);
+}
+
+// FNV-1a over the bytes of every stream
+uint32_t HashVertex(const VertexStream *streams, size_t nStreams, size_t v)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t s = 0; s < nStreams; ++s)
+    {
+        const uint8_t *element = GetElement(streams[s], v);
+        for (size_t j = 0; j < streams[s].size; ++j)
+        {
+            hash ^= element[j];
+            hash *= 16777619u;
+        }
+    }
+    return hash;
+}
+
+bool VerticesEqual(const VertexStream *streams, size_t nStreams, size_t a, size_t b)
+{
+    for (size_t s = 0; s < nStreams; ++s)
+    {
+        if (memcmp(GetElement(streams[s], a), GetElement(streams[s], b), streams[s].size) != 0)
+            return false;
+    }
+    return true;
+}
+} // namespace
+
+size_t WeldVertices(const VertexStream *streams, size_t nStreams, size_t nVerts, uint32_t *vertexRemap) noexcept
+{
+    if (!streams || !nStreams || !nVerts || !vertexRemap)
+        return 0;
+
+    if (nVerts >= UINT32_MAX)
+        return 0;
+
+    for (size_t s = 0; s < nStreams; ++s)
+    {
+        if (!streams[s].data || !streams[s].size)
+            return 0;
+    }
+
+    // Open addressing with linear probing, kept below 80% full
+    size_t tableSize = 1;
+    while (tableSize < nVerts + nVerts / 4)
+        tableSize *= 2;
+
+    auto table = std::make_unique<uint32_t[]>(tableSize);
+    if (!table)
+    {
+        return 0;
+    }
+    memset(table.get(), 0xff, sizeof(uint32_t) * tableSize);
+
+    size_t uniqueVerts = 0;
+    for (size_t v = 0; v < nVerts; ++v)
+    {
+        size_t bucket = HashVertex(streams, nStreams, v) & (tableSize - 1);
+        for (;;)
+        {
+            uint32_t entry = table[bucket];
+            if (entry == uint32_t(-1))
+            {
+                table[bucket] = uint32_t(v);
+                vertexRemap[v] = uint32_t(uniqueVerts++);
+                break;
+            }
+            if (VerticesEqual(streams, nStreams, entry, v))
+            {
+                vertexRemap[v] = vertexRemap[entry];
+                break;
+            }
+            bucket = (bucket + 1) & (tableSize - 1);
+        }
+    }
+
+    return uniqueVerts;
+}
+
+bool CompactVB(const VertexStream &stream, size_t nVerts, const uint32_t *vertexRemap, void *dst) noexcept
+{
+    if (!stream.data || !stream.size || !nVerts || !vertexRemap || !dst)
+        return false;
+
+    // Duplicates land on the same element with the same bytes
+    uint8_t *out = static_cast<uint8_t *>(dst);
+    for (size_t v = 0; v < nVerts; ++v)
+        memcpy(out + size_t(vertexRemap[v]) * stream.size, GetElement(stream, v), stream.size);
+
+    return true;
+}
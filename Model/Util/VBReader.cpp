@@ -1,75 +1,208 @@
 #include "VulkanMesh.h"
 
 #include <Utility.h>
+#include <algorithm>
 #include <glm/gtc/packing.hpp>
-#include <map>
+#include <type_traits>
+#include <vulkan/vulkan_format_traits.hpp>
 
 constexpr size_t c_MaxBinding = 32;
+constexpr size_t c_MaxLocation = 32;
 constexpr size_t c_MaxStride = 2048;
 
+namespace
+{
+// Converts count elements from the vertex buffer to the caller's array, selected for a format and destination type
+template <class D> using ReadFn = void (*)(const uint8_t *ptr, size_t stride, D *dst, size_t count);
+
+template <class V> inline glm::vec4 ToVec4(const V &v)
+{
+    glm::vec4 res(0.0f);
+    for (size_t i = 0; i < v.length(); ++i)
+    {
+        res[i] = v[i];
+    }
+    return res;
+}
+
+inline glm::vec4 ToVec4(float v) { return glm::vec4(v, 0.0f, 0.0f, 0.0f); }
+
+template <class D> inline D FromVec4(const glm::vec4 &v)
+{
+    if constexpr (std::is_same_v<D, float>)
+        return v.x;
+    else
+        return D(v);
+}
+
+template <class D, class T> void LoadVerts(const uint8_t *ptr, size_t stride, D *dst, size_t count)
+{
+    for (size_t i = 0; i < count; ++i, ptr += stride)
+        dst[i] = FromVec4<D>(ToVec4(*(const T *)ptr));
+}
+
+template <class D, class T, auto Unpack> void UnpackVerts(const uint8_t *ptr, size_t stride, D *dst, size_t count)
+{
+    for (size_t i = 0; i < count; ++i, ptr += stride)
+        dst[i] = FromVec4<D>(ToVec4(Unpack(*(const T *)ptr)));
+}
+
+template <class D> ReadFn<D> SelectReader(vk::Format format)
+{
+    switch (format)
+    {
+    case vk::Format::eR32G32B32A32Sfloat:
+        return LoadVerts<D, glm::vec4>;
+    case vk::Format::eR32G32B32A32Sint:
+        return LoadVerts<D, glm::ivec4>;
+    case vk::Format::eR32G32B32A32Uint:
+        return LoadVerts<D, glm::uvec4>;
+    case vk::Format::eR32G32B32Sfloat:
+        return LoadVerts<D, glm::vec3>;
+    case vk::Format::eR32G32B32Sint:
+        return LoadVerts<D, glm::ivec3>;
+    case vk::Format::eR32G32B32Uint:
+        return LoadVerts<D, glm::uvec3>;
+    case vk::Format::eR16G16B16A16Sfloat:
+        return UnpackVerts<D, glm::uint64, glm::unpackHalf4x16>;
+    case vk::Format::eR16G16B16A16Sint:
+        return LoadVerts<D, glm::i16vec4>;
+    case vk::Format::eR16G16B16A16Snorm:
+        return UnpackVerts<D, glm::uint64, glm::unpackSnorm4x16>;
+    case vk::Format::eR16G16B16A16Uint:
+        return LoadVerts<D, glm::u16vec4>;
+    case vk::Format::eR16G16B16A16Unorm:
+        return UnpackVerts<D, glm::uint64, glm::unpackUnorm4x16>;
+    case vk::Format::eR32G32Sfloat:
+        return LoadVerts<D, glm::vec2>;
+    case vk::Format::eR32G32Sint:
+        return LoadVerts<D, glm::ivec2>;
+    case vk::Format::eR32G32Uint:
+        return LoadVerts<D, glm::uvec2>;
+    case vk::Format::eA2B10G10R10UintPack32:
+        return UnpackVerts<D, glm::uint32, glm::unpackU3x10_1x2>;
+    case vk::Format::eA2B10G10R10UnormPack32:
+        return UnpackVerts<D, glm::uint32, glm::unpackUnorm3x10_1x2>;
+    case vk::Format::eA2B10G10R10SnormPack32:
+        return UnpackVerts<D, glm::uint32, glm::unpackSnorm3x10_1x2>;
+    case vk::Format::eB10G11R11UfloatPack32:
+        return UnpackVerts<D, glm::uint32, glm::unpackF2x11_1x10>;
+    case vk::Format::eR8G8B8A8Sint:
+        return LoadVerts<D, glm::i8vec4>;
+    case vk::Format::eR8G8B8A8Snorm:
+        return UnpackVerts<D, glm::uint, glm::unpackSnorm4x8>;
+    case vk::Format::eR8G8B8A8Uint:
+        return LoadVerts<D, glm::u8vec4>;
+    case vk::Format::eR8G8B8A8Unorm:
+    case vk::Format::eB8G8R8A8Unorm: // TODO: swizzle
+        return UnpackVerts<D, glm::uint, glm::unpackUnorm4x8>;
+    case vk::Format::eR16G16Sfloat:
+        return UnpackVerts<D, glm::uint, glm::unpackHalf2x16>;
+    case vk::Format::eR16G16Sint:
+        return LoadVerts<D, glm::i16vec2>;
+    case vk::Format::eR16G16Snorm:
+        return UnpackVerts<D, glm::uint, glm::unpackSnorm2x16>;
+    case vk::Format::eR16G16Uint:
+        return LoadVerts<D, glm::u16vec2>;
+    case vk::Format::eR16G16Unorm:
+        return UnpackVerts<D, glm::uint, glm::unpackUnorm2x16>;
+    case vk::Format::eR32Sfloat:
+        return LoadVerts<D, glm::vec1>;
+    case vk::Format::eR32Sint:
+        return LoadVerts<D, glm::ivec1>;
+    case vk::Format::eR32Uint:
+        return LoadVerts<D, glm::uvec1>;
+    case vk::Format::eR8G8Sint:
+        return LoadVerts<D, glm::i8vec2>;
+    case vk::Format::eR8G8Snorm:
+        return UnpackVerts<D, glm::uint16, glm::unpackSnorm2x8>;
+    case vk::Format::eR8G8Uint:
+        return LoadVerts<D, glm::u8vec2>;
+    case vk::Format::eR8G8Unorm:
+        return UnpackVerts<D, glm::uint16, glm::unpackUnorm2x8>;
+    case vk::Format::eR16Sfloat:
+        return UnpackVerts<D, glm::uint16, glm::unpackHalf1x16>;
+    case vk::Format::eR16Sint:
+        return LoadVerts<D, glm::i16vec1>;
+    case vk::Format::eR16Snorm:
+        return UnpackVerts<D, glm::uint16, glm::unpackSnorm1x16>;
+    case vk::Format::eR16Uint:
+        return LoadVerts<D, glm::u16vec1>;
+    case vk::Format::eR16Unorm:
+        return UnpackVerts<D, glm::uint16, glm::unpackUnorm1x16>;
+    case vk::Format::eR8Sint:
+        return LoadVerts<D, glm::i8vec1>;
+    case vk::Format::eR8Snorm:
+        return UnpackVerts<D, glm::uint8, glm::unpackSnorm1x8>;
+    case vk::Format::eR8Uint:
+        return LoadVerts<D, glm::u8vec1>;
+    case vk::Format::eR8Unorm:
+        return UnpackVerts<D, glm::uint8, glm::unpackUnorm1x8>;
+    case vk::Format::eB5G6R5UnormPack16:
+        return UnpackVerts<D, glm::uint16, glm::unpackUnorm1x5_1x6_1x5>;
+    case vk::Format::eB5G5R5A1UnormPack16:
+        return UnpackVerts<D, glm::uint16, glm::unpackUnorm3x5_1x1>;
+    case vk::Format::eA4B4G4R4UnormPack16:
+        return UnpackVerts<D, glm::uint16, glm::unpackUnorm4x4>;
+    default:
+        return nullptr;
+    }
+}
+} // namespace
+
 class VBReader::Impl
 {
 public:
-    Impl() noexcept : mStrides{}, mBuffers{}, mVerts{}, mDefaultStrides{}, mTempSize(0) {}
+    Impl() noexcept : mAttributes{}, mStrides{}, mBuffers{}, mVerts{}, mDefaultStrides{} {}
 
     bool Initialize(const std::vector<vk::VertexInputAttributeDescription> &desc);
     bool AddStream(void *vb, size_t nVerts, size_t binding, size_t stride);
-    bool Read(glm::vec4 *buffer, uint32_t location, size_t count) const;
+    template <class D> bool Read(D *buffer, uint32_t location, size_t count) const;
 
     void Release() noexcept
     {
-        mInputDesc.clear();
-        mLocations.clear();
+        memset(mAttributes, 0, sizeof(mAttributes));
         memset(mStrides, 0, sizeof(mStrides));
         memset(mBuffers, 0, sizeof(mBuffers));
         memset(mVerts, 0, sizeof(mVerts));
         memset(mDefaultStrides, 0, sizeof(mDefaultStrides));
-        mTempBuffer.reset();
-    }
-
-    glm::vec4 *GetTemporaryBuffer(size_t count) const noexcept
-    {
-        // alloc enough space for temp buffer
-        if (!mTempBuffer || mTempSize < count)
-        {
-            mTempSize = count;
-
-            for (size_t j = 0; j < c_MaxBinding; ++j)
-            {
-                if (mVerts[j] > mTempSize)
-                    mTempSize = mVerts[j];
-            }
-
-            auto temp = std::make_unique<glm::vec4[]>(mTempSize);
-            if (!temp)
-            {
-                mTempSize = 0;
-            }
-            mTempBuffer.swap(temp);
-        }
-        return mTempBuffer.get();
     }
 
 private:
-    // location versus index
-    using LocationMap = std::map<uint32_t, uint32_t>;
-
-    std::vector<vk::VertexInputAttributeDescription> mInputDesc;
-    LocationMap mLocations;
+    // Looked up by location, the kernels for each destination type are picked once from the format
+    struct Attribute
+    {
+        uint32_t binding;
+        uint32_t offset;
+        uint32_t size; // 0 when the location isn't in the layout
+        ReadFn<float> readFloat;
+        ReadFn<glm::vec2> readVec2;
+        ReadFn<glm::vec3> readVec3;
+        ReadFn<glm::vec4> readVec4;
+
+        ReadFn<float> Kernel(const float *) const { return readFloat; }
+        ReadFn<glm::vec2> Kernel(const glm::vec2 *) const { return readVec2; }
+        ReadFn<glm::vec3> Kernel(const glm::vec3 *) const { return readVec3; }
+        ReadFn<glm::vec4> Kernel(const glm::vec4 *) const { return readVec4; }
+    };
+
+    Attribute mAttributes[c_MaxLocation];
     uint32_t mStrides[c_MaxBinding];
     const void *mBuffers[c_MaxBinding];
     size_t mVerts[c_MaxBinding];
     uint32_t mDefaultStrides[c_MaxBinding];
-    mutable size_t mTempSize;
-    mutable std::unique_ptr<glm::vec4[]> mTempBuffer;
 };
 
 bool VBReader::Impl::Initialize(const std::vector<vk::VertexInputAttributeDescription> &desc)
 {
     Release();
-    uint32_t offsets[c_MaxBinding] = {};
+    uint32_t offsets[c_MaxLocation] = {};
 
-    // TODO: Check for desc valid
+    for (size_t i = 0; i < desc.size(); ++i)
+    {
+        if (i >= c_MaxLocation || desc[i].location >= c_MaxLocation || desc[i].binding >= c_MaxBinding)
+            return false;
+    }
 
     ComputeInputLayout(desc, offsets, mDefaultStrides);
 
@@ -77,9 +210,16 @@ bool VBReader::Impl::Initialize(const std::vector<vk::VertexInputAttributeDescri
     {
         // TODO: Instance data not supported yet in DXMesh
 
-        mInputDesc.push_back(desc[i]);
-        mInputDesc[i].offset = offsets[i];
-        mLocations[desc[i].location] = i;
+        Attribute &attrib = mAttributes[desc[i].location];
+        attrib.binding = desc[i].binding;
+        attrib.offset = offsets[i];
+        attrib.size = vk::blockSize(desc[i].format);
+        attrib.readFloat = SelectReader<float>(desc[i].format);
+        attrib.readVec2 = SelectReader<glm::vec2>(desc[i].format);
+        attrib.readVec3 = SelectReader<glm::vec3>(desc[i].format);
+        attrib.readVec4 = SelectReader<glm::vec4>(desc[i].format);
+        if (!attrib.readVec4)
+            Utility::Printf("Reader Format unsupport: %d\n", desc[i].format);
     }
 
     return true;
@@ -103,184 +243,47 @@ bool VBReader::Impl::AddStream(void *vb, size_t nVerts, size_t binding, size_t s
     return true;
 }
 
-//-------------------------------------------------------------------------------------
-#define STORE_VERTS(type)                                                                                              \
-    for (size_t icount = 0; icount < count; ++icount)                                                                  \
-    {                                                                                                                  \
-        if ((ptr + sizeof(type)) > eptr)                                                                               \
-            return false;                                                                                              \
-        glm::vec4 res(0.0);                                                                                            \
-        type &data = *(type *)ptr;                                                                                     \
-        for (size_t i = 0; i < data.length(); ++i)                                                                     \
-        {                                                                                                              \
-            res[i] = data[i];                                                                                          \
-        }                                                                                                              \
-        *buffer++ = res;                                                                                               \
-        ptr += stride;                                                                                                 \
-    }                                                                                                                  \
-    break;
-
-#define STORE_PACK(type, func)                                                                                         \
-    for (size_t icount = 0; icount < count; ++icount)                                                                  \
-    {                                                                                                                  \
-        if ((ptr + sizeof(type)) > eptr)                                                                               \
-            return false;                                                                                              \
-        glm::vec4 res(0.0);                                                                                            \
-        auto data = func(*(type *)ptr);                                                                                \
-        for (size_t i = 0; i < data.length(); ++i)                                                                     \
-        {                                                                                                              \
-            res[i] = data[i];                                                                                          \
-        }                                                                                                              \
-        *buffer++ = res;                                                                                               \
-        ptr += stride;                                                                                                 \
-    }                                                                                                                  \
-    break;
-
-#define LOAD_UNPACKF(type, func)                                                                                       \
-    for (size_t icount = 0; icount < count; ++icount)                                                                  \
-    {                                                                                                                  \
-        if ((ptr + sizeof(type)) > eptr)                                                                               \
-            return false;                                                                                              \
-        float data = func(*(type *)ptr);                                                                               \
-        *buffer++ = glm::vec4(data, 0.0, 0.0, 0.0);                                                                    \
-        ptr += stride;                                                                                                 \
-    }                                                                                                                  \
-    break;
-
-bool VBReader::Impl::Read(glm::vec4 *buffer, uint32_t location, size_t count) const
+template <class D> bool VBReader::Impl::Read(D *buffer, uint32_t location, size_t count) const
 {
     if (!buffer || count == 0)
         return false;
 
-    auto iter = mLocations.find(location);
-    if (iter == mLocations.end())
+    if (location >= c_MaxLocation || mAttributes[location].size == 0)
+    {
+        return false;
+    }
+    const Attribute &attrib = mAttributes[location];
+    assert(attrib.binding == location);
+    const ReadFn<D> kernel = attrib.Kernel(buffer);
+    if (!kernel)
     {
         return false;
     }
-    assert(mInputDesc[iter->second].binding == location);
-
-    const uint32_t binding = mInputDesc[iter->second].binding;
 
-    auto vb = (uint8_t *)mBuffers[binding];
+    auto vb = (const uint8_t *)mBuffers[attrib.binding];
     if (!vb)
     {
         return false;
     }
-    if (count > mVerts[binding])
+    if (count > mVerts[attrib.binding])
     {
         return false;
     }
-    const uint32_t stride = mStrides[binding];
+    const uint32_t stride = mStrides[attrib.binding];
     if (stride == 0)
     {
         return false;
     }
 
-    const uint8_t *eptr = vb + stride * mVerts[binding];
-    const uint8_t *ptr = vb + mInputDesc[iter->second].offset; // offset should be 0 here
+    // Read as many elements as end inside the buffer, the kernel doesn't check
+    const size_t end = stride * mVerts[attrib.binding];
+    size_t fits = 0;
+    if (attrib.offset + attrib.size <= end)
+        fits = std::min(count, (end - attrib.offset - attrib.size) / stride + 1);
 
-    // copy data from ptr(mBuffers) to buffer until exceeds eptr
-    switch (mInputDesc[iter->second].format)
-    {
-    case vk::Format::eR32G32B32A32Sfloat:
-        STORE_VERTS(glm::vec4)
-    case vk::Format::eR32G32B32A32Sint:
-        STORE_VERTS(glm::ivec4)
-    case vk::Format::eR32G32B32A32Uint:
-        STORE_VERTS(glm::uvec4)
-    case vk::Format::eR32G32B32Sfloat:
-        STORE_VERTS(glm::vec3)
-    case vk::Format::eR32G32B32Sint:
-        STORE_VERTS(glm::ivec3)
-    case vk::Format::eR32G32B32Uint:
-        STORE_VERTS(glm::uvec3)
-    case vk::Format::eR16G16B16A16Sfloat:
-        STORE_PACK(glm::uint64, glm::unpackHalf4x16)
-    case vk::Format::eR16G16B16A16Sint:
-        STORE_VERTS(glm::i16vec4)
-    case vk::Format::eR16G16B16A16Snorm:
-        STORE_PACK(glm::uint64, glm::unpackSnorm4x16)
-    case vk::Format::eR16G16B16A16Uint:
-        STORE_VERTS(glm::u16vec4)
-    case vk::Format::eR16G16B16A16Unorm:
-        STORE_PACK(glm::uint64, glm::unpackUnorm4x16)
-    case vk::Format::eR32G32Sfloat:
-        STORE_VERTS(glm::vec2)
-    case vk::Format::eR32G32Sint:
-        STORE_VERTS(glm::ivec2)
-    case vk::Format::eR32G32Uint:
-        STORE_VERTS(glm::uvec2)
-    case vk::Format::eA2B10G10R10UintPack32:
-        STORE_PACK(glm::uint32, glm::unpackU3x10_1x2)
-    case vk::Format::eA2B10G10R10UnormPack32:
-        STORE_PACK(glm::uint32, glm::unpackUnorm3x10_1x2)
-    case vk::Format::eA2B10G10R10SnormPack32:
-        STORE_PACK(glm::uint32, glm::unpackSnorm3x10_1x2)
-    case vk::Format::eB10G11R11UfloatPack32:
-        STORE_PACK(glm::uint32, glm::unpackF2x11_1x10)
-    case vk::Format::eR8G8B8A8Sint:
-        STORE_VERTS(glm::i8vec4)
-    case vk::Format::eR8G8B8A8Snorm:
-        STORE_PACK(glm::uint, glm::unpackSnorm4x8)
-    case vk::Format::eR8G8B8A8Uint:
-        STORE_VERTS(glm::u8vec4)
-    case vk::Format::eR8G8B8A8Unorm:
-    case vk::Format::eB8G8R8A8Unorm: // TODO: swizzle
-        STORE_PACK(glm::uint, glm::unpackUnorm4x8)
-    case vk::Format::eR16G16Sfloat:
-        STORE_PACK(glm::uint, glm::unpackHalf2x16)
-    case vk::Format::eR16G16Sint:
-        STORE_VERTS(glm::i16vec2)
-    case vk::Format::eR16G16Snorm:
-        STORE_PACK(glm::uint, glm::unpackSnorm2x16)
-    case vk::Format::eR16G16Uint:
-        STORE_VERTS(glm::u16vec2)
-    case vk::Format::eR16G16Unorm:
-        STORE_PACK(glm::uint, glm::unpackUnorm2x16)
-    case vk::Format::eR32Sfloat:
-        STORE_VERTS(glm::vec1)
-    case vk::Format::eR32Sint:
-        STORE_VERTS(glm::ivec1)
-    case vk::Format::eR32Uint:
-        STORE_VERTS(glm::uvec1)
-    case vk::Format::eR8G8Sint:
-        STORE_VERTS(glm::i8vec2)
-    case vk::Format::eR8G8Snorm:
-        STORE_PACK(glm::uint16, glm::unpackSnorm2x8)
-    case vk::Format::eR8G8Uint:
-        STORE_VERTS(glm::u8vec2)
-    case vk::Format::eR8G8Unorm:
-        STORE_PACK(glm::uint16, glm::unpackUnorm2x8)
-    case vk::Format::eR16Sfloat:
-        LOAD_UNPACKF(glm::uint16, glm::unpackHalf1x16)
-    case vk::Format::eR16Sint:
-        STORE_VERTS(glm::i16vec1)
-    case vk::Format::eR16Snorm:
-        LOAD_UNPACKF(glm::uint16, glm::unpackSnorm1x16)
-    case vk::Format::eR16Uint:
-        STORE_VERTS(glm::u16vec1)
-    case vk::Format::eR16Unorm:
-        LOAD_UNPACKF(glm::uint16, glm::unpackUnorm1x16)
-    case vk::Format::eR8Sint:
-        STORE_VERTS(glm::i8vec1)
-    case vk::Format::eR8Snorm:
-        LOAD_UNPACKF(glm::uint8, glm::unpackSnorm1x8)
-    case vk::Format::eR8Uint:
-        STORE_VERTS(glm::u8vec1)
-    case vk::Format::eR8Unorm:
-        LOAD_UNPACKF(glm::uint8, glm::unpackUnorm1x8)
-    case vk::Format::eB5G6R5UnormPack16:
-        STORE_PACK(glm::uint16, glm::unpackUnorm1x5_1x6_1x5)
-    case vk::Format::eB5G5R5A1UnormPack16:
-        STORE_PACK(glm::uint16, glm::unpackUnorm3x5_1x1)
-    case vk::Format::eA4B4G4R4UnormPack16:
-        STORE_PACK(glm::uint16, glm::unpackUnorm4x4)
-    default:
-        Utility::Printf("Reader Format unsupport: %d\n", mInputDesc[iter->second].format);
-        return false;
-    }
+    kernel(vb + attrib.offset, stride, buffer, fits); // offset should be 0 here
 
-    return true;
+    return fits == count;
 }
 
 VBReader::VBReader() noexcept(false) : pImpl(std::make_unique<Impl>()) {}
@@ -301,68 +304,17 @@ bool VBReader::AddStream(void *vb, size_t nVerts, size_t binding, size_t stride)
 
 bool VBReader::Read(float *buffer, uint32_t location, size_t count) const
 {
-    auto temp = pImpl->GetTemporaryBuffer(count);
-    if (!temp)
-    {
-        return false;
-    }
-    bool hr = pImpl->Read(temp, location, count);
-    if (!hr)
-    {
-        return false;
-    }
-    float *dptr = buffer;
-    for (size_t i = 0; i < count; ++i)
-    {
-        const glm::vec4 v = *temp++;
-        *dptr++ = v.x;
-    }
-
-    return true;
+    return pImpl->Read(buffer, location, count);
 }
 
 bool VBReader::Read(glm::vec2 *buffer, uint32_t location, size_t count) const
 {
-    auto temp = pImpl->GetTemporaryBuffer(count);
-    if (!temp)
-    {
-        return false;
-    }
-    bool hr = pImpl->Read(temp, location, count);
-    if (!hr)
-    {
-        return false;
-    }
-    glm::vec2 *dptr = buffer;
-    for (size_t i = 0; i < count; ++i)
-    {
-        const glm::vec4 v = *temp++;
-        *dptr++ = v;
-    }
-
-    return true;
+    return pImpl->Read(buffer, location, count);
 }
 
 bool VBReader::Read(glm::vec3 *buffer, uint32_t location, size_t count) const
 {
-    auto temp = pImpl->GetTemporaryBuffer(count);
-    if (!temp)
-    {
-        return false;
-    }
-    bool hr = pImpl->Read(temp, location, count);
-    if (!hr)
-    {
-        return false;
-    }
-    glm::vec3 *dptr = buffer;
-    for (size_t i = 0; i < count; ++i)
-    {
-        const glm::vec4 v = *temp++;
-        *dptr++ = v;
-    }
-
-    return true;
+    return pImpl->Read(buffer, location, count);
 }
 
 bool VBReader::Read(glm::vec4 *buffer, uint32_t location, size_t count) const
@@ -370,4 +322,4 @@ bool VBReader::Read(glm::vec4 *buffer, uint32_t location, size_t count) const
     return pImpl->Read(buffer, location, count);
 }
 
-void VBReader::Release() noexcept { pImpl->Release(); }
\ No newline at end of file
+void VBReader::Release() noexcept { pImpl->Release(); }
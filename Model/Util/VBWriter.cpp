@@ -1,277 +1,417 @@
-#include "VulkanMesh.h"
+#include "VulkanMeshP.h"
 
 #include <Utility.h>
+#include <algorithm>
 #include <glm/gtc/packing.hpp>
-#include <map>
+#include <type_traits>
+#include <vulkan/vulkan_format_traits.hpp>
 
 constexpr size_t c_MaxBinding = 32;
+constexpr size_t c_MaxLocation = 32;
 constexpr size_t c_MaxStride = 2048;
 
-class VBWriter::Impl
+namespace
 {
-public:
-    Impl() noexcept : mStrides{}, mBuffers{}, mVerts{}, mDefaultStrides{}, mTempSize(0) {}
-
-    bool Initialize(const std::vector<vk::VertexInputAttributeDescription> &desc);
-    bool AddStream(void *vb, size_t nVerts, size_t binding, size_t stride);
-    bool Write(glm::vec4 *buffer, uint32_t location, size_t count) const;
+// Converts count elements from the caller's array to the vertex buffer, selected for a format and source type
+template <class S> using WriteFn = void (*)(const S *src, uint8_t *ptr, size_t stride, size_t count);
 
-    void Release() noexcept
+template <class V> inline glm::vec4 ToVec4(const V &v)
+{
+    glm::vec4 res(0.0f);
+    for (size_t i = 0; i < v.length(); ++i)
     {
-        mInputDesc.clear();
-        mLocations.clear();
-        memset(mStrides, 0, sizeof(mStrides));
-        memset(mBuffers, 0, sizeof(mBuffers));
-        memset(mVerts, 0, sizeof(mVerts));
-        memset(mDefaultStrides, 0, sizeof(mDefaultStrides));
-        mTempBuffer.reset();
+        res[i] = v[i];
     }
+    return res;
+}
 
-    glm::vec4 *GetTemporaryBuffer(size_t count) const noexcept
-    {
-        // alloc enough space for temp buffer
-        if (!mTempBuffer || mTempSize < count)
-        {
-            mTempSize = count;
-
-            for (size_t j = 0; j < c_MaxBinding; ++j)
-            {
-                if (mVerts[j] > mTempSize)
-                    mTempSize = mVerts[j];
-            }
-
-            auto temp = std::make_unique<glm::vec4[]>(mTempSize);
-            if (!temp)
-            {
-                mTempSize = 0;
-            }
-            mTempBuffer.swap(temp);
-        }
-        return mTempBuffer.get();
-    }
+inline glm::vec4 ToVec4(float v) { return glm::vec4(v, 0.0f, 0.0f, 0.0f); }
 
-private:
-    // location versus index
-    using LocationMap = std::map<uint32_t, uint32_t>;
+inline glm::vec4 ToVec4(const glm::vec4 &v) { return v; }
 
-    std::vector<vk::VertexInputAttributeDescription> mInputDesc;
-    LocationMap mLocations;
-    uint32_t mStrides[c_MaxBinding];
-    const void *mBuffers[c_MaxBinding];
-    size_t mVerts[c_MaxBinding];
-    uint32_t mDefaultStrides[c_MaxBinding];
-    mutable size_t mTempSize;
-    mutable std::unique_ptr<glm::vec4[]> mTempBuffer;
-};
+template <class S, class T> void StoreVerts(const S *src, uint8_t *ptr, size_t stride, size_t count)
+{
+    for (size_t i = 0; i < count; ++i, ptr += stride)
+        *(T *)ptr = T(ToVec4(src[i]));
+}
 
-bool VBWriter::Impl::Initialize(const std::vector<vk::VertexInputAttributeDescription> &desc)
+template <class S, class T, auto Pack> void PackVerts(const S *src, uint8_t *ptr, size_t stride, size_t count)
 {
-    Release();
-    uint32_t offsets[c_MaxBinding] = {};
+    for (size_t i = 0; i < count; ++i, ptr += stride)
+        *(T *)ptr = Pack(ToVec4(src[i]));
+}
 
-    // TODO: Check for desc valid
+template <class S, class T, auto Pack> void PackScalars(const S *src, uint8_t *ptr, size_t stride, size_t count)
+{
+    for (size_t i = 0; i < count; ++i, ptr += stride)
+        *(T *)ptr = Pack(ToVec4(src[i]).x);
+}
 
-    ComputeInputLayout(desc, offsets, mDefaultStrides);
+#if VULKANMESH_SSE2
+inline __m128 LoadLanes(float v) { return _mm_set_ss(v); }
 
-    for (size_t i = 0; i < desc.size(); ++i)
-    {
-        // TODO: Instance data not supported yet in DXMesh
+inline __m128 LoadLanes(const glm::vec2 &v) { return _mm_castpd_ps(_mm_load_sd((const double *)&v)); }
 
-        mInputDesc.push_back(desc[i]);
-        mInputDesc[i].offset = offsets[i];
-        mLocations[desc[i].location] = i;
-    }
+inline __m128 LoadLanes(const glm::vec3 &v) { return _mm_setr_ps(v.x, v.y, v.z, 0.0f); }
 
-    return true;
+inline __m128 LoadLanes(const glm::vec4 &v) { return _mm_loadu_ps(&v.x); }
+
+// Rounds half away from zero like glm::round, which _mm_cvtps_epi32 doesn't
+inline __m128i RoundLanes(__m128 v)
+{
+    const __m128i t = _mm_cvttps_epi32(v);
+    const __m128 frac = _mm_sub_ps(v, _mm_cvtepi32_ps(t));
+    const __m128i up = _mm_castps_si128(_mm_cmpge_ps(frac, _mm_set1_ps(0.5f)));
+    const __m128i down = _mm_castps_si128(_mm_cmple_ps(frac, _mm_set1_ps(-0.5f)));
+    return _mm_add_epi32(_mm_sub_epi32(t, up), down);
 }
 
-bool VBWriter::Impl::AddStream(void *vb, size_t nVerts, size_t binding, size_t stride)
+// Bit for bit what glm::packHalf1x16 gives: the dropped mantissa bits round half up, small values go denormal,
+// overflow goes to infinity and NaNs keep the top of their payload.
+inline __m128i HalfLanes(__m128 v)
 {
-    if (!vb || nVerts == 0)
-        return false;
-    if (nVerts >= UINT32_MAX)
-        return false;
-    if (binding >= c_MaxBinding)
-        return false;
-    if (stride >= c_MaxStride)
-        return false;
+    const __m128i bits = _mm_castps_si128(v);
+    const __m128i sign = _mm_and_si128(_mm_srli_epi32(bits, 16), _mm_set1_epi32(0x8000));
+    const __m128i abs = _mm_and_si128(bits, _mm_set1_epi32(0x7fffffff));
+
+    const __m128i rebias = _mm_set1_epi32(112 << 10);
+    const __m128i normal = _mm_sub_epi32(_mm_srli_epi32(_mm_add_epi32(abs, _mm_set1_epi32(0x1000)), 13), rebias);
+    const __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(abs), _mm_set1_ps(16777216.0f));
+    const __m128i denormal = RoundLanes(scaled);
+    const __m128i isDenormal = _mm_cmplt_epi32(abs, _mm_set1_epi32(0x38800000));
+    __m128i half = _mm_or_si128(_mm_and_si128(isDenormal, denormal), _mm_andnot_si128(isDenormal, normal));
+
+    __m128i payload = _mm_and_si128(_mm_srli_epi32(abs, 13), _mm_set1_epi32(0x3ff));
+    payload = _mm_or_si128(payload, _mm_and_si128(_mm_cmpeq_epi32(payload, _mm_setzero_si128()), _mm_set1_epi32(1)));
+    const __m128i isNaN = _mm_cmpgt_epi32(abs, _mm_set1_epi32(0x7f800000));
+    const __m128i isInf = _mm_cmpgt_epi32(abs, _mm_set1_epi32(0x477fefff));
+    const __m128i inf = _mm_or_si128(_mm_set1_epi32(0x7c00), _mm_and_si128(isNaN, payload));
+    half = _mm_or_si128(_mm_and_si128(isInf, inf), _mm_andnot_si128(isInf, half));
+
+    return _mm_or_si128(half, sign);
+}
 
-    mStrides[binding] = (stride > 0) ? stride : mDefaultStrides[binding];
-    mBuffers[binding] = vb;
-    mVerts[binding] = nVerts;
+inline __m128i Unorm16Lanes(__m128 v)
+{
+    v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    return RoundLanes(_mm_mul_ps(v, _mm_set1_ps(65535.0f)));
+}
 
-    return true;
+// Keeps the low 16 bits of every lane, a in the low half of the result
+inline __m128i NarrowLanes(__m128i a, __m128i b)
+{
+    return _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16), _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
 }
 
-//-------------------------------------------------------------------------------------
-#define STORE_VERTS(type)                                                                                              \
-    for (size_t icount = 0; icount < count; ++icount)                                                                  \
-    {                                                                                                                  \
-        if ((ptr + sizeof(type)) > eptr)                                                                               \
-            return false;                                                                                              \
-        *(type *)ptr = *buffer++;                                                                                      \
-        ptr += stride;                                                                                                 \
-    }                                                                                                                  \
-    break;
-
-#define STORE_PACK(type, func)                                                                                         \
-    for (size_t icount = 0; icount < count; ++icount)                                                                  \
-    {                                                                                                                  \
-        if ((ptr + sizeof(type)) > eptr)                                                                               \
-            return false;                                                                                              \
-        type data = func(*buffer++);                                                                                   \
-        *(type *)ptr = data;                                                                                           \
-        ptr += stride;                                                                                                 \
-    }                                                                                                                  \
-    break;
-
-#define LOAD_UNPACKF(type, func)                                                                                       \
-    for (size_t icount = 0; icount < count; ++icount)                                                                  \
-    {                                                                                                                  \
-        if ((ptr + sizeof(type)) > eptr)                                                                               \
-            return false;                                                                                              \
-        glm::vec4 v = *buffer++;                                                                                       \
-        type data = func(v.x);                                                                                         \
-        *(type *)ptr = data;                                                                                           \
-        ptr += stride;                                                                                                 \
-    }                                                                                                                  \
-    break;
-
-bool VBWriter::Impl::Write(glm::vec4 *buffer, uint32_t location, size_t count) const
+// N 16-bit components per vertex, two vertices per iteration
+template <class S, size_t N, __m128i (*Lanes)(__m128), auto Pack>
+void Pack16(const S *src, uint8_t *ptr, size_t stride, size_t count)
 {
-    if (!buffer || count == 0)
-        return false;
+    static_assert(N == 2 || N == 4, "Two or four components");
+    using T = std::conditional_t<N == 4, glm::uint64, glm::uint32>;
 
-    auto iter = mLocations.find(location);
-    if (iter == mLocations.end())
+    size_t i = 0;
+    for (; i + 1 < count; i += 2, ptr += 2 * stride)
     {
-        return false;
+        if constexpr (N == 4)
+        {
+            const __m128i packed = NarrowLanes(Lanes(LoadLanes(src[i])), Lanes(LoadLanes(src[i + 1])));
+            _mm_storel_epi64((__m128i *)ptr, packed);
+            _mm_storel_epi64((__m128i *)(ptr + stride), _mm_unpackhi_epi64(packed, packed));
+        }
+        else
+        {
+            const __m128i lanes = Lanes(_mm_movelh_ps(LoadLanes(src[i]), LoadLanes(src[i + 1])));
+            const __m128i packed = NarrowLanes(lanes, lanes);
+            *(uint32_t *)ptr = (uint32_t)_mm_cvtsi128_si32(packed);
+            *(uint32_t *)(ptr + stride) = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(packed, 4));
+        }
     }
+    if (i < count)
+        *(T *)ptr = Pack(ToVec4(src[i]));
+}
 
-    const uint32_t binding = mInputDesc[iter->second].binding;
+// Four vertices per iteration, transposed so every lane is one vertex
+template <class S> void PackSnorm10(const S *src, uint8_t *ptr, size_t stride, size_t count)
+{
+    const __m128 one = _mm_set1_ps(1.0f), minusOne = _mm_set1_ps(-1.0f), scale = _mm_set1_ps(511.0f);
+    const __m128i mask = _mm_set1_epi32(0x3ff);
 
-    auto vb = (uint8_t *)mBuffers[binding];
-    if (!vb)
-    {
-        return false;
-    }
-    if (count > mVerts[binding])
-    {
-        return false;
-    }
-    const uint32_t stride = mStrides[binding];
-    if (stride == 0)
+    size_t i = 0;
+    for (; i + 3 < count; i += 4)
     {
-        return false;
+        __m128 x = LoadLanes(src[i]), y = LoadLanes(src[i + 1]), z = LoadLanes(src[i + 2]), w = LoadLanes(src[i + 3]);
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+        x = _mm_mul_ps(_mm_min_ps(_mm_max_ps(x, minusOne), one), scale);
+        y = _mm_mul_ps(_mm_min_ps(_mm_max_ps(y, minusOne), one), scale);
+        z = _mm_mul_ps(_mm_min_ps(_mm_max_ps(z, minusOne), one), scale);
+        w = _mm_min_ps(_mm_max_ps(w, minusOne), one);
+
+        __m128i packed = _mm_and_si128(RoundLanes(x), mask);
+        packed = _mm_or_si128(packed, _mm_slli_epi32(_mm_and_si128(RoundLanes(y), mask), 10));
+        packed = _mm_or_si128(packed, _mm_slli_epi32(_mm_and_si128(RoundLanes(z), mask), 20));
+        packed = _mm_or_si128(packed, _mm_slli_epi32(RoundLanes(w), 30));
+
+        alignas(16) uint32_t out[4];
+        _mm_store_si128((__m128i *)out, packed);
+        for (size_t j = 0; j < 4; ++j, ptr += stride)
+            *(uint32_t *)ptr = out[j];
     }
+    for (; i < count; ++i, ptr += stride)
+        *(glm::uint32 *)ptr = glm::packSnorm3x10_1x2(ToVec4(src[i]));
+}
 
-    const uint8_t *eptr = vb + stride * mVerts[binding];
-    const uint8_t *ptr = vb + mInputDesc[iter->second].offset; // offset should be 0
-
-    // copy data from ptr(mBuffers) to buffer until exceeds eptr
-    switch (mInputDesc[iter->second].format)
+template <class S> constexpr WriteFn<S> c_PackHalf2 = Pack16<S, 2, HalfLanes, glm::packHalf2x16>;
+template <class S> constexpr WriteFn<S> c_PackHalf4 = Pack16<S, 4, HalfLanes, glm::packHalf4x16>;
+template <class S> constexpr WriteFn<S> c_PackUnorm2x16 = Pack16<S, 2, Unorm16Lanes, glm::packUnorm2x16>;
+template <class S> constexpr WriteFn<S> c_PackUnorm4x16 = Pack16<S, 4, Unorm16Lanes, glm::packUnorm4x16>;
+template <class S> constexpr WriteFn<S> c_PackSnorm3x10 = PackSnorm10<S>;
+#else
+template <class S> constexpr WriteFn<S> c_PackHalf2 = PackVerts<S, glm::uint, glm::packHalf2x16>;
+template <class S> constexpr WriteFn<S> c_PackHalf4 = PackVerts<S, glm::uint64, glm::packHalf4x16>;
+template <class S> constexpr WriteFn<S> c_PackUnorm2x16 = PackVerts<S, glm::uint, glm::packUnorm2x16>;
+template <class S> constexpr WriteFn<S> c_PackUnorm4x16 = PackVerts<S, glm::uint64, glm::packUnorm4x16>;
+template <class S> constexpr WriteFn<S> c_PackSnorm3x10 = PackVerts<S, glm::uint32, glm::packSnorm3x10_1x2>;
+#endif
+
+template <class S> WriteFn<S> SelectWriter(vk::Format format)
+{
+    switch (format)
     {
     case vk::Format::eR32G32B32A32Sfloat:
-        STORE_VERTS(glm::vec4)
+        return StoreVerts<S, glm::vec4>;
     case vk::Format::eR32G32B32A32Sint:
-        STORE_VERTS(glm::ivec4)
+        return StoreVerts<S, glm::ivec4>;
     case vk::Format::eR32G32B32A32Uint:
-        STORE_VERTS(glm::uvec4)
+        return StoreVerts<S, glm::uvec4>;
     case vk::Format::eR32G32B32Sfloat:
-        STORE_VERTS(glm::vec3)
+        return StoreVerts<S, glm::vec3>;
     case vk::Format::eR32G32B32Sint:
-        STORE_VERTS(glm::ivec3)
+        return StoreVerts<S, glm::ivec3>;
     case vk::Format::eR32G32B32Uint:
-        STORE_VERTS(glm::uvec3)
+        return StoreVerts<S, glm::uvec3>;
     case vk::Format::eR16G16B16A16Sfloat:
-        STORE_PACK(glm::uint64, glm::packHalf4x16)
+        return c_PackHalf4<S>;
     case vk::Format::eR16G16B16A16Sint:
-        STORE_VERTS(glm::i16vec4)
+        return StoreVerts<S, glm::i16vec4>;
     case vk::Format::eR16G16B16A16Snorm:
-        STORE_PACK(glm::uint64, glm::packSnorm4x16)
+        return PackVerts<S, glm::uint64, glm::packSnorm4x16>;
     case vk::Format::eR16G16B16A16Uint:
-        STORE_VERTS(glm::u16vec4)
+        return StoreVerts<S, glm::u16vec4>;
     case vk::Format::eR16G16B16A16Unorm:
-        STORE_PACK(glm::uint64, glm::packUnorm4x16)
+        return c_PackUnorm4x16<S>;
     case vk::Format::eR32G32Sfloat:
-        STORE_VERTS(glm::vec2)
+        return StoreVerts<S, glm::vec2>;
     case vk::Format::eR32G32Sint:
-        STORE_VERTS(glm::ivec2)
+        return StoreVerts<S, glm::ivec2>;
     case vk::Format::eR32G32Uint:
-        STORE_VERTS(glm::uvec2)
+        return StoreVerts<S, glm::uvec2>;
     case vk::Format::eA2B10G10R10UintPack32:
-        STORE_PACK(glm::uint32, glm::packU3x10_1x2)
+        return PackVerts<S, glm::uint32, glm::packU3x10_1x2>;
     case vk::Format::eA2B10G10R10UnormPack32:
-        STORE_PACK(glm::uint32, glm::packUnorm3x10_1x2)
+        return PackVerts<S, glm::uint32, glm::packUnorm3x10_1x2>;
     case vk::Format::eA2B10G10R10SnormPack32:
-        STORE_PACK(glm::uint32, glm::packSnorm3x10_1x2)
+        return c_PackSnorm3x10<S>;
     case vk::Format::eB10G11R11UfloatPack32:
-        STORE_PACK(glm::uint32, glm::packF2x11_1x10)
+        return PackVerts<S, glm::uint32, glm::packF2x11_1x10>;
     case vk::Format::eR8G8B8A8Sint:
-        STORE_VERTS(glm::i8vec4)
+        return StoreVerts<S, glm::i8vec4>;
     case vk::Format::eR8G8B8A8Snorm:
-        STORE_PACK(glm::uint, glm::packSnorm4x8)
+        return PackVerts<S, glm::uint, glm::packSnorm4x8>;
     case vk::Format::eR8G8B8A8Uint:
-        STORE_VERTS(glm::u8vec4)
+        return StoreVerts<S, glm::u8vec4>;
     case vk::Format::eR8G8B8A8Unorm:
     case vk::Format::eB8G8R8A8Unorm: // TODO: swizzle
-        STORE_PACK(glm::uint, glm::packUnorm4x8)
+        return PackVerts<S, glm::uint, glm::packUnorm4x8>;
     case vk::Format::eR16G16Sfloat:
-        STORE_PACK(glm::uint, glm::packHalf2x16)
+        return c_PackHalf2<S>;
     case vk::Format::eR16G16Sint:
-        STORE_VERTS(glm::i16vec2)
+        return StoreVerts<S, glm::i16vec2>;
     case vk::Format::eR16G16Snorm:
-        STORE_PACK(glm::uint, glm::packSnorm2x16)
+        return PackVerts<S, glm::uint, glm::packSnorm2x16>;
     case vk::Format::eR16G16Uint:
-        STORE_VERTS(glm::u16vec2)
+        return StoreVerts<S, glm::u16vec2>;
     case vk::Format::eR16G16Unorm:
-        STORE_PACK(glm::uint, glm::packUnorm2x16)
+        return c_PackUnorm2x16<S>;
     case vk::Format::eR32Sfloat:
-        STORE_VERTS(glm::vec1)
+        return StoreVerts<S, glm::vec1>;
     case vk::Format::eR32Sint:
-        STORE_VERTS(glm::ivec1)
+        return StoreVerts<S, glm::ivec1>;
     case vk::Format::eR32Uint:
-        STORE_VERTS(glm::uvec1)
+        return StoreVerts<S, glm::uvec1>;
     case vk::Format::eR8G8Sint:
-        STORE_VERTS(glm::i8vec2)
+        return StoreVerts<S, glm::i8vec2>;
     case vk::Format::eR8G8Snorm:
-        STORE_PACK(glm::uint16, glm::packSnorm2x8)
+        return PackVerts<S, glm::uint16, glm::packSnorm2x8>;
     case vk::Format::eR8G8Uint:
-        STORE_VERTS(glm::u8vec2)
+        return StoreVerts<S, glm::u8vec2>;
     case vk::Format::eR8G8Unorm:
-        STORE_PACK(glm::uint16, glm::packUnorm2x8)
+        return PackVerts<S, glm::uint16, glm::packUnorm2x8>;
     case vk::Format::eR16Sfloat:
-        LOAD_UNPACKF(glm::uint16, glm::packHalf1x16)
+        return PackScalars<S, glm::uint16, glm::packHalf1x16>;
     case vk::Format::eR16Sint:
-        STORE_VERTS(glm::i16vec1)
+        return StoreVerts<S, glm::i16vec1>;
     case vk::Format::eR16Snorm:
-        LOAD_UNPACKF(glm::uint16, glm::packSnorm1x16)
+        return PackScalars<S, glm::uint16, glm::packSnorm1x16>;
     case vk::Format::eR16Uint:
-        STORE_VERTS(glm::u16vec1)
+        return StoreVerts<S, glm::u16vec1>;
     case vk::Format::eR16Unorm:
-        LOAD_UNPACKF(glm::uint16, glm::packUnorm1x16)
+        return PackScalars<S, glm::uint16, glm::packUnorm1x16>;
     case vk::Format::eR8Sint:
-        STORE_VERTS(glm::i8vec1)
+        return StoreVerts<S, glm::i8vec1>;
     case vk::Format::eR8Snorm:
-        LOAD_UNPACKF(glm::uint8, glm::packSnorm1x8)
+        return PackScalars<S, glm::uint8, glm::packSnorm1x8>;
     case vk::Format::eR8Uint:
-        STORE_VERTS(glm::u8vec1)
+        return StoreVerts<S, glm::u8vec1>;
     case vk::Format::eR8Unorm:
-        LOAD_UNPACKF(glm::uint8, glm::packUnorm1x8)
+        return PackScalars<S, glm::uint8, glm::packUnorm1x8>;
     case vk::Format::eB5G6R5UnormPack16:
-        STORE_PACK(glm::uint16, glm::packUnorm1x5_1x6_1x5)
+        return PackVerts<S, glm::uint16, glm::packUnorm1x5_1x6_1x5>;
     case vk::Format::eB5G5R5A1UnormPack16:
-        STORE_PACK(glm::uint16, glm::packUnorm3x5_1x1)
+        return PackVerts<S, glm::uint16, glm::packUnorm3x5_1x1>;
     case vk::Format::eA4B4G4R4UnormPack16:
-        STORE_PACK(glm::uint16, glm::packUnorm4x4)
+        return PackVerts<S, glm::uint16, glm::packUnorm4x4>;
     default:
-        Utility::Printf("Writer Format unsupport: %d\n", mInputDesc[iter->second].format);
-        return false;
+        return nullptr;
+    }
+}
+} // namespace
+
+class VBWriter::Impl
+{
+public:
+    Impl() noexcept : mAttributes{}, mStrides{}, mBuffers{}, mVerts{}, mDefaultStrides{} {}
+
+    bool Initialize(const std::vector<vk::VertexInputAttributeDescription> &desc);
+    bool AddStream(void *vb, size_t nVerts, size_t binding, size_t stride);
+    template <class S> bool Write(const S *buffer, uint32_t location, size_t count) const;
+
+    void Release() noexcept
+    {
+        memset(mAttributes, 0, sizeof(mAttributes));
+        memset(mStrides, 0, sizeof(mStrides));
+        memset(mBuffers, 0, sizeof(mBuffers));
+        memset(mVerts, 0, sizeof(mVerts));
+        memset(mDefaultStrides, 0, sizeof(mDefaultStrides));
+    }
+
+private:
+    // Looked up by location, the kernels for each source type are picked once from the format
+    struct Attribute
+    {
+        uint32_t binding;
+        uint32_t offset;
+        uint32_t size; // 0 when the location isn't in the layout
+        WriteFn<float> writeFloat;
+        WriteFn<glm::vec2> writeVec2;
+        WriteFn<glm::vec3> writeVec3;
+        WriteFn<glm::vec4> writeVec4;
+
+        WriteFn<float> Kernel(const float *) const { return writeFloat; }
+        WriteFn<glm::vec2> Kernel(const glm::vec2 *) const { return writeVec2; }
+        WriteFn<glm::vec3> Kernel(const glm::vec3 *) const { return writeVec3; }
+        WriteFn<glm::vec4> Kernel(const glm::vec4 *) const { return writeVec4; }
+    };
+
+    Attribute mAttributes[c_MaxLocation];
+    uint32_t mStrides[c_MaxBinding];
+    const void *mBuffers[c_MaxBinding];
+    size_t mVerts[c_MaxBinding];
+    uint32_t mDefaultStrides[c_MaxBinding];
+};
+
+bool VBWriter::Impl::Initialize(const std::vector<vk::VertexInputAttributeDescription> &desc)
+{
+    Release();
+    uint32_t offsets[c_MaxLocation] = {};
+
+    for (size_t i = 0; i < desc.size(); ++i)
+    {
+        if (i >= c_MaxLocation || desc[i].location >= c_MaxLocation || desc[i].binding >= c_MaxBinding)
+            return false;
+    }
+
+    ComputeInputLayout(desc, offsets, mDefaultStrides);
+
+    for (size_t i = 0; i < desc.size(); ++i)
+    {
+        // TODO: Instance data not supported yet in DXMesh
+
+        Attribute &attrib = mAttributes[desc[i].location];
+        attrib.binding = desc[i].binding;
+        attrib.offset = offsets[i];
+        attrib.size = vk::blockSize(desc[i].format);
+        attrib.writeFloat = SelectWriter<float>(desc[i].format);
+        attrib.writeVec2 = SelectWriter<glm::vec2>(desc[i].format);
+        attrib.writeVec3 = SelectWriter<glm::vec3>(desc[i].format);
+        attrib.writeVec4 = SelectWriter<glm::vec4>(desc[i].format);
+        if (!attrib.writeVec4)
+            Utility::Printf("Writer Format unsupport: %d\n", desc[i].format);
     }
 
     return true;
 }
 
+bool VBWriter::Impl::AddStream(void *vb, size_t nVerts, size_t binding, size_t stride)
+{
+    if (!vb || nVerts == 0)
+        return false;
+    if (nVerts >= UINT32_MAX)
+        return false;
+    if (binding >= c_MaxBinding)
+        return false;
+    if (stride >= c_MaxStride)
+        return false;
+
+    mStrides[binding] = (stride > 0) ? stride : mDefaultStrides[binding];
+    mBuffers[binding] = vb;
+    mVerts[binding] = nVerts;
+
+    return true;
+}
+
+template <class S> bool VBWriter::Impl::Write(const S *buffer, uint32_t location, size_t count) const
+{
+    if (!buffer || count == 0)
+        return false;
+
+    if (location >= c_MaxLocation || mAttributes[location].size == 0)
+    {
+        return false;
+    }
+    const Attribute &attrib = mAttributes[location];
+    const WriteFn<S> kernel = attrib.Kernel(buffer);
+    if (!kernel)
+    {
+        return false;
+    }
+
+    auto vb = (uint8_t *)mBuffers[attrib.binding];
+    if (!vb)
+    {
+        return false;
+    }
+    if (count > mVerts[attrib.binding])
+    {
+        return false;
+    }
+    const uint32_t stride = mStrides[attrib.binding];
+    if (stride == 0)
+    {
+        return false;
+    }
+
+    // Write as many elements as end inside the buffer, the kernel doesn't check
+    const size_t end = stride * mVerts[attrib.binding];
+    size_t fits = 0;
+    if (attrib.offset + attrib.size <= end)
+        fits = std::min(count, (end - attrib.offset - attrib.size) / stride + 1);
+
+    kernel(buffer, vb + attrib.offset, stride, fits);
+
+    return fits == count;
+}
+
 VBWriter::VBWriter() noexcept(false) : pImpl(std::make_unique<Impl>()) {}
 
 VBWriter::VBWriter(VBWriter &&) noexcept = default;
@@ -290,59 +430,17 @@ bool VBWriter::AddStream(void *vb, size_t nVerts, size_t binding, size_t stride)
 
 bool VBWriter::Write(float *buffer, uint32_t location, size_t count) const
 {
-    auto temp = pImpl->GetTemporaryBuffer(count);
-    if (!temp)
-    {
-        return false;
-    }
-
-    glm::vec4 *dptr = temp;
-    const float *sptr = buffer;
-    for (size_t i = 0; i < count; ++i)
-    {
-        const glm::vec4 v = glm::vec4(*sptr++, 0.0, 0.0, 0.0);
-        *dptr++ = v;
-    }
-
-    return pImpl->Write(temp, location, count);
+    return pImpl->Write(buffer, location, count);
 }
 
 bool VBWriter::Write(glm::vec2 *buffer, uint32_t location, size_t count) const
 {
-    auto temp = pImpl->GetTemporaryBuffer(count);
-    if (!temp)
-    {
-        return false;
-    }
-
-    glm::vec4 *dptr = temp;
-    const glm::vec2 *sptr = buffer;
-    for (size_t i = 0; i < count; ++i)
-    {
-        const glm::vec4 v = glm::vec4(*sptr++, 0.0, 0.0);
-        *dptr++ = v;
-    }
-
-    return pImpl->Write(temp, location, count);
+    return pImpl->Write(buffer, location, count);
 }
 
 bool VBWriter::Write(glm::vec3 *buffer, uint32_t location, size_t count) const
 {
-    auto temp = pImpl->GetTemporaryBuffer(count);
-    if (!temp)
-    {
-        return false;
-    }
-
-    glm::vec4 *dptr = temp;
-    const glm::vec3 *sptr = buffer;
-    for (size_t i = 0; i < count; ++i)
-    {
-        const glm::vec4 v = glm::vec4(*sptr++, 0.0);
-        *dptr++ = v;
-    }
-
-    return pImpl->Write(temp, location, count);
+    return pImpl->Write(buffer, location, count);
 }
 
 bool VBWriter::Write(glm::vec4 *buffer, uint32_t location, size_t count) const
@@ -350,4 +448,4 @@ bool VBWriter::Write(glm::vec4 *buffer, uint32_t location, size_t count) const
     return pImpl->Write(buffer, location, count);
 }
 
-void VBWriter::Release() noexcept { pImpl->Release(); }
\ No newline at end of file
+void VBWriter::Release() noexcept { pImpl->Release(); }
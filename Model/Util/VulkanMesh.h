@@ -82,3 +82,101 @@ bool ComputeTangentFrame(const uint16_t *indices, size_t nFaces, const glm::vec3
 
 bool ComputeTangentFrame(const uint32_t *indices, size_t nFaces, const glm::vec3 *positions, const glm::vec3 *normals,
                          const glm::vec2 *texcoords, size_t nVerts, glm::vec4 *tangents) noexcept;
+
+// One vertex attribute as laid out in its buffer. A stride of 0 means the elements are packed.
+struct VertexStream
+{
+    const void *data;
+    size_t size; // Bytes of each element
+    size_t stride;
+};
+
+// Finds the vertices that are bit-identical in every stream and numbers the distinct ones in order of
+// first occurrence, vertexRemap[old] = new. Returns the number of distinct vertices, 0 for invalid input.
+size_t WeldVertices(const VertexStream *streams, size_t nStreams, size_t nVerts, uint32_t *vertexRemap) noexcept;
+
+// Packs a stream into dst following a remap from WeldVertices, dst holds one element per distinct vertex
+bool CompactVB(const VertexStream &stream, size_t nVerts, const uint32_t *vertexRemap, void *dst) noexcept;
+
+// Orders vertices by their first use in the index buffer, so vertex fetches walk the buffer front to back.
+// vertexRemap[new] = old. Vertices no face uses are dropped and counted in trailingUnused, their remap
+// entries at the end are -1.
+bool OptimizeVertices(const uint16_t *indices, size_t nFaces, size_t nVerts, uint32_t *vertexRemap,
+                      size_t *trailingUnused = nullptr) noexcept;
+
+bool OptimizeVertices(const uint32_t *indices, size_t nFaces, size_t nVerts, uint32_t *vertexRemap,
+                      size_t *trailingUnused = nullptr) noexcept;
+
+// Rewrite indices and reorder a vertex stream of nVerts elements in place to follow a vertex remap
+bool FinalizeIB(uint16_t *indices, size_t nFaces, const uint32_t *vertexRemap, size_t nVerts) noexcept;
+
+bool FinalizeIB(uint32_t *indices, size_t nFaces, const uint32_t *vertexRemap, size_t nVerts) noexcept;
+
+bool FinalizeVB(void *vb, size_t stride, size_t nVerts, const uint32_t *vertexRemap) noexcept;
+
+// Vertices transformed with a FIFO post-transform cache of cacheSize entries, per face (ACMR, 0.5 at
+// best for large meshes) and per used vertex (ATVR, 1.0 at best)
+void ComputeVertexCacheMissRate(const uint16_t *indices, size_t nFaces, size_t nVerts, size_t cacheSize,
+                                float &acmr, float &atvr) noexcept;
+
+void ComputeVertexCacheMissRate(const uint32_t *indices, size_t nFaces, size_t nVerts, size_t cacheSize,
+                                float &acmr, float &atvr) noexcept;
+
+// Bytes read from a vertex buffer with the given stride through a small cache of 64 byte lines. Divided by
+// the size of the used vertices this is the overfetch, 1.0 when every line is read once.
+size_t ComputeVertexFetchBytes(const uint16_t *indices, size_t nFaces, size_t nVerts, size_t stride) noexcept;
+
+size_t ComputeVertexFetchBytes(const uint32_t *indices, size_t nFaces, size_t nVerts, size_t stride) noexcept;
+
+// Reorders the faces of a cache optimized index buffer in clusters, those far out from the center of the mesh
+// and facing away from it first, so that less of the mesh gets shaded twice. Clusters end where the cache
+// hit rate since the last split comes within threshold of the hit rate of the surrounding run of faces;
+// 1.05 lets the ACMR degrade by up to 5%, larger thresholds give smaller clusters and less overdraw.
+bool OptimizeOverdraw(uint16_t *indices, size_t nFaces, const glm::vec3 *positions, size_t nVerts,
+                      float threshold) noexcept;
+
+bool OptimizeOverdraw(uint32_t *indices, size_t nFaces, const glm::vec3 *positions, size_t nVerts,
+                      float threshold) noexcept;
+
+// Shaded fragments per covered pixel, rasterized on the CPU from the six axis views of the mesh with depth
+// testing. 1.0 means no pixel is shaded twice. Returns a negative value for invalid input.
+float ComputeOverdraw(const uint16_t *indices, size_t nFaces, const glm::vec3 *positions, size_t nVerts) noexcept;
+
+float ComputeOverdraw(const uint32_t *indices, size_t nFaces, const glm::vec3 *positions, size_t nVerts) noexcept;
+
+constexpr size_t kMeshletMaxVertices = 64;
+constexpr size_t kMeshletMaxTriangles = 124;
+
+// A run of consecutive faces of an index buffer, drawn with an ordinary indexed draw and culled as one.
+// A viewer at v sees none of its faces when dot(center - v, coneAxis) >= coneCutoff * |center - v| + radius.
+struct Meshlet
+{
+    uint32_t firstFace;
+    uint32_t faceCount;
+    glm::vec3 center; // Bounding sphere
+    float radius;
+    glm::vec3 coneAxis; // Average face normal
+    float coneCutoff;   // Sine of the widest angle to the axis, 1.0 when the faces spread too far to cull
+};
+
+// Cuts the index buffer into meshlets touching at most maxVerts vertices and holding at most maxFaces faces.
+// The faces keep their order, so run it after OptimizeFaces to get compact meshlets.
+bool ComputeMeshlets(const uint16_t *indices, size_t nFaces, const glm::vec3 *positions, size_t nVerts,
+                     std::vector<Meshlet> &meshlets, size_t maxVerts = kMeshletMaxVertices,
+                     size_t maxFaces = kMeshletMaxTriangles) noexcept;
+
+bool ComputeMeshlets(const uint32_t *indices, size_t nFaces, const glm::vec3 *positions, size_t nVerts,
+                     std::vector<Meshlet> &meshlets, size_t maxVerts = kMeshletMaxVertices,
+                     size_t maxFaces = kMeshletMaxTriangles) noexcept;
+
+// Quadric error edge collapse. Moves vertices onto a neighbor until at most targetFaces faces are left or the
+// cheapest collapse would put the surface further than maxError from where it was. Vertices on borders and
+// attribute seams stay put, so the faces written to outIndices (nFaces * 3 long) index the same vertices.
+// outError is the largest distance accepted, in the units of positions.
+bool SimplifyMesh(const uint16_t *indices, size_t nFaces, const glm::vec3 *positions, size_t nVerts,
+                  size_t targetFaces, float maxError, uint16_t *outIndices, size_t &outFaces,
+                  float &outError) noexcept;
+
+bool SimplifyMesh(const uint32_t *indices, size_t nFaces, const glm::vec3 *positions, size_t nVerts,
+                  size_t targetFaces, float maxError, uint32_t *outIndices, size_t &outFaces,
+                  float &outError) noexcept;
@@ -0,0 +1,196 @@
+#pragma once
+
+// Shared by the mesh functions, not part of the VulkanMesh interface
+
+#include "VulkanMesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VULKANMESH_SSE2 1
+#include <emmintrin.h>
+#else
+#define VULKANMESH_SSE2 0
+#endif
+
+// Threads ParallelFor may use, the calling one included
+size_t GetParallelThreadCount();
+
+// Calls fn(context, begin, end) on `threads` contiguous ranges of [0, count) at once. The calling thread takes the
+// first range, the others go to worker threads that are started on first use and kept for the life of the process.
+// While another call has the workers, including one made from inside fn, it calls fn(context, 0, count) instead.
+void RunParallelRanges(size_t threads, size_t count, void (*fn)(const void *, size_t, size_t), const void *context);
+
+// Calls fn(begin, end) on contiguous ranges of [0, count), one per hardware thread. Ranges are at least minCount
+// long, so small meshes run on the calling thread alone.
+template <class Fn> void ParallelFor(size_t count, size_t minCount, const Fn &fn)
+{
+    const size_t threads = std::min(GetParallelThreadCount(), count / std::max<size_t>(minCount, 1));
+    if (threads <= 1)
+    {
+        fn(size_t(0), count);
+        return;
+    }
+
+    RunParallelRanges(
+        threads, count,
+        [](const void *context, size_t begin, size_t end) { (*static_cast<const Fn *>(context))(begin, end); }, &fn);
+}
+
+// The corners (face * 3 + j) around every vertex in face order. Those of vertex v are
+// corners[offsets[v]] to corners[offsets[v + 1]]. Indices past the vertices, like the -1 of a missing face, belong
+// to no vertex.
+struct VertexCorners
+{
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> corners;
+};
+
+template <class index_t>
+void BuildVertexCorners(const index_t *indices, size_t nFaces, size_t nVerts, VertexCorners &vertexCorners)
+{
+    std::vector<uint32_t> &offsets = vertexCorners.offsets;
+    offsets.assign(nVerts + 1, 0);
+    for (size_t corner = 0; corner < nFaces * 3; ++corner)
+    {
+        if (indices[corner] < nVerts)
+            ++offsets[indices[corner] + 1];
+    }
+    for (size_t vert = 0; vert < nVerts; ++vert)
+        offsets[vert + 1] += offsets[vert];
+
+    // Filled in corner order, so every vertex lists its corners in face order
+    vertexCorners.corners.resize(offsets[nVerts]);
+    std::vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+    for (size_t corner = 0; corner < nFaces * 3; ++corner)
+    {
+        if (indices[corner] < nVerts)
+            vertexCorners.corners[next[indices[corner]]++] = uint32_t(corner);
+    }
+}
+
+// Four floats operated on together. Every operation rounds like its scalar counterpart, so four lanes give the
+// same bits as four passes of the scalar glm code.
+struct Float4
+{
+#if VULKANMESH_SSE2
+    __m128 v;
+
+    static Float4 Load(const float *f) { return {_mm_loadu_ps(f)}; }
+    static Float4 Splat(float f) { return {_mm_set1_ps(f)}; }
+    void Store(float *f) const { _mm_storeu_ps(f, v); }
+
+    Float4 operator+(Float4 b) const { return {_mm_add_ps(v, b.v)}; }
+    Float4 operator-(Float4 b) const { return {_mm_sub_ps(v, b.v)}; }
+    Float4 operator*(Float4 b) const { return {_mm_mul_ps(v, b.v)}; }
+    Float4 operator/(Float4 b) const { return {_mm_div_ps(v, b.v)}; }
+
+    // Lanes where the test holds, as a mask for Select and a bit per lane for Bits
+    Float4 operator>(Float4 b) const { return {_mm_cmpgt_ps(v, b.v)}; }
+    Float4 operator<(Float4 b) const { return {_mm_cmplt_ps(v, b.v)}; }
+    Float4 operator<=(Float4 b) const { return {_mm_cmple_ps(v, b.v)}; }
+    Float4 operator|(Float4 b) const { return {_mm_or_ps(v, b.v)}; }
+    int Bits() const { return _mm_movemask_ps(v); }
+
+    friend Float4 Sqrt(Float4 a) { return {_mm_sqrt_ps(a.v)}; }
+    friend Float4 Min(Float4 a, Float4 b) { return {_mm_min_ps(a.v, b.v)}; }
+    friend Float4 Max(Float4 a, Float4 b) { return {_mm_max_ps(a.v, b.v)}; }
+    friend Float4 Select(Float4 mask, Float4 a, Float4 b)
+    {
+        return {_mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v))};
+    }
+#else
+    float v[4];
+
+    static Float4 Load(const float *f) { return {{f[0], f[1], f[2], f[3]}}; }
+    static Float4 Splat(float f) { return {{f, f, f, f}}; }
+    void Store(float *f) const { std::copy_n(v, 4, f); }
+
+    template <class Op> Float4 Map(Float4 b, Op op) const
+    {
+        return {{op(v[0], b.v[0]), op(v[1], b.v[1]), op(v[2], b.v[2]), op(v[3], b.v[3])}};
+    }
+    template <class Op> Float4 Test(Float4 b, Op op) const
+    {
+        return Map(b, [&](float x, float y) { return op(x, y) ? -1.0f : 0.0f; });
+    }
+
+    Float4 operator+(Float4 b) const { return Map(b, [](float x, float y) { return x + y; }); }
+    Float4 operator-(Float4 b) const { return Map(b, [](float x, float y) { return x - y; }); }
+    Float4 operator*(Float4 b) const { return Map(b, [](float x, float y) { return x * y; }); }
+    Float4 operator/(Float4 b) const { return Map(b, [](float x, float y) { return x / y; }); }
+
+    // Lanes where the test holds, as a mask for Select and a bit per lane for Bits
+    Float4 operator>(Float4 b) const { return Test(b, [](float x, float y) { return x > y; }); }
+    Float4 operator<(Float4 b) const { return Test(b, [](float x, float y) { return x < y; }); }
+    Float4 operator<=(Float4 b) const { return Test(b, [](float x, float y) { return x <= y; }); }
+    Float4 operator|(Float4 b) const { return Test(b, [](float x, float y) { return x != 0.0f || y != 0.0f; }); }
+    int Bits() const { return (v[0] != 0.0f) | (v[1] != 0.0f) << 1 | (v[2] != 0.0f) << 2 | (v[3] != 0.0f) << 3; }
+
+    friend Float4 Sqrt(Float4 a)
+    {
+        return {{std::sqrt(a.v[0]), std::sqrt(a.v[1]), std::sqrt(a.v[2]), std::sqrt(a.v[3])}};
+    }
+    friend Float4 Min(Float4 a, Float4 b) { return a.Map(b, [](float x, float y) { return x < y ? x : y; }); }
+    friend Float4 Max(Float4 a, Float4 b) { return a.Map(b, [](float x, float y) { return x > y ? x : y; }); }
+    friend Float4 Select(Float4 mask, Float4 a, Float4 b)
+    {
+        return {{mask.v[0] != 0.0f ? a.v[0] : b.v[0], mask.v[1] != 0.0f ? a.v[1] : b.v[1],
+                 mask.v[2] != 0.0f ? a.v[2] : b.v[2], mask.v[3] != 0.0f ? a.v[3] : b.v[3]}};
+    }
+#endif
+};
+
+// Four vec3 as a structure of arrays, lane i of x, y and z is vector i
+struct Vec3x4
+{
+    Float4 x, y, z;
+
+    static Vec3x4 Gather(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c, const glm::vec3 &d)
+    {
+        const float xs[4] = {a.x, b.x, c.x, d.x}, ys[4] = {a.y, b.y, c.y, d.y}, zs[4] = {a.z, b.z, c.z, d.z};
+        return {Float4::Load(xs), Float4::Load(ys), Float4::Load(zs)};
+    }
+
+    void Scatter(glm::vec3 *a, glm::vec3 *b, glm::vec3 *c, glm::vec3 *d) const
+    {
+        float xs[4], ys[4], zs[4];
+        x.Store(xs);
+        y.Store(ys);
+        z.Store(zs);
+        *a = glm::vec3(xs[0], ys[0], zs[0]);
+        *b = glm::vec3(xs[1], ys[1], zs[1]);
+        *c = glm::vec3(xs[2], ys[2], zs[2]);
+        *d = glm::vec3(xs[3], ys[3], zs[3]);
+    }
+
+    Vec3x4 operator+(const Vec3x4 &b) const { return {x + b.x, y + b.y, z + b.z}; }
+    Vec3x4 operator-(const Vec3x4 &b) const { return {x - b.x, y - b.y, z - b.z}; }
+    Vec3x4 operator*(Float4 s) const { return {x * s, y * s, z * s}; }
+};
+
+// In the order glm::dot and glm::cross evaluate them
+inline Float4 Dot(const Vec3x4 &a, const Vec3x4 &b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+inline Vec3x4 Cross(const Vec3x4 &a, const Vec3x4 &b)
+{
+    return {a.y * b.z - b.y * a.z, a.z * b.x - b.z * a.x, a.x * b.y - b.x * a.y};
+}
+
+// glm::normalize, except that zero vectors stay zero instead of turning into NaNs
+inline Vec3x4 SafeNormalize(const Vec3x4 &a)
+{
+    const Float4 lengthSq = Dot(a, a);
+    const Float4 zero = Float4::Splat(0.0f);
+    const Vec3x4 n = a * (Float4::Splat(1.0f) / Sqrt(lengthSq));
+    const Float4 valid = lengthSq > zero;
+    return {Select(valid, n.x, zero), Select(valid, n.y, zero), Select(valid, n.z, zero)};
+}
+
+inline glm::vec3 SafeNormalize(const glm::vec3 &a)
+{
+    return glm::dot(a, a) > 0.0f ? glm::normalize(a) : glm::vec3(0.0f);
+}
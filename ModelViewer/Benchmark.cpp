@@ -0,0 +1,398 @@
+#include "Benchmark.h"
+
+#include <BufferManager.h>
+#include <CommandContext.h>
+#include <Display.h>
+#include <EngineProfiling.h>
+#include <FrameStats.h>
+#include <GpuTimeManager.h>
+#include <GraphicsCore.h>
+#include <Util/CommandLineArg.h>
+#include <Utility.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+using namespace Math;
+using namespace Graphics;
+
+namespace
+{
+// Frames to wait for the GPU times of the last frame before writing the results without them
+constexpr uint32_t c_MaxGpuWaitFrames = 8;
+
+struct Summary
+{
+    size_t Count;
+    float Mean, Min, P50, P95, P99, Max;
+};
+
+Summary Summarize(std::vector<float> values)
+{
+    Summary s = {};
+    if (values.empty())
+        return s;
+
+    std::sort(values.begin(), values.end());
+    auto percentile = [&](float p) {
+        size_t rank = (size_t)std::ceil(p * values.size());
+        return values[std::min(std::max(rank, (size_t)1), values.size()) - 1];
+    };
+
+    double sum = 0.0;
+    for (float v : values)
+        sum += v;
+
+    s.Count = values.size();
+    s.Mean = (float)(sum / values.size());
+    s.Min = values.front();
+    s.P50 = percentile(0.50f);
+    s.P95 = percentile(0.95f);
+    s.P99 = percentile(0.99f);
+    s.Max = values.back();
+    return s;
+}
+
+std::string EscapeJson(const std::string &str)
+{
+    std::string result;
+    for (char c : str)
+    {
+        if (c == '"' || c == '\\')
+            result += '\\';
+        if ((unsigned char)c >= 0x20)
+            result += c;
+    }
+    return result;
+}
+
+// null when nothing was measured, like GPU times that were never read back
+void WriteSummary(std::ostream &out, const Summary &s)
+{
+    if (s.Count == 0)
+    {
+        out << "null";
+        return;
+    }
+    out << "{\"mean\": " << s.Mean << ", \"min\": " << s.Min << ", \"p50\": " << s.P50 << ", \"p95\": " << s.P95
+        << ", \"p99\": " << s.P99 << ", \"max\": " << s.Max << "}";
+}
+} // namespace
+
+bool Benchmark::Initialize(const BoundingSphere &bounds, const std::string &modelName)
+{
+    m_Bounds = bounds;
+    m_ModelName = modelName;
+
+    CommandLineArgs::GetString("recordcamerapath", m_RecordFile);
+
+    CommandLineArgs::GetInteger("benchmark", m_NumFrames);
+    if (m_NumFrames == 0)
+        return false;
+
+    m_NumWarmupFrames = 10;
+    CommandLineArgs::GetInteger("warmup", m_NumWarmupFrames);
+
+    m_OutputFile = "benchmark.json";
+    CommandLineArgs::GetString("benchmarkoutput", m_OutputFile);
+
+    std::string pathFile;
+    if (CommandLineArgs::GetString("camerapath", pathFile))
+    {
+        std::ifstream file(pathFile);
+        CameraKey key;
+        while (file >> key.Eye.x >> key.Eye.y >> key.Eye.z >> key.At.x >> key.At.y >> key.At.z)
+            m_CameraPath.push_back(key);
+
+        if (m_CameraPath.empty())
+            Utility::Printf("Camera path %s has no keyframes, orbiting the model instead\n", pathFile.c_str());
+    }
+
+    // Playing back a path while recording one would only copy it
+    m_RecordFile.clear();
+
+    m_Frames.resize(m_NumFrames);
+    m_ScopeCpuTimes.resize(m_NumFrames * kMaxScopes);
+    m_ScopeGpuTimes.resize(m_NumFrames * kMaxScopes);
+    m_ScopeNames.reserve(kMaxScopes);
+    m_Scopes.reserve(kMaxScopes);
+    m_ScopeIndices.reserve(kMaxScopes);
+
+    Utility::Printf("Benchmark: %u frames after %u warm-up frames\n", m_NumFrames, m_NumWarmupFrames);
+    return true;
+}
+
+void Benchmark::Shutdown(void)
+{
+    WriteCameraPath();
+
+    m_CameraPath.clear();
+    m_RecordedPath.clear();
+    m_ScopeNames.clear();
+    m_Frames.clear();
+    m_ScopeCpuTimes.clear();
+    m_ScopeGpuTimes.clear();
+    m_Scopes.clear();
+    m_ScopeIndices.clear();
+}
+
+void Benchmark::Update(Camera &camera)
+{
+    // Scopes are already looked up during warm-up, so the recorded frames find them all
+    if (!m_Done)
+    {
+        EngineProfiling::GetLastFrameScopeTimes(m_Scopes);
+        // Only kMaxScopes can be recorded anyway, and this keeps the vectors within what Initialize reserved
+        if (m_Scopes.size() > kMaxScopes)
+            m_Scopes.resize(kMaxScopes);
+        m_ScopeIndices.clear();
+        for (const EngineProfiling::ScopeTime &scope : m_Scopes)
+            m_ScopeIndices.push_back(GetScopeIndex(scope.Name));
+    }
+
+    // The CPU stats of a frame are only complete once the next one starts, its GPU times come a few
+    // frames later
+    if (m_CurrentFrame > m_NumWarmupFrames && !m_Done)
+    {
+        if (m_NumRecorded < m_NumFrames)
+            RecordFrame((uint32_t)Graphics::GetFrameCount() - 1);
+        RecordGpuTimes();
+
+        if (m_NumRecorded == m_NumFrames && (m_Frames.back().HasGpuTime || ++m_GpuWaitFrames > c_MaxGpuWaitFrames))
+        {
+            WriteResults();
+            m_Done = true;
+        }
+    }
+
+    uint32_t pathFrame = m_CurrentFrame < m_NumWarmupFrames ? 0 : m_CurrentFrame - m_NumWarmupFrames;
+    MoveCamera(camera, std::min(pathFrame, m_NumFrames - 1));
+
+    ++m_CurrentFrame;
+}
+
+void Benchmark::RecordCameraPath(const Camera &camera)
+{
+    if (m_RecordFile.empty())
+        return;
+
+    glm::vec3 eye = camera.GetPosition();
+    m_RecordedPath.push_back({eye, eye + camera.GetForwardVec()});
+}
+
+void Benchmark::WriteCameraPath(void) const
+{
+    if (m_RecordFile.empty())
+        return;
+
+    std::ofstream file(m_RecordFile);
+    if (!file)
+    {
+        Utility::Printf("Benchmark: can't write %s\n", m_RecordFile.c_str());
+        return;
+    }
+
+    for (const CameraKey &key : m_RecordedPath)
+    {
+        file << key.Eye.x << " " << key.Eye.y << " " << key.Eye.z << " " << key.At.x << " " << key.At.y << " "
+             << key.At.z << "\n";
+    }
+    Utility::Printf("Benchmark: %u camera keyframes written to %s\n", (uint32_t)m_RecordedPath.size(),
+                    m_RecordFile.c_str());
+}
+
+void Benchmark::MoveCamera(Camera &camera, uint32_t frame) const
+{
+    float t = m_NumFrames > 1 ? (float)frame / (m_NumFrames - 1) : 0.0f;
+
+    glm::vec3 eye, at;
+    if (m_CameraPath.size() > 1)
+    {
+        float key = t * (m_CameraPath.size() - 1);
+        uint32_t index = std::min((uint32_t)key, (uint32_t)m_CameraPath.size() - 2);
+        float blend = key - index;
+        eye = glm::mix(m_CameraPath[index].Eye, m_CameraPath[index + 1].Eye, blend);
+        at = glm::mix(m_CameraPath[index].At, m_CameraPath[index + 1].At, blend);
+    }
+    else if (m_CameraPath.size() == 1)
+    {
+        eye = m_CameraPath[0].Eye;
+        at = m_CameraPath[0].At;
+    }
+    else
+    {
+        // One orbit around the model, moving up and down and in and out on the way like OrbitCamera does
+        float heading = t * glm::two_pi<float>();
+        float pitch = 0.4f * glm::sin(2.0f * heading);
+        float closeness = 0.5f + 0.4f * glm::sin(heading);
+        float distance = m_Bounds.GetRadius() * glm::mix(3.0f, 1.0f, closeness) + camera.GetNearClip();
+
+        glm::vec3 direction(glm::sin(heading) * glm::cos(pitch), -glm::sin(pitch), glm::cos(heading) * glm::cos(pitch));
+        at = m_Bounds.GetCenter();
+        eye = at + direction * distance;
+    }
+
+    camera.SetEyeAtUp(eye, at, glm::vec3(0.0f, 1.0f, 0.0f));
+    camera.Update();
+}
+
+// UINT32_MAX once kMaxScopes scopes were seen
+uint32_t Benchmark::GetScopeIndex(const char *name)
+{
+    auto iter = std::find_if(m_ScopeNames.begin(), m_ScopeNames.end(),
+                             [&](const char *scope) { return strcmp(scope, name) == 0; });
+    if (iter != m_ScopeNames.end())
+        return (uint32_t)(iter - m_ScopeNames.begin());
+    if (m_ScopeNames.size() == kMaxScopes)
+        return UINT32_MAX;
+    m_ScopeNames.push_back(name);
+    return (uint32_t)m_ScopeNames.size() - 1;
+}
+
+void Benchmark::RecordFrame(uint32_t frame)
+{
+    if (m_NumRecorded == 0)
+        m_FirstFrame = frame;
+
+    FrameStats &stats = m_Frames[m_NumRecorded];
+    float *scopeCpuTimes = &m_ScopeCpuTimes[m_NumRecorded * kMaxScopes];
+    ++m_NumRecorded;
+
+    stats.CpuTime = Graphics::GetFrameTime() * 1000.0f;
+    stats.GpuTime = 0.0f;
+    stats.HasGpuTime = false;
+    stats.Draws = CommandContext::GetLastFrameDrawCount();
+    stats.HeapAllocations = ::FrameStats::GetLastFrameHeapAllocations();
+
+    for (size_t s = 0; s < m_Scopes.size(); ++s)
+    {
+        if (m_ScopeIndices[s] != UINT32_MAX)
+            scopeCpuTimes[m_ScopeIndices[s]] = m_Scopes[s].CpuTime;
+    }
+}
+
+// The GPU times read back this frame belong to an older one, GpuTimeManager says which
+void Benchmark::RecordGpuTimes(void)
+{
+    uint32_t gpuFrame = GpuTimeManager::GetReadBackFrame();
+    if (gpuFrame == m_LastGpuFrame || gpuFrame == UINT32_MAX)
+        return;
+    m_LastGpuFrame = gpuFrame;
+
+    // Frames from the warm-up, or still being recorded
+    if (gpuFrame < m_FirstFrame || gpuFrame - m_FirstFrame >= m_NumRecorded)
+        return;
+
+    uint32_t index = gpuFrame - m_FirstFrame;
+    m_Frames[index].GpuTime = EngineProfiling::GetLastFrameGpuTime();
+    m_Frames[index].HasGpuTime = true;
+    float *scopeGpuTimes = &m_ScopeGpuTimes[index * kMaxScopes];
+    for (size_t s = 0; s < m_Scopes.size(); ++s)
+    {
+        if (m_ScopeIndices[s] != UINT32_MAX)
+            scopeGpuTimes[m_ScopeIndices[s]] = m_Scopes[s].GpuTime;
+    }
+}
+
+void Benchmark::WriteResults(void) const
+{
+    std::ofstream out(m_OutputFile);
+    if (!out)
+    {
+        Utility::Printf("Benchmark: can't write %s\n", m_OutputFile.c_str());
+        return;
+    }
+
+    std::vector<float> cpuTimes, gpuTimes, draws, allocs;
+    uint32_t allocatingFrames = 0;
+    for (const FrameStats &frame : m_Frames)
+    {
+        cpuTimes.push_back(frame.CpuTime);
+        if (frame.HasGpuTime)
+            gpuTimes.push_back(frame.GpuTime);
+        draws.push_back((float)frame.Draws);
+        allocs.push_back((float)frame.HeapAllocations);
+        allocatingFrames += frame.HeapAllocations > 0;
+    }
+    Summary cpu = Summarize(cpuTimes);
+    Summary gpu = Summarize(gpuTimes);
+
+    out << "{\n";
+    out << "  \"model\": \"" << EscapeJson(m_ModelName) << "\",\n";
+    out << "  \"device\": \"" << EscapeJson(g_PhysicalDevice.getProperties().deviceName.data()) << "\",\n";
+    out << "  \"resolution\": [" << g_SceneColorBuffer.GetWidth() << ", " << g_SceneColorBuffer.GetHeight() << "],\n";
+    out << "  \"frames\": " << m_NumFrames << ",\n";
+    out << "  \"warmupFrames\": " << m_NumWarmupFrames << ",\n";
+    out << "  \"timeStep\": " << GetDeltaTime() << ",\n";
+    out << "  \"cameraPath\": \"" << (m_CameraPath.empty() ? "orbit" : "keyframes") << "\",\n";
+
+    out << "  \"summary\": {\n";
+    out << "    \"cpuFrameTime\": ";
+    WriteSummary(out, cpu);
+    out << ",\n    \"gpuFrameTime\": ";
+    WriteSummary(out, gpu);
+    out << ",\n    \"draws\": ";
+    WriteSummary(out, Summarize(draws));
+    out << ",\n    \"heapAllocations\": ";
+    WriteSummary(out, Summarize(allocs));
+    out << ",\n    \"allocatingFrames\": " << allocatingFrames;
+    out << ",\n    \"scopes\": {";
+    for (size_t s = 0; s < m_ScopeNames.size(); ++s)
+    {
+        std::vector<float> scopeCpu, scopeGpu;
+        for (size_t f = 0; f < m_Frames.size(); ++f)
+        {
+            scopeCpu.push_back(m_ScopeCpuTimes[f * kMaxScopes + s]);
+            if (m_Frames[f].HasGpuTime)
+                scopeGpu.push_back(m_ScopeGpuTimes[f * kMaxScopes + s]);
+        }
+        out << (s == 0 ? "\n" : ",\n") << "      \"" << EscapeJson(m_ScopeNames[s]) << "\": {\"cpu\": ";
+        WriteSummary(out, Summarize(scopeCpu));
+        out << ", \"gpu\": ";
+        WriteSummary(out, Summarize(scopeGpu));
+        out << "}";
+    }
+    out << "\n    }\n  },\n";
+
+    // Times are in milliseconds, scopes map to [cpu, gpu]. GPU times that were never read back are null.
+    out << "  \"perFrame\": [";
+    for (size_t f = 0; f < m_Frames.size(); ++f)
+    {
+        const FrameStats &frame = m_Frames[f];
+        out << (f == 0 ? "\n" : ",\n") << "    {\"cpu\": " << frame.CpuTime << ", \"gpu\": ";
+        if (frame.HasGpuTime)
+            out << frame.GpuTime;
+        else
+            out << "null";
+        out << ", \"draws\": " << frame.Draws << ", \"allocs\": " << frame.HeapAllocations << ", \"scopes\": {";
+        for (size_t s = 0; s < m_ScopeNames.size(); ++s)
+        {
+            out << (s == 0 ? "" : ", ") << "\"" << EscapeJson(m_ScopeNames[s]) << "\": ["
+                << m_ScopeCpuTimes[f * kMaxScopes + s] << ", ";
+            if (frame.HasGpuTime)
+                out << m_ScopeGpuTimes[f * kMaxScopes + s];
+            else
+                out << "null";
+            out << "]";
+        }
+        out << "}}";
+    }
+    out << "\n  ]\n}\n";
+
+    if (gpu.Count > 0)
+    {
+        Utility::Printf("Benchmark: CPU %.3f ms (p99 %.3f ms), GPU %.3f ms (p99 %.3f ms), results in %s\n",
+                        cpu.Mean, cpu.P99, gpu.Mean, gpu.P99, m_OutputFile.c_str());
+    }
+    else
+    {
+        Utility::Printf("Benchmark: CPU %.3f ms (p99 %.3f ms), no GPU times, results in %s\n", cpu.Mean, cpu.P99,
+                        m_OutputFile.c_str());
+    }
+    if (allocatingFrames > 0)
+    {
+        Utility::Printf("Benchmark: %u of %u frames allocated from the heap\n", allocatingFrames,
+                        (uint32_t)m_Frames.size());
+    }
+}
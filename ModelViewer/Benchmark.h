@@ -0,0 +1,94 @@
+#pragma once
+
+#include <Camera.h>
+#include <EngineProfiling.h>
+#include <Math/BoundingSphere.h>
+#include <string>
+#include <vector>
+
+// Deterministic benchmark runs for comparing engine builds:
+//
+//     ModelViewer -model <file> -benchmark <frames> [-warmup <frames>] [-camerapath <file>] [-benchmarkoutput <file>]
+//
+// The camera follows a fixed path and everything that advances with time does so in fixed steps, so
+// every run renders the same frames. The CPU and GPU times, the time of every profiling scope, the
+// draw count and the number of heap allocations of each frame are written to a JSON file
+// (benchmark.json by default) once all frames ran. After warm-up every frame should allocate nothing.
+// GPU times are read back a few frames late, so they are matched to their frame by the frame index
+// GpuTimeManager read them for, and the run goes on until the last frame's GPU times are in.
+//
+// Without -camerapath the camera orbits the model once. A path file holds one keyframe per line,
+// "eye.x eye.y eye.z at.x at.y at.z", and the frames are spread evenly across the keyframes.
+// "-recordcamerapath <file>" writes such a file from an interactive session, one keyframe per frame. The
+// keyframes are kept in memory and written on shutdown.
+class Benchmark
+{
+public:
+    // Returns false when the command line doesn't ask for a benchmark
+    bool Initialize(const Math::BoundingSphere &bounds, const std::string &modelName);
+    void Shutdown(void);
+
+    bool IsRunning(void) const { return m_NumFrames > 0; }
+    bool IsDone(void) const { return m_Done; }
+
+    // Time step for everything that animates while benchmarking
+    float GetDeltaTime(void) const { return 1.0f / 60.0f; }
+
+    // Call once per frame before rendering. Records the stats of the previous frame and moves the
+    // camera to where the path is on this one.
+    void Update(Math::Camera &camera);
+
+    // Adds the camera to the path written to the file given by -recordcamerapath, if any
+    void RecordCameraPath(const Math::Camera &camera);
+
+private:
+    // Scopes beyond this many aren't recorded
+    static const uint32_t kMaxScopes = 64;
+
+    struct CameraKey
+    {
+        glm::vec3 Eye;
+        glm::vec3 At;
+    };
+
+    struct FrameStats
+    {
+        float CpuTime;
+        float GpuTime;
+        bool HasGpuTime; // False until read back, and for good if the GPU fell a whole query ring behind
+        uint32_t Draws;
+        uint64_t HeapAllocations;
+    };
+
+    void MoveCamera(Math::Camera &camera, uint32_t frame) const;
+    void RecordFrame(uint32_t frame);
+    void RecordGpuTimes(void);
+    uint32_t GetScopeIndex(const char *name);
+    void WriteResults(void) const;
+    void WriteCameraPath(void) const;
+
+    uint32_t m_NumFrames = 0;
+    uint32_t m_NumWarmupFrames = 0;
+    uint32_t m_CurrentFrame = 0;
+    bool m_Done = false;
+    uint32_t m_FirstFrame = 0;            // Frame index of m_Frames[0]
+    uint32_t m_NumRecorded = 0;           // Frames of m_Frames recorded so far
+    uint32_t m_LastGpuFrame = UINT32_MAX; // Frame of the last GPU times read back
+    uint32_t m_GpuWaitFrames = 0;         // Frames waited for the GPU times after the last frame
+
+    Math::BoundingSphere m_Bounds;
+    std::vector<CameraKey> m_CameraPath;
+    std::vector<CameraKey> m_RecordedPath;
+    std::string m_ModelName;
+    std::string m_OutputFile;
+    std::string m_RecordFile;
+
+    // Everything a frame records is allocated by Initialize, so recording doesn't show up in the heap
+    // allocations it measures
+    std::vector<const char *> m_ScopeNames;           // Owned by EngineProfiling
+    std::vector<EngineProfiling::ScopeTime> m_Scopes; // Scopes of the last frame
+    std::vector<uint32_t> m_ScopeIndices;             // Where each of m_Scopes is in m_ScopeNames
+    std::vector<FrameStats> m_Frames;
+    std::vector<float> m_ScopeCpuTimes; // kMaxScopes per frame, 0 for scopes not timed in the frame
+    std::vector<float> m_ScopeGpuTimes;
+};
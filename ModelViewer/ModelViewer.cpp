@@ -1,17 +1,20 @@
 #include <utility>
 #include <vulkan/vulkan.hpp>
 
+#include "Benchmark.h"
 #include <BufferManager.h>
 #include <Camera.h>
 #include <CameraController.h>
 #include <CommandContext.h>
 #include <Display.h>
+#include <EngineProfiling.h>
 #include <EngineTuning.h>
 #include <GameCore.h>
 #include <GameInput.h>
 #include <GpuBuffer.h>
 #include <GraphicsCore.h>
 #include <ModelLoader.h>
+#include <RenderGraph.h>
 #include <Renderer.h>
 #include <ShadowCamera.h>
 #include <TextureManager.h>
@@ -36,6 +39,8 @@ public:
     virtual void Startup(void) override;
     virtual void Cleanup(void) override;
 
+    virtual bool IsDone(void) override;
+
     virtual void Update(float deltaT) override;
     virtual void RenderScene(void) override;
 
@@ -48,6 +53,13 @@ private:
 
     ModelInstance m_ModelInst;
     ShadowCamera m_SunShadowCamera;
+
+    // Kept across frames so their sort lists and the graph's passes don't have to grow again every frame
+    MeshSorter m_Sorter{MeshSorter::kDefault};
+    MeshSorter m_ShadowSorter{MeshSorter::kShadows};
+    RenderGraph m_Graph;
+
+    Benchmark m_Benchmark;
 };
 
 CREATE_APPLICATION(ModelViewer)
@@ -153,11 +165,15 @@ void ModelViewer::Startup(void)
     //     m_CameraController.reset(new FlyingFPSCamera(m_Camera, Vector3(kYUnitVector)));
     // else
     m_CameraController.reset(new OrbitCamera(m_Camera, m_ModelInst.GetBoundingSphere(), CreateYUnitVector()));
+
+    m_Benchmark.Initialize(m_ModelInst.GetBoundingSphere(), gltfFileName);
 }
 
 void ModelViewer::Cleanup(void)
 {
+    m_Benchmark.Shutdown();
     m_ModelInst = nullptr;
+    m_Graph.DestroyTransients();
 
     g_IBLTextures.clear();
     Renderer::Shutdown();
@@ -168,14 +184,27 @@ namespace Graphics
 extern EnumVar DebugZoom;
 }
 
+bool ModelViewer::IsDone(void) { return m_Benchmark.IsDone() || IGameApp::IsDone(); }
+
 void ModelViewer::Update(float deltaT)
 {
+    ScopedTimer _prof("Update State");
+
     if (GameInput::IsFirstPressed(GameInput::kLShoulder))
         DebugZoom.Decrement();
     else if (GameInput::IsFirstPressed(GameInput::kRShoulder))
         DebugZoom.Increment();
 
-    m_CameraController->Update(deltaT);
+    if (m_Benchmark.IsRunning())
+    {
+        deltaT = m_Benchmark.GetDeltaTime();
+        m_Benchmark.Update(m_Camera);
+    }
+    else
+    {
+        m_CameraController->Update(deltaT);
+        m_Benchmark.RecordCameraPath(m_Camera);
+    }
 
     GraphicsContext &gfxContext = GraphicsContext::Begin("Scene Update");
     m_ModelInst.Update(gfxContext, deltaT);
@@ -214,47 +243,88 @@ void ModelViewer::RenderScene(void)
     globals.SunDirection = glm::vec4(SunDirection, 0.0);
     globals.SunIntensity = glm::vec3(g_SunLightIntensity); // w will be ignored anyway
 
-    // gfxContext.ClearColor(g_SceneColorBuffer);
-    gfxContext.ClearDepth(g_SceneDepthBuffer);
-
-    MeshSorter sorter(MeshSorter::kDefault);
+    MeshSorter &sorter = m_Sorter;
+    sorter.Reset();
     sorter.SetCamera(m_Camera);
     sorter.SetViewport(m_MainViewport);
     sorter.SetScissor(m_MainScissor);
-    sorter.SetDepthBuffer(g_SceneDepthBuffer);
     sorter.AddColorBuffer(g_SceneColorBuffer);
+    sorter.SetDiscardDepth(true);
 
     m_ModelInst.Render(sorter);
 
     sorter.Sort();
 
-    {
-        // ScopedTimer _prof(L"Depth Pre-Pass", gfxContext);
-        sorter.RenderMeshes(MeshSorter::kZPass, gfxContext, globals);
-    }
-
-    MeshSorter shadowSorter(MeshSorter::kShadows);
+    MeshSorter &shadowSorter = m_ShadowSorter;
+    shadowSorter.Reset();
     shadowSorter.SetCamera(m_SunShadowCamera);
     shadowSorter.SetDepthBuffer(g_ShadowBuffer);
 
     m_ModelInst.Render(shadowSorter);
 
     shadowSorter.Sort();
-    shadowSorter.RenderMeshes(MeshSorter::kZPass, gfxContext, globals);
-
-    gfxContext.ClearColor(g_SceneColorBuffer);
-
-    gfxContext.TransitionImageLayout(g_SSAOFullScreen, vk::ImageLayout::eShaderReadOnlyOptimal);
-    gfxContext.TransitionImageLayout(g_ShadowBuffer, vk::ImageLayout::eShaderReadOnlyOptimal);
-    gfxContext.TransitionImageLayout(g_SceneDepthBuffer, vk::ImageLayout::eDepthStencilAttachmentOptimal);
-    // gfxContext.SetRenderTarget(g_SceneColorBuffer.GetRTV(), g_SceneDepthBuffer.GetDSV_DepthReadOnly());
-    gfxContext.SetViewportAndScissor(m_MainViewport, m_MainScissor);
-
-    sorter.RenderMeshes(MeshSorter::kOpaque, gfxContext, globals);
-
-    Renderer::DrawSkybox(gfxContext, m_Camera, m_MainViewport, m_MainScissor);
 
-    sorter.RenderMeshes(MeshSorter::kTransparent, gfxContext, globals);
+    RenderGraph &graph = m_Graph;
+    graph.Reset();
+    RenderGraph::Resource sceneColor = graph.Import(g_SceneColorBuffer, true);
+    RenderGraph::Resource sceneDepth = graph.CreateTransient(
+        "Scene Depth", {g_SceneColorBuffer.GetWidth(), g_SceneColorBuffer.GetHeight(), DefaultDepthFormat});
+    RenderGraph::Resource shadowMap = graph.Import(g_ShadowBuffer);
+    RenderGraph::Resource ssao = graph.Import(g_SSAOFullScreen);
+
+    graph.AddPass(
+        "Depth Pre-Pass",
+        [&](RenderGraph::PassBuilder &pass) {
+            pass.Clear(sceneDepth, vk::ImageLayout::eDepthStencilAttachmentOptimal);
+        },
+        [&](GraphicsContext &context) {
+            sorter.SetDepthBuffer(graph.GetDepthBuffer(sceneDepth));
+            sorter.RenderMeshes(MeshSorter::kZPass, context, globals);
+        });
+
+    graph.AddPass(
+        "Shadow Map",
+        [&](RenderGraph::PassBuilder &pass) {
+            pass.Clear(shadowMap, vk::ImageLayout::eDepthStencilAttachmentOptimal);
+        },
+        [&](GraphicsContext &context) { shadowSorter.RenderMeshes(MeshSorter::kZPass, context, globals); });
+
+    graph.AddPass(
+        "Opaque",
+        [&](RenderGraph::PassBuilder &pass) {
+            pass.Read(ssao);
+            pass.Read(shadowMap);
+            pass.Clear(sceneColor, vk::ImageLayout::eColorAttachmentOptimal);
+            pass.Write(sceneDepth, vk::ImageLayout::eDepthStencilAttachmentOptimal);
+        },
+        [&](GraphicsContext &context) {
+            // gfxContext.SetRenderTarget(g_SceneColorBuffer.GetRTV(), g_SceneDepthBuffer.GetDSV_DepthReadOnly());
+            context.SetViewportAndScissor(m_MainViewport, m_MainScissor);
+            sorter.RenderMeshes(MeshSorter::kOpaque, context, globals);
+        });
+
+    graph.AddPass(
+        "Skybox",
+        [&](RenderGraph::PassBuilder &pass) {
+            pass.Write(sceneColor, vk::ImageLayout::eColorAttachmentOptimal);
+            pass.Write(sceneDepth, vk::ImageLayout::eDepthStencilAttachmentOptimal);
+        },
+        [&](GraphicsContext &context) {
+            Renderer::DrawSkybox(context, m_Camera, m_MainViewport, m_MainScissor, g_SceneColorBuffer,
+                                 graph.GetDepthBuffer(sceneDepth));
+        });
+
+    graph.AddPass(
+        "Transparent",
+        [&](RenderGraph::PassBuilder &pass) {
+            pass.Read(ssao);
+            pass.Read(shadowMap);
+            pass.Write(sceneColor, vk::ImageLayout::eColorAttachmentOptimal);
+            pass.Write(sceneDepth, vk::ImageLayout::eDepthStencilAttachmentOptimal);
+        },
+        [&](GraphicsContext &context) { sorter.RenderMeshes(MeshSorter::kTransparent, context, globals); });
+
+    graph.Execute(gfxContext);
 
     // Renderer::Render(gfxContext, globals);
 
@@ -0,0 +1,76 @@
+// Times the CRC32C state hashing and a cache hit in ShardedHashMap against the std::map the caches used
+// before. Run it on the target machine, the numbers are only meaningful relative to each other.
+#include "Hash.h"
+#include "HashMap.h"
+#include "SystemTime.h"
+
+#include <map>
+#include <random>
+#include <stdio.h>
+#include <vector>
+
+namespace
+{
+// About the size of a sampler or render pass description
+struct Desc
+{
+    uint32_t words[24];
+};
+
+constexpr size_t c_Entries = 300;
+constexpr size_t c_Lookups = 10000000;
+
+template <class Fn> double NanosecondsPerCall(size_t calls, Fn &&fn)
+{
+    CpuTimer timer;
+    timer.Start();
+    fn();
+    timer.Stop();
+    return timer.GetTime() * 1e9 / calls;
+}
+} // namespace
+
+int main()
+{
+    SystemTime::Initialize();
+
+    std::mt19937 rng(27);
+    std::vector<Desc> descs(c_Entries);
+    for (Desc &desc : descs)
+    {
+        for (uint32_t &word : desc.words)
+            word = rng();
+    }
+
+    size_t sink = 0;
+    double hashNs = NanosecondsPerCall(c_Lookups, [&]() {
+        for (size_t i = 0; i < c_Lookups; ++i)
+            sink += Utility::HashState(&descs[i % c_Entries]);
+    });
+
+    std::vector<size_t> keys;
+    Utility::ShardedHashMap<size_t, size_t> map;
+    std::map<size_t, size_t> stdMap;
+    for (const Desc &desc : descs)
+    {
+        keys.push_back(Utility::HashState(&desc));
+        map.Insert(keys.back(), keys.size());
+        stdMap[keys.back()] = keys.size();
+    }
+
+    double findNs = NanosecondsPerCall(c_Lookups, [&]() {
+        size_t value = 0;
+        for (size_t i = 0; i < c_Lookups; ++i)
+            sink += map.Find(keys[i % c_Entries], value) ? value : 0;
+    });
+
+    double stdMapNs = NanosecondsPerCall(c_Lookups, [&]() {
+        for (size_t i = 0; i < c_Lookups; ++i)
+            sink += stdMap.find(keys[i % c_Entries])->second;
+    });
+
+    printf("CRC32C (%s), %zu byte state: %.2f ns\n", Utility::GetHashImplementation(), sizeof(Desc), hashNs);
+    printf("ShardedHashMap hit, %zu entries: %.2f ns\n", c_Entries, findNs);
+    printf("std::map hit, %zu entries: %.2f ns\n", c_Entries, stdMapNs);
+    return sink == 0 ? 1 : 0;
+}
@@ -0,0 +1,147 @@
+#include "Hash.h"
+#include "HashMap.h"
+#include "Test.h"
+
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace
+{
+// Bit at a time CRC32C, the definition every Crc32c implementation has to match
+uint32_t ReferenceCrc32c(uint32_t crc, const uint8_t *data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; ++bit)
+            crc = (crc >> 1) ^ (0x82F63B78u & (0u - (crc & 1u)));
+    }
+    return crc;
+}
+
+void TestCrc32c()
+{
+    printf("Crc32c implementation: %s\n", Utility::GetHashImplementation());
+
+    // Known values from RFC 3720, B.4
+    uint32_t words[8] = {};
+    CHECK(~Utility::Crc32c(~0u, words, words + 8) == 0x8A9136AAu);
+    for (uint32_t &word : words)
+        word = ~0u;
+    CHECK(~Utility::Crc32c(~0u, words, words + 8) == 0x62A8AB43u);
+
+    // Every length and 4-byte alignment, so the 8-byte paths see both a leading and a trailing word
+    std::mt19937 rng(27);
+    uint32_t buffer[64];
+    for (uint32_t &word : buffer)
+        word = rng();
+    for (size_t begin = 0; begin < 4; ++begin)
+    {
+        for (size_t end = begin; end <= 64; ++end)
+        {
+            uint32_t expected = ReferenceCrc32c(2166136261u, (const uint8_t *)(buffer + begin), (end - begin) * 4);
+            CHECK(Utility::Crc32c(2166136261u, buffer + begin, buffer + end) == expected);
+        }
+    }
+}
+
+void TestInsertFindErase()
+{
+    Utility::ShardedHashMap<size_t, size_t> map;
+
+    for (size_t key = 0; key < 1000; ++key)
+        CHECK(map.Insert(key, key * 3) == key * 3);
+
+    // Insert never overwrites
+    CHECK(map.Insert(10, 0) == 30);
+
+    size_t value = 0;
+    for (size_t key = 0; key < 1000; ++key)
+        CHECK(map.Find(key, value) && value == key * 3);
+    CHECK(!map.Find(1000, value));
+
+    map.EraseIf([](size_t key, const size_t &) { return key % 2 == 0; });
+    for (size_t key = 0; key < 1000; ++key)
+        CHECK(map.Find(key, value) == (key % 2 == 1));
+
+    size_t count = 0;
+    map.ForEach([&](size_t, size_t &) { ++count; });
+    CHECK(count == 500);
+
+    map.Clear();
+    CHECK(!map.Find(1, value));
+    CHECK(map.GetRetiredTableCount() == 0);
+}
+
+// Framebuffers are erased and created again on every resize. Grown tables must be freed as frames go
+// by instead of piling up.
+void TestRetiredTablesAreFreed()
+{
+    Utility::ShardedHashMap<size_t, size_t> map;
+
+    size_t key = 0;
+    size_t mostRetired = 0;
+    for (int frame = 0; frame < 1000; ++frame)
+    {
+        map.EraseIf([](size_t, const size_t &) { return true; });
+        for (int i = 0; i < 64; ++i, ++key)
+            map.Insert(key, key);
+        Utility::AdvanceHashMapEpoch();
+        mostRetired = std::max(mostRetired, map.GetRetiredTableCount());
+    }
+
+    // At most the tables of the last two frames in each of the 16 shards
+    printf("Most retired tables at once: %zu\n", mostRetired);
+    CHECK(mostRetired <= 16 * 8);
+
+    size_t value = 0;
+    CHECK(map.Find(key - 1, value) && value == key - 1);
+}
+
+// Readers look up keys that are always present while a writer keeps growing and erasing
+void TestConcurrentFind()
+{
+    Utility::ShardedHashMap<size_t, size_t> map;
+    for (size_t key = 0; key < 256; ++key)
+        map.Insert(key, key + 1);
+
+    std::atomic<bool> done{false};
+    std::atomic<int> misses{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; ++t)
+    {
+        readers.emplace_back([&, t]() {
+            size_t value = 0;
+            for (size_t i = t; !done.load(std::memory_order_relaxed); ++i)
+            {
+                size_t key = i % 256;
+                if (!map.Find(key, value) || value != key + 1)
+                    misses.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+
+    for (size_t round = 0; round < 200; ++round)
+    {
+        for (size_t key = 0; key < 256; ++key)
+            map.Insert(round * 1000 + 1000 + key, key);
+        map.EraseIf([](size_t key, const size_t &) { return key >= 1000; });
+    }
+
+    done = true;
+    for (std::thread &reader : readers)
+        reader.join();
+    CHECK(misses == 0);
+}
+} // namespace
+
+int main()
+{
+    TestCrc32c();
+    TestInsertFindErase();
+    TestRetiredTablesAreFreed();
+    TestConcurrentFind();
+    return Test::Result("HashMapTest");
+}
@@ -0,0 +1,294 @@
+// Imports generated glTF primitives with OptimizeMesh and reads the triangles back out of its vertex and index
+// buffers. Whatever the welding and reordering did, every primitive must still draw the source triangles.
+#include "Test.h"
+#include "MeshConvert.h"
+
+#include <Util/CommandLineArg.h>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+struct Source
+{
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> texcoords;
+    std::vector<uint32_t> indices; // Empty for an unindexed primitive
+};
+
+// The nine coordinates of a triangle, starting from its smallest corner so the winding is kept
+typedef std::array<float, 9> Triangle;
+
+Triangle MakeTriangle(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c)
+{
+    const Triangle rotations[3] = {
+        {a.x, a.y, a.z, b.x, b.y, b.z, c.x, c.y, c.z},
+        {b.x, b.y, b.z, c.x, c.y, c.z, a.x, a.y, a.z},
+        {c.x, c.y, c.z, a.x, a.y, a.z, b.x, b.y, b.z},
+    };
+    return std::min({rotations[0], rotations[1], rotations[2]});
+}
+
+std::vector<Triangle> SourceTriangles(const Source &src)
+{
+    std::vector<Triangle> triangles;
+    const size_t indexCount = src.indices.empty() ? src.positions.size() : src.indices.size();
+    for (size_t k = 0; k + 2 < indexCount; k += 3)
+    {
+        auto corner = [&](size_t j) { return src.positions[src.indices.empty() ? j : src.indices[j]]; };
+        triangles.push_back(MakeTriangle(corner(k), corner(k + 1), corner(k + 2)));
+    }
+    std::sort(triangles.begin(), triangles.end());
+    return triangles;
+}
+
+std::vector<uint32_t> ReadIndices(const std::vector<uint8_t> &ib, bool index32)
+{
+    std::vector<uint32_t> indices(ib.size() / (index32 ? 4 : 2));
+    for (size_t k = 0; k < indices.size(); ++k)
+        indices[k] = index32 ? ((const uint32_t *)ib.data())[k] : ((const uint16_t *)ib.data())[k];
+    return indices;
+}
+
+// Positions are the leading float3 of every vertex, as long as they aren't quantized. Returns the triangles
+// sorted, or nothing when an index is out of range.
+std::vector<Triangle> BufferTriangles(const std::vector<uint8_t> &vb, size_t stride, const std::vector<uint32_t> &ib)
+{
+    const size_t vertexCount = vb.size() / stride;
+    std::vector<Triangle> triangles;
+    for (size_t k = 0; k + 2 < ib.size(); k += 3)
+    {
+        glm::vec3 p[3];
+        for (size_t j = 0; j < 3; ++j)
+        {
+            if (ib[k + j] >= vertexCount)
+                return {};
+            memcpy(&p[j], vb.data() + ib[k + j] * stride, sizeof(glm::vec3));
+        }
+        triangles.push_back(MakeTriangle(p[0], p[1], p[2]));
+    }
+    std::sort(triangles.begin(), triangles.end());
+    return triangles;
+}
+
+size_t VertexCount(const Renderer::Primitive &prim) { return prim.VB->size() / prim.vertexStride; }
+
+void Import(const Source &src, Renderer::Primitive &prim)
+{
+    const bool index32 = src.positions.size() > 0xFFFF;
+    std::vector<uint16_t> indices16(src.indices.begin(), src.indices.end());
+
+    glTF::Accessor positions = {(uint8_t *)src.positions.data(), sizeof(glm::vec3), (uint32_t)src.positions.size(),
+                                glTF::Accessor::kFloat, glTF::Accessor::kVec3};
+    glTF::Accessor normals = {(uint8_t *)src.normals.data(), sizeof(glm::vec3), (uint32_t)src.normals.size(),
+                              glTF::Accessor::kFloat, glTF::Accessor::kVec3};
+    glTF::Accessor texcoords = {(uint8_t *)src.texcoords.data(), sizeof(glm::vec2), (uint32_t)src.texcoords.size(),
+                                glTF::Accessor::kFloat, glTF::Accessor::kVec2};
+    glTF::Accessor indices = {index32 ? (uint8_t *)src.indices.data() : (uint8_t *)indices16.data(),
+                              index32 ? 4u : 2u, (uint32_t)src.indices.size(),
+                              index32 ? glTF::Accessor::kUnsignedInt : glTF::Accessor::kUnsignedShort,
+                              glTF::Accessor::kScalar};
+
+    glTF::Material material = {};
+    glTF::Primitive inPrim = {};
+    inPrim.attributes[glTF::Primitive::kPosition] = &positions;
+    inPrim.attributes[glTF::Primitive::kNormal] = &normals;
+    inPrim.attributes[glTF::Primitive::kTexcoord0] = &texcoords;
+    inPrim.indices = src.indices.empty() ? nullptr : &indices;
+    inPrim.material = &material;
+    inPrim.mode = 4;
+
+    glm::vec3 minPos = src.positions[0], maxPos = src.positions[0];
+    for (const glm::vec3 &position : src.positions)
+    {
+        minPos = glm::min(minPos, position);
+        maxPos = glm::max(maxPos, position);
+    }
+    memcpy(inPrim.minPos, &minPos, sizeof(minPos));
+    memcpy(inPrim.maxPos, &maxPos, sizeof(maxPos));
+
+    OptimizeMesh(prim, inPrim, glm::mat4(1.0f), nullptr, false);
+}
+
+// A flat grid of size * size quads facing up, two triangles per quad
+Source MakeGrid(uint32_t size)
+{
+    Source grid;
+    for (uint32_t z = 0; z <= size; ++z)
+    {
+        for (uint32_t x = 0; x <= size; ++x)
+        {
+            grid.positions.push_back(glm::vec3((float)x, 0.0f, (float)z));
+            grid.normals.push_back(glm::vec3(0.0f, 1.0f, 0.0f));
+            grid.texcoords.push_back(glm::vec2((float)x / size, (float)z / size));
+        }
+    }
+    for (uint32_t z = 0; z < size; ++z)
+    {
+        for (uint32_t x = 0; x < size; ++x)
+        {
+            uint32_t a = z * (size + 1) + x, b = a + 1, c = a + size + 1, d = c + 1;
+            grid.indices.insert(grid.indices.end(), {a, c, b, b, c, d});
+        }
+    }
+    return grid;
+}
+
+// Without an index buffer every corner is a vertex of its own, the weld must find the shared ones
+void TestWeldUnindexed()
+{
+    const uint32_t c_Size = 16;
+    const Source grid = MakeGrid(c_Size);
+    Source corners;
+    for (uint32_t index : grid.indices)
+    {
+        corners.positions.push_back(grid.positions[index]);
+        corners.normals.push_back(grid.normals[index]);
+        corners.texcoords.push_back(grid.texcoords[index]);
+    }
+
+    Renderer::Primitive prim;
+    Import(corners, prim);
+    CHECK(prim.index32 == 0);
+    CHECK(prim.primCount == corners.positions.size());
+    CHECK(VertexCount(prim) == grid.positions.size());
+    CHECK(BufferTriangles(*prim.VB, prim.vertexStride, ReadIndices(*prim.IB, false)) == SourceTriangles(corners));
+    printf("Unindexed grid: %zu corners welded to %zu vertices\n", corners.positions.size(), VertexCount(prim));
+}
+
+// A UV sphere whose seam column and pole vertices repeat a position with another texcoord
+Source MakeSphere(uint32_t rings, uint32_t segments)
+{
+    Source sphere;
+    auto add = [&](uint32_t ring, uint32_t segment, float u) {
+        const float theta = glm::pi<float>() * ring / rings;
+        const float phi = glm::two_pi<float>() * (segment % segments) / segments;
+        glm::vec3 position(glm::sin(theta) * glm::cos(phi), glm::cos(theta), glm::sin(theta) * glm::sin(phi));
+        if (ring == 0 || ring == rings)
+            position = glm::vec3(0.0f, ring == 0 ? 1.0f : -1.0f, 0.0f);
+        sphere.positions.push_back(position);
+        sphere.normals.push_back(position);
+        sphere.texcoords.push_back(glm::vec2(u, (float)ring / rings));
+        return (uint32_t)sphere.positions.size() - 1;
+    };
+
+    std::vector<uint32_t> grid; // (rings - 1) rows of segments + 1 columns
+    for (uint32_t ring = 1; ring < rings; ++ring)
+    {
+        for (uint32_t segment = 0; segment <= segments; ++segment)
+            grid.push_back(add(ring, segment, (float)segment / segments));
+    }
+    auto vertex = [&](uint32_t ring, uint32_t segment) { return grid[(ring - 1) * (segments + 1) + segment]; };
+
+    for (uint32_t segment = 0; segment < segments; ++segment)
+    {
+        const float u = (segment + 0.5f) / segments;
+        const uint32_t top = add(0, segment, u), bottom = add(rings, segment, u);
+        sphere.indices.insert(sphere.indices.end(), {top, vertex(1, segment + 1), vertex(1, segment)});
+        sphere.indices.insert(sphere.indices.end(),
+                              {bottom, vertex(rings - 1, segment), vertex(rings - 1, segment + 1)});
+        for (uint32_t ring = 1; ring + 1 < rings; ++ring)
+        {
+            uint32_t a = vertex(ring, segment), b = vertex(ring, segment + 1);
+            uint32_t c = vertex(ring + 1, segment), d = vertex(ring + 1, segment + 1);
+            sphere.indices.insert(sphere.indices.end(), {a, b, c, b, d, c});
+        }
+    }
+    return sphere;
+}
+
+// The depth stream welds the seams and poles away, and its index buffers draw the triangles of the main ones
+void TestDepthStream()
+{
+    const uint32_t c_Rings = 24, c_Segments = 32;
+    const Source sphere = MakeSphere(c_Rings, c_Segments);
+
+    Renderer::Primitive prim;
+    Import(sphere, prim);
+    const size_t depthVertexCount = prim.DepthVB->size() / prim.depthVertexStride;
+    CHECK(prim.index32 == 0);
+    CHECK(VertexCount(prim) == sphere.positions.size());
+    CHECK(depthVertexCount == (c_Rings - 1) * c_Segments + 2);
+
+    const std::vector<Triangle> triangles = SourceTriangles(sphere);
+    CHECK(BufferTriangles(*prim.VB, prim.vertexStride, ReadIndices(*prim.IB, false)) == triangles);
+    CHECK(BufferTriangles(*prim.DepthVB, prim.depthVertexStride, ReadIndices(*prim.DepthIB, false)) == triangles);
+
+    // Run with -lodcount, each LOD has a depth index buffer over the same welded stream
+    CHECK(!prim.lods.empty());
+    size_t wrongLODs = 0;
+    for (const Renderer::Primitive::LOD &lod : prim.lods)
+    {
+        const std::vector<Triangle> lodTriangles =
+            BufferTriangles(*prim.VB, prim.vertexStride, ReadIndices(*lod.IB, false));
+        wrongLODs += lodTriangles.empty() || lodTriangles.size() * 3 != lod.primCount ||
+                     BufferTriangles(*prim.DepthVB, prim.depthVertexStride, ReadIndices(*lod.DepthIB, false)) !=
+                         lodTriangles;
+    }
+    CHECK(wrongLODs == 0);
+    printf("Sphere: %zu vertices, %zu depth vertices, %zu LODs\n", VertexCount(prim), depthVertexCount,
+           prim.lods.size());
+}
+
+// A grid with more vertices than 16-bit indices reach is split into chunks that do, and together the chunks
+// draw every face once, in both streams
+void TestSplit()
+{
+    const uint32_t c_Size = 300;
+    const Source grid = MakeGrid(c_Size);
+
+    Renderer::Primitive prim;
+    Import(grid, prim);
+    CHECK(prim.index32 == 1);
+    CHECK(prim.lods.empty());
+
+    std::vector<Renderer::Primitive> chunks;
+    SplitPrimitive(prim, chunks);
+    CHECK(chunks.size() >= 2);
+
+    std::vector<Triangle> triangles, depthTriangles;
+    size_t wrongChunks = 0, primCount = 0;
+    for (const Renderer::Primitive &chunk : chunks)
+    {
+        const size_t depthVertexCount = chunk.DepthVB->size() / chunk.depthVertexStride;
+        const std::vector<Triangle> chunkTriangles =
+            BufferTriangles(*chunk.VB, chunk.vertexStride, ReadIndices(*chunk.IB, false));
+        const std::vector<Triangle> chunkDepthTriangles =
+            BufferTriangles(*chunk.DepthVB, chunk.depthVertexStride, ReadIndices(*chunk.DepthIB, false));
+
+        wrongChunks += chunk.index32 != 0 || VertexCount(chunk) > 0x10000 || depthVertexCount > 0x10000 ||
+                       chunk.IB->size() != chunk.primCount * sizeof(uint16_t) ||
+                       chunk.DepthIB->size() != chunk.primCount * sizeof(uint16_t) ||
+                       chunkTriangles.size() * 3 != chunk.primCount ||
+                       chunkDepthTriangles.size() * 3 != chunk.primCount;
+        triangles.insert(triangles.end(), chunkTriangles.begin(), chunkTriangles.end());
+        depthTriangles.insert(depthTriangles.end(), chunkDepthTriangles.begin(), chunkDepthTriangles.end());
+        primCount += chunk.primCount;
+    }
+    CHECK(wrongChunks == 0);
+    CHECK(primCount == prim.primCount);
+
+    // Every grid face has corners of its own, so equal sorted lists mean each face is drawn exactly once
+    const std::vector<Triangle> expected = SourceTriangles(grid);
+    std::sort(triangles.begin(), triangles.end());
+    std::sort(depthTriangles.begin(), depthTriangles.end());
+    CHECK(triangles == expected);
+    CHECK(depthTriangles == expected);
+    printf("Grid: %zu vertices split into %zu chunks\n", VertexCount(prim), chunks.size());
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    CommandLineArgs::Initialize(argc, argv);
+
+    TestWeldUnindexed();
+    TestDepthStream();
+    TestSplit();
+    return Test::Result("MeshConvertTest");
+}
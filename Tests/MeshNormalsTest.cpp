@@ -0,0 +1,217 @@
+// Compares ComputeNormals and ComputeTangentFrame with plain scalar versions of the same math, summed face
+// by face. The meshes have faces with a repeated index, collinear corners, coincident texcoords and a
+// missing (-1) index, plus vertices no face uses. The large mesh is split across threads.
+#include "Test.h"
+#include "Util/VulkanMesh.h"
+
+#include <cmath>
+#include <vector>
+
+namespace
+{
+constexpr float c_Tolerance = 1e-5f;
+constexpr float c_Epsilon = 0.0001f;
+
+struct Mesh
+{
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> texcoords;
+    std::vector<uint32_t> indices;
+};
+
+glm::vec3 SafeNormalize(const glm::vec3 &v) { return glm::dot(v, v) > 0.0f ? glm::normalize(v) : glm::vec3(0.0f); }
+
+bool Missing(const uint32_t *f) { return f[0] == uint32_t(-1) || f[1] == uint32_t(-1) || f[2] == uint32_t(-1); }
+
+std::vector<glm::vec3> ReferenceNormals(const Mesh &mesh)
+{
+    std::vector<glm::vec3> normals(mesh.positions.size(), glm::vec3(0.0f));
+    for (size_t face = 0; face < mesh.indices.size() / 3; ++face)
+    {
+        const uint32_t *f = &mesh.indices[face * 3];
+        if (Missing(f))
+            continue;
+
+        glm::vec3 p[3] = {mesh.positions[f[0]], mesh.positions[f[1]], mesh.positions[f[2]]};
+        glm::vec3 faceNormal = SafeNormalize(glm::cross(p[1] - p[0], p[2] - p[0]));
+        for (size_t k = 0; k < 3; ++k)
+        {
+            glm::vec3 a = SafeNormalize(p[(k + 1) % 3] - p[k]);
+            glm::vec3 b = SafeNormalize(p[(k + 2) % 3] - p[k]);
+            float angle = glm::acos(glm::clamp(glm::dot(a, b), -1.0f, 1.0f));
+            normals[f[k]] += faceNormal * angle;
+        }
+    }
+    for (glm::vec3 &normal : normals)
+        normal = SafeNormalize(normal);
+    return normals;
+}
+
+glm::vec4 ReferenceTangent(const glm::vec3 &normal, const glm::vec3 &tan1, const glm::vec3 &tan2)
+{
+    glm::vec3 b0 = SafeNormalize(normal);
+    glm::vec3 b1 = SafeNormalize(tan1 - glm::dot(b0, tan1) * b0);
+    glm::vec3 b2 = SafeNormalize(tan2 - glm::dot(b0, tan2) * b0 - glm::dot(b1, tan2) * b1);
+
+    const float len1 = glm::length(b1), len2 = glm::length(b2);
+    if (len1 <= c_Epsilon || len2 <= c_Epsilon)
+    {
+        if (len1 > 0.5f)
+            b2 = glm::cross(b0, b1);
+        else if (len2 > 0.5f)
+            b1 = glm::cross(b2, b0);
+        else
+        {
+            // The axis least aligned with the normal
+            const glm::vec3 d = glm::abs(b0);
+            glm::vec3 axis = d.x < d.y ? (d.x < d.z ? glm::vec3(1, 0, 0) : glm::vec3(0, 0, 1))
+                                       : (d.y < d.z ? glm::vec3(0, 1, 0) : glm::vec3(0, 0, 2));
+            b1 = glm::cross(b0, axis);
+        }
+    }
+    return glm::vec4(b1, glm::dot(glm::cross(b0, tan1), tan2) < 0.0f ? -1.0f : 1.0f);
+}
+
+std::vector<glm::vec4> ReferenceTangents(const Mesh &mesh, const std::vector<glm::vec3> &normals)
+{
+    std::vector<glm::vec3> tan1(mesh.positions.size(), glm::vec3(0.0f)), tan2 = tan1;
+    for (size_t face = 0; face < mesh.indices.size() / 3; ++face)
+    {
+        const uint32_t *f = &mesh.indices[face * 3];
+        if (Missing(f))
+            continue;
+
+        glm::vec2 t10 = mesh.texcoords[f[1]] - mesh.texcoords[f[0]];
+        glm::vec2 t20 = mesh.texcoords[f[2]] - mesh.texcoords[f[0]];
+        glm::vec3 e1 = mesh.positions[f[1]] - mesh.positions[f[0]];
+        glm::vec3 e2 = mesh.positions[f[2]] - mesh.positions[f[0]];
+
+        float d = t10.x * t20.y - t10.y * t20.x;
+        d = std::fabs(d) <= c_Epsilon ? 1.0f : 1.0f / d;
+        glm::vec3 tangent = e1 * (t20.y * d) - e2 * (t10.y * d);
+        glm::vec3 bitangent = e2 * (t10.x * d) - e1 * (t20.x * d);
+        for (size_t k = 0; k < 3; ++k)
+        {
+            tan1[f[k]] += tangent;
+            tan2[f[k]] += bitangent;
+        }
+    }
+
+    std::vector<glm::vec4> tangents(mesh.positions.size());
+    for (size_t vert = 0; vert < tangents.size(); ++vert)
+        tangents[vert] = ReferenceTangent(normals[vert], tan1[vert], tan2[vert]);
+    return tangents;
+}
+
+// A bumpy grid of size * size quads, followed by the odd faces and a vertex no face uses
+Mesh MakeMesh(uint32_t size)
+{
+    Mesh mesh;
+    for (uint32_t z = 0; z <= size; ++z)
+    {
+        for (uint32_t x = 0; x <= size; ++x)
+        {
+            float u = (float)x / size, v = (float)z / size;
+            float height = 0.2f * glm::sin(9.0f * u) * glm::cos(7.0f * v);
+            mesh.positions.push_back(glm::vec3(u, height, v));
+            mesh.texcoords.push_back(glm::vec2(u + 0.05f * glm::sin(5.0f * v), v));
+        }
+    }
+
+    auto vertex = [&](uint32_t x, uint32_t z) { return z * (size + 1) + x; };
+    for (uint32_t z = 0; z < size; ++z)
+    {
+        for (uint32_t x = 0; x < size; ++x)
+        {
+            uint32_t a = vertex(x, z), b = vertex(x + 1, z), c = vertex(x, z + 1), d = vertex(x + 1, z + 1);
+            mesh.indices.insert(mesh.indices.end(), {a, c, b, b, c, d});
+        }
+    }
+
+    // Collinear corners, with a vertex of their own halfway along an edge
+    const uint32_t mid = (uint32_t)mesh.positions.size();
+    mesh.positions.push_back((mesh.positions[vertex(1, 1)] + mesh.positions[vertex(2, 1)]) * 0.5f);
+    mesh.texcoords.push_back(glm::vec2(0.5f));
+    // Corners whose texcoords all coincide
+    const uint32_t flat = (uint32_t)mesh.positions.size();
+    mesh.positions.push_back(glm::vec3(0.5f, 1.0f, 0.5f));
+    mesh.texcoords.push_back(mesh.texcoords[vertex(size / 2, size / 2)]);
+    // Only used by the face with a missing index, so it ends up like the unused vertex
+    const uint32_t orphan = (uint32_t)mesh.positions.size();
+    mesh.positions.push_back(glm::vec3(2.0f, 0.0f, 0.0f));
+    mesh.texcoords.push_back(glm::vec2(2.0f, 0.0f));
+    mesh.positions.push_back(glm::vec3(3.0f, 0.0f, 0.0f));
+    mesh.texcoords.push_back(glm::vec2(3.0f, 0.0f));
+
+    mesh.indices.insert(mesh.indices.end(), {vertex(1, 1), mid, vertex(2, 1)});
+    mesh.indices.insert(mesh.indices.end(), {vertex(3, 3), vertex(3, 3), vertex(4, 3)});
+    mesh.indices.insert(mesh.indices.end(), {vertex(size / 2, size / 2), flat, flat});
+    mesh.indices.insert(mesh.indices.end(), {flat, vertex(size / 2, size / 2 + 1), flat});
+    mesh.indices.insert(mesh.indices.end(), {orphan, uint32_t(-1), vertex(0, 0)});
+    return mesh;
+}
+
+bool Near(const glm::vec3 &a, const glm::vec3 &b)
+{
+    return glm::all(glm::lessThanEqual(glm::abs(a - b), glm::vec3(c_Tolerance)));
+}
+
+template <class index_t> void CheckMesh(const Mesh &mesh)
+{
+    const size_t nFaces = mesh.indices.size() / 3, nVerts = mesh.positions.size();
+    std::vector<index_t> indices(mesh.indices.size());
+    for (size_t j = 0; j < indices.size(); ++j)
+        indices[j] = index_t(mesh.indices[j]);
+
+    const std::vector<glm::vec3> expectedNormals = ReferenceNormals(mesh);
+    std::vector<glm::vec3> normals(nVerts, glm::vec3(7.0f));
+    CHECK(ComputeNormals(indices.data(), nFaces, mesh.positions.data(), nVerts, normals.data()));
+
+    size_t wrongNormals = 0;
+    for (size_t vert = 0; vert < nVerts; ++vert)
+        wrongNormals += !Near(normals[vert], expectedNormals[vert]);
+    CHECK(wrongNormals == 0);
+
+    // Vertices without a normal fall back to an axis for their tangent
+    std::vector<glm::vec3> frameNormals = expectedNormals;
+    for (glm::vec3 &normal : frameNormals)
+    {
+        if (normal == glm::vec3(0.0f))
+            normal = glm::vec3(0.0f, 1.0f, 0.0f);
+    }
+
+    const std::vector<glm::vec4> expectedTangents = ReferenceTangents(mesh, frameNormals);
+    std::vector<glm::vec4> tangents(nVerts, glm::vec4(7.0f));
+    CHECK(ComputeTangentFrame(indices.data(), nFaces, mesh.positions.data(), frameNormals.data(),
+                              mesh.texcoords.data(), nVerts, tangents.data()));
+
+    size_t wrongTangents = 0;
+    for (size_t vert = 0; vert < nVerts; ++vert)
+    {
+        wrongTangents += !Near(glm::vec3(tangents[vert]), glm::vec3(expectedTangents[vert])) ||
+                         tangents[vert].w != expectedTangents[vert].w;
+    }
+    CHECK(wrongTangents == 0);
+    printf("%zu faces, %zu vertices, %zu-bit indices: %zu normals and %zu tangents differ\n", nFaces, nVerts,
+           sizeof(index_t) * 8, wrongNormals, wrongTangents);
+
+    // The same again, now that the worker threads are running
+    std::vector<glm::vec3> again(nVerts);
+    CHECK(ComputeNormals(indices.data(), nFaces, mesh.positions.data(), nVerts, again.data()));
+    CHECK(again == normals);
+}
+} // namespace
+
+int main()
+{
+    const Mesh small = MakeMesh(8);
+    CheckMesh<uint16_t>(small);
+    CheckMesh<uint32_t>(small);
+
+    // Enough faces and vertices for several threads in both passes
+    const Mesh large = MakeMesh(160);
+    CheckMesh<uint16_t>(large);
+    CheckMesh<uint32_t>(large);
+
+    return Test::Result("MeshNormalsTest");
+}
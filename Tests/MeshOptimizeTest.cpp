@@ -0,0 +1,194 @@
+// Runs OptimizeOverdraw on a fixed mesh, a sphere inside a larger one, and checks that it shades fewer
+// fragments while keeping the vertex cache efficiency within its threshold. Then shuffles the vertices of the
+// same mesh among some unused ones and checks that OptimizeVertices, FinalizeIB and FinalizeVB put them back
+// in order of first use without changing what the faces draw.
+#include "IndexOptimizePostTransform.h"
+#include "Test.h"
+#include "Util/VulkanMesh.h"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace
+{
+constexpr size_t c_CacheSize = 16;
+constexpr float c_Threshold = 1.05f;
+
+// Latitude and longitude sphere. The poles are single vertices, so the mesh is closed.
+void AddSphere(const glm::vec3 &center, float radius, std::vector<glm::vec3> &positions,
+               std::vector<uint16_t> &indices)
+{
+    constexpr uint32_t c_Rings = 12;
+    constexpr uint32_t c_Segments = 16;
+    const uint16_t base = (uint16_t)positions.size();
+
+    positions.push_back(center + glm::vec3(0.0f, radius, 0.0f));
+    for (uint32_t ring = 1; ring < c_Rings; ++ring)
+    {
+        float theta = glm::pi<float>() * ring / c_Rings;
+        for (uint32_t segment = 0; segment < c_Segments; ++segment)
+        {
+            float phi = glm::two_pi<float>() * segment / c_Segments;
+            glm::vec3 dir(glm::sin(theta) * glm::cos(phi), glm::cos(theta), glm::sin(theta) * glm::sin(phi));
+            positions.push_back(center + dir * radius);
+        }
+    }
+    positions.push_back(center - glm::vec3(0.0f, radius, 0.0f));
+    const uint16_t bottom = (uint16_t)(positions.size() - 1);
+
+    auto vertex = [&](uint32_t ring, uint32_t segment) {
+        return (uint16_t)(base + 1 + (ring - 1) * c_Segments + segment % c_Segments);
+    };
+    for (uint32_t segment = 0; segment < c_Segments; ++segment)
+    {
+        indices.insert(indices.end(), {base, vertex(1, segment + 1), vertex(1, segment)});
+        for (uint32_t ring = 1; ring + 1 < c_Rings; ++ring)
+        {
+            uint16_t a = vertex(ring, segment), b = vertex(ring, segment + 1);
+            uint16_t c = vertex(ring + 1, segment), d = vertex(ring + 1, segment + 1);
+            indices.insert(indices.end(), {a, b, c, b, d, c});
+        }
+        indices.insert(indices.end(), {vertex(c_Rings - 1, segment), vertex(c_Rings - 1, segment + 1), bottom});
+    }
+}
+
+void TestOptimizeOverdraw()
+{
+    // The inner sphere comes first, so every view shades it and then the shell that hides it
+    std::vector<glm::vec3> positions;
+    std::vector<uint16_t> source;
+    AddSphere(glm::vec3(0.0f), 0.5f, positions, source);
+    AddSphere(glm::vec3(0.0f), 1.0f, positions, source);
+    const size_t nFaces = source.size() / 3;
+    const size_t nVerts = positions.size();
+
+    // OptimizeOverdraw expects a cache friendly order, which the strips around each sphere already are
+    std::vector<uint16_t> indices = source;
+
+    float acmrBefore, atvr;
+    ComputeVertexCacheMissRate(indices.data(), nFaces, nVerts, c_CacheSize, acmrBefore, atvr);
+    float overdrawBefore = ComputeOverdraw(indices.data(), nFaces, positions.data(), nVerts);
+
+    CHECK(OptimizeOverdraw(indices.data(), nFaces, positions.data(), nVerts, c_Threshold));
+
+    float acmrAfter;
+    ComputeVertexCacheMissRate(indices.data(), nFaces, nVerts, c_CacheSize, acmrAfter, atvr);
+    float overdrawAfter = ComputeOverdraw(indices.data(), nFaces, positions.data(), nVerts);
+
+    printf("Overdraw %.3f -> %.3f, ACMR %.3f -> %.3f\n", overdrawBefore, overdrawAfter, acmrBefore, acmrAfter);
+    CHECK(overdrawBefore > 1.0f);
+    CHECK(overdrawAfter < overdrawBefore);
+    CHECK(acmrAfter <= acmrBefore * c_Threshold);
+
+    // Only the order of the faces changes
+    std::vector<uint32_t> usesBefore(nVerts), usesAfter(nVerts);
+    for (size_t j = 0; j < source.size(); ++j)
+    {
+        ++usesBefore[source[j]];
+        ++usesAfter[indices[j]];
+    }
+    CHECK(usesBefore == usesAfter);
+}
+
+void TestOptimizeVertices()
+{
+    std::vector<glm::vec3> sphere;
+    std::vector<uint16_t> sphereIndices;
+    AddSphere(glm::vec3(0.0f), 0.5f, sphere, sphereIndices);
+    AddSphere(glm::vec3(0.0f), 1.0f, sphere, sphereIndices);
+
+    // Scatter the vertices over a larger buffer whose other slots no face uses
+    const size_t c_Unused = 37;
+    const size_t nVerts = sphere.size() + c_Unused;
+    std::vector<uint16_t> slot(nVerts);
+    for (size_t v = 0; v < nVerts; ++v)
+        slot[v] = (uint16_t)v;
+    std::mt19937 rng(41);
+    std::shuffle(slot.begin(), slot.end(), rng);
+
+    std::vector<glm::vec3> positions(nVerts, glm::vec3(9.0f));
+    for (size_t v = 0; v < sphere.size(); ++v)
+        positions[slot[v]] = sphere[v];
+    std::vector<uint16_t> scattered(sphereIndices.size());
+    for (size_t j = 0; j < scattered.size(); ++j)
+        scattered[j] = slot[sphereIndices[j]];
+
+    const size_t nFaces = scattered.size() / 3;
+    std::vector<uint16_t> source(scattered.size());
+    OptimizeFaces(scattered.data(), scattered.size(), source.data(), c_CacheSize);
+
+    std::vector<uint32_t> remap(nVerts);
+    size_t unused = 0;
+    CHECK(OptimizeVertices(source.data(), nFaces, nVerts, remap.data(), &unused));
+    CHECK(unused == c_Unused);
+    const size_t nUsed = nVerts - unused;
+
+    // remap[new] = old is a permutation of the used vertices, numbered by first use, with the unused at the end
+    std::vector<uint32_t> firstUse;
+    std::vector<bool> used(nVerts, false);
+    for (uint16_t index : source)
+    {
+        if (!used[index])
+            firstUse.push_back(index);
+        used[index] = true;
+    }
+    CHECK(std::equal(firstUse.begin(), firstUse.end(), remap.begin()) && firstUse.size() == nUsed);
+    CHECK(std::count(remap.begin() + nUsed, remap.end(), uint32_t(-1)) == (ptrdiff_t)unused);
+
+    std::vector<uint16_t> indices = source;
+    std::vector<glm::vec3> finalPositions = positions;
+    CHECK(FinalizeIB(indices.data(), nFaces, remap.data(), nVerts));
+    CHECK(FinalizeVB(finalPositions.data(), sizeof(glm::vec3), nVerts, remap.data()));
+    finalPositions.resize(nUsed);
+
+    // Every corner still reads the same position, from a vertex within the kept ones
+    size_t wrongCorners = 0;
+    for (size_t j = 0; j < indices.size(); ++j)
+    {
+        wrongCorners += indices[j] >= nUsed ||
+                        memcmp(&finalPositions[indices[j]], &positions[source[j]], sizeof(glm::vec3)) != 0;
+    }
+    CHECK(wrongCorners == 0);
+    size_t wrongVertices = 0;
+    for (size_t v = 0; v < nUsed; ++v)
+        wrongVertices += memcmp(&finalPositions[v], &positions[remap[v]], sizeof(glm::vec3)) != 0;
+    CHECK(wrongVertices == 0);
+
+    // Renumbering vertices leaves the cache hits alone and walks the buffer front to back
+    const size_t c_Stride = 32;
+    float acmrBefore, acmrAfter, atvrBefore, atvrAfter;
+    ComputeVertexCacheMissRate(source.data(), nFaces, nVerts, c_CacheSize, acmrBefore, atvrBefore);
+    ComputeVertexCacheMissRate(indices.data(), nFaces, nUsed, c_CacheSize, acmrAfter, atvrAfter);
+    const size_t fetchBefore = ComputeVertexFetchBytes(source.data(), nFaces, nVerts, c_Stride);
+    const size_t fetchAfter = ComputeVertexFetchBytes(indices.data(), nFaces, nUsed, c_Stride);
+    printf("ACMR %.3f -> %.3f, fetched %zu -> %zu bytes for %zu vertices\n", acmrBefore, acmrAfter, fetchBefore,
+           fetchAfter, nUsed * c_Stride);
+    CHECK(acmrAfter <= acmrBefore && atvrAfter <= atvrBefore);
+    CHECK(fetchAfter < fetchBefore);
+}
+
+void TestInvalidInput()
+{
+    glm::vec3 positions[3] = {};
+    uint16_t indices[3] = {0, 1, 3};
+    CHECK(!OptimizeOverdraw(indices, 1, positions, 3, c_Threshold));
+    CHECK(!OptimizeOverdraw((uint16_t *)nullptr, 1, positions, 3, c_Threshold));
+    CHECK(ComputeOverdraw(indices, 1, positions, 3) < 0.0f);
+
+    uint32_t remap[3];
+    CHECK(!OptimizeVertices(indices, 1, 3, remap));
+    const uint32_t outOfRange[3] = {0, 1, 3};
+    uint16_t valid[3] = {0, 1, 2};
+    CHECK(!FinalizeIB(valid, 1, outOfRange, 3));
+}
+} // namespace
+
+int main()
+{
+    TestOptimizeOverdraw();
+    TestOptimizeVertices();
+    TestInvalidInput();
+    return Test::Result("MeshOptimizeTest");
+}
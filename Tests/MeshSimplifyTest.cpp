@@ -0,0 +1,191 @@
+// Simplifies a closed sphere and an open, gently curved grid with SimplifyMesh. Checks that the result is
+// the same on every run, that no face turns over, that the sphere stays closed and that the vertices on
+// the border and on an attribute seam of the grid are all still there.
+#include "Test.h"
+#include "Util/VulkanMesh.h"
+
+#include <algorithm>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace
+{
+struct Mesh
+{
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+};
+
+struct Simplified
+{
+    std::vector<uint32_t> indices;
+    size_t faces;
+    float error;
+};
+
+Simplified Simplify(const Mesh &mesh, size_t targetFaces, float maxError)
+{
+    Simplified result;
+    result.indices.resize(mesh.indices.size());
+    CHECK(SimplifyMesh(mesh.indices.data(), mesh.indices.size() / 3, mesh.positions.data(), mesh.positions.size(),
+                       targetFaces, maxError, result.indices.data(), result.faces, result.error));
+    result.indices.resize(result.faces * 3);
+    return result;
+}
+
+glm::vec3 FaceNormal(const Mesh &mesh, const uint32_t *f)
+{
+    return glm::cross(mesh.positions[f[1]] - mesh.positions[f[0]], mesh.positions[f[2]] - mesh.positions[f[0]]);
+}
+
+// Edges that only one face walks along
+std::set<std::pair<uint32_t, uint32_t>> BorderEdges(const std::vector<uint32_t> &indices)
+{
+    std::set<std::pair<uint32_t, uint32_t>> edges;
+    for (size_t face = 0; face < indices.size() / 3; ++face)
+    {
+        for (size_t j = 0; j < 3; ++j)
+            edges.insert({indices[face * 3 + j], indices[face * 3 + (j + 1) % 3]});
+    }
+
+    std::set<std::pair<uint32_t, uint32_t>> border;
+    for (const auto &edge : edges)
+    {
+        if (edges.count({edge.second, edge.first}) == 0)
+            border.insert(edge);
+    }
+    return border;
+}
+
+// Latitude and longitude sphere around the origin, wound counterclockwise from outside
+Mesh MakeSphere(uint32_t rings, uint32_t segments)
+{
+    Mesh mesh;
+    mesh.positions.push_back(glm::vec3(0.0f, 1.0f, 0.0f));
+    for (uint32_t ring = 1; ring < rings; ++ring)
+    {
+        float theta = glm::pi<float>() * ring / rings;
+        for (uint32_t segment = 0; segment < segments; ++segment)
+        {
+            float phi = glm::two_pi<float>() * segment / segments;
+            mesh.positions.push_back(
+                glm::vec3(glm::sin(theta) * glm::cos(phi), glm::cos(theta), glm::sin(theta) * glm::sin(phi)));
+        }
+    }
+    mesh.positions.push_back(glm::vec3(0.0f, -1.0f, 0.0f));
+    const uint32_t bottom = (uint32_t)mesh.positions.size() - 1;
+
+    auto vertex = [&](uint32_t ring, uint32_t segment) { return 1 + (ring - 1) * segments + segment % segments; };
+    for (uint32_t segment = 0; segment < segments; ++segment)
+    {
+        mesh.indices.insert(mesh.indices.end(), {0, vertex(1, segment + 1), vertex(1, segment)});
+        for (uint32_t ring = 1; ring + 1 < rings; ++ring)
+        {
+            uint32_t a = vertex(ring, segment), b = vertex(ring, segment + 1);
+            uint32_t c = vertex(ring + 1, segment), d = vertex(ring + 1, segment + 1);
+            mesh.indices.insert(mesh.indices.end(), {a, b, c, b, d, c});
+        }
+        mesh.indices.insert(mesh.indices.end(),
+                            {vertex(rings - 1, segment), vertex(rings - 1, segment + 1), bottom});
+    }
+    return mesh;
+}
+
+void TestClosedMesh()
+{
+    const Mesh sphere = MakeSphere(24, 32);
+    const size_t nFaces = sphere.indices.size() / 3;
+    const float c_MaxError = 0.05f;
+
+    Simplified result = Simplify(sphere, nFaces / 4, c_MaxError);
+    printf("Sphere: %zu -> %zu faces, error %.4f\n", nFaces, result.faces, result.error);
+    CHECK(result.faces < nFaces / 2);
+    CHECK(result.error <= c_MaxError);
+
+    // Deterministic
+    Simplified again = Simplify(sphere, nFaces / 4, c_MaxError);
+    CHECK(again.faces == result.faces && again.indices == result.indices);
+
+    // Every face still faces out of the sphere, and every edge still has a face on both sides
+    for (size_t face = 0; face < result.faces; ++face)
+    {
+        const uint32_t *f = &result.indices[face * 3];
+        CHECK(f[0] != f[1] && f[1] != f[2] && f[2] != f[0]);
+        glm::vec3 centroid = (sphere.positions[f[0]] + sphere.positions[f[1]] + sphere.positions[f[2]]) / 3.0f;
+        CHECK(glm::dot(FaceNormal(sphere, f), centroid) > 0.0f);
+    }
+    CHECK(BorderEdges(result.indices).empty());
+}
+
+// A grid over x and z with a low bump in the middle. The column at x == c_Seam is stored twice, like
+// vertices split by a UV seam, and the faces right of it use the copies.
+void TestOpenMesh()
+{
+    const uint32_t c_Size = 24;
+    const uint32_t c_Seam = 12;
+
+    Mesh grid;
+    std::vector<uint32_t> seamCopy(c_Size + 1);
+    for (uint32_t z = 0; z <= c_Size; ++z)
+    {
+        for (uint32_t x = 0; x <= c_Size; ++x)
+        {
+            float u = (float)x / c_Size - 0.5f, v = (float)z / c_Size - 0.5f;
+            float height = 0.1f * glm::cos(glm::pi<float>() * u) * glm::cos(glm::pi<float>() * v);
+            grid.positions.push_back(glm::vec3(u, height, v));
+        }
+    }
+    for (uint32_t z = 0; z <= c_Size; ++z)
+    {
+        seamCopy[z] = (uint32_t)grid.positions.size();
+        grid.positions.push_back(grid.positions[z * (c_Size + 1) + c_Seam]);
+    }
+
+    auto vertex = [&](uint32_t x, uint32_t z, bool right) {
+        return right && x == c_Seam ? seamCopy[z] : z * (c_Size + 1) + x;
+    };
+    for (uint32_t z = 0; z < c_Size; ++z)
+    {
+        for (uint32_t x = 0; x < c_Size; ++x)
+        {
+            // Counterclockwise seen from above
+            bool right = x >= c_Seam;
+            uint32_t a = vertex(x, z, right), b = vertex(x + 1, z, right);
+            uint32_t c = vertex(x, z + 1, right), d = vertex(x + 1, z + 1, right);
+            grid.indices.insert(grid.indices.end(), {a, c, b, b, c, d});
+        }
+    }
+    const size_t nFaces = grid.indices.size() / 3;
+    const float c_MaxError = 0.02f;
+
+    Simplified result = Simplify(grid, 0, c_MaxError);
+    printf("Grid: %zu -> %zu faces, error %.4f\n", nFaces, result.faces, result.error);
+    CHECK(result.faces < nFaces / 2);
+    CHECK(result.error <= c_MaxError);
+
+    Simplified again = Simplify(grid, 0, c_MaxError);
+    CHECK(again.faces == result.faces && again.indices == result.indices);
+
+    for (size_t face = 0; face < result.faces; ++face)
+        CHECK(FaceNormal(grid, &result.indices[face * 3]).y > 0.0f);
+
+    // The outline and both sides of the seam don't move, so the border of the result is made of the same
+    // vertices: the outline, the inner vertices of the seam column and the copies of all of them
+    std::vector<bool> fixedBefore(grid.positions.size(), false), fixedAfter(grid.positions.size(), false);
+    for (const auto &edge : BorderEdges(grid.indices))
+        fixedBefore[edge.first] = fixedBefore[edge.second] = true;
+    for (const auto &edge : BorderEdges(result.indices))
+        fixedAfter[edge.first] = fixedAfter[edge.second] = true;
+    size_t numFixed = std::count(fixedBefore.begin(), fixedBefore.end(), true);
+    CHECK(numFixed == 4 * c_Size + (c_Size - 1) + (c_Size + 1));
+    CHECK(fixedAfter == fixedBefore);
+}
+} // namespace
+
+int main()
+{
+    TestClosedMesh();
+    TestOpenMesh();
+    return Test::Result("MeshSimplifyTest");
+}
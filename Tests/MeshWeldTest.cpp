@@ -0,0 +1,142 @@
+// Welds vertices with WeldVertices and packs them with CompactVB, and compares the result with a brute force
+// search for the first earlier vertex that has the same bytes in every stream. The vertices are read from an
+// interleaved buffer with padding between the elements and from a packed one.
+#include "Test.h"
+#include "Util/VulkanMesh.h"
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace
+{
+// Interleaved like a glTF buffer view, the padding holds garbage that must not keep vertices apart
+struct Interleaved
+{
+    glm::vec3 position;
+    uint32_t padding;
+    glm::vec2 texcoord;
+};
+
+bool SameBytes(const VertexStream *streams, size_t nStreams, size_t a, size_t b)
+{
+    for (size_t s = 0; s < nStreams; ++s)
+    {
+        const uint8_t *data = static_cast<const uint8_t *>(streams[s].data);
+        const size_t stride = streams[s].stride ? streams[s].stride : streams[s].size;
+        if (memcmp(data + a * stride, data + b * stride, streams[s].size) != 0)
+            return false;
+    }
+    return true;
+}
+
+// remap[v] is the remap of the first vertex equal to v, new vertices are numbered as they first appear
+std::vector<uint32_t> ReferenceRemap(const VertexStream *streams, size_t nStreams, size_t nVerts)
+{
+    std::vector<uint32_t> remap(nVerts);
+    uint32_t unique = 0;
+    for (size_t v = 0; v < nVerts; ++v)
+    {
+        size_t first = 0;
+        while (first < v && !SameBytes(streams, nStreams, first, v))
+            ++first;
+        remap[v] = first < v ? remap[first] : unique++;
+    }
+    return remap;
+}
+
+void TestWeld()
+{
+    // A few values per attribute, so many vertices repeat every stream and many others share only some
+    const glm::vec3 c_Positions[] = {glm::vec3(0.0f), glm::vec3(-0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 2.0f, 3.0f)};
+    const glm::vec2 c_Texcoords[] = {glm::vec2(0.0f), glm::vec2(0.5f, 1.0f)};
+    const glm::vec3 c_Normals[] = {glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f)};
+
+    const size_t c_Verts = 2000;
+    std::mt19937 rng(43);
+    std::vector<Interleaved> interleaved(c_Verts);
+    std::vector<glm::vec3> normals(c_Verts);
+    for (size_t v = 0; v < c_Verts; ++v)
+    {
+        interleaved[v].position = c_Positions[rng() % 3];
+        interleaved[v].padding = rng();
+        interleaved[v].texcoord = c_Texcoords[rng() % 2];
+        normals[v] = c_Normals[rng() % 2];
+    }
+
+    const VertexStream streams[3] = {
+        {&interleaved[0].position, sizeof(glm::vec3), sizeof(Interleaved)},
+        {&interleaved[0].texcoord, sizeof(glm::vec2), sizeof(Interleaved)},
+        {normals.data(), sizeof(glm::vec3), 0},
+    };
+
+    std::vector<uint32_t> remap(c_Verts);
+    const size_t unique = WeldVertices(streams, 3, c_Verts, remap.data());
+    const std::vector<uint32_t> expected = ReferenceRemap(streams, 3, c_Verts);
+
+    // -0.0 and 0.0 differ in their bits, so every combination of values is a vertex of its own
+    CHECK(unique == 3 * 2 * 2);
+    CHECK(remap == expected);
+
+    std::vector<uint32_t> again(c_Verts);
+    CHECK(WeldVertices(streams, 3, c_Verts, again.data()) == unique && again == remap);
+
+    // Each packed element holds the bytes of the vertices welded into it
+    std::vector<glm::vec3> positions(unique);
+    std::vector<glm::vec2> texcoords(unique);
+    std::vector<glm::vec3> packedNormals(unique);
+    CHECK(CompactVB(streams[0], c_Verts, remap.data(), positions.data()));
+    CHECK(CompactVB(streams[1], c_Verts, remap.data(), texcoords.data()));
+    CHECK(CompactVB(streams[2], c_Verts, remap.data(), packedNormals.data()));
+    size_t wrongElements = 0;
+    for (size_t v = 0; v < c_Verts; ++v)
+    {
+        wrongElements += memcmp(&positions[remap[v]], &interleaved[v].position, sizeof(glm::vec3)) != 0;
+        wrongElements += memcmp(&texcoords[remap[v]], &interleaved[v].texcoord, sizeof(glm::vec2)) != 0;
+        wrongElements += memcmp(&packedNormals[remap[v]], &normals[v], sizeof(glm::vec3)) != 0;
+    }
+    CHECK(wrongElements == 0);
+
+    // Welding on fewer streams only merges more
+    std::vector<uint32_t> positionRemap(c_Verts);
+    CHECK(WeldVertices(streams, 1, c_Verts, positionRemap.data()) == 3);
+    CHECK(positionRemap == ReferenceRemap(streams, 1, c_Verts));
+}
+
+void TestNoDuplicates()
+{
+    std::vector<glm::vec3> positions;
+    for (int i = 0; i < 100; ++i)
+        positions.push_back(glm::vec3((float)i, 0.0f, 0.0f));
+    const VertexStream stream = {positions.data(), sizeof(glm::vec3), 0};
+
+    std::vector<uint32_t> remap(positions.size());
+    CHECK(WeldVertices(&stream, 1, positions.size(), remap.data()) == positions.size());
+    size_t moved = 0;
+    for (size_t v = 0; v < remap.size(); ++v)
+        moved += remap[v] != v;
+    CHECK(moved == 0);
+}
+
+void TestInvalidInput()
+{
+    glm::vec3 positions[3] = {};
+    uint32_t remap[3];
+    const VertexStream stream = {positions, sizeof(glm::vec3), 0};
+    const VertexStream empty = {positions, 0, 0};
+    CHECK(WeldVertices(nullptr, 1, 3, remap) == 0);
+    CHECK(WeldVertices(&stream, 0, 3, remap) == 0);
+    CHECK(WeldVertices(&stream, 1, 0, remap) == 0);
+    CHECK(WeldVertices(&stream, 1, 3, nullptr) == 0);
+    CHECK(WeldVertices(&empty, 1, 3, remap) == 0);
+    CHECK(!CompactVB(stream, 3, nullptr, positions));
+}
+} // namespace
+
+int main()
+{
+    TestWeld();
+    TestNoDuplicates();
+    TestInvalidInput();
+    return Test::Result("MeshWeldTest");
+}
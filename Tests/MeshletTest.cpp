@@ -0,0 +1,131 @@
+// Cuts a bumpy sphere into meshlets with ComputeMeshlets and checks them against their definition: the limits
+// hold, the meshlets cover every face once in order, each sphere contains the vertices of its faces and each
+// cone contains the normals of its faces, so culling by the cone never drops a face that faces the viewer.
+#include "Test.h"
+#include "Util/VulkanMesh.h"
+
+#include <cmath>
+#include <vector>
+
+namespace
+{
+constexpr float c_Tolerance = 1e-4f;
+
+struct Mesh
+{
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+};
+
+// Latitude and longitude sphere with a bumpy radius, closed at single pole vertices, plus a degenerate face
+Mesh MakeSphere(uint32_t rings, uint32_t segments)
+{
+    Mesh mesh;
+    mesh.positions.push_back(glm::vec3(0.0f, 1.0f, 0.0f));
+    for (uint32_t ring = 1; ring < rings; ++ring)
+    {
+        float theta = glm::pi<float>() * ring / rings;
+        for (uint32_t segment = 0; segment < segments; ++segment)
+        {
+            float phi = glm::two_pi<float>() * segment / segments;
+            float radius = 1.0f + 0.1f * glm::sin(5.0f * theta) * glm::cos(3.0f * phi);
+            glm::vec3 dir(glm::sin(theta) * glm::cos(phi), glm::cos(theta), glm::sin(theta) * glm::sin(phi));
+            mesh.positions.push_back(dir * radius);
+        }
+    }
+    mesh.positions.push_back(glm::vec3(0.0f, -1.0f, 0.0f));
+    const uint32_t bottom = (uint32_t)mesh.positions.size() - 1;
+
+    auto vertex = [&](uint32_t ring, uint32_t segment) { return 1 + (ring - 1) * segments + segment % segments; };
+    for (uint32_t segment = 0; segment < segments; ++segment)
+    {
+        mesh.indices.insert(mesh.indices.end(), {0, vertex(1, segment + 1), vertex(1, segment)});
+        for (uint32_t ring = 1; ring + 1 < rings; ++ring)
+        {
+            uint32_t a = vertex(ring, segment), b = vertex(ring, segment + 1);
+            uint32_t c = vertex(ring + 1, segment), d = vertex(ring + 1, segment + 1);
+            mesh.indices.insert(mesh.indices.end(), {a, b, c, b, d, c});
+        }
+        mesh.indices.insert(mesh.indices.end(), {vertex(rings - 1, segment), vertex(rings - 1, segment + 1), bottom});
+    }
+    mesh.indices.insert(mesh.indices.end(), {vertex(2, 0), vertex(2, 0), vertex(2, 1)});
+    return mesh;
+}
+
+template <class index_t> void CheckMeshlets(const Mesh &mesh, size_t maxVerts, size_t maxFaces)
+{
+    const size_t nFaces = mesh.indices.size() / 3, nVerts = mesh.positions.size();
+    std::vector<index_t> indices(mesh.indices.begin(), mesh.indices.end());
+
+    std::vector<Meshlet> meshlets;
+    CHECK(ComputeMeshlets(indices.data(), nFaces, mesh.positions.data(), nVerts, meshlets, maxVerts, maxFaces));
+    CHECK(!meshlets.empty());
+
+    size_t overLimit = 0, gaps = 0, outsideSphere = 0, outsideCone = 0, cones = 0;
+    size_t nextFace = 0;
+    std::vector<uint32_t> seen(nVerts, uint32_t(-1));
+    for (size_t m = 0; m < meshlets.size(); ++m)
+    {
+        const Meshlet &meshlet = meshlets[m];
+        gaps += meshlet.firstFace != nextFace || meshlet.faceCount == 0;
+        nextFace = meshlet.firstFace + meshlet.faceCount;
+        if (nextFace > nFaces)
+            break;
+
+        const float minDot = std::sqrt(1.0f - meshlet.coneCutoff * meshlet.coneCutoff);
+        cones += meshlet.coneCutoff < 1.0f;
+        size_t vertexCount = 0;
+        for (size_t face = meshlet.firstFace; face < nextFace; ++face)
+        {
+            const uint32_t *f = &mesh.indices[face * 3];
+            for (size_t j = 0; j < 3; ++j)
+            {
+                vertexCount += seen[f[j]] != m;
+                seen[f[j]] = (uint32_t)m;
+                glm::vec3 offset = mesh.positions[f[j]] - meshlet.center;
+                outsideSphere += glm::length(offset) > meshlet.radius + c_Tolerance;
+            }
+
+            glm::vec3 normal = glm::cross(mesh.positions[f[1]] - mesh.positions[f[0]],
+                                          mesh.positions[f[2]] - mesh.positions[f[0]]);
+            if (meshlet.coneCutoff < 1.0f && glm::length(normal) > 0.0f)
+                outsideCone += glm::dot(glm::normalize(normal), meshlet.coneAxis) < minDot - c_Tolerance;
+        }
+        overLimit += vertexCount > maxVerts || meshlet.faceCount > maxFaces;
+    }
+    CHECK(nextFace == nFaces);
+    CHECK(gaps == 0);
+    CHECK(overLimit == 0);
+    CHECK(outsideSphere == 0);
+    CHECK(outsideCone == 0);
+    // The sphere is smooth enough for most meshlets to have a cone, or the cone check proves nothing
+    CHECK(cones * 2 > meshlets.size());
+    printf("%zu faces, %zu-bit indices, at most %zu vertices and %zu faces: %zu meshlets, %zu with a cone\n",
+           nFaces, sizeof(index_t) * 8, maxVerts, maxFaces, meshlets.size(), cones);
+}
+
+void TestInvalidInput()
+{
+    const Mesh mesh = MakeSphere(4, 4);
+    std::vector<uint32_t> indices = mesh.indices;
+    std::vector<Meshlet> meshlets;
+    CHECK(!ComputeMeshlets(indices.data(), indices.size() / 3, mesh.positions.data(), mesh.positions.size(),
+                           meshlets, 2, 1));
+    indices[4] = (uint32_t)mesh.positions.size();
+    CHECK(!ComputeMeshlets(indices.data(), indices.size() / 3, mesh.positions.data(), mesh.positions.size(),
+                           meshlets));
+}
+} // namespace
+
+int main()
+{
+    const Mesh sphere = MakeSphere(48, 64);
+    CheckMeshlets<uint16_t>(sphere, kMeshletMaxVertices, kMeshletMaxTriangles);
+    CheckMeshlets<uint32_t>(sphere, kMeshletMaxVertices, kMeshletMaxTriangles);
+
+    // Small enough for both limits to close meshlets
+    CheckMeshlets<uint16_t>(sphere, 8, 6);
+
+    TestInvalidInput();
+    return Test::Result("MeshletTest");
+}
@@ -0,0 +1,97 @@
+// Runs a render graph headless whose transient images have lifetimes that don't all overlap, and checks
+// that the ones that never meet share memory. Once warmed up, frames of this graph must not allocate from
+// the heap, counted by HeapAllocationCounter.cpp which CMake compiles into this test only. That covers
+// building and executing the graph and the engine's frame loop, not ModelViewer's scene rendering.
+// Needs a Vulkan device.
+#include "Test.h"
+
+#include <BufferManager.h>
+#include <CommandContext.h>
+#include <Display.h>
+#include <FrameStats.h>
+#include <GameCore.h>
+#include <RenderGraph.h>
+
+using namespace Graphics;
+
+// Frames that may still allocate: the first one creates everything, the next ones fill the query and
+// fence rings
+constexpr uint64_t c_WarmupFrames = 4;
+
+class RenderGraphTest : public GameCore::IGameApp
+{
+public:
+    virtual void Startup(void) override;
+    virtual void Cleanup(void) override { m_Graph.DestroyTransients(); }
+    virtual bool IsDone(void) override { return false; }
+    virtual void Update(float) override {}
+    virtual void RenderScene(void) override;
+
+private:
+    RenderGraph m_Graph;
+};
+
+void RenderGraphTest::Startup(void)
+{
+    // The checks of RenderScene prove nothing unless allocations are really counted
+    uint64_t allocations = FrameStats::GetHeapAllocationCount();
+    ::operator delete(::operator new(16));
+    CHECK(FrameStats::GetHeapAllocationCount() > allocations);
+}
+
+// A fills the first image, every later pass reads the previous image and fills the next one:
+//     A [0, 1]   B [1, 2]   C [2, 3]
+// A and C never live at the same time, so they should end up in one allocation. The graph is rebuilt
+// every frame like ModelViewer's, and frames after the first must not allocate while building it.
+void RenderGraphTest::RenderScene(void)
+{
+    GraphicsContext &gfxContext = GraphicsContext::Begin("Render Graph Test");
+
+    RenderGraph &graph = m_Graph;
+    uint64_t allocations = FrameStats::GetHeapAllocationCount();
+    graph.Reset();
+    RenderGraph::TransientDesc desc = {g_SceneColorBuffer.GetWidth(), g_SceneColorBuffer.GetHeight(),
+                                       g_SceneColorBuffer.GetFormat()};
+    RenderGraph::Resource output = graph.Import(g_SceneColorBuffer, true);
+    RenderGraph::Resource images[3] = {graph.CreateTransient("Test A", desc), graph.CreateTransient("Test B", desc),
+                                       graph.CreateTransient("Test C", desc)};
+
+    for (uint32_t i = 0; i <= 3; ++i)
+    {
+        RenderGraph::Resource target = i < 3 ? images[i] : output;
+        graph.AddPass(
+            "Test Pass",
+            [&, i, target](RenderGraph::PassBuilder &pass) {
+                if (i > 0)
+                    pass.Read(images[i - 1]);
+                if (i < 3)
+                    pass.Clear(target, vk::ImageLayout::eColorAttachmentOptimal);
+                else
+                    pass.Write(target, vk::ImageLayout::eColorAttachmentOptimal);
+            },
+            [&, target](GraphicsContext &context) {
+                context.BeginRenderPass(graph.GetColorBuffer(target));
+                context.EndRenderPass();
+            });
+    }
+
+    if (GetFrameCount() > 0)
+        CHECK(FrameStats::GetHeapAllocationCount() == allocations);
+    if (GetFrameCount() > c_WarmupFrames)
+        CHECK(FrameStats::GetLastFrameHeapAllocations() == 0);
+
+    graph.Execute(gfxContext);
+    gfxContext.Finish();
+
+    RenderGraph::TransientStats stats = graph.GetTransientStats();
+    CHECK(stats.Images == 3);
+    CHECK(stats.Allocations == 2);
+    CHECK(stats.Size < stats.UnaliasedSize);
+}
+
+int main(int argc, char **argv)
+{
+    RenderGraphTest app;
+    GameCore::RunApplication(app, "RenderGraphTest", argc, argv);
+    return Test::Result("RenderGraphTest");
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdio.h>
+
+// Checks for the test executables. A failed check is printed and the test carries on; main returns
+// Test::Result() so that ctest sees the failure.
+namespace Test
+{
+inline int &FailureCount()
+{
+    static int s_Failures = 0;
+    return s_Failures;
+}
+
+inline int Result(const char *name)
+{
+    if (FailureCount() == 0)
+    {
+        printf("%s: passed\n", name);
+        return 0;
+    }
+    printf("%s: %d check(s) failed\n", name, FailureCount());
+    return 1;
+}
+} // namespace Test
+
+#define CHECK(cond)                                                                                                    \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond))                                                                                                   \
+        {                                                                                                              \
+            printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #cond);                                           \
+            ++Test::FailureCount();                                                                                    \
+        }                                                                                                              \
+    } while (0)
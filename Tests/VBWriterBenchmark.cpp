@@ -0,0 +1,140 @@
+// Times VBWriter on the formats that have SSE2 kernels against the scalar glm loop those kernels replaced, and
+// against the Write before kernels were picked at Initialize: source widened to a vec4 array, then a switch on
+// the format around a loop that checks the end of the buffer for every element. Run it on the target machine,
+// the numbers are only meaningful relative to each other.
+#include "SystemTime.h"
+#include "Util/VulkanMeshP.h"
+
+#include <glm/gtc/packing.hpp>
+#include <random>
+#include <stdio.h>
+#include <vector>
+#include <vulkan/vulkan_format_traits.hpp>
+
+namespace
+{
+constexpr size_t c_Verts = 1 << 16;
+constexpr size_t c_Repeats = 100;
+
+// Read from every buffer, so the writes into it can't be dropped
+volatile uint8_t s_Sink;
+
+template <class Fn> double NanosecondsPerVertex(Fn &&fn)
+{
+    fn(); // Warm the caches
+    CpuTimer timer;
+    timer.Start();
+    for (size_t i = 0; i < c_Repeats; ++i)
+        fn();
+    timer.Stop();
+    return timer.GetTime() * 1e9 / (c_Repeats * c_Verts);
+}
+
+template <class V> glm::vec4 ToVec4(const V &v)
+{
+    glm::vec4 res(0.0f);
+    for (glm::length_t i = 0; i < V::length(); ++i)
+        res[i] = v[i];
+    return res;
+}
+
+// What the scalar kernels do for every element
+template <class S, class T, auto Pack> void ScalarWrite(const S *src, uint8_t *ptr, size_t stride, size_t count)
+{
+    for (size_t i = 0; i < count; ++i, ptr += stride)
+        *(T *)ptr = Pack(ToVec4(src[i]));
+}
+
+template <class T, auto Pack>
+bool LegacyStore(const glm::vec4 *buffer, uint8_t *ptr, const uint8_t *eptr, size_t stride, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        if ((ptr + sizeof(T)) > eptr)
+            return false;
+        *(T *)ptr = Pack(*buffer++);
+        ptr += stride;
+    }
+    return true;
+}
+
+template <class S>
+bool LegacyWrite(vk::Format format, const S *src, std::vector<glm::vec4> &temp, uint8_t *vb, size_t stride,
+                 size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+        temp[i] = ToVec4(src[i]);
+
+    const uint8_t *eptr = vb + stride * count;
+    switch (format)
+    {
+    case vk::Format::eR16G16Sfloat:
+        return LegacyStore<glm::uint32, glm::packHalf2x16>(temp.data(), vb, eptr, stride, count);
+    case vk::Format::eR16G16B16A16Sfloat:
+        return LegacyStore<glm::uint64, glm::packHalf4x16>(temp.data(), vb, eptr, stride, count);
+    case vk::Format::eR16G16Unorm:
+        return LegacyStore<glm::uint32, glm::packUnorm2x16>(temp.data(), vb, eptr, stride, count);
+    case vk::Format::eR16G16B16A16Unorm:
+        return LegacyStore<glm::uint64, glm::packUnorm4x16>(temp.data(), vb, eptr, stride, count);
+    case vk::Format::eA2B10G10R10SnormPack32:
+        return LegacyStore<glm::uint32, glm::packSnorm3x10_1x2>(temp.data(), vb, eptr, stride, count);
+    default:
+        return false;
+    }
+}
+
+glm::uint32 PackHalf2(const glm::vec4 &v) { return glm::packHalf2x16(glm::vec2(v)); }
+glm::uint32 PackUnorm2x16(const glm::vec4 &v) { return glm::packUnorm2x16(glm::vec2(v)); }
+
+// The source type is the one the importer writes into the format
+template <class S, class T, auto Pack> void Benchmark(const char *name, vk::Format format, std::mt19937 &rng)
+{
+    std::uniform_real_distribution<float> range(-1.5f, 1.5f);
+    std::vector<S> src(c_Verts);
+    for (S &v : src)
+    {
+        for (glm::length_t c = 0; c < S::length(); ++c)
+            v[c] = range(rng);
+    }
+
+    const uint32_t stride = vk::blockSize(format);
+    std::vector<uint8_t> vb(stride * c_Verts);
+    std::vector<glm::vec4> temp(c_Verts);
+
+    VBWriter writer;
+    if (!writer.Initialize({{0, 0, format, 0}}) || !writer.AddStream(vb.data(), c_Verts, 0, stride))
+    {
+        printf("%s: VBWriter doesn't take the format\n", name);
+        return;
+    }
+
+    uint8_t *dst = vb.data();
+    double legacyNs = NanosecondsPerVertex([&]() { LegacyWrite(format, src.data(), temp, dst, stride, c_Verts); });
+    double scalarNs = NanosecondsPerVertex([&]() { ScalarWrite<S, T, Pack>(src.data(), dst, stride, c_Verts); });
+    double writerNs = NanosecondsPerVertex([&]() { writer.Write(src.data(), 0, c_Verts); });
+
+    printf("%-10s from vec%d: per element switch %.2f ns, scalar %.2f ns, VBWriter %.2f ns (%.1fx, %.1fx)\n", name,
+           (int)S::length(), legacyNs, scalarNs, writerNs, legacyNs / writerNs, scalarNs / writerNs);
+    s_Sink = vb.back();
+}
+} // namespace
+
+int main()
+{
+    SystemTime::Initialize();
+
+#if VULKANMESH_SSE2
+    printf("VBWriter uses the SSE2 kernels, %zu vertices\n", c_Verts);
+#else
+    printf("VBWriter uses the scalar kernels, %zu vertices\n", c_Verts);
+#endif
+
+    std::mt19937 rng(49);
+    Benchmark<glm::vec2, glm::uint32, PackHalf2>("half2", vk::Format::eR16G16Sfloat, rng);
+    Benchmark<glm::vec4, glm::uint64, glm::packHalf4x16>("half4", vk::Format::eR16G16B16A16Sfloat, rng);
+    Benchmark<glm::vec2, glm::uint32, PackUnorm2x16>("unorm2x16", vk::Format::eR16G16Unorm, rng);
+    Benchmark<glm::vec3, glm::uint64, glm::packUnorm4x16>("unorm4x16", vk::Format::eR16G16B16A16Unorm, rng);
+    Benchmark<glm::vec3, glm::uint32, glm::packSnorm3x10_1x2>("snorm3x10", vk::Format::eA2B10G10R10SnormPack32,
+                                                              rng);
+    return 0;
+}
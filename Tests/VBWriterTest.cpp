@@ -0,0 +1,157 @@
+// Writes float, vec2, vec3 and vec4 arrays through VBWriter into the formats that have SSE2 kernels (half
+// 2x16 and 4x16, unorm 2x16 and 4x16, snorm 3x10_1x2) and compares every element with the glm packing
+// function of the format. Covers every count up to a few vector widths, padded strides, the special
+// floats and a large sample of random bit patterns.
+#include "Test.h"
+#include "Util/VulkanMesh.h"
+
+#include <cmath>
+#include <cstring>
+#include <glm/gtc/packing.hpp>
+#include <limits>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+namespace
+{
+typedef glm::uint64 (*ReferenceFn)(const glm::vec4 &v);
+
+glm::uint64 PackHalf2(const glm::vec4 &v) { return glm::packHalf2x16(glm::vec2(v)); }
+glm::uint64 PackHalf4(const glm::vec4 &v) { return glm::packHalf4x16(v); }
+glm::uint64 PackUnorm2x16(const glm::vec4 &v) { return glm::packUnorm2x16(glm::vec2(v)); }
+glm::uint64 PackUnorm4x16(const glm::vec4 &v) { return glm::packUnorm4x16(v); }
+glm::uint64 PackSnorm3x10(const glm::vec4 &v) { return glm::packSnorm3x10_1x2(v); }
+
+struct PackedFormat
+{
+    const char *name;
+    vk::Format format;
+    uint32_t size;
+    ReferenceFn reference;
+    bool nanDefined; // glm gives a defined result for NaN inputs
+};
+
+const PackedFormat c_Formats[] = {
+    {"half2", vk::Format::eR16G16Sfloat, 4, PackHalf2, true},
+    {"half4", vk::Format::eR16G16B16A16Sfloat, 8, PackHalf4, true},
+    {"unorm2x16", vk::Format::eR16G16Unorm, 4, PackUnorm2x16, false},
+    {"unorm4x16", vk::Format::eR16G16B16A16Unorm, 8, PackUnorm4x16, false},
+    {"snorm3x10", vk::Format::eA2B10G10R10SnormPack32, 4, PackSnorm3x10, false},
+};
+
+// Bytes after each element, so the kernels can't assume packed elements
+constexpr uint32_t c_Padding = 4;
+
+// The components a source type fills, the others are written as 0
+glm::vec4 Widen(float v) { return glm::vec4(v, 0.0f, 0.0f, 0.0f); }
+glm::vec4 Widen(const glm::vec2 &v) { return glm::vec4(v, 0.0f, 0.0f); }
+glm::vec4 Widen(const glm::vec3 &v) { return glm::vec4(v, 0.0f); }
+glm::vec4 Widen(const glm::vec4 &v) { return v; }
+
+template <class S> void Fill(const std::vector<float> &values, size_t first, std::vector<S> &dst)
+{
+    for (size_t i = 0; i < dst.size(); ++i)
+    {
+        if constexpr (std::is_same<S, float>::value)
+            dst[i] = values[(first + i) % values.size()];
+        else
+        {
+            for (glm::length_t c = 0; c < S::length(); ++c)
+                dst[i][c] = values[(first + i * S::length() + c) % values.size()];
+        }
+    }
+}
+
+// Writes count elements into a buffer with room for exactly count, so the last element ends at the end
+template <class S>
+bool CheckWrite(const PackedFormat &format, const std::vector<float> &values, size_t first, size_t count)
+{
+    std::vector<S> src(count);
+    Fill(values, first, src);
+
+    VBWriter writer;
+    if (!writer.Initialize({{0, 0, format.format, 0}}))
+        return false;
+    const size_t stride = format.size + c_Padding;
+    std::vector<uint8_t> vb(stride * count, 0xcd);
+    if (!writer.AddStream(vb.data(), count, 0, stride) || !writer.Write(src.data(), 0, count))
+        return false;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        glm::uint64 expected = format.reference(Widen(src[i]));
+        glm::uint64 written = 0;
+        memcpy(&written, &vb[i * stride], format.size);
+        if (written != expected)
+        {
+            glm::vec4 v = Widen(src[i]);
+            printf("%s: element %zu of %zu, (%g, %g, %g, %g) written as %llx instead of %llx\n", format.name, i,
+                   count, v.x, v.y, v.z, v.w, (unsigned long long)written, (unsigned long long)expected);
+            return false;
+        }
+        for (size_t b = format.size; b < stride; ++b)
+        {
+            if (vb[i * stride + b] != 0xcd)
+            {
+                printf("%s: element %zu of %zu wrote into the padding\n", format.name, i, count);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+template <class S> void CheckSourceType(const PackedFormat &format, const std::vector<float> &values)
+{
+    // Every count up to past two full iterations of the widest kernel, then everything at once
+    for (size_t count = 1; count <= 9; ++count)
+    {
+        for (size_t first = 0; first < values.size(); first += 97)
+            CHECK(CheckWrite<S>(format, values, first, count));
+    }
+    CHECK(CheckWrite<S>(format, values, 0, values.size()));
+}
+
+std::vector<float> TestValues(bool withNaN)
+{
+    const float inf = std::numeric_limits<float>::infinity();
+    std::vector<float> values = {0.0f, -0.0f, 1.0f, -1.0f, 0.5f, -0.5f, 2.0f, -2.0f, 1.0f / 65535.0f, 0.5f / 511.0f,
+                                 1.5f / 511.0f, -0.5f / 511.0f, 0.99999f, 1.00001f, 65504.0f, -65504.0f, 65519.0f,
+                                 65520.0f, 1e6f, inf, -inf, 6.1035156e-5f, 6.0e-5f, 5.96e-8f, 2.98e-8f, 2.0e-8f,
+                                 1e-30f, std::numeric_limits<float>::denorm_min(), std::numeric_limits<float>::max()};
+    if (withNaN)
+        values.push_back(std::numeric_limits<float>::quiet_NaN());
+
+    std::mt19937 rng(49);
+    std::uniform_real_distribution<float> range(-1.5f, 1.5f);
+    for (int i = 0; i < 20000; ++i)
+        values.push_back(range(rng));
+    for (int i = 0; i < 20000; ++i)
+    {
+        uint32_t bits = rng();
+        float v;
+        memcpy(&v, &bits, sizeof(v));
+        if (withNaN || !std::isnan(v))
+            values.push_back(v);
+    }
+    return values;
+}
+} // namespace
+
+int main()
+{
+    const std::vector<float> withNaN = TestValues(true);
+    const std::vector<float> withoutNaN = TestValues(false);
+
+    for (const PackedFormat &format : c_Formats)
+    {
+        const std::vector<float> &values = format.nanDefined ? withNaN : withoutNaN;
+        CheckSourceType<float>(format, values);
+        CheckSourceType<glm::vec2>(format, values);
+        CheckSourceType<glm::vec3>(format, values);
+        CheckSourceType<glm::vec4>(format, values);
+    }
+
+    return Test::Result("VBWriterTest");
+}